@@ -17,101 +17,249 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
 
 #include "libyagbe/bus.h"
-#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/cart.h"
 #include "libyagbe/compat/compat_stdint.h"
 #include "libyagbe/cpu.h"
 #include "libyagbe/debug/logger.h"
+#include "libyagbe/debug/trace.h"
 #include "libyagbe/gb.h"
+#include "rom_loader.h"
+#include "save_file.h"
 
-static bool running = true;
-static uint16_t current_pc = 0x0000;
+/* The address the test ROMs we run spin at once they've finished. */
+#define STOP_ADDRESS 0xC8B0
 
-static uint8_t* open_rom(const char* const file_name) {
-  FILE* rom_file;
-  uint8_t* rom_data;
-  struct stat st;
-  size_t rom_size;
+/* How often battery-backed RAM is flushed, in cycles; about once a
+ * second. */
+#define SAVE_FLUSH_INTERVAL 4194304UL
 
-  rom_file = fopen(file_name, "rb");
+/* Large enough that the trace is written out in big sequential chunks. */
+#define TRACE_BUFFER_SIZE (LIBYAGBE_TRACE_RECORD_SIZE * 65536UL)
 
-  if (!rom_file) {
-    fprintf(stderr, "unable to open ROM file %s: %s\n", file_name,
-            strerror(errno));
-    return NULL;
-  }
+/* Hangs off the userdata pointer of the instance. */
+struct runner_data {
+  FILE* trace_file;
+  struct yagbe_save_file save;
+  int save_open;
+};
 
-  stat(file_name, &st);
-  rom_size = st.st_size;
+static void info_log_handler(struct libyagbe_gb* const gb,
+                             const char* const msg) {
+  (void)gb;
+  printf("[INFO]: %s\n", msg);
+}
 
-  rom_data = malloc(sizeof(uint8_t) * rom_size);
+static void warning_log_handler(struct libyagbe_gb* const gb,
+                                const char* const msg) {
+  (void)gb;
+  printf("[WARNING]: %s\n", msg);
+}
 
-  fread(rom_data, 1, rom_size, rom_file);
-  fclose(rom_file);
+static void critical_log_handler(struct libyagbe_gb* const gb,
+                                 const char* const msg) {
+  (void)gb;
+  printf("[CRITICAL]: %s\n", msg);
+}
 
-  return rom_data;
+static void serial_handler(struct libyagbe_gb* const gb, const uint8_t data) {
+  (void)gb;
+  putchar(data);
 }
 
-static void info_log_handler(const char* const msg) {
-  printf("[INFO]: %s\n", msg);
+static void trace_sink(struct libyagbe_gb* const gb, const uint8_t* const data,
+                       const size_t size) {
+  const struct runner_data* const runner = gb->userdata;
+
+  if (fwrite(data, 1, size, runner->trace_file) != size) {
+    fprintf(stderr, "unable to write trace: %s\n", strerror(errno));
+  }
 }
 
-static void warning_log_handler(const char* const msg) {
-  printf("[WARNING]: %s\n", msg);
+static void save_flush_handler(struct libyagbe_gb* const gb,
+                               const size_t offset, const size_t size) {
+  struct runner_data* const runner = gb->userdata;
+
+  if (!yagbe_save_file_flush(&runner->save, offset, size)) {
+    fprintf(stderr, "unable to flush save file: %s\n", strerror(errno));
+  }
 }
 
-static void critical_log_handler(const char* const msg) {
-  running = false;
-  printf("[CRITICAL]: %s\n", msg);
+/* Keeps battery-backed RAM in a file named after the ROM, with the extension
+ * replaced by .sav. */
+static int open_save_file(struct libyagbe_gb* const gb,
+                          const char* const rom_file_name,
+                          struct yagbe_save_file* const save) {
+  const char* const slash = strrchr(rom_file_name, '/');
+  const char* extension = strrchr(rom_file_name, '.');
+  size_t length;
+  char* file_name;
+  int opened;
+
+  if ((extension == NULL) || ((slash != NULL) && (extension < slash))) {
+    extension = &rom_file_name[strlen(rom_file_name)];
+  }
+  length = (size_t)(extension - rom_file_name);
+
+  file_name = malloc(length + sizeof(".sav"));
+
+  if (file_name == NULL) {
+    fprintf(stderr, "unable to allocate save file name\n");
+    return 0;
+  }
+
+  memcpy(file_name, rom_file_name, length);
+  strcpy(&file_name[length], ".sav");
+
+  opened = yagbe_save_file_open(file_name, gb->cart.header.ram_size, save);
+
+  if (!opened) {
+    fprintf(stderr, "unable to open save file %s: %s\n", file_name,
+            strerror(errno));
+  }
+  free(file_name);
+
+  if (!opened) {
+    return 0;
+  }
+
+  if (!libyagbe_cart_set_ram_buffer(gb, save->data)) {
+    fprintf(stderr, "unable to keep cartridge RAM in save file\n");
+    yagbe_save_file_close(save);
+
+    return 0;
+  }
+  return 1;
 }
 
 int main(int argc, char* argv[]) {
-  uint8_t* rom_data;
-  struct libyagbe_cpu* cpu;
-  FILE* trace_file;
+  struct yagbe_rom rom;
+  struct libyagbe_gb* gb;
+  struct runner_data runner;
+  uint8_t* trace_buffer = NULL;
 
   if (argc < 2) {
     fprintf(stderr, "%s: missing required argument.\n", argv[0]);
-    fprintf(stderr, "%s: syntax: %s rom_file\n", argv[0], argv[0]);
+    fprintf(stderr, "%s: syntax: %s rom_file [trace_file]\n", argv[0],
+            argv[0]);
 
     return EXIT_FAILURE;
   }
 
-  rom_data = open_rom(argv[1]);
+  if (!yagbe_rom_load(argv[1], &rom)) {
+    fprintf(stderr, "unable to open ROM file %s: %s\n", argv[1],
+            strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  gb = libyagbe_gb_create();
+
+  if (gb == NULL) {
+    fprintf(stderr, "unable to create emulator instance\n");
+    yagbe_rom_unload(&rom);
 
-  if (rom_data == NULL) {
     return EXIT_FAILURE;
   }
 
-  libyagbe_logger_set_log_level_cb(LIBYAGBE_LOG_LEVEL_INFO, &info_log_handler);
-  libyagbe_logger_set_log_level_cb(LIBYAGBE_LOG_LEVEL_WARNING,
+  libyagbe_logger_set_log_level_cb(gb, LIBYAGBE_LOG_LEVEL_INFO,
+                                   &info_log_handler);
+  libyagbe_logger_set_log_level_cb(gb, LIBYAGBE_LOG_LEVEL_WARNING,
                                    &warning_log_handler);
-  libyagbe_logger_set_log_level_cb(LIBYAGBE_LOG_LEVEL_CRITICAL,
+  libyagbe_logger_set_log_level_cb(gb, LIBYAGBE_LOG_LEVEL_CRITICAL,
                                    &critical_log_handler);
 
-  libyagbe_bus_set_cart_data(rom_data);
-  cpu = libyagbe_cpu_get_data();
+  libyagbe_bus_set_serial_cb(gb, &serial_handler);
+
+  if (!libyagbe_cart_insert(gb, rom.data, rom.size)) {
+    fprintf(stderr, "unable to insert cartridge\n");
+    libyagbe_gb_destroy(gb);
+    yagbe_rom_unload(&rom);
+
+    return EXIT_FAILURE;
+  }
+
+  memset(&runner, 0, sizeof(runner));
+  gb->userdata = &runner;
+
+  if (gb->cart.header.has_battery && (gb->cart.header.ram_size != 0)) {
+    if (!open_save_file(gb, argv[1], &runner.save)) {
+      libyagbe_gb_destroy(gb);
+      yagbe_rom_unload(&rom);
+
+      return EXIT_FAILURE;
+    }
+    runner.save_open = 1;
+  }
+
+  libyagbe_system_reset(gb);
+
+  if (argc >= 3) {
+    runner.trace_file = fopen(argv[2], "wb");
+
+    if (!runner.trace_file) {
+      fprintf(stderr, "unable to open trace file %s: %s\n", argv[2],
+              strerror(errno));
+      libyagbe_gb_destroy(gb);
 
-  libyagbe_system_reset();
+      if (runner.save_open) {
+        yagbe_save_file_close(&runner.save);
+      }
+      yagbe_rom_unload(&rom);
 
-  trace_file = fopen("trace.txt", "w");
+      return EXIT_FAILURE;
+    }
+
+    trace_buffer = malloc(TRACE_BUFFER_SIZE);
+
+    if (trace_buffer == NULL) {
+      fprintf(stderr, "unable to allocate trace buffer\n");
+      fclose(runner.trace_file);
+      libyagbe_gb_destroy(gb);
+
+      if (runner.save_open) {
+        yagbe_save_file_close(&runner.save);
+      }
+      yagbe_rom_unload(&rom);
+
+      return EXIT_FAILURE;
+    }
+
+    libyagbe_trace_start(gb, trace_buffer, TRACE_BUFFER_SIZE, &trace_sink);
+  }
 
-  while (running) {
-    current_pc = cpu->reg.pc.value;
+  /* Whatever the program writes to battery-backed RAM is in the save file
+   * straight away, so a crash loses nothing; flushing along the way only
+   * gets it to storage sooner, without waiting on it. */
+  do {
+    libyagbe_system_run_cycles_until(gb, SAVE_FLUSH_INTERVAL, STOP_ADDRESS);
 
-    fprintf(trace_file, "BC=%04X DE=%04X HL=%04X AF=%04X SP=%04X PC=%04X\n",
-            cpu->reg.bc.value, cpu->reg.de.value, cpu->reg.hl.value,
-            cpu->reg.af.value, cpu->reg.sp.value, cpu->reg.pc.value);
+    if (runner.save_open) {
+      libyagbe_cart_flush_ram(gb, &save_flush_handler);
+    }
+  } while ((gb->cpu.reg.pc.value != STOP_ADDRESS) &&
+           !gb->logger.critical_raised);
+
+  libyagbe_bus_report_unhandled(gb);
 
-    if (current_pc == 0xC8B0) {
-      running = false;
-      break;
+  if (runner.trace_file) {
+    /* The state the ROM finished in belongs in the trace too. */
+    if (gb->cpu.reg.pc.value == STOP_ADDRESS) {
+      libyagbe_trace_record(gb);
     }
-    libyagbe_system_step();
+
+    libyagbe_trace_stop(gb);
+
+    fclose(runner.trace_file);
+    free(trace_buffer);
   }
 
-  fclose(trace_file);
+  libyagbe_gb_destroy(gb);
+
+  if (runner.save_open) {
+    yagbe_save_file_close(&runner.save);
+  }
+  yagbe_rom_unload(&rom);
+
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,337 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "libyagbe/gb.h"
+#include "manifest.h"
+#include "rom_loader.h"
+#include "work_stealing_pool.h"
+
+namespace {
+
+using yagbe::batch_runner::ManifestEntry;
+using yagbe::batch_runner::WorkStealingPool;
+
+// How often a running ROM is checked for having reported a result.
+constexpr std::uintmax_t kSliceCycles = 1 << 20;
+
+enum class Verdict { kPassed, kFailed, kCrashed, kTimedOut, kNoResult };
+
+struct JobResult {
+  Verdict verdict = Verdict::kNoResult;
+  std::uintmax_t cycles = 0;
+  std::chrono::duration<double, std::milli> wall_time{};
+
+  // Why the ROM didn't pass, if there's more to say than the verdict.
+  std::string detail;
+};
+
+// Hangs off the userdata pointer of each instance.
+struct InstanceData {
+  std::string serial_output;
+  std::string critical_message;
+};
+
+using GbPtr = std::unique_ptr<libyagbe_gb, decltype(&libyagbe_gb_destroy)>;
+
+InstanceData& GetInstanceData(libyagbe_gb* const gb) {
+  return *static_cast<InstanceData*>(gb->userdata);
+}
+
+const char* VerdictName(const Verdict verdict) {
+  switch (verdict) {
+    case Verdict::kPassed:
+      return "PASS";
+
+    case Verdict::kFailed:
+      return "FAIL";
+
+    case Verdict::kCrashed:
+      return "CRASH";
+
+    case Verdict::kTimedOut:
+      return "TIMEOUT";
+
+    case Verdict::kNoResult:
+      return "NORESULT";
+  }
+  return "?";
+}
+
+// Loads every distinct ROM in the manifest once, so that all of the jobs
+// running the same ROM share a single read-only mapping of it.
+class RomCache {
+ public:
+  RomCache() = default;
+  RomCache(const RomCache&) = delete;
+  RomCache& operator=(const RomCache&) = delete;
+
+  ~RomCache() {
+    for (auto& [path, entry] : entries_) {
+      if (entry.loaded) {
+        yagbe_rom_unload(&entry.rom);
+      }
+    }
+  }
+
+  // Returns the ROM at \p path, loading it if it hasn't been already. If it
+  // can't be loaded, nullptr is returned and \p error describes why.
+  const yagbe_rom* Get(const std::filesystem::path& path, std::string& error) {
+    auto [it, inserted] = entries_.try_emplace(path.lexically_normal());
+    Entry& entry = it->second;
+
+    if (inserted) {
+      entry.loaded = yagbe_rom_load(path.string().c_str(), &entry.rom) != 0;
+
+      if (!entry.loaded) {
+        entry.error = "unable to open ROM: ";
+        entry.error += std::strerror(errno);
+      }
+    }
+
+    if (!entry.loaded) {
+      error = entry.error;
+      return nullptr;
+    }
+    return &entry.rom;
+  }
+
+ private:
+  struct Entry {
+    yagbe_rom rom{};
+    bool loaded = false;
+    std::string error;
+  };
+
+  std::map<std::filesystem::path, Entry> entries_;
+};
+
+// Looks for the result that test ROMs in the style of Blargg's print to the
+// serial port once they're done.
+Verdict CheckSerialOutput(const std::string& serial_output) {
+  if (serial_output.find("Passed") != std::string::npos) {
+    return Verdict::kPassed;
+  }
+
+  if (serial_output.find("Failed") != std::string::npos) {
+    return Verdict::kFailed;
+  }
+  return Verdict::kNoResult;
+}
+
+void RunEmulator(const ManifestEntry& entry, libyagbe_gb* const gb,
+                 JobResult& result) {
+  for (;;) {
+    const std::uintmax_t slice =
+        std::min(kSliceCycles, entry.max_cycles - result.cycles);
+
+    if (entry.stop_pc) {
+      result.cycles +=
+          libyagbe_system_run_cycles_until(gb, slice, *entry.stop_pc);
+    } else {
+      result.cycles += libyagbe_system_run_cycles(gb, slice);
+    }
+
+    const InstanceData& data = GetInstanceData(gb);
+
+    if (gb->logger.critical_raised) {
+      result.verdict = Verdict::kCrashed;
+      result.detail = data.critical_message;
+
+      return;
+    }
+
+    result.verdict = CheckSerialOutput(data.serial_output);
+
+    if (result.verdict != Verdict::kNoResult) {
+      return;
+    }
+
+    if (entry.stop_pc && (gb->cpu.reg.pc.value == *entry.stop_pc)) {
+      result.detail = "stopped without reporting a result";
+      return;
+    }
+
+    if (result.cycles >= entry.max_cycles) {
+      result.verdict = Verdict::kTimedOut;
+      return;
+    }
+  }
+}
+
+JobResult RunJob(const ManifestEntry& entry, const yagbe_rom& rom,
+                 const bool verify_jit) {
+  const auto start_time = std::chrono::steady_clock::now();
+
+  JobResult result;
+
+  GbPtr gb(libyagbe_gb_create(), &libyagbe_gb_destroy);
+
+  if (!gb) {
+    result.verdict = Verdict::kCrashed;
+    result.detail = "unable to create emulator instance";
+
+    return result;
+  }
+
+  // Every compiled block is checked against the interpreter, and any
+  // disagreement crashes the job.
+  if (verify_jit &&
+      !libyagbe_cpu_set_jit_mode(gb.get(), LIBYAGBE_CPU_JIT_VERIFY)) {
+    result.verdict = Verdict::kCrashed;
+    result.detail = "the JIT compiler is not built in";
+
+    return result;
+  }
+
+  InstanceData data;
+  gb->userdata = &data;
+
+  libyagbe_logger_set_log_level_cb(gb.get(), LIBYAGBE_LOG_LEVEL_INFO,
+                                   [](libyagbe_gb*, const char*) {});
+  libyagbe_logger_set_log_level_cb(gb.get(), LIBYAGBE_LOG_LEVEL_WARNING,
+                                   [](libyagbe_gb*, const char*) {});
+  libyagbe_logger_set_log_level_cb(
+      gb.get(), LIBYAGBE_LOG_LEVEL_CRITICAL,
+      [](libyagbe_gb* const gb, const char* const msg) {
+        GetInstanceData(gb).critical_message = msg;
+      });
+
+  libyagbe_bus_set_serial_cb(
+      gb.get(), [](libyagbe_gb* const gb, const std::uint8_t data) {
+        GetInstanceData(gb).serial_output.push_back(static_cast<char>(data));
+      });
+
+  // Only serial output and memory are checked, so the PPU only has to keep
+  // its timing.
+  libyagbe_ppu_set_render_mode(gb.get(), LIBYAGBE_PPU_RENDER_NONE, 0);
+
+  if (!libyagbe_cart_insert(gb.get(), rom.data, rom.size)) {
+    result.verdict = Verdict::kCrashed;
+    result.detail = "unable to insert cartridge";
+
+    return result;
+  }
+  libyagbe_system_reset(gb.get());
+
+  RunEmulator(entry, gb.get(), result);
+
+  result.wall_time = std::chrono::steady_clock::now() - start_time;
+  return result;
+}
+
+void PrintUsage(const char* const program_name) {
+  std::fprintf(stderr,
+               "%s: syntax: %s [-j num_threads] [--verify-jit] manifest_file\n",
+               program_name, program_name);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t num_threads = 0;
+  const char* manifest_path = nullptr;
+  bool verify_jit = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if ((std::strcmp(argv[i], "-j") == 0) && ((i + 1) < argc)) {
+      num_threads = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--verify-jit") == 0) {
+      verify_jit = true;
+    } else if (manifest_path == nullptr) {
+      manifest_path = argv[i];
+    } else {
+      PrintUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (manifest_path == nullptr) {
+    std::fprintf(stderr, "%s: missing required argument.\n", argv[0]);
+    PrintUsage(argv[0]);
+
+    return EXIT_FAILURE;
+  }
+
+  std::vector<ManifestEntry> entries;
+
+  try {
+    entries = yagbe::batch_runner::ParseManifest(manifest_path);
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "%s: %s\n", argv[0], e.what());
+    return EXIT_FAILURE;
+  }
+
+  // Each job only ever touches its own slot, so no locking is needed.
+  std::vector<JobResult> results(entries.size());
+  WorkStealingPool pool(num_threads);
+  RomCache roms;
+
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    const yagbe_rom* const rom =
+        roms.Get(entries[i].rom_path, results[i].detail);
+
+    if (rom == nullptr) {
+      results[i].verdict = Verdict::kCrashed;
+      continue;
+    }
+
+    pool.Push([&entries, &results, rom, i, verify_jit] {
+      results[i] = RunJob(entries[i], *rom, verify_jit);
+    });
+  }
+
+  const auto start_time = std::chrono::steady_clock::now();
+  pool.Run();
+  const std::chrono::duration<double, std::milli> wall_time =
+      std::chrono::steady_clock::now() - start_time;
+
+  std::size_t num_passed = 0;
+
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    const JobResult& result = results[i];
+
+    std::printf("%-8s %12ju cycles %10.1f ms  %s", VerdictName(result.verdict),
+                result.cycles, result.wall_time.count(),
+                entries[i].rom_path.string().c_str());
+
+    if (!result.detail.empty()) {
+      std::printf(" (%s)", result.detail.c_str());
+    }
+    std::putchar('\n');
+
+    if (result.verdict == Verdict::kPassed) {
+      ++num_passed;
+    }
+  }
+
+  std::printf("%zu/%zu passed in %.1f ms using %zu thread(s)\n", num_passed,
+              entries.size(), wall_time.count(), pool.num_workers());
+
+  return (num_passed == entries.size()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
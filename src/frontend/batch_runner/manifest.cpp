@@ -0,0 +1,109 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "manifest.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace yagbe::batch_runner {
+
+namespace {
+
+[[noreturn]] void ThrowParseError(const std::filesystem::path& path,
+                                  const unsigned int line_number,
+                                  const std::string& what) {
+  std::ostringstream msg;
+  msg << path.string() << ':' << line_number << ": " << what;
+
+  throw std::runtime_error(msg.str());
+}
+
+// Parses an unsigned number in the given base, rejecting trailing garbage.
+std::optional<std::uintmax_t> ParseNumber(const std::string& str,
+                                          const int base) {
+  std::size_t consumed = 0;
+  std::uintmax_t value;
+
+  try {
+    value = std::stoull(str, &consumed, base);
+  } catch (const std::logic_error&) {
+    return std::nullopt;
+  }
+
+  if ((consumed != str.size()) || (str[0] == '-')) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+}  // namespace
+
+std::vector<ManifestEntry> ParseManifest(const std::filesystem::path& path) {
+  std::ifstream file(path);
+
+  if (!file) {
+    throw std::runtime_error("unable to open manifest " + path.string());
+  }
+
+  const std::filesystem::path base_dir = path.parent_path();
+  std::vector<ManifestEntry> entries;
+  std::string line;
+  unsigned int line_number = 0;
+
+  while (std::getline(file, line)) {
+    ++line_number;
+
+    std::istringstream fields(line);
+    std::string rom_path;
+
+    if (!(fields >> rom_path) || (rom_path[0] == '#')) {
+      continue;
+    }
+
+    ManifestEntry entry;
+    entry.rom_path = base_dir / rom_path;
+
+    std::string field;
+
+    if ((fields >> field) && (field != "-")) {
+      const auto max_cycles = ParseNumber(field, 10);
+
+      if (!max_cycles || (*max_cycles == 0)) {
+        ThrowParseError(path, line_number, "invalid cycle count " + field);
+      }
+      entry.max_cycles = *max_cycles;
+    }
+
+    if ((fields >> field) && (field != "-")) {
+      const auto stop_pc = ParseNumber(field, 16);
+
+      if (!stop_pc || (*stop_pc > 0xFFFF)) {
+        ThrowParseError(path, line_number, "invalid stop address " + field);
+      }
+      entry.stop_pc = static_cast<std::uint16_t>(*stop_pc);
+    }
+
+    if (fields >> field) {
+      ThrowParseError(path, line_number, "unexpected field " + field);
+    }
+    entries.push_back(std::move(entry));
+  }
+  return entries;
+}
+
+}  // namespace yagbe::batch_runner
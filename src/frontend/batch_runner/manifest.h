@@ -0,0 +1,57 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef YAGBE_BATCH_RUNNER_MANIFEST_H
+#define YAGBE_BATCH_RUNNER_MANIFEST_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace yagbe::batch_runner {
+
+/// The number of cycles a ROM may run for if the manifest doesn't say; two
+/// minutes of emulated time is plenty for any of the usual test suites.
+constexpr std::uintmax_t kDefaultMaxCycles = 4194304ULL * 120;
+
+/// Describes a single ROM to run and when to stop running it.
+struct ManifestEntry {
+  /// The path to the ROM, resolved relative to the manifest.
+  std::filesystem::path rom_path;
+
+  /// The ROM fails if it hasn't reported a result within this many cycles.
+  std::uintmax_t max_cycles = kDefaultMaxCycles;
+
+  /// If set, the ROM is considered done once the program counter reaches this
+  /// address, whether or not it has reported a result.
+  std::optional<std::uint16_t> stop_pc;
+};
+
+/// Parses the manifest at \p path.
+///
+/// Each non-blank line that doesn't begin with '#' describes one ROM:
+///
+///     rom_path [max_cycles [stop_pc]]
+///
+/// where \p max_cycles is decimal and \p stop_pc is hexadecimal. Either may be
+/// given as '-' to use the default.
+///
+/// Throws std::runtime_error if the manifest can't be read or is malformed.
+std::vector<ManifestEntry> ParseManifest(const std::filesystem::path& path);
+
+}  // namespace yagbe::batch_runner
+
+#endif  // YAGBE_BATCH_RUNNER_MANIFEST_H
@@ -0,0 +1,110 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "work_stealing_pool.h"
+
+#include <thread>
+
+namespace yagbe::batch_runner {
+
+WorkStealingPool::WorkStealingPool(std::size_t num_workers) {
+  if (num_workers == 0) {
+    num_workers = std::thread::hardware_concurrency();
+
+    // hardware_concurrency() is allowed to return 0 if it has no idea.
+    if (num_workers == 0) {
+      num_workers = 1;
+    }
+  }
+
+  queues_.reserve(num_workers);
+
+  for (std::size_t i = 0; i < num_workers; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+}
+
+void WorkStealingPool::Push(Task task) {
+  queues_[next_queue_]->tasks.push_back(std::move(task));
+  next_queue_ = (next_queue_ + 1) % queues_.size();
+}
+
+void WorkStealingPool::Run() {
+  std::vector<std::thread> workers;
+  workers.reserve(queues_.size() - 1);
+
+  // The calling thread doubles as the first worker.
+  for (std::size_t i = 1; i < queues_.size(); ++i) {
+    workers.emplace_back(&WorkStealingPool::WorkerMain, this, i);
+  }
+
+  WorkerMain(0);
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+void WorkStealingPool::WorkerMain(const std::size_t worker_id) {
+  // Tasks never push more tasks, so once every queue is empty there is
+  // nothing left to wait for.
+  for (;;) {
+    auto task = PopLocal(worker_id);
+
+    if (!task) {
+      task = Steal(worker_id);
+
+      if (!task) {
+        return;
+      }
+    }
+    (*task)();
+  }
+}
+
+std::optional<WorkStealingPool::Task> WorkStealingPool::PopLocal(
+    const std::size_t worker_id) {
+  Queue& queue = *queues_[worker_id];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+
+  if (queue.tasks.empty()) {
+    return std::nullopt;
+  }
+
+  Task task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+
+  return task;
+}
+
+std::optional<WorkStealingPool::Task> WorkStealingPool::Steal(
+    const std::size_t worker_id) {
+  // Start with the next worker along so that the thieves spread themselves out
+  // instead of all piling onto worker 0.
+  for (std::size_t i = 1; i < queues_.size(); ++i) {
+    Queue& victim = *queues_[(worker_id + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+
+    if (!victim.tasks.empty()) {
+      Task task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+
+      return task;
+    }
+  }
+  return std::nullopt;
+}
+
+}  // namespace yagbe::batch_runner
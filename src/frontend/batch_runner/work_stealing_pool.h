@@ -0,0 +1,73 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef YAGBE_BATCH_RUNNER_WORK_STEALING_POOL_H
+#define YAGBE_BATCH_RUNNER_WORK_STEALING_POOL_H
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace yagbe::batch_runner {
+
+/// Runs a fixed set of tasks across a number of worker threads.
+///
+/// Every worker owns a queue of tasks. A worker takes tasks from the back of
+/// its own queue, and once that runs dry it steals from the front of the queues
+/// belonging to the other workers. Test ROMs vary wildly in how long they run
+/// for, so this keeps every core busy until the very last task is picked up
+/// without any central queue for the workers to fight over.
+class WorkStealingPool {
+ public:
+  using Task = std::function<void()>;
+
+  /// Constructs a pool with \p num_workers workers, or one per hardware thread
+  /// if \p num_workers is 0.
+  explicit WorkStealingPool(std::size_t num_workers = 0);
+
+  /// Adds a task to the pool. Tasks are handed out to workers round-robin.
+  ///
+  /// This must not be called while \ref Run() is in progress.
+  void Push(Task task);
+
+  /// Runs every task that has been pushed, blocking until all of them have
+  /// completed.
+  void Run();
+
+  /// Returns the number of workers in the pool.
+  std::size_t num_workers() const { return queues_.size(); }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void WorkerMain(std::size_t worker_id);
+
+  std::optional<Task> PopLocal(std::size_t worker_id);
+  std::optional<Task> Steal(std::size_t worker_id);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::size_t next_queue_ = 0;
+};
+
+}  // namespace yagbe::batch_runner
+
+#endif  // YAGBE_BATCH_RUNNER_WORK_STEALING_POOL_H
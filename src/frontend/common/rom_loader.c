@@ -0,0 +1,174 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L
+#define HAVE_MMAP
+#endif /* defined(__unix__) || defined(__APPLE__) */
+
+#include "rom_loader.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif /* HAVE_MMAP */
+
+#include "libyagbe/cart.h"
+
+/* Reads the whole file into a heap buffer. This is used when mapping isn't
+ * possible, and for ROMs smaller than the cartridge address space, as pages of
+ * a mapping past the end of the file can't be read from. */
+static int read_rom(const char* const file_name, struct yagbe_rom* const rom) {
+  FILE* rom_file;
+  uint8_t* data;
+  long file_size;
+  size_t buffer_size;
+  int saved_errno;
+
+  rom_file = fopen(file_name, "rb");
+
+  if (!rom_file) {
+    return 0;
+  }
+
+  if ((fseek(rom_file, 0, SEEK_END) != 0) ||
+      ((file_size = ftell(rom_file)) < 0) ||
+      (fseek(rom_file, 0, SEEK_SET) != 0)) {
+    goto error;
+  }
+
+  buffer_size = (size_t)file_size;
+
+  if (buffer_size < LIBYAGBE_CART_MEM_SIZE_ROM_MIN) {
+    buffer_size = LIBYAGBE_CART_MEM_SIZE_ROM_MIN;
+  }
+
+  data = malloc(buffer_size);
+
+  if (data == NULL) {
+    errno = ENOMEM;
+    goto error;
+  }
+
+  /* Whatever the file doesn't cover reads as open bus. */
+  memset(data, 0xFF, buffer_size);
+
+  if (fread(data, 1, (size_t)file_size, rom_file) != (size_t)file_size) {
+    if (!ferror(rom_file)) {
+      errno = EIO;
+    }
+
+    saved_errno = errno;
+    free(data);
+    errno = saved_errno;
+
+    goto error;
+  }
+
+  fclose(rom_file);
+
+  rom->data = data;
+  rom->size = buffer_size;
+  rom->mapping_size = 0;
+
+  return 1;
+
+error:
+  saved_errno = errno;
+  fclose(rom_file);
+  errno = saved_errno;
+
+  return 0;
+}
+
+#ifdef HAVE_MMAP
+static int map_rom(const char* const file_name, struct yagbe_rom* const rom) {
+  struct stat st;
+  void* mapping;
+  int fd;
+  int saved_errno;
+
+  fd = open(file_name, O_RDONLY);
+
+  if (fd < 0) {
+    return 0;
+  }
+
+  if (fstat(fd, &st) != 0) {
+    goto error;
+  }
+
+  if (st.st_size < LIBYAGBE_CART_MEM_SIZE_ROM_MIN) {
+    close(fd);
+    return read_rom(file_name, rom);
+  }
+
+  mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  if (mapping == MAP_FAILED) {
+    goto error;
+  }
+
+  /* The mapping holds its own reference to the file. */
+  close(fd);
+
+  /* Have the kernel start reading the file in now instead of faulting it in
+   * page by page once the instance runs. This is only a hint, so failure
+   * doesn't matter. */
+  posix_madvise(mapping, (size_t)st.st_size, POSIX_MADV_WILLNEED);
+
+  rom->data = mapping;
+  rom->size = (size_t)st.st_size;
+  rom->mapping_size = (size_t)st.st_size;
+
+  return 1;
+
+error:
+  saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+
+  return 0;
+}
+#endif /* HAVE_MMAP */
+
+int yagbe_rom_load(const char* const file_name, struct yagbe_rom* const rom) {
+#ifdef HAVE_MMAP
+  return map_rom(file_name, rom);
+#else
+  return read_rom(file_name, rom);
+#endif /* HAVE_MMAP */
+}
+
+void yagbe_rom_unload(struct yagbe_rom* const rom) {
+#ifdef HAVE_MMAP
+  if (rom->mapping_size != 0) {
+    munmap((void*)rom->data, rom->mapping_size);
+  } else {
+    free((void*)rom->data);
+  }
+#else
+  free((void*)rom->data);
+#endif /* HAVE_MMAP */
+
+  memset(rom, 0, sizeof(struct yagbe_rom));
+}
@@ -0,0 +1,71 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef YAGBE_FRONTEND_ROM_LOADER_H
+#define YAGBE_FRONTEND_ROM_LOADER_H
+
+#include <stddef.h>
+
+#include "libyagbe/compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @brief Defines a ROM loaded into memory.
+ *
+ * Where possible the ROM file is mapped into memory rather than read, so it
+ * costs next to nothing to load, and the pages holding it are shared with
+ * every other process that has it open.
+ */
+struct yagbe_rom {
+  /** The ROM data, suitable for \ref libyagbe_cart_insert(). This must not
+   * be written to. */
+  const uint8_t* data;
+
+  /** The size of \ref data in bytes. A ROM file smaller than
+   * \ref LIBYAGBE_CART_MEM_SIZE_ROM_MIN bytes is padded to it with $FF. */
+  size_t size;
+
+  /** The size of the mapping, or 0 if the ROM was read into a heap buffer. */
+  size_t mapping_size;
+};
+
+/**
+ * @brief Loads a ROM file.
+ *
+ * The same loaded ROM may be handed to any number of instances at once.
+ *
+ * @param file_name The path to the ROM file.
+ * @param rom Receives the loaded ROM.
+ * @return int Nonzero on success. On failure, errno describes the error.
+ */
+int yagbe_rom_load(const char* const file_name, struct yagbe_rom* const rom);
+
+/**
+ * @brief Unloads a ROM loaded by \ref yagbe_rom_load().
+ *
+ * No instance may be using the ROM anymore.
+ *
+ * @param rom The ROM to unload.
+ */
+void yagbe_rom_unload(struct yagbe_rom* const rom);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* YAGBE_FRONTEND_ROM_LOADER_H */
@@ -0,0 +1,175 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L
+#define HAVE_MMAP
+#endif /* defined(__unix__) || defined(__APPLE__) */
+
+#include "save_file.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif /* HAVE_MMAP */
+
+/* Reads the file into a heap buffer, which is written back to the file as
+ * it's flushed. This is used when mapping isn't possible. */
+static int read_save_file(const char* const file_name, const size_t size,
+                          struct yagbe_save_file* const save) {
+  FILE* file;
+  uint8_t* data;
+  int saved_errno;
+
+  file = fopen(file_name, "r+b");
+
+  if (!file && (errno == ENOENT)) {
+    file = fopen(file_name, "w+b");
+  }
+
+  if (!file) {
+    return 0;
+  }
+
+  /* Whatever the file doesn't cover yet starts out cleared, and is written
+   * once it's flushed. */
+  data = calloc(1, size);
+
+  if (data == NULL) {
+    errno = ENOMEM;
+    goto error;
+  }
+
+  if ((fread(data, 1, size, file) != size) && ferror(file)) {
+    saved_errno = errno;
+    free(data);
+    errno = saved_errno;
+
+    goto error;
+  }
+
+  save->data = data;
+  save->size = size;
+  save->mapping_size = 0;
+  save->file = file;
+
+  return 1;
+
+error:
+  saved_errno = errno;
+  fclose(file);
+  errno = saved_errno;
+
+  return 0;
+}
+
+#ifdef HAVE_MMAP
+static int map_save_file(const char* const file_name, const size_t size,
+                         struct yagbe_save_file* const save) {
+  struct stat st;
+  void* mapping;
+  int fd;
+  int saved_errno;
+
+  fd = open(file_name, O_RDWR | O_CREAT, 0666);
+
+  if (fd < 0) {
+    return 0;
+  }
+
+  if (fstat(fd, &st) != 0) {
+    goto error;
+  }
+
+  /* Pages of a mapping past the end of the file can't be written to. */
+  if ((st.st_size < (off_t)size) && (ftruncate(fd, (off_t)size) != 0)) {
+    goto error;
+  }
+
+  mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (mapping == MAP_FAILED) {
+    goto error;
+  }
+
+  /* The mapping holds its own reference to the file. */
+  close(fd);
+
+  save->data = mapping;
+  save->size = size;
+  save->mapping_size = size;
+  save->file = NULL;
+
+  return 1;
+
+error:
+  saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+
+  return 0;
+}
+#endif /* HAVE_MMAP */
+
+int yagbe_save_file_open(const char* const file_name, const size_t size,
+                         struct yagbe_save_file* const save) {
+#ifdef HAVE_MMAP
+  /* Not every file system can map files for writing. */
+  if (map_save_file(file_name, size, save)) {
+    return 1;
+  }
+#endif /* HAVE_MMAP */
+
+  return read_save_file(file_name, size, save);
+}
+
+int yagbe_save_file_flush(struct yagbe_save_file* const save,
+                          const size_t offset, const size_t size) {
+#ifdef HAVE_MMAP
+  if (save->mapping_size != 0) {
+    /* The range has to start on a page boundary, and the mapping does. */
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t start = offset - (offset % page_size);
+
+    return msync(&save->data[start], (offset + size) - start, MS_ASYNC) == 0;
+  }
+#endif /* HAVE_MMAP */
+
+  return (fseek(save->file, (long)offset, SEEK_SET) == 0) &&
+         (fwrite(&save->data[offset], 1, size, save->file) == size) &&
+         (fflush(save->file) == 0);
+}
+
+void yagbe_save_file_close(struct yagbe_save_file* const save) {
+#ifdef HAVE_MMAP
+  if (save->mapping_size != 0) {
+    munmap(save->data, save->mapping_size);
+  } else {
+    free(save->data);
+    fclose(save->file);
+  }
+#else
+  free(save->data);
+  fclose(save->file);
+#endif /* HAVE_MMAP */
+
+  memset(save, 0, sizeof(struct yagbe_save_file));
+}
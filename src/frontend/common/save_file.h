@@ -0,0 +1,99 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef YAGBE_FRONTEND_SAVE_FILE_H
+#define YAGBE_FRONTEND_SAVE_FILE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "libyagbe/compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @brief Defines a file holding battery-backed cartridge RAM.
+ *
+ * Where possible the file is mapped into memory and shared, so that the RAM
+ * an instance keeps in it is the file itself: nothing is written out on exit,
+ * and nothing written is lost if the process crashes. Flushing only asks the
+ * system to start writing to storage, which matters should the system itself
+ * go down.
+ *
+ * Otherwise the file is read into memory, and flushing writes the changes
+ * back to it as it happens.
+ */
+struct yagbe_save_file {
+  /** The contents of the file, suitable for
+   * \ref libyagbe_cart_set_ram_buffer(). */
+  uint8_t* data;
+
+  /** The size of \ref data in bytes. */
+  size_t size;
+
+  /** The size of the mapping, or 0 if the file was read into a heap buffer,
+   * in which case flushing writes to \ref file. */
+  size_t mapping_size;
+
+  /** The file, or NULL if it's mapped. */
+  FILE* file;
+};
+
+/**
+ * @brief Opens a save file, creating it if it doesn't exist.
+ *
+ * @param file_name The path to the save file.
+ * @param size The size of the cartridge's RAM. A file smaller than this is
+ * extended with zeroes, and anything past it in a bigger file is left alone.
+ * @param save Receives the opened file.
+ * @return int Nonzero on success. On failure, errno describes the error.
+ */
+int yagbe_save_file_open(const char* const file_name, const size_t size,
+                         struct yagbe_save_file* const save);
+
+/**
+ * @brief Starts writing part of a save file out to storage.
+ *
+ * The offsets are those passed to a \ref libyagbe_cart_dirty_cb. If the file
+ * is mapped, this doesn't wait for the write to finish, so it's fine to call
+ * from the thread running the instance. If it isn't, the part is written to
+ * the file and the file is flushed before this returns, which blocks for as
+ * long as the system takes to accept the write.
+ *
+ * @param save The save file to flush.
+ * @param offset Where the part to write starts, in bytes.
+ * @param size The size of the part in bytes.
+ * @return int Nonzero on success. On failure, errno describes the error.
+ */
+int yagbe_save_file_flush(struct yagbe_save_file* const save,
+                          const size_t offset, const size_t size);
+
+/**
+ * @brief Closes a save file opened by \ref yagbe_save_file_open().
+ *
+ * No instance may be keeping RAM in it anymore. Anything not yet on storage
+ * is still written out by the system in its own time.
+ *
+ * @param save The save file to close.
+ */
+void yagbe_save_file_close(struct yagbe_save_file* const save);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* YAGBE_FRONTEND_SAVE_FILE_H */
@@ -13,4 +13,792 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include "libyagbe/apu.h"
\ No newline at end of file
+#include "libyagbe/apu.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apu_blip.h"
+#include "debug/log.h"
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/gb.h"
+#include "libyagbe/output.h"
+#include "libyagbe/scheduler.h"
+#include "utility.h"
+
+/* The number of cycles between steps of the frame sequencer, which clocks the
+ * length counters, the sweep and the envelopes. */
+#define SEQUENCER_PERIOD 8192
+
+/* The number of cycles between frames of output, one video frame. */
+#define FRAME_PERIOD 70224
+
+/* A channel at full volume with the master volume all the way up comes out
+ * at 15 * 8 * VOLUME_SCALE, so all four together still fit in a sample. */
+#define VOLUME_SCALE 64
+
+/* The registers of each channel are 5 addresses apart, starting at NRx0. */
+#define CHANNEL_REG_COUNT 5
+
+enum channel_regs { NRX0, NRX1, NRX2, NRX3, NRX4 };
+
+enum sides { SIDE_LEFT, SIDE_RIGHT };
+
+/* The bits of the registers which always read back as 1, as they're either
+ * unused or write only. */
+static const uint8_t read_masks[LIBYAGBE_APU_IO_REG_COUNT] = {
+    0x80, 0x3F, 0x00, 0xFF, 0xBF, 0xFF, 0x3F, 0x00, 0xFF, 0xBF, 0x7F, 0xFF,
+    0x9F, 0xFF, 0xBF, 0xFF, 0xFF, 0x00, 0x00, 0xBF, 0x00, 0x00, 0x70};
+
+/* Which of the 8 steps of each duty cycle are high, step N in bit N. */
+static const uint8_t duty_cycles[4] = {0x80, 0x81, 0xE1, 0x7E};
+
+/* How far each sample of wave RAM is shifted right for each output level; 4
+ * mutes the channel. */
+static const uint8_t wave_shifts[4] = {4, 0, 1, 2};
+
+static const uint8_t noise_divisors[8] = {8, 16, 32, 48, 64, 80, 96, 112};
+
+static uint8_t get_channel_reg(const struct libyagbe_apu* const apu,
+                               const unsigned int channel,
+                               const enum channel_regs reg) {
+  return apu->regs[(channel * CHANNEL_REG_COUNT) + reg];
+}
+
+static bool apu_is_powered(const struct libyagbe_apu* const apu) {
+  return BIT_IS_SET(apu->regs[LIBYAGBE_APU_IO_REG_NR52], 7);
+}
+
+static bool dac_is_on(const struct libyagbe_apu* const apu,
+                      const unsigned int channel) {
+  if (channel == LIBYAGBE_APU_CHANNEL_WAVE) {
+    return BIT_IS_SET(apu->regs[LIBYAGBE_APU_IO_REG_NR30], 7);
+  }
+  return (get_channel_reg(apu, channel, NRX2) & 0xF8) != 0;
+}
+
+static unsigned int get_frequency(const struct libyagbe_apu* const apu,
+                                  const unsigned int channel) {
+  return get_channel_reg(apu, channel, NRX3) |
+         ((get_channel_reg(apu, channel, NRX4) & 0x07) << 8);
+}
+
+static unsigned int get_period(const struct libyagbe_apu* const apu,
+                               const unsigned int channel) {
+  const uint8_t nr43 = apu->regs[LIBYAGBE_APU_IO_REG_NR43];
+
+  switch (channel) {
+    case LIBYAGBE_APU_CHANNEL_WAVE:
+      return (2048 - get_frequency(apu, channel)) * 2;
+
+    case LIBYAGBE_APU_CHANNEL_NOISE:
+      return (unsigned int)noise_divisors[nr43 & 0x07] << (nr43 >> 4);
+
+    default:
+      return (2048 - get_frequency(apu, channel)) * 4;
+  }
+}
+
+/* Returns the level an enabled channel is outputting at its current step. */
+static uint8_t get_level(const struct libyagbe_apu* const apu,
+                         const unsigned int channel) {
+  const struct libyagbe_apu_channel* const ch = &apu->channels[channel];
+  uint8_t sample;
+
+  switch (channel) {
+    case LIBYAGBE_APU_CHANNEL_WAVE:
+      sample = apu->wave_ram[ch->position >> 1];
+      sample = ((ch->position & 1) != 0) ? (sample & 0x0F) : (sample >> 4);
+
+      return sample >> wave_shifts[(apu->regs[LIBYAGBE_APU_IO_REG_NR32] >> 5) &
+                                   0x03];
+
+    case LIBYAGBE_APU_CHANNEL_NOISE:
+      return ((ch->lfsr & 1) == 0) ? ch->volume : 0;
+
+    default:
+      return BIT_IS_SET(duty_cycles[get_channel_reg(apu, channel, NRX1) >> 6],
+                        ch->position)
+                 ? ch->volume
+                 : 0;
+  }
+}
+
+/* Returns true if an enabled channel can't output anything but silence until
+ * one of its registers is written to, or its envelope changes the volume. */
+static bool channel_is_silent(const struct libyagbe_apu* const apu,
+                              const unsigned int channel) {
+  if (channel == LIBYAGBE_APU_CHANNEL_WAVE) {
+    return (apu->regs[LIBYAGBE_APU_IO_REG_NR32] & 0x60) == 0;
+  }
+  return apu->channels[channel].volume == 0;
+}
+
+/* Returns how loud a channel comes out on one side, taking the panning and
+ * the master volume into account. */
+static int get_gain(const struct libyagbe_apu* const apu,
+                    const unsigned int channel, const enum sides side) {
+  const uint8_t nr50 = apu->regs[LIBYAGBE_APU_IO_REG_NR50];
+  const uint8_t nr51 = apu->regs[LIBYAGBE_APU_IO_REG_NR51];
+
+  if (side == SIDE_LEFT) {
+    return BIT_IS_SET(nr51, (channel + 4))
+               ? (((nr50 >> 4) & 0x07) + 1) * VOLUME_SCALE
+               : 0;
+  }
+  return BIT_IS_SET(nr51, channel) ? ((nr50 & 0x07) + 1) * VOLUME_SCALE : 0;
+}
+
+/* Whether samples are being produced, allocating the buffers for them the
+ * first time. If that fails, the sample rate is dropped to 0. */
+static bool has_output(struct libyagbe_gb* const gb) {
+  struct libyagbe_apu* const apu = &gb->apu;
+
+  if (apu->sample_rate == 0) {
+    return false;
+  }
+
+  if (apu->left == NULL) {
+    apu->left = calloc(2, sizeof(struct libyagbe_apu_buffer));
+
+    if (apu->left == NULL) {
+      LOG_WARNING((gb, "Out of memory for the sample buffers, producing no "
+                       "more samples."));
+      apu->sample_rate = 0;
+      return false;
+    }
+    apu->right = &apu->left[1];
+  }
+  return true;
+}
+
+/* Clears out both sides of the output, if there's anything to clear. */
+static void clear_output(struct libyagbe_apu* const apu) {
+  if (apu->left != NULL) {
+    libyagbe_apu_blip_clear(apu->left);
+    libyagbe_apu_blip_clear(apu->right);
+  }
+}
+
+/* Adds a change in the output on each side at the given point in time. */
+static void add_delta(struct libyagbe_gb* const gb, const uintmax_t timestamp,
+                      const int left, const int right) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  unsigned long time;
+  size_t sample;
+  unsigned long fraction;
+
+  /* There's no room for changes from before the frame; the samples they
+   * would land on may well have been read already. */
+  if (timestamp < apu->timestamp_frame) {
+    return;
+  }
+
+  time =
+      ((unsigned long)(timestamp - apu->timestamp_frame) * apu->sample_factor) +
+      apu->sample_remainder;
+  sample = apu->samples_available + (time >> LIBYAGBE_APU_BLIP_TIME_BITS);
+  fraction = time & ((1UL << LIBYAGBE_APU_BLIP_TIME_BITS) - 1);
+
+  if (left != 0) {
+    libyagbe_apu_blip_add_delta(apu->left, sample, fraction, left);
+  }
+
+  if (right != 0) {
+    libyagbe_apu_blip_add_delta(apu->right, sample, fraction, right);
+  }
+}
+
+/* Changes the level a channel is outputting. This is the only place where
+ * channels produce any output, so nothing is done unless the level actually
+ * changes. */
+static void set_level(struct libyagbe_gb* const gb, const unsigned int channel,
+                      const uint8_t level, const uintmax_t timestamp) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  const int delta = level - apu->channels[channel].level;
+
+  if (delta == 0) {
+    return;
+  }
+  apu->channels[channel].level = level;
+
+  if (has_output(gb)) {
+    add_delta(gb, timestamp, delta * get_gain(apu, channel, SIDE_LEFT),
+              delta * get_gain(apu, channel, SIDE_RIGHT));
+  }
+}
+
+/* Brings the level of a channel in line with its state after the state has
+ * changed other than by the channel moving on a step. */
+static void refresh_level(struct libyagbe_gb* const gb,
+                          const unsigned int channel,
+                          const uintmax_t timestamp) {
+  const struct libyagbe_apu* const apu = &gb->apu;
+
+  set_level(gb, channel,
+            apu->channels[channel].enabled ? get_level(apu, channel) : 0,
+            timestamp);
+}
+
+static void disable_channel(struct libyagbe_gb* const gb,
+                            const unsigned int channel,
+                            const uintmax_t timestamp) {
+  gb->apu.channels[channel].enabled = false;
+  set_level(gb, channel, 0, timestamp);
+}
+
+/* Runs a channel up to and including the given point in time. Only the steps
+ * where its level may change cost anything; a channel which can't be heard
+ * jumps ahead in one go. */
+static void run_channel(struct libyagbe_gb* const gb,
+                        const unsigned int channel, const uintmax_t timestamp) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  struct libyagbe_apu_channel* const ch = &apu->channels[channel];
+
+  if (!ch->enabled || (ch->timestamp_step > timestamp)) {
+    return;
+  }
+
+  if ((apu->sample_rate == 0) || channel_is_silent(apu, channel)) {
+    const uintmax_t steps = ((timestamp - ch->timestamp_step) / ch->period) + 1;
+
+    ch->timestamp_step += steps * ch->period;
+
+    /* The noise channel's LFSR is left alone; where a random sequence picks
+     * up again can't be heard. */
+    ch->position = (uint8_t)((ch->position + steps) &
+                             ((channel == LIBYAGBE_APU_CHANNEL_WAVE) ? 31 : 7));
+    return;
+  }
+
+  while (ch->timestamp_step <= timestamp) {
+    switch (channel) {
+      case LIBYAGBE_APU_CHANNEL_WAVE:
+        ch->position = (ch->position + 1) & 31;
+        break;
+
+      case LIBYAGBE_APU_CHANNEL_NOISE: {
+        const unsigned int bit = (ch->lfsr ^ (ch->lfsr >> 1)) & 1;
+
+        ch->lfsr = (uint16_t)((ch->lfsr >> 1) | (bit << 14));
+
+        if (BIT_IS_SET(apu->regs[LIBYAGBE_APU_IO_REG_NR43], 3)) {
+          ch->lfsr = (uint16_t)((ch->lfsr & ~0x40) | (bit << 6));
+        }
+        break;
+      }
+
+      default:
+        ch->position = (ch->position + 1) & 7;
+        break;
+    }
+
+    set_level(gb, channel, get_level(apu, channel), ch->timestamp_step);
+    ch->timestamp_step += ch->period;
+  }
+}
+
+static void run_channels(struct libyagbe_gb* const gb,
+                         const uintmax_t timestamp) {
+  unsigned int channel;
+
+  for (channel = 0; channel < LIBYAGBE_APU_CHANNEL_COUNT; ++channel) {
+    run_channel(gb, channel, timestamp);
+  }
+}
+
+/* Works out the next frequency of the sweep, disabling channel 1 if it's out
+ * of range. */
+static unsigned int calculate_sweep(struct libyagbe_gb* const gb,
+                                    const uintmax_t timestamp) {
+  const struct libyagbe_apu* const apu = &gb->apu;
+  const uint8_t nr10 = apu->regs[LIBYAGBE_APU_IO_REG_NR10];
+  const unsigned int change = apu->sweep_frequency >> (nr10 & 0x07);
+  const unsigned int frequency = BIT_IS_SET(nr10, 3)
+                                     ? apu->sweep_frequency - change
+                                     : apu->sweep_frequency + change;
+
+  if (frequency > 2047) {
+    disable_channel(gb, LIBYAGBE_APU_CHANNEL_SQUARE1, timestamp);
+  }
+  return frequency;
+}
+
+static void clock_lengths(struct libyagbe_gb* const gb,
+                          const uintmax_t timestamp) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  unsigned int channel;
+
+  for (channel = 0; channel < LIBYAGBE_APU_CHANNEL_COUNT; ++channel) {
+    struct libyagbe_apu_channel* const ch = &apu->channels[channel];
+
+    if (BIT_IS_SET(get_channel_reg(apu, channel, NRX4), 6) &&
+        (ch->length != 0)) {
+      if (--ch->length == 0) {
+        disable_channel(gb, channel, timestamp);
+      }
+    }
+  }
+}
+
+static void clock_sweep(struct libyagbe_gb* const gb,
+                        const uintmax_t timestamp) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  const uint8_t nr10 = apu->regs[LIBYAGBE_APU_IO_REG_NR10];
+  const unsigned int period = (nr10 >> 4) & 0x07;
+  unsigned int frequency;
+
+  if (--apu->sweep_timer != 0) {
+    return;
+  }
+  apu->sweep_timer = (period != 0) ? period : 8;
+
+  if (!apu->sweep_enabled || (period == 0)) {
+    return;
+  }
+
+  frequency = calculate_sweep(gb, timestamp);
+
+  if ((frequency <= 2047) && ((nr10 & 0x07) != 0)) {
+    apu->sweep_frequency = frequency;
+    apu->regs[LIBYAGBE_APU_IO_REG_NR13] = frequency & 0xFF;
+    apu->regs[LIBYAGBE_APU_IO_REG_NR14] =
+        (apu->regs[LIBYAGBE_APU_IO_REG_NR14] & ~0x07) | (frequency >> 8);
+    apu->channels[LIBYAGBE_APU_CHANNEL_SQUARE1].period =
+        get_period(apu, LIBYAGBE_APU_CHANNEL_SQUARE1);
+
+    /* The new frequency is checked again straight away, without being
+     * used. */
+    calculate_sweep(gb, timestamp);
+  }
+}
+
+static void clock_envelopes(struct libyagbe_gb* const gb,
+                            const uintmax_t timestamp) {
+  static const unsigned int channels[3] = {LIBYAGBE_APU_CHANNEL_SQUARE1,
+                                           LIBYAGBE_APU_CHANNEL_SQUARE2,
+                                           LIBYAGBE_APU_CHANNEL_NOISE};
+  struct libyagbe_apu* const apu = &gb->apu;
+  unsigned int i;
+
+  for (i = 0; i < 3; ++i) {
+    struct libyagbe_apu_channel* const ch = &apu->channels[channels[i]];
+    const uint8_t nrx2 = get_channel_reg(apu, channels[i], NRX2);
+
+    if (!ch->enabled || ((nrx2 & 0x07) == 0)) {
+      continue;
+    }
+
+    if (ch->envelope_timer > 1) {
+      --ch->envelope_timer;
+      continue;
+    }
+    ch->envelope_timer = nrx2 & 0x07;
+
+    if (BIT_IS_SET(nrx2, 3)) {
+      if (ch->volume < 15) {
+        ++ch->volume;
+      }
+    } else if (ch->volume > 0) {
+      --ch->volume;
+    }
+    refresh_level(gb, channels[i], timestamp);
+  }
+}
+
+static void clock_sequencer(struct libyagbe_gb* const gb,
+                            const uintmax_t timestamp) {
+  struct libyagbe_apu* const apu = &gb->apu;
+
+  if ((apu->sequencer_step & 1) == 0) {
+    clock_lengths(gb, timestamp);
+  }
+
+  if ((apu->sequencer_step == 2) || (apu->sequencer_step == 6)) {
+    clock_sweep(gb, timestamp);
+  }
+
+  if (apu->sequencer_step == 7) {
+    clock_envelopes(gb, timestamp);
+  }
+  apu->sequencer_step = (apu->sequencer_step + 1) & 7;
+}
+
+/* Catches the APU up to the current point in time. Each step of the frame
+ * sequencer is applied at the point in time it happened at, so the channels
+ * are run up to it first. */
+static void sync(struct libyagbe_gb* const gb) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  const uintmax_t now = gb->scheduler.timestamp_now;
+
+  while (apu->timestamp_sequencer <= now) {
+    run_channels(gb, apu->timestamp_sequencer);
+    clock_sequencer(gb, apu->timestamp_sequencer);
+
+    apu->timestamp_sequencer += SEQUENCER_PERIOD;
+  }
+  run_channels(gb, now);
+}
+
+/* Finishes the samples up to the current point in time, so that they can be
+ * read. The APU must have been caught up first. */
+static void end_frame(struct libyagbe_gb* const gb) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  const unsigned long time =
+      ((unsigned long)(gb->scheduler.timestamp_now - apu->timestamp_frame) *
+       apu->sample_factor) +
+      apu->sample_remainder;
+
+  apu->samples_available += time >> LIBYAGBE_APU_BLIP_TIME_BITS;
+  apu->sample_remainder = time & ((1UL << LIBYAGBE_APU_BLIP_TIME_BITS) - 1);
+  apu->timestamp_frame = gb->scheduler.timestamp_now;
+
+  /* Nobody's reading the samples, or not quickly enough. Keep the newest
+   * ones, leaving room for the next frame. */
+  if (apu->samples_available > (LIBYAGBE_APU_BUFFER_SIZE / 2)) {
+    const size_t count =
+        apu->samples_available - (LIBYAGBE_APU_BUFFER_SIZE / 2);
+
+    libyagbe_apu_blip_read_samples(apu->left, NULL, count, 1);
+    libyagbe_apu_blip_read_samples(apu->right, NULL, count, 1);
+    apu->samples_available -= count;
+  }
+}
+
+/* Makes sure the output is produced in frames short enough for their samples
+ * to fit in the buffer, even if nothing touches the APU. */
+static void handle_frame_end(struct libyagbe_gb* const gb) {
+  sync(gb);
+
+  if (has_output(gb)) {
+    end_frame(gb);
+    libyagbe_output_handle_samples(gb);
+  }
+
+  libyagbe_scheduler_schedule_event(gb, LIBYAGBE_SCHEDULER_EVENT_APU_FRAME_END,
+                                    gb->scheduler.timestamp_now + FRAME_PERIOD);
+}
+
+static void trigger_channel(struct libyagbe_gb* const gb,
+                            const unsigned int channel) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  struct libyagbe_apu_channel* const ch = &apu->channels[channel];
+  const uintmax_t now = gb->scheduler.timestamp_now;
+  const uint8_t nrx2 = get_channel_reg(apu, channel, NRX2);
+
+  ch->enabled = dac_is_on(apu, channel);
+
+  if (ch->length == 0) {
+    ch->length = (channel == LIBYAGBE_APU_CHANNEL_WAVE) ? 256 : 64;
+  }
+
+  ch->period = get_period(apu, channel);
+  ch->timestamp_step = now + ch->period;
+
+  if (channel == LIBYAGBE_APU_CHANNEL_WAVE) {
+    ch->position = 0;
+  } else {
+    ch->volume = nrx2 >> 4;
+    ch->envelope_timer = nrx2 & 0x07;
+  }
+
+  if (channel == LIBYAGBE_APU_CHANNEL_NOISE) {
+    ch->lfsr = 0x7FFF;
+  }
+
+  if (channel == LIBYAGBE_APU_CHANNEL_SQUARE1) {
+    const uint8_t nr10 = apu->regs[LIBYAGBE_APU_IO_REG_NR10];
+    const unsigned int period = (nr10 >> 4) & 0x07;
+
+    apu->sweep_frequency = get_frequency(apu, channel);
+    apu->sweep_timer = (period != 0) ? period : 8;
+    apu->sweep_enabled = (period != 0) || ((nr10 & 0x07) != 0);
+
+    if ((nr10 & 0x07) != 0) {
+      calculate_sweep(gb, now);
+    }
+  }
+  refresh_level(gb, channel, now);
+}
+
+static void handle_channel_write(struct libyagbe_gb* const gb,
+                                 const unsigned int channel,
+                                 const enum channel_regs reg,
+                                 const uint8_t data) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  struct libyagbe_apu_channel* const ch = &apu->channels[channel];
+  const uintmax_t now = gb->scheduler.timestamp_now;
+
+  switch (reg) {
+    case NRX1:
+      ch->length = (channel == LIBYAGBE_APU_CHANNEL_WAVE)
+                       ? (256 - data)
+                       : (64 - (data & 0x3F));
+      break;
+
+    case NRX0:
+    case NRX2:
+      if (!dac_is_on(apu, channel)) {
+        disable_channel(gb, channel, now);
+      }
+      break;
+
+    case NRX3:
+      ch->period = get_period(apu, channel);
+      break;
+
+    case NRX4:
+      ch->period = get_period(apu, channel);
+
+      if (BIT_IS_SET(data, 7)) {
+        trigger_channel(gb, channel);
+      }
+      break;
+  }
+
+  /* The duty cycle or the volume of the wave channel may have changed. */
+  refresh_level(gb, channel, now);
+}
+
+/* Applies a change to the panning or the master volume to what every channel
+ * is outputting. */
+static void handle_mixer_write(struct libyagbe_gb* const gb,
+                               const enum libyagbe_apu_io_regs reg,
+                               const uint8_t data) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  int gains[LIBYAGBE_APU_CHANNEL_COUNT][2];
+  int left = 0;
+  int right = 0;
+  unsigned int channel;
+
+  for (channel = 0; channel < LIBYAGBE_APU_CHANNEL_COUNT; ++channel) {
+    gains[channel][SIDE_LEFT] = get_gain(apu, channel, SIDE_LEFT);
+    gains[channel][SIDE_RIGHT] = get_gain(apu, channel, SIDE_RIGHT);
+  }
+  apu->regs[reg] = data;
+
+  if (!has_output(gb)) {
+    return;
+  }
+
+  for (channel = 0; channel < LIBYAGBE_APU_CHANNEL_COUNT; ++channel) {
+    const int level = apu->channels[channel].level;
+
+    left += level *
+            (get_gain(apu, channel, SIDE_LEFT) - gains[channel][SIDE_LEFT]);
+    right += level *
+             (get_gain(apu, channel, SIDE_RIGHT) - gains[channel][SIDE_RIGHT]);
+  }
+  add_delta(gb, gb->scheduler.timestamp_now, left, right);
+}
+
+static void handle_power_write(struct libyagbe_gb* const gb,
+                               const uint8_t data) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  unsigned int channel;
+
+  if (BIT_IS_SET(data, 7)) {
+    if (!apu_is_powered(apu)) {
+      apu->regs[LIBYAGBE_APU_IO_REG_NR52] = 0x80;
+      apu->sequencer_step = 0;
+    }
+    return;
+  }
+
+  /* Every register is cleared, and stays that way until the APU is turned
+   * back on. Wave RAM is left alone. */
+  for (channel = 0; channel < LIBYAGBE_APU_CHANNEL_COUNT; ++channel) {
+    disable_channel(gb, channel, gb->scheduler.timestamp_now);
+  }
+  memset(apu->regs, 0, sizeof(apu->regs));
+}
+
+void libyagbe_apu_reset(struct libyagbe_gb* const gb) {
+  struct libyagbe_apu* const apu = &gb->apu;
+
+  /* These are the values left behind by the boot ROM. */
+  static const uint8_t regs[LIBYAGBE_APU_IO_REG_COUNT] = {
+      0x80, 0xBF, 0xF3, 0xFF, 0xBF, 0xFF, 0x3F, 0x00, 0xFF, 0xBF, 0x7F, 0xFF,
+      0x9F, 0xFF, 0xBF, 0xFF, 0xFF, 0x00, 0x00, 0xBF, 0x77, 0xF3, 0x80};
+
+  memcpy(apu->regs, regs, sizeof(apu->regs));
+  memset(apu->wave_ram, 0, sizeof(apu->wave_ram));
+  memset(apu->channels, 0, sizeof(apu->channels));
+
+  /* The boot ROM's chime leaves channel 1 on, with its envelope faded out. */
+  apu->channels[LIBYAGBE_APU_CHANNEL_SQUARE1].enabled = true;
+  apu->channels[LIBYAGBE_APU_CHANNEL_SQUARE1].period =
+      get_period(apu, LIBYAGBE_APU_CHANNEL_SQUARE1);
+  apu->channels[LIBYAGBE_APU_CHANNEL_SQUARE1].timestamp_step =
+      apu->channels[LIBYAGBE_APU_CHANNEL_SQUARE1].period;
+
+  apu->sweep_frequency = 0;
+  apu->sweep_timer = 8;
+  apu->sweep_enabled = false;
+  apu->sequencer_step = 0;
+  apu->timestamp_sequencer = SEQUENCER_PERIOD;
+  apu->timestamp_frame = 0;
+
+  /* The sample rate is left as it was, like the framebuffer of the PPU. */
+  clear_output(apu);
+  apu->samples_available = 0;
+  apu->sample_remainder = 0;
+
+  libyagbe_scheduler_register_event(gb, LIBYAGBE_SCHEDULER_EVENT_APU_FRAME_END,
+                                    LIBYAGBE_SCHEDULER_EVENT_GROUP_APU,
+                                    &handle_frame_end);
+  libyagbe_scheduler_schedule_event(gb, LIBYAGBE_SCHEDULER_EVENT_APU_FRAME_END,
+                                    gb->scheduler.timestamp_now + FRAME_PERIOD);
+}
+
+void libyagbe_apu_release(struct libyagbe_gb* const gb) {
+  free(gb->apu.left);
+  gb->apu.left = NULL;
+  gb->apu.right = NULL;
+}
+
+int libyagbe_apu_set_sample_rate(struct libyagbe_gb* const gb,
+                                 const unsigned long sample_rate) {
+  struct libyagbe_apu* const apu = &gb->apu;
+
+  if ((sample_rate != 0) && ((sample_rate < LIBYAGBE_APU_SAMPLE_RATE_MIN) ||
+                             (sample_rate > LIBYAGBE_APU_SAMPLE_RATE_MAX))) {
+    LOG_WARNING((gb, "Unsupported sample rate: %lu Hz", sample_rate));
+    return 0;
+  }
+  sync(gb);
+
+  apu->sample_rate = sample_rate;
+
+  /* The clock runs at 2^22 Hz, so this is the sample rate / 2^22 with
+   * LIBYAGBE_APU_BLIP_TIME_BITS fractional bits. */
+  apu->sample_factor =
+      (sample_rate + (1UL << (21 - LIBYAGBE_APU_BLIP_TIME_BITS))) >>
+      (22 - LIBYAGBE_APU_BLIP_TIME_BITS);
+
+  clear_output(apu);
+  apu->samples_available = 0;
+  apu->sample_remainder = 0;
+  apu->timestamp_frame = gb->scheduler.timestamp_now;
+
+  return 1;
+}
+
+void libyagbe_apu_restart_output(struct libyagbe_gb* const gb) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  uintmax_t timestamp = gb->scheduler.timestamp_now;
+  unsigned int channel;
+
+  /* The APU is only caught up now and then, so channels and the frame
+   * sequencer can still have steps to take from before now. The frame starts
+   * at the earliest of them, so that they aren't lost or misplaced. */
+  if (apu->timestamp_sequencer < timestamp) {
+    timestamp = apu->timestamp_sequencer;
+  }
+
+  for (channel = 0; channel < LIBYAGBE_APU_CHANNEL_COUNT; ++channel) {
+    const struct libyagbe_apu_channel* const ch = &apu->channels[channel];
+
+    if (ch->enabled && (ch->timestamp_step < timestamp)) {
+      timestamp = ch->timestamp_step;
+    }
+  }
+
+  clear_output(apu);
+  apu->samples_available = 0;
+  apu->sample_remainder = 0;
+  apu->timestamp_frame = timestamp;
+}
+
+size_t libyagbe_apu_read_samples(struct libyagbe_gb* const gb,
+                                 int16_t* const samples, const size_t count) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  size_t available;
+
+  assert(samples != NULL);
+
+  if (!has_output(gb)) {
+    return 0;
+  }
+
+  sync(gb);
+  end_frame(gb);
+
+  available = (count < apu->samples_available) ? count : apu->samples_available;
+
+  libyagbe_apu_blip_read_samples(apu->left, samples, available, 2);
+  libyagbe_apu_blip_read_samples(apu->right, &samples[1], available, 2);
+  apu->samples_available -= available;
+
+  return available;
+}
+
+uint8_t libyagbe_apu_read_register(struct libyagbe_gb* const gb,
+                                   const uint16_t address) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  const unsigned int reg = address - 0xFF10;
+  uint8_t status;
+  unsigned int channel;
+
+  if (reg >= LIBYAGBE_APU_IO_WAVE_RAM) {
+    return apu->wave_ram[reg - LIBYAGBE_APU_IO_WAVE_RAM];
+  }
+
+  if (reg >= LIBYAGBE_APU_IO_REG_COUNT) {
+    return 0xFF;
+  }
+
+  if (reg != LIBYAGBE_APU_IO_REG_NR52) {
+    return apu->regs[reg] | read_masks[reg];
+  }
+
+  /* Whether the channels are still on depends on their length counters and
+   * the sweep. */
+  sync(gb);
+
+  status = apu->regs[LIBYAGBE_APU_IO_REG_NR52] | read_masks[reg];
+
+  for (channel = 0; channel < LIBYAGBE_APU_CHANNEL_COUNT; ++channel) {
+    if (apu->channels[channel].enabled) {
+      SET_BIT(status, channel);
+    }
+  }
+  return status;
+}
+
+void libyagbe_apu_handle_register_write(struct libyagbe_gb* const gb,
+                                        const uint16_t address,
+                                        const uint8_t data) {
+  struct libyagbe_apu* const apu = &gb->apu;
+  const unsigned int reg = address - 0xFF10;
+
+  if (reg >= LIBYAGBE_APU_IO_REG_COUNT) {
+    if (reg >= LIBYAGBE_APU_IO_WAVE_RAM) {
+      sync(gb);
+      apu->wave_ram[reg - LIBYAGBE_APU_IO_WAVE_RAM] = data;
+    }
+    return;
+  }
+
+  /* Everything up to now happened with the old value. */
+  sync(gb);
+
+  if (reg == LIBYAGBE_APU_IO_REG_NR52) {
+    handle_power_write(gb, data);
+    return;
+  }
+
+  if (!apu_is_powered(apu)) {
+    return;
+  }
+
+  if ((reg == LIBYAGBE_APU_IO_REG_NR50) || (reg == LIBYAGBE_APU_IO_REG_NR51)) {
+    handle_mixer_write(gb, (enum libyagbe_apu_io_regs)reg, data);
+    return;
+  }
+  apu->regs[reg] = data;
+
+  handle_channel_write(gb, reg / CHANNEL_REG_COUNT,
+                       (enum channel_regs)(reg % CHANNEL_REG_COUNT), data);
+}
@@ -0,0 +1,154 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "apu_blip.h"
+
+#include <assert.h>
+#include <string.h>
+
+/* The number of fractional bits of the kernel, and of the summed deltas. */
+#define DELTA_BITS 15
+
+/* How quickly the DC offset of the output is taken out; each sample, the level
+ * moves 1/2^BASS_SHIFT of the way towards zero. */
+#define BASS_SHIFT 9
+
+/* A band-limited step for each of the fractional positions a change in level
+ * can start at, as differences between consecutive samples. Each one is a
+ * Blackman windowed sinc with its cutoff at 90% of the Nyquist frequency,
+ * integrated over each sample, and sums up to exactly 1 << DELTA_BITS. */
+static const short
+    step_kernel[1 << LIBYAGBE_APU_BLIP_PHASE_BITS][LIBYAGBE_APU_STEP_WIDTH] = {
+    {6, -34, 69, -35, -249, 1115, -3388, 18901, 18899, -3388, 1115, -249, -35,
+     69, -34, 6},
+    {5, -30, 55, 2, -321, 1230, -3537, 18059, 19711, -3199, 985, -171, -74, 84,
+     -38, 7},
+    {5, -27, 41, 36, -387, 1331, -3647, 17192, 20491, -2969, 840, -88, -114, 99,
+     -42, 7},
+    {4, -23, 28, 69, -447, 1415, -3720, 16303, 21234, -2698, 681, 0, -155, 115,
+     -46, 8},
+    {4, -19, 15, 99, -500, 1485, -3758, 15397, 21937, -2384, 508, 93, -197, 130,
+     -50, 8},
+    {3, -16, 3, 126, -547, 1539, -3762, 14482, 22596, -2028, 323, 189, -240,
+     145, -54, 9},
+    {3, -13, -8, 151, -587, 1578, -3735, 13555, 23210, -1628, 126, 288, -283,
+     160, -58, 9},
+    {3, -9, -18, 174, -621, 1602, -3677, 12621, 23775, -1186, -81, 389, -326,
+     174, -61, 9},
+    {2, -7, -28, 193, -647, 1613, -3592, 11688, 24287, -700, -298, 492, -369,
+     188, -64, 10},
+    {2, -4, -36, 210, -667, 1609, -3481, 10755, 24746, -173, -523, 596, -410,
+     201, -67, 10},
+    {1, -2, -44, 225, -681, 1593, -3346, 9831, 25147, 396, -755, 700, -451, 213,
+     -69, 10},
+    {1, 1, -51, 236, -689, 1565, -3191, 8914, 25491, 1005, -991, 803, -489, 224,
+     -71, 10},
+    {1, 2, -56, 245, -690, 1525, -3017, 8010, 25774, 1654, -1230, 904, -526,
+     234, -72, 10},
+    {1, 4, -61, 252, -686, 1475, -2827, 7124, 25996, 2339, -1471, 1002, -560,
+     242, -72, 10},
+    {1, 6, -65, 255, -676, 1414, -2622, 6259, 26155, 3061, -1711, 1096, -591,
+     249, -72, 9},
+    {0, 7, -68, 257, -662, 1346, -2406, 5419, 26251, 3816, -1948, 1185, -619,
+     253, -72, 9},
+    {0, 8, -70, 256, -642, 1269, -2181, 4603, 26282, 4603, -2181, 1269, -642,
+     256, -70, 8},
+    {0, 9, -72, 253, -619, 1185, -1948, 3816, 26251, 5419, -2406, 1346, -662,
+     257, -68, 7},
+    {0, 9, -72, 249, -591, 1096, -1711, 3061, 26154, 6260, -2622, 1415, -676,
+     255, -65, 6},
+    {0, 10, -72, 242, -560, 1002, -1471, 2340, 25994, 7126, -2827, 1475, -686,
+     252, -61, 4},
+    {0, 10, -72, 234, -526, 904, -1230, 1654, 25774, 8011, -3017, 1525, -690,
+     245, -56, 2},
+    {0, 10, -71, 224, -490, 803, -991, 1005, 25494, 8913, -3191, 1565, -689,
+     236, -51, 1},
+    {0, 10, -69, 213, -451, 700, -755, 396, 25150, 9829, -3346, 1593, -681, 225,
+     -44, -2},
+    {0, 10, -67, 201, -410, 596, -523, -173, 24749, 10755, -3481, 1609, -668,
+     210, -36, -4},
+    {0, 10, -64, 188, -369, 493, -298, -700, 24289, 11687, -3592, 1613, -647,
+     193, -28, -7},
+    {0, 9, -61, 174, -326, 389, -81, -1186, 23777, 12622, -3677, 1602, -621,
+     174, -18, -9},
+    {0, 9, -58, 160, -283, 288, 126, -1628, 23213, 13555, -3735, 1578, -587,
+     151, -8, -13},
+    {0, 9, -54, 145, -240, 189, 323, -2028, 22599, 14483, -3763, 1539, -547,
+     126, 3, -16},
+    {0, 8, -50, 130, -197, 93, 508, -2385, 21938, 15402, -3759, 1485, -500, 99,
+     15, -19},
+    {0, 8, -46, 115, -155, 0, 681, -2698, 21235, 16307, -3721, 1415, -447, 69,
+     28, -23},
+    {0, 7, -42, 99, -114, -88, 840, -2970, 20495, 17195, -3648, 1331, -387, 36,
+     41, -27},
+    {0, 7, -38, 84, -74, -171, 985, -3200, 19714, 18061, -3537, 1231, -321, 2,
+     55, -30},
+};
+
+void libyagbe_apu_blip_clear(struct libyagbe_apu_buffer* const buffer) {
+  memset(buffer->deltas, 0, sizeof(buffer->deltas));
+  buffer->integrator = 0;
+}
+
+void libyagbe_apu_blip_add_delta(struct libyagbe_apu_buffer* const buffer,
+                                 const size_t sample,
+                                 const unsigned long fraction,
+                                 const int delta) {
+  const short* const kernel =
+      step_kernel[fraction >> (LIBYAGBE_APU_BLIP_TIME_BITS -
+                               LIBYAGBE_APU_BLIP_PHASE_BITS)];
+  int32_t* const out = &buffer->deltas[sample];
+  unsigned int i;
+
+  assert(sample < LIBYAGBE_APU_BUFFER_SIZE);
+
+  for (i = 0; i < LIBYAGBE_APU_STEP_WIDTH; ++i) {
+    out[i] += kernel[i] * delta;
+  }
+}
+
+void libyagbe_apu_blip_read_samples(struct libyagbe_apu_buffer* const buffer,
+                                    int16_t* const samples, const size_t count,
+                                    const size_t stride) {
+  int32_t sum = buffer->integrator;
+  size_t i;
+
+  for (i = 0; i < count; ++i) {
+    int32_t sample;
+
+    sum += buffer->deltas[i];
+    sample = sum >> DELTA_BITS;
+    sum -= sample * (1 << (DELTA_BITS - BASS_SHIFT));
+
+    if (samples != NULL) {
+      if (sample > 32767) {
+        sample = 32767;
+      } else if (sample < -32768) {
+        sample = -32768;
+      }
+      samples[i * stride] = (int16_t)sample;
+    }
+  }
+  buffer->integrator = sum;
+
+  /* Changes belonging to the frame being produced may lie anywhere after the
+   * samples read, so everything has to move. */
+  memmove(buffer->deltas, &buffer->deltas[count],
+          (LIBYAGBE_APU_BUFFER_SIZE + LIBYAGBE_APU_STEP_WIDTH - count) *
+              sizeof(buffer->deltas[0]));
+  memset(&buffer->deltas[LIBYAGBE_APU_BUFFER_SIZE + LIBYAGBE_APU_STEP_WIDTH -
+                         count],
+         0, count * sizeof(buffer->deltas[0]));
+}
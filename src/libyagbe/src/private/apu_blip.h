@@ -0,0 +1,54 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Band-limited synthesis for the APU. Changes in level are spread over
+ * LIBYAGBE_APU_STEP_WIDTH samples with a windowed sinc, which keeps even the
+ * highest pitched channels free of aliasing without having to run the
+ * channels at the host sample rate, let alone at the clock rate. */
+
+#ifndef LIBYAGBE_APU_BLIP_H
+#define LIBYAGBE_APU_BLIP_H
+
+#include <stddef.h>
+
+#include "libyagbe/apu.h"
+#include "libyagbe/compat/compat_stdint.h"
+
+/* The number of fractional bits sample times have. */
+#define LIBYAGBE_APU_BLIP_TIME_BITS 20
+
+/* The number of fractional bits of a sample time the step is positioned
+ * with. */
+#define LIBYAGBE_APU_BLIP_PHASE_BITS 5
+
+/* Clears out every sample and change in level. */
+void libyagbe_apu_blip_clear(struct libyagbe_apu_buffer* const buffer);
+
+/* Adds a change in level at a sample time relative to the first
+ * sample that has yet to be read, split into a whole number of samples and
+ * a fraction with LIBYAGBE_APU_BLIP_TIME_BITS bits. */
+void libyagbe_apu_blip_add_delta(struct libyagbe_apu_buffer* const buffer,
+                                 const size_t sample,
+                                 const unsigned long fraction,
+                                 const int delta);
+
+/* Reads the first \p count samples, writing them \p stride values apart, and
+ * moves everything after them to the front. Passing NULL for \p samples
+ * discards them instead. */
+void libyagbe_apu_blip_read_samples(struct libyagbe_apu_buffer* const buffer,
+                                    int16_t* const samples, const size_t count,
+                                    const size_t stride);
+
+#endif /* LIBYAGBE_APU_BLIP_H */
@@ -0,0 +1,66 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Minimal atomic operations for sharing data between the emulation thread and
+ * a host thread. C90 has no notion of threads, so these map onto compiler
+ * builtins where available. */
+
+#ifndef LIBYAGBE_ATOMIC_H
+#define LIBYAGBE_ATOMIC_H
+
+#if defined(__GNUC__) || defined(__clang__)
+
+#define LIBYAGBE_HAVE_ATOMICS
+
+/* Loads a value written by another thread, along with everything that thread
+ * wrote before storing it. */
+#define ATOMIC_LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+
+/* Stores a value for another thread, making everything written before it
+ * visible to that thread once it loads the value. */
+#define ATOMIC_STORE_RELEASE(ptr, value) \
+  __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+
+/* Loads a value which only needs to be read whole, imposing no ordering. */
+#define ATOMIC_LOAD_RELAXED(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+
+/* Stores a new value and returns the old one in one go, with the ordering of
+ * both a release store and an acquire load. There's no fallback for this; code
+ * using it must check for LIBYAGBE_HAVE_ATOMICS. */
+#define ATOMIC_EXCHANGE_ACQ_REL(ptr, value) \
+  __atomic_exchange_n((ptr), (value), __ATOMIC_ACQ_REL)
+
+/* Adds to a counter which nothing else is ordered against. */
+#define ATOMIC_INCREMENT_RELAXED(ptr) \
+  __atomic_add_fetch((ptr), 1, __ATOMIC_RELAXED)
+
+/* Subtracts from a counter and returns the new value, ordered so that the
+ * thread which takes it to zero sees everything the others did before. */
+#define ATOMIC_DECREMENT_ACQ_REL(ptr) \
+  __atomic_sub_fetch((ptr), 1, __ATOMIC_ACQ_REL)
+
+#else
+
+/* Without atomics only single threaded use is possible. Anything that shares
+ * data between threads must check for LIBYAGBE_HAVE_ATOMICS. */
+#define ATOMIC_LOAD_ACQUIRE(ptr) (*(ptr))
+#define ATOMIC_STORE_RELEASE(ptr, value) (*(ptr) = (value))
+#define ATOMIC_LOAD_RELAXED(ptr) (*(ptr))
+#define ATOMIC_INCREMENT_RELAXED(ptr) (++*(ptr))
+#define ATOMIC_DECREMENT_ACQ_REL(ptr) (--*(ptr))
+
+#endif /* defined(__GNUC__) || defined(__clang__) */
+
+#endif /* LIBYAGBE_ATOMIC_H */
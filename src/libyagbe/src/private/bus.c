@@ -15,72 +15,329 @@
 
 #include "libyagbe/bus.h"
 
-#include <stdio.h>
+#include <limits.h>
+#include <string.h>
 
+#include "cow.h"
+#include "debug/log.h"
 #include "libyagbe/apu.h"
-#include "libyagbe/debug/logger.h"
+#include "libyagbe/cart.h"
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/cpu.h"
+#include "libyagbe/gb.h"
 #include "libyagbe/ppu.h"
 #include "libyagbe/scheduler.h"
 #include "libyagbe/timer.h"
 #include "utility.h"
 
-static struct libyagbe_bus bus;
-static uint8_t* cart_data;
+void libyagbe_bus_set_interrupt(struct libyagbe_gb* const gb,
+                                const enum libyagbe_bus_if_bits interrupt) {
+  SET_BIT(gb->bus.interrupt_flag, interrupt);
+}
+
+/* Marks unhandled access keys as belonging to writes. */
+#define UNHANDLED_WRITE 0x10000UL
+
+/* Counts an access to an address the bus doesn't know how to handle. Returns
+ * true if this is the first access to the address, in which case it should be
+ * logged. */
+static bool track_unhandled_access(struct libyagbe_gb* const gb,
+                                   const unsigned long key) {
+  size_t index = (key ^ (key >> 8)) % LIBYAGBE_BUS_UNHANDLED_MAX;
+  size_t probe;
+
+  for (probe = 0; probe < LIBYAGBE_BUS_UNHANDLED_MAX; ++probe) {
+    struct libyagbe_bus_unhandled_access* const entry =
+        &gb->bus.unhandled[index];
+
+    if (entry->hits == 0) {
+      entry->key = key;
+      entry->hits = 1;
+
+      return true;
+    }
+
+    if (entry->key == key) {
+      if (entry->hits != ULONG_MAX) {
+        entry->hits++;
+      }
+      return false;
+    }
+    index = (index + 1) % LIBYAGBE_BUS_UNHANDLED_MAX;
+  }
 
-struct libyagbe_bus* libyagbe_bus_get_data(void) {
-  return &bus;
+  /* Out of room, better to log too much than nothing at all. */
+  return true;
 }
 
-void libyagbe_bus_set_interrupt(const enum libyagbe_bus_if_bits interrupt) {
-  SET_BIT(bus.interrupt_flag, interrupt);
+/* VRAM tile data is never in the write map, as the PPU has to see every write
+ * to it to keep its decoded tiles up to date. */
+static bool is_tile_data_page(const unsigned int page) {
+  return (page >= (0x8000 / LIBYAGBE_BUS_PAGE_SIZE)) &&
+         (page < ((0x8000 + LIBYAGBE_PPU_MEM_SIZE_TILE_DATA) /
+                  LIBYAGBE_BUS_PAGE_SIZE));
 }
 
-void libyagbe_bus_set_cart_data(uint8_t* const data) { cart_data = data; }
+static bool is_vram_page(const unsigned int page) {
+  return (page >= (0x8000 / LIBYAGBE_BUS_PAGE_SIZE)) &&
+         (page < ((0x8000 + LIBYAGBE_PPU_MEM_SIZE_VRAM) /
+                  LIBYAGBE_BUS_PAGE_SIZE));
+}
 
-uint8_t libyagbe_bus_read_memory(const uint16_t address) {
-  switch (address >> 12) {
-    case 0x0:
-    case 0x4:
-      return cart_data[address];
+static bool is_wram_page(const unsigned int page) {
+  return (page >= (0xC000 / LIBYAGBE_BUS_PAGE_SIZE)) &&
+         (page < ((0xC000 / LIBYAGBE_BUS_PAGE_SIZE) +
+                  LIBYAGBE_BUS_WRAM_PAGE_COUNT));
+}
+
+static bool is_cart_ram_page(const unsigned int page) {
+  return (page >= (0xA000 / LIBYAGBE_BUS_PAGE_SIZE)) &&
+         (page < ((0xA000 + LIBYAGBE_CART_MEM_SIZE_RAM_BANK) /
+                  LIBYAGBE_BUS_PAGE_SIZE));
+}
+
+/* Returns the index of the page of cartridge RAM mapped to a page of the
+ * address space. Smaller RAM is mirrored throughout the bank. */
+static unsigned int get_cart_ram_index(const struct libyagbe_gb* const gb,
+                                       const unsigned int page) {
+  return ((unsigned int)gb->cart.ram_page + page -
+          (0xA000 / LIBYAGBE_BUS_PAGE_SIZE)) %
+         gb->cart.ram_page_count;
+}
+
+static bool is_cart_ram_mapped(const struct libyagbe_gb* const gb) {
+  return (gb->cart.ram_page >= 0) && (gb->cart.ram_page_count != 0);
+}
+
+static bool is_cart_ram_dirty(const struct libyagbe_gb* const gb,
+                              const unsigned int index) {
+  return (gb->cart.ram_dirty[index / 8] & (1 << (index % 8))) != 0;
+}
+
+/* Pages which are written through the slow path, even when they're backed by
+ * memory: besides tile data, that's MBC2 RAM, which only has 4 bits per byte,
+ * and cartridge RAM that's clean, which has to be marked dirty first. */
+static bool is_write_through_page(const struct libyagbe_gb* const gb,
+                                  const unsigned int page) {
+  if (is_tile_data_page(page)) {
+    return true;
+  }
+
+  if (!is_cart_ram_page(page) || !is_cart_ram_mapped(gb)) {
+    return false;
+  }
+  return (gb->cart.header.mbc == LIBYAGBE_CART_MBC2) ||
+         !is_cart_ram_dirty(gb, get_cart_ram_index(gb, page));
+}
+
+/* Returns where the block of memory backing a page is kept, or NULL if the
+ * page isn't backed by writable memory. */
+static uint8_t** get_page_block(struct libyagbe_gb* const gb,
+                                const unsigned int page) {
+  if (is_wram_page(page)) {
+    return &gb->bus.wram[page - (0xC000 / LIBYAGBE_BUS_PAGE_SIZE)];
+  }
+
+  if (is_vram_page(page)) {
+    return &gb->ppu.vram;
+  }
+
+  if (is_cart_ram_page(page) && is_cart_ram_mapped(gb)) {
+    return &gb->cart.ram[get_cart_ram_index(gb, page)];
+  }
+  return NULL;
+}
+
+/* Returns the writable memory backing a page, or NULL if there is none. */
+static uint8_t* get_page_memory(struct libyagbe_gb* const gb,
+                                const unsigned int page) {
+  uint8_t** const block = get_page_block(gb, page);
+
+  if (block == NULL) {
+    return NULL;
+  }
+
+  if (is_vram_page(page)) {
+    return &(*block)[(page * LIBYAGBE_BUS_PAGE_SIZE) - 0x8000];
+  }
+  return *block;
+}
+
+static bool is_shared_page(struct libyagbe_gb* const gb,
+                           const unsigned int page) {
+  uint8_t** const block = get_page_block(gb, page);
+
+  /* Cartridge RAM in the caller's buffer is never shared. */
+  if ((block == NULL) ||
+      (is_cart_ram_page(page) && (gb->cart.ram_buffer != NULL))) {
+    return false;
+  }
+  return libyagbe_cow_is_shared(*block);
+}
+
+/* Puts a watched page back into the write map, discarding the code cached
+ * from it. */
+static void unwatch_page(struct libyagbe_gb* const gb,
+                         const unsigned int page) {
+  if (!is_write_through_page(gb, page) && !is_shared_page(gb, page)) {
+    gb->bus.write_map[page] = gb->bus.watched_pages[page];
+  }
+  gb->bus.watched_pages[page] = NULL;
+
+  libyagbe_cpu_invalidate_page(gb, page);
+}
+
+/* Maps host memory into the address space. Memory which may only be read
+ * from is passed as \p read_data with \p write_data set to NULL; otherwise
+ * both point to the same memory. */
+static void map_pages(struct libyagbe_gb* const gb, const uint16_t address,
+                      const size_t size, const uint8_t* const read_data,
+                      uint8_t* const write_data) {
+  size_t page;
+
+  for (page = 0; page < (size / LIBYAGBE_BUS_PAGE_SIZE); ++page) {
+    const size_t index = (address / LIBYAGBE_BUS_PAGE_SIZE) + page;
+    const size_t offset = page * LIBYAGBE_BUS_PAGE_SIZE;
+
+    if (gb->bus.watched_pages[index] != NULL) {
+      unwatch_page(gb, index);
+    }
+
+    gb->bus.read_map[index] = (read_data != NULL) ? &read_data[offset] : NULL;
+    gb->bus.write_map[index] =
+        (write_data != NULL) ? &write_data[offset] : NULL;
+  }
+}
+
+static void map_vram(struct libyagbe_gb* const gb) {
+  uint8_t* const maps = &gb->ppu.vram[LIBYAGBE_PPU_MEM_SIZE_TILE_DATA];
+
+  map_pages(gb, 0x8000, LIBYAGBE_PPU_MEM_SIZE_TILE_DATA, gb->ppu.vram, NULL);
+  map_pages(gb, 0x8000 + LIBYAGBE_PPU_MEM_SIZE_TILE_DATA,
+            LIBYAGBE_PPU_MEM_SIZE_VRAM - LIBYAGBE_PPU_MEM_SIZE_TILE_DATA,
+            maps, libyagbe_cow_is_shared(gb->ppu.vram) ? NULL : maps);
+}
+
+static void map_wram_page(struct libyagbe_gb* const gb,
+                          const unsigned int index) {
+  uint8_t* const data = gb->bus.wram[index];
+
+  map_pages(gb, (uint16_t)(0xC000 + (index * LIBYAGBE_BUS_PAGE_SIZE)),
+            LIBYAGBE_BUS_PAGE_SIZE, data,
+            libyagbe_cow_is_shared(data) ? NULL : data);
+}
+
+static void map_cart_ram_page(struct libyagbe_gb* const gb,
+                              const unsigned int page) {
+  uint8_t** const block = get_page_block(gb, page);
+  const uint16_t address = (uint16_t)(page * LIBYAGBE_BUS_PAGE_SIZE);
+
+  if (block == NULL) {
+    map_pages(gb, address, LIBYAGBE_BUS_PAGE_SIZE, NULL, NULL);
+    return;
+  }
 
-    case 0xC:
-      return bus.wram0[address - 0xC000];
+  map_pages(gb, address, LIBYAGBE_BUS_PAGE_SIZE, *block,
+            (is_write_through_page(gb, page) || is_shared_page(gb, page))
+                ? NULL
+                : *block);
+}
+
+/* Gets a page of memory ready to be written to, copying it first if it's
+ * shared with another instance. Returns false if the copy couldn't be made,
+ * in which case the write must be dropped. */
+static bool own_page(struct libyagbe_gb* const gb, const unsigned int page) {
+  uint8_t** const block = get_page_block(gb, page);
+  const bool shared = is_shared_page(gb, page);
 
-    case 0xD:
-      return bus.wram1[address - 0xD000];
+  /* Cartridge RAM is about to be written to, so it has to be flushed. */
+  if ((block != NULL) && is_cart_ram_page(page)) {
+    const unsigned int index = get_cart_ram_index(gb, page);
+
+    gb->cart.ram_dirty[index / 8] |= (uint8_t)(1 << (index % 8));
+  }
+
+  if (shared && !libyagbe_cow_unshare(block)) {
+    LOG_CRITICAL((gb, "Out of memory copying page $%02X00", page));
+    return false;
+  }
+
+  /* Also remap pages another instance stopped sharing since they were mapped,
+   * which are still missing from the write map. */
+  if (shared || ((block != NULL) && !is_write_through_page(gb, page) &&
+                 (gb->bus.write_map[page] == NULL))) {
+    if (is_vram_page(page)) {
+      map_vram(gb);
+    } else if (is_wram_page(page)) {
+      map_wram_page(gb, page - (0xC000 / LIBYAGBE_BUS_PAGE_SIZE));
+    } else {
+      map_cart_ram_page(gb, page);
+    }
+  }
+  return true;
+}
+
+/* Accesses to anything not present in the memory map end up here. */
+static uint8_t read_memory_slow(struct libyagbe_gb* const gb,
+                                const uint16_t address) {
+  switch (address >> 12) {
+    case 0xA:
+    case 0xB:
+      return libyagbe_cart_read_ram(gb, address);
 
     case 0xF:
       switch ((address >> 8) & 0x0F) {
+        case 0xE:
+          if (address < 0xFEA0) {
+            return gb->ppu.oam[address - 0xFE00];
+          }
+
+          /* The rest of the page is unusable. */
+          return 0x00;
+
         case 0xF:
           switch ((address & 0x00FF) >> 4) {
             case 0x0:
               switch (address & 0x000F) {
+                case LIBYAGBE_TIMER_IO_REG_DIV:
+                  return libyagbe_timer_read_div(gb);
+
+                case LIBYAGBE_TIMER_IO_REG_TIMA:
+                  return libyagbe_timer_read_tima(gb);
+
+                case LIBYAGBE_TIMER_IO_REG_TMA:
+                  return libyagbe_timer_read_tma(gb);
+
+                case LIBYAGBE_TIMER_IO_REG_TAC:
+                  return libyagbe_timer_read_tac(gb);
+
                 case LIBYAGBE_BUS_IO_REG_IF:
-                  return bus.interrupt_flag;
+                  return gb->bus.interrupt_flag;
 
                 default:
                   break;
               }
               break;
 
-            case 0x4:
-              switch (address & 0x000F) {
-                /* Stubbed. */
-                case LIBYAGBE_PPU_IO_REG_LY:
-                  return 0xFF;
+            case 0x1:
+            case 0x2:
+            case 0x3:
+              return libyagbe_apu_read_register(gb, address);
 
-                default:
-                  break;
+            case 0x4:
+              if ((address & 0x000F) <= LIBYAGBE_PPU_IO_REG_WX) {
+                return libyagbe_ppu_read_register(
+                    gb, (enum libyagbe_ppu_io_regs)(address & 0x000F));
               }
               break;
 
             case 0x8:
-              return bus.hram[address - 0xFF80];
+              return gb->bus.hram[address - 0xFF80];
 
             case 0xF:
               switch (address & 0x000F) {
                 case 0xF:
-                  return bus.interrupt_enable;
+                  return gb->bus.interrupt_enable;
 
                 default:
                   break;
@@ -98,54 +355,94 @@ uint8_t libyagbe_bus_read_memory(const uint16_t address) {
       break;
   }
 
-  libyagbe_log(LIBYAGBE_LOG_LEVEL_WARNING,
-               "Unhandled memory read: $%04X, returning $FF", address);
+  if (track_unhandled_access(gb, address)) {
+    LOG_WARNING((gb, "Unhandled memory read: $%04X, returning $FF", address));
+  }
   return 0xFF;
 }
 
-void libyagbe_bus_write_memory(const uint16_t address, const uint8_t data) {
+static void write_memory_slow(struct libyagbe_gb* const gb,
+                              const uint16_t address, const uint8_t data) {
+  const unsigned int page = address >> 8;
+
+  if (gb->bus.watched_pages[page] != NULL) {
+    unwatch_page(gb, page);
+  }
+
+  if (!own_page(gb, page)) {
+    return;
+  }
+
+  if (gb->bus.write_map[page] != NULL) {
+    gb->bus.write_map[page][address & 0xFF] = data;
+    return;
+  }
+
   switch (address >> 12) {
-    /* Stubbed. */
-    case 0x8:
-    case 0x9:
+    case 0x0:
+    case 0x1:
+    case 0x2:
+    case 0x3:
+    case 0x4:
+    case 0x5:
+    case 0x6:
+    case 0x7:
+      libyagbe_cart_handle_register_write(gb, address, data);
       return;
 
-    case 0xC:
-      bus.wram0[address - 0xC000] = data;
+    case 0x8:
+    case 0x9:
+      libyagbe_ppu_handle_vram_write(gb, address, data);
       return;
 
-    case 0xD:
-      bus.wram1[address - 0xD000] = data;
+    case 0xA:
+    case 0xB:
+      libyagbe_cart_write_ram(gb, address, data);
       return;
 
     case 0xF:
       switch ((address >> 8) & 0x0F) {
+        case 0xE:
+          if (address < 0xFEA0) {
+            gb->ppu.oam[address - 0xFE00] = data;
+          }
+
+          /* The rest of the page is unusable, and writes to it are
+           * ignored. */
+          return;
+
         case 0xF:
           switch ((address & 0x00FF) >> 4) {
             case 0x0:
               switch (address & 0x000F) {
                 case LIBYAGBE_BUS_IO_REG_SB:
-                  putchar(data);
+                  if (gb->bus.serial_cb != NULL) {
+                    gb->bus.serial_cb(gb, data);
+                  }
                   return;
 
                 /* Stubbed. */
                 case LIBYAGBE_BUS_IO_REG_SC:
                   return;
 
+                case LIBYAGBE_TIMER_IO_REG_DIV:
+                  libyagbe_timer_handle_div_write(gb);
+                  return;
+
                 case LIBYAGBE_TIMER_IO_REG_TIMA:
-                  libyagbe_timer_handle_tima_write(data);
+                  libyagbe_timer_handle_tima_write(gb, data);
                   return;
 
                 case LIBYAGBE_TIMER_IO_REG_TMA:
-                  libyagbe_timer_handle_tma_write(data);
+                  libyagbe_timer_handle_tma_write(gb, data);
                   return;
 
                 case LIBYAGBE_TIMER_IO_REG_TAC:
-                  libyagbe_timer_handle_tac_write(data);
+                  libyagbe_timer_handle_tac_write(gb, data);
                   return;
 
                 case LIBYAGBE_BUS_IO_REG_IF:
-                  bus.interrupt_flag = data;
+                  gb->bus.interrupt_flag = data;
                   return;
 
                 default:
@@ -153,41 +450,28 @@ void libyagbe_bus_write_memory(const uint16_t address, const uint8_t data) {
               }
               break;
 
+            case 0x1:
             case 0x2:
-              switch (address & 0x000F) {
-                /* Stubbed. */
-                case LIBYAGBE_APU_IO_REG_NR50:
-                case LIBYAGBE_APU_IO_REG_NR51:
-                case LIBYAGBE_APU_IO_REG_NR52:
-                  return;
-
-                default:
-                  break;
-              }
-              break;
+            case 0x3:
+              libyagbe_apu_handle_register_write(gb, address, data);
+              return;
 
             case 0x4:
-              switch (address & 0x000F) {
-                /* Stubbed. */
-                case LIBYAGBE_PPU_IO_REG_LCDC:
-                case LIBYAGBE_PPU_IO_REG_SCY:
-                case LIBYAGBE_PPU_IO_REG_SCX:
-                case LIBYAGBE_PPU_IO_REG_BGP:
-                  return;
-
-                default:
-                  break;
+              if ((address & 0x000F) <= LIBYAGBE_PPU_IO_REG_WX) {
+                libyagbe_ppu_handle_register_write(
+                    gb, (enum libyagbe_ppu_io_regs)(address & 0x000F), data);
+                return;
               }
               break;
 
             case 0x8:
-              bus.hram[address - 0xFF80] = data;
+              gb->bus.hram[address - 0xFF80] = data;
               return;
 
             case 0xF:
               switch (address & 0x000F) {
                 case 0xF:
-                  bus.interrupt_enable = data;
+                  gb->bus.interrupt_enable = data;
                   return;
 
                 default:
@@ -203,6 +487,266 @@ void libyagbe_bus_write_memory(const uint16_t address, const uint8_t data) {
       break;
   }
 
-  libyagbe_log(LIBYAGBE_LOG_LEVEL_WARNING,
-               "Unhandled memory write: $%04X <- $%02X", address, data);
+  if (track_unhandled_access(gb, address | UNHANDLED_WRITE)) {
+    LOG_WARNING(
+        (gb, "Unhandled memory write: $%04X <- $%02X", address, data));
+  }
+}
+
+void libyagbe_bus_reset(struct libyagbe_gb* const gb) {
+  unsigned int index;
+
+  /* Other instances keep their copy of whatever was shared. Pages which
+   * couldn't be copied are left as they are. */
+  libyagbe_bus_unshare_memory(gb);
+
+  for (index = 0; index < LIBYAGBE_BUS_WRAM_PAGE_COUNT; ++index) {
+    if (!libyagbe_cow_is_shared(gb->bus.wram[index])) {
+      memset(gb->bus.wram[index], 0, LIBYAGBE_BUS_PAGE_SIZE);
+    }
+  }
+
+  memset(gb->bus.hram, 0, sizeof(gb->bus.hram));
+  memset(gb->bus.unhandled, 0, sizeof(gb->bus.unhandled));
+
+  gb->bus.interrupt_flag = 0x00;
+  gb->bus.interrupt_enable = 0x00;
+
+  libyagbe_bus_update_memory_map(gb);
+}
+
+void libyagbe_bus_update_memory_map(struct libyagbe_gb* const gb) {
+  unsigned int page;
+
+  for (page = 0; page < LIBYAGBE_BUS_PAGE_COUNT; ++page) {
+    if (gb->bus.watched_pages[page] != NULL) {
+      unwatch_page(gb, page);
+    }
+  }
+
+  memset(gb->bus.read_map, 0, sizeof(gb->bus.read_map));
+  memset(gb->bus.write_map, 0, sizeof(gb->bus.write_map));
+
+  /* Writes to ROM go to the MBC, through the slow path. */
+  libyagbe_bus_map_cart_rom(gb);
+  libyagbe_bus_map_cart_ram(gb);
+
+  map_vram(gb);
+
+  for (page = 0; page < LIBYAGBE_BUS_WRAM_PAGE_COUNT; ++page) {
+    map_wram_page(gb, page);
+  }
+
+  /* $FF00-$FFFF mixes I/O registers with HRAM and is never mapped. */
+}
+
+void libyagbe_bus_map_cart_rom(struct libyagbe_gb* const gb) {
+  const struct libyagbe_cart* const cart = &gb->cart;
+  unsigned int area;
+
+  for (area = 0; area < 2; ++area) {
+    map_pages(gb, (uint16_t)(area * LIBYAGBE_CART_MEM_SIZE_ROM_BANK),
+              LIBYAGBE_CART_MEM_SIZE_ROM_BANK,
+              (cart->rom != NULL)
+                  ? &cart->rom[(size_t)cart->rom_banks[area] *
+                               LIBYAGBE_CART_MEM_SIZE_ROM_BANK]
+                  : NULL,
+              NULL);
+  }
+}
+
+void libyagbe_bus_map_cart_ram(struct libyagbe_gb* const gb) {
+  unsigned int page;
+
+  for (page = 0xA000 / LIBYAGBE_BUS_PAGE_SIZE;
+       page < ((0xA000 + LIBYAGBE_CART_MEM_SIZE_RAM_BANK) /
+               LIBYAGBE_BUS_PAGE_SIZE);
+       ++page) {
+    map_cart_ram_page(gb, page);
+  }
+}
+
+void libyagbe_bus_protect_cart_ram(struct libyagbe_gb* const gb) {
+  unsigned int page;
+
+  for (page = 0xA000 / LIBYAGBE_BUS_PAGE_SIZE;
+       page < ((0xA000 + LIBYAGBE_CART_MEM_SIZE_RAM_BANK) /
+               LIBYAGBE_BUS_PAGE_SIZE);
+       ++page) {
+    /* Watched pages are out of the write map already, and only go back in
+     * once they're dirty. */
+    if (is_write_through_page(gb, page)) {
+      gb->bus.write_map[page] = NULL;
+    }
+  }
+}
+
+bool libyagbe_bus_watch_page(struct libyagbe_gb* const gb,
+                             const unsigned int page) {
+  uint8_t* memory;
+
+  if (gb->bus.watched_pages[page] != NULL) {
+    return true;
+  }
+
+  /* Tile data and shared pages are already written through the slow path,
+   * and are left out of the write map when no longer watched. */
+  memory = get_page_memory(gb, page);
+
+  if (memory == NULL) {
+    return false;
+  }
+
+  gb->bus.watched_pages[page] = memory;
+  gb->bus.write_map[page] = NULL;
+
+  return true;
+}
+
+bool libyagbe_bus_alloc_memory(struct libyagbe_gb* const gb) {
+  unsigned int index;
+
+  for (index = 0; index < LIBYAGBE_BUS_WRAM_PAGE_COUNT; ++index) {
+    gb->bus.wram[index] = libyagbe_cow_alloc(LIBYAGBE_BUS_PAGE_SIZE);
+
+    if (gb->bus.wram[index] == NULL) {
+      return false;
+    }
+  }
+
+  gb->ppu.vram = libyagbe_cow_alloc(LIBYAGBE_PPU_MEM_SIZE_VRAM);
+  return gb->ppu.vram != NULL;
+}
+
+void libyagbe_bus_release_memory(struct libyagbe_gb* const gb) {
+  unsigned int index;
+
+  for (index = 0; index < LIBYAGBE_BUS_WRAM_PAGE_COUNT; ++index) {
+    libyagbe_cow_release(gb->bus.wram[index]);
+    gb->bus.wram[index] = NULL;
+  }
+
+  libyagbe_cow_release(gb->ppu.vram);
+  gb->ppu.vram = NULL;
+}
+
+void libyagbe_bus_fork(struct libyagbe_gb* const child,
+                       struct libyagbe_gb* const gb) {
+  unsigned int page;
+
+  for (page = 0; page < LIBYAGBE_BUS_WRAM_PAGE_COUNT; ++page) {
+    child->bus.wram[page] = libyagbe_cow_share(gb->bus.wram[page]);
+  }
+  child->ppu.vram = libyagbe_cow_share(gb->ppu.vram);
+
+  memcpy(child->bus.hram, gb->bus.hram, sizeof(child->bus.hram));
+  child->bus.interrupt_flag = gb->bus.interrupt_flag;
+  child->bus.interrupt_enable = gb->bus.interrupt_enable;
+  child->bus.serial_cb = gb->bus.serial_cb;
+
+  libyagbe_bus_update_memory_map(child);
+
+  /* The parent keeps its watched pages and the code cached from them; they
+   * just aren't put back into the write map anymore. */
+  for (page = 0; page < LIBYAGBE_BUS_PAGE_COUNT; ++page) {
+    if (get_page_block(gb, page) != NULL) {
+      gb->bus.write_map[page] = NULL;
+    }
+  }
+}
+
+/* Replaces a block of memory with a copy of its own if it's shared. Returns
+ * false if out of memory. */
+static bool unshare_block(struct libyagbe_gb* const gb, uint8_t** const block,
+                          bool* const copied) {
+  if (!libyagbe_cow_is_shared(*block)) {
+    return true;
+  }
+
+  if (!libyagbe_cow_unshare(block)) {
+    LOG_CRITICAL((gb, "Out of memory copying shared memory"));
+    return false;
+  }
+
+  *copied = true;
+  return true;
+}
+
+bool libyagbe_bus_unshare_memory(struct libyagbe_gb* const gb) {
+  bool unshared = true;
+  bool copied = false;
+  unsigned int index;
+
+  for (index = 0; index < LIBYAGBE_BUS_WRAM_PAGE_COUNT; ++index) {
+    if (!unshare_block(gb, &gb->bus.wram[index], &copied)) {
+      unshared = false;
+    }
+  }
+
+  if (!unshare_block(gb, &gb->ppu.vram, &copied)) {
+    unshared = false;
+  }
+
+  /* Every bank of cartridge RAM, not only the one that's mapped. RAM in the
+   * caller's buffer is never shared. */
+  if (gb->cart.ram_buffer == NULL) {
+    for (index = 0; index < gb->cart.ram_page_count; ++index) {
+      if (!unshare_block(gb, &gb->cart.ram[index], &copied)) {
+        unshared = false;
+      }
+    }
+  }
+
+  /* The memory map still points at the shared copies. */
+  if (copied) {
+    libyagbe_bus_update_memory_map(gb);
+  }
+  return unshared;
+}
+
+void libyagbe_bus_set_serial_cb(struct libyagbe_gb* const gb,
+                                const libyagbe_bus_serial_cb cb_func) {
+  gb->bus.serial_cb = cb_func;
+}
+
+void libyagbe_bus_report_unhandled(struct libyagbe_gb* const gb) {
+  size_t index;
+
+  for (index = 0; index < LIBYAGBE_BUS_UNHANDLED_MAX; ++index) {
+    const struct libyagbe_bus_unhandled_access* const entry =
+        &gb->bus.unhandled[index];
+
+    if (entry->hits == 0) {
+      continue;
+    }
+
+    if (entry->key & UNHANDLED_WRITE) {
+      LOG_WARNING((gb, "Unhandled memory write: $%04lX (%lu times)",
+                   entry->key & 0xFFFF, entry->hits));
+    } else {
+      LOG_WARNING((gb, "Unhandled memory read: $%04lX (%lu times)",
+                   entry->key, entry->hits));
+    }
+  }
+}
+
+uint8_t libyagbe_bus_read_memory(struct libyagbe_gb* const gb,
+                                 const uint16_t address) {
+  const uint8_t* const page = gb->bus.read_map[address >> 8];
+
+  if (page != NULL) {
+    return page[address & 0xFF];
+  }
+  return read_memory_slow(gb, address);
+}
+
+void libyagbe_bus_write_memory(struct libyagbe_gb* const gb,
+                               const uint16_t address, const uint8_t data) {
+  uint8_t* const page = gb->bus.write_map[address >> 8];
+
+  if (page != NULL) {
+    page[address & 0xFF] = data;
+    return;
+  }
+  write_memory_slow(gb, address, data);
 }
\ No newline at end of file
@@ -0,0 +1,677 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/cart.h"
+
+#include <string.h>
+
+#include "cow.h"
+#include "debug/log.h"
+#include "libyagbe/bus.h"
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/gb.h"
+#include "utility.h"
+
+/* The number of cycles in one second of the clock. */
+#define RTC_CYCLES_PER_SECOND 4194304UL
+
+#define SECONDS_PER_DAY 86400UL
+
+/* The bits of DH. */
+#define RTC_DH_DAY_HIGH 0
+#define RTC_DH_HALT 6
+#define RTC_DH_DAY_CARRY 7
+
+/* The values $4000-$5FFF selects the clock registers with on an MBC3. */
+#define RTC_SELECT_FIRST 0x08
+#define RTC_SELECT_LAST (RTC_SELECT_FIRST + LIBYAGBE_CART_RTC_REG_COUNT - 1)
+
+/* The cartridge header fields. */
+#define HEADER_TITLE 0x134
+#define HEADER_TYPE 0x147
+#define HEADER_ROM_SIZE 0x148
+#define HEADER_RAM_SIZE 0x149
+#define HEADER_CHECKSUM_START 0x134
+#define HEADER_CHECKSUM 0x14D
+
+/* The bits of each clock register that exist. */
+static const uint8_t rtc_masks[LIBYAGBE_CART_RTC_REG_COUNT] = {0x3F, 0x3F,
+                                                               0x1F, 0xFF,
+                                                               0xC1};
+
+/* Fills in what the cartridge type says about the hardware. */
+static void parse_type(struct libyagbe_cart_header* const header) {
+  header->mbc = LIBYAGBE_CART_MBC_UNSUPPORTED;
+  header->has_ram = false;
+  header->has_battery = false;
+  header->has_rtc = false;
+
+  switch (header->type) {
+    case 0x00:
+      header->mbc = LIBYAGBE_CART_MBC_NONE;
+      break;
+
+    case 0x09:
+      header->has_battery = true;
+      /* Fall through. */
+
+    case 0x08:
+      header->mbc = LIBYAGBE_CART_MBC_NONE;
+      header->has_ram = true;
+      break;
+
+    case 0x03:
+      header->has_battery = true;
+      /* Fall through. */
+
+    case 0x02:
+      header->has_ram = true;
+      /* Fall through. */
+
+    case 0x01:
+      header->mbc = LIBYAGBE_CART_MBC1;
+      break;
+
+    case 0x06:
+      header->has_battery = true;
+      /* Fall through. */
+
+    case 0x05:
+      header->mbc = LIBYAGBE_CART_MBC2;
+      header->has_ram = true;
+      break;
+
+    case 0x10:
+      header->has_ram = true;
+      /* Fall through. */
+
+    case 0x0F:
+      header->mbc = LIBYAGBE_CART_MBC3;
+      header->has_battery = true;
+      header->has_rtc = true;
+      break;
+
+    case 0x13:
+      header->has_battery = true;
+      /* Fall through. */
+
+    case 0x12:
+      header->has_ram = true;
+      /* Fall through. */
+
+    case 0x11:
+      header->mbc = LIBYAGBE_CART_MBC3;
+      break;
+
+    /* The rumble motor of $1C-$1E is simply left out. */
+    case 0x1B:
+    case 0x1E:
+      header->has_battery = true;
+      /* Fall through. */
+
+    case 0x1A:
+    case 0x1D:
+      header->has_ram = true;
+      /* Fall through. */
+
+    case 0x19:
+    case 0x1C:
+      header->mbc = LIBYAGBE_CART_MBC5;
+      break;
+
+    default:
+      break;
+  }
+}
+
+int libyagbe_cart_parse_header(const uint8_t* const data, const size_t size,
+                               struct libyagbe_cart_header* const header) {
+  static const unsigned long ram_sizes[6] = {0, 2048, 8192, 32768, 131072,
+                                             65536};
+  unsigned int address;
+  unsigned int index;
+  uint8_t checksum = 0;
+
+  if (size < LIBYAGBE_CART_HEADER_END) {
+    return 0;
+  }
+
+  memset(header, 0, sizeof(struct libyagbe_cart_header));
+
+  for (index = 0; index < LIBYAGBE_CART_TITLE_SIZE; ++index) {
+    const uint8_t c = data[HEADER_TITLE + index];
+
+    if (c == 0x00) {
+      break;
+    }
+    header->title[index] = (char)c;
+  }
+
+  header->type = data[HEADER_TYPE];
+  parse_type(header);
+
+  header->rom_size = (unsigned long)LIBYAGBE_CART_MEM_SIZE_ROM_MIN
+                     << (data[HEADER_ROM_SIZE] & 0x0F);
+
+  if (header->mbc == LIBYAGBE_CART_MBC2) {
+    header->ram_size = LIBYAGBE_CART_MEM_SIZE_MBC2_RAM;
+  } else if (header->has_ram && (data[HEADER_RAM_SIZE] < 6)) {
+    header->ram_size = ram_sizes[data[HEADER_RAM_SIZE]];
+  }
+
+  for (address = HEADER_CHECKSUM_START; address < HEADER_CHECKSUM;
+       ++address) {
+    checksum = (uint8_t)(checksum - data[address] - 1);
+  }
+  header->checksum_valid = (checksum == data[HEADER_CHECKSUM]);
+
+  return 1;
+}
+
+/* RAM in a buffer of the caller's is only let go of. */
+static void release_ram(struct libyagbe_cart* const cart) {
+  unsigned int page;
+
+  for (page = 0; page < cart->ram_page_count; ++page) {
+    if (cart->ram_buffer == NULL) {
+      libyagbe_cow_release(cart->ram[page]);
+    }
+    cart->ram[page] = NULL;
+  }
+
+  cart->ram_page_count = 0;
+  cart->ram_buffer = NULL;
+
+  memset(cart->ram_dirty, 0, sizeof(cart->ram_dirty));
+}
+
+/* Allocates pages of RAM and copies the current RAM into them. Returns false
+ * if out of memory, in which case nothing is allocated. */
+static bool copy_ram(uint8_t** const copy,
+                     const struct libyagbe_cart* const cart) {
+  unsigned int page;
+
+  for (page = 0; page < cart->ram_page_count; ++page) {
+    copy[page] = libyagbe_cow_alloc(LIBYAGBE_BUS_PAGE_SIZE);
+
+    if (copy[page] == NULL) {
+      while (page-- > 0) {
+        libyagbe_cow_release(copy[page]);
+      }
+      return false;
+    }
+    memcpy(copy[page], cart->ram[page], LIBYAGBE_BUS_PAGE_SIZE);
+  }
+  return true;
+}
+
+static bool is_ram_dirty(const struct libyagbe_cart* const cart,
+                         const unsigned int page) {
+  return (cart->ram_dirty[page / 8] & (1 << (page % 8))) != 0;
+}
+
+/* Points the memory map at the selected ROM banks, if they changed. */
+static void update_rom_banks(struct libyagbe_gb* const gb,
+                             const unsigned int bank0,
+                             const unsigned int bank1) {
+  struct libyagbe_cart* const cart = &gb->cart;
+  unsigned int banks[2];
+
+  /* Bank numbers wrap around, as the upper bits have nowhere to go. */
+  banks[0] = bank0 % cart->rom_bank_count;
+  banks[1] = bank1 % cart->rom_bank_count;
+
+  if ((banks[0] != cart->rom_banks[0]) || (banks[1] != cart->rom_banks[1])) {
+    cart->rom_banks[0] = banks[0];
+    cart->rom_banks[1] = banks[1];
+
+    libyagbe_bus_map_cart_rom(gb);
+  }
+}
+
+/* Points the memory map at the selected RAM bank, or takes RAM out of it if
+ * it's disabled or there is none. */
+static void update_ram_bank(struct libyagbe_gb* const gb, const int bank) {
+  struct libyagbe_cart* const cart = &gb->cart;
+  int page = -1;
+
+  if (cart->ram_enabled && (cart->ram_page_count != 0) && (bank >= 0)) {
+    page = (int)(((unsigned int)bank *
+                  (LIBYAGBE_CART_MEM_SIZE_RAM_BANK / LIBYAGBE_BUS_PAGE_SIZE)) %
+                 cart->ram_page_count);
+  }
+
+  if (page != cart->ram_page) {
+    cart->ram_page = page;
+    libyagbe_bus_map_cart_ram(gb);
+  }
+}
+
+/* Works out which banks are selected from the MBC registers. */
+static void update_banks(struct libyagbe_gb* const gb) {
+  const struct libyagbe_cart* const cart = &gb->cart;
+
+  switch (cart->header.mbc) {
+    case LIBYAGBE_CART_MBC1: {
+      /* The upper bits apply to both areas in mode 1, even though a bank
+       * number of 0 is only ever turned into 1 for $4000-$7FFF. */
+      const unsigned int upper = (unsigned int)cart->ram_bank << 5;
+
+      update_rom_banks(gb, cart->mode ? upper : 0,
+                       upper | ((cart->rom_bank == 0) ? 1 : cart->rom_bank));
+      update_ram_bank(gb, cart->mode ? cart->ram_bank : 0);
+      break;
+    }
+
+    case LIBYAGBE_CART_MBC2:
+      update_rom_banks(gb, 0, (cart->rom_bank == 0) ? 1 : cart->rom_bank);
+      update_ram_bank(gb, 0);
+      break;
+
+    case LIBYAGBE_CART_MBC3:
+      update_rom_banks(gb, 0, (cart->rom_bank == 0) ? 1 : cart->rom_bank);
+
+      /* The clock registers are read and written through the slow path. */
+      update_ram_bank(gb, (cart->ram_bank < RTC_SELECT_FIRST)
+                              ? cart->ram_bank
+                              : -1);
+      break;
+
+    case LIBYAGBE_CART_MBC5:
+      update_rom_banks(gb, 0, cart->rom_bank);
+      update_ram_bank(gb, cart->ram_bank);
+      break;
+
+    default:
+      update_rom_banks(gb, 0, 1);
+      update_ram_bank(gb, 0);
+      break;
+  }
+}
+
+/* Brings the clock up to date with the scheduler. The clock may be set to
+ * values it could never count up to; those just carry over like any other. */
+static void update_rtc(struct libyagbe_gb* const gb) {
+  struct libyagbe_cart* const cart = &gb->cart;
+  uint8_t* const rtc = cart->rtc;
+  const uintmax_t elapsed =
+      (gb->scheduler.timestamp_now - cart->timestamp_rtc) + cart->rtc_cycles;
+  uintmax_t seconds;
+  uintmax_t days;
+
+  cart->timestamp_rtc = gb->scheduler.timestamp_now;
+
+  if (BIT_IS_SET(rtc[LIBYAGBE_CART_RTC_REG_DH], RTC_DH_HALT)) {
+    return;
+  }
+
+  cart->rtc_cycles = (unsigned long)(elapsed % RTC_CYCLES_PER_SECOND);
+
+  if (elapsed < RTC_CYCLES_PER_SECOND) {
+    return;
+  }
+
+  seconds = (elapsed / RTC_CYCLES_PER_SECOND) + rtc[LIBYAGBE_CART_RTC_REG_S] +
+            (rtc[LIBYAGBE_CART_RTC_REG_M] * 60UL) +
+            (rtc[LIBYAGBE_CART_RTC_REG_H] * 3600UL);
+
+  days = (seconds / SECONDS_PER_DAY) + rtc[LIBYAGBE_CART_RTC_REG_DL] +
+         ((rtc[LIBYAGBE_CART_RTC_REG_DH] & 0x01) << 8);
+  seconds %= SECONDS_PER_DAY;
+
+  rtc[LIBYAGBE_CART_RTC_REG_S] = (uint8_t)(seconds % 60);
+  rtc[LIBYAGBE_CART_RTC_REG_M] = (uint8_t)((seconds / 60) % 60);
+  rtc[LIBYAGBE_CART_RTC_REG_H] = (uint8_t)(seconds / 3600);
+  rtc[LIBYAGBE_CART_RTC_REG_DL] = (uint8_t)(days & 0xFF);
+
+  /* The carry stays set once the day counter overflows, until it's cleared
+   * by the program. */
+  rtc[LIBYAGBE_CART_RTC_REG_DH] =
+      (uint8_t)((rtc[LIBYAGBE_CART_RTC_REG_DH] & 0xFE) | ((days >> 8) & 0x01));
+
+  if (days > 0x1FF) {
+    SET_BIT(rtc[LIBYAGBE_CART_RTC_REG_DH], RTC_DH_DAY_CARRY);
+  }
+}
+
+/* Puts the MBC registers back to how they are at power on. */
+static void reset_mbc(struct libyagbe_gb* const gb) {
+  struct libyagbe_cart* const cart = &gb->cart;
+
+  /* A cartridge without an MBC has its RAM mapped at all times. */
+  cart->ram_enabled = (cart->header.mbc == LIBYAGBE_CART_MBC_NONE) ||
+                      (cart->header.mbc == LIBYAGBE_CART_MBC_UNSUPPORTED);
+  cart->rom_bank = 1;
+  cart->ram_bank = 0;
+  cart->mode = 0;
+
+  /* Makes sure the memory map is updated below, whatever was mapped. */
+  cart->rom_banks[0] = (unsigned int)-1;
+  cart->ram_page = -2;
+
+  update_banks(gb);
+}
+
+int libyagbe_cart_insert(struct libyagbe_gb* const gb,
+                         const uint8_t* const data, const size_t size) {
+  struct libyagbe_cart* const cart = &gb->cart;
+  struct libyagbe_cart_header header;
+  unsigned int page_count;
+  unsigned int page;
+
+  if ((size < LIBYAGBE_CART_MEM_SIZE_ROM_MIN) ||
+      !libyagbe_cart_parse_header(data, size, &header)) {
+    return 0;
+  }
+
+  if (header.mbc == LIBYAGBE_CART_MBC_UNSUPPORTED) {
+    LOG_WARNING((gb, "Unsupported cartridge type $%02X, running it as ROM",
+                 header.type));
+  }
+
+  release_ram(cart);
+  cart->ram_page = -1;
+
+  page_count = (unsigned int)(header.ram_size / LIBYAGBE_BUS_PAGE_SIZE);
+
+  for (page = 0; page < page_count; ++page) {
+    cart->ram[page] = libyagbe_cow_alloc(LIBYAGBE_BUS_PAGE_SIZE);
+
+    if (cart->ram[page] == NULL) {
+      cart->ram_page_count = page;
+      release_ram(cart);
+
+      cart->rom = NULL;
+      libyagbe_bus_update_memory_map(gb);
+
+      return 0;
+    }
+  }
+
+  cart->header = header;
+  cart->rom = data;
+  cart->rom_bank_count =
+      (unsigned int)(size / LIBYAGBE_CART_MEM_SIZE_ROM_BANK);
+  cart->ram_page_count = page_count;
+
+  memset(cart->rtc, 0, sizeof(cart->rtc));
+  memset(cart->rtc_latched, 0, sizeof(cart->rtc_latched));
+  cart->rtc_latch_armed = false;
+  cart->timestamp_rtc = gb->scheduler.timestamp_now;
+  cart->rtc_cycles = 0;
+
+  reset_mbc(gb);
+  libyagbe_bus_update_memory_map(gb);
+
+  /* Code cached from the previous cartridge can't be told apart from code in
+   * the new one if it happens to be loaded at the same host address. */
+  libyagbe_cpu_flush_blocks(gb);
+
+  return 1;
+}
+
+int libyagbe_cart_set_ram_buffer(struct libyagbe_gb* const gb,
+                                 uint8_t* const data) {
+  struct libyagbe_cart* const cart = &gb->cart;
+  const unsigned int page_count = cart->ram_page_count;
+  uint8_t* ram[LIBYAGBE_CART_RAM_PAGE_COUNT];
+  unsigned int page;
+
+  if (page_count == 0) {
+    return 0;
+  }
+
+  if (data != NULL) {
+    for (page = 0; page < page_count; ++page) {
+      ram[page] = &data[page * LIBYAGBE_BUS_PAGE_SIZE];
+    }
+  } else if (cart->ram_buffer == NULL) {
+    return 1;
+  } else if (!copy_ram(ram, cart)) {
+    return 0;
+  }
+
+  release_ram(cart);
+
+  memcpy(cart->ram, ram, page_count * sizeof(ram[0]));
+  cart->ram_page_count = page_count;
+  cart->ram_buffer = data;
+
+  /* Code cached from the old RAM goes along with it. */
+  libyagbe_bus_map_cart_ram(gb);
+
+  return 1;
+}
+
+void libyagbe_cart_flush_ram(struct libyagbe_gb* const gb,
+                             const libyagbe_cart_dirty_cb cb_func) {
+  struct libyagbe_cart* const cart = &gb->cart;
+  unsigned int page = 0;
+  bool flushed = false;
+
+  while (page < cart->ram_page_count) {
+    unsigned int end;
+
+    if (!is_ram_dirty(cart, page)) {
+      ++page;
+      continue;
+    }
+
+    for (end = page; (end < cart->ram_page_count) && is_ram_dirty(cart, end);
+         ++end) {
+      cart->ram_dirty[end / 8] &= (uint8_t)~(1 << (end % 8));
+    }
+
+    cb_func(gb, (size_t)page * LIBYAGBE_BUS_PAGE_SIZE,
+            (size_t)(end - page) * LIBYAGBE_BUS_PAGE_SIZE);
+
+    page = end;
+    flushed = true;
+  }
+
+  if (flushed) {
+    libyagbe_bus_protect_cart_ram(gb);
+  }
+}
+
+void libyagbe_cart_release(struct libyagbe_gb* const gb) {
+  release_ram(&gb->cart);
+}
+
+int libyagbe_cart_fork(struct libyagbe_gb* const child,
+                       const struct libyagbe_gb* const gb) {
+  const struct libyagbe_cart* const cart = &gb->cart;
+  unsigned int page;
+
+  child->cart = *cart;
+
+  /* Writes the child makes mustn't end up in the caller's buffer, which may
+   * well be a save file. */
+  if (cart->ram_buffer != NULL) {
+    child->cart.ram_buffer = NULL;
+
+    if (!copy_ram(child->cart.ram, cart)) {
+      child->cart.ram_page_count = 0;
+      return 0;
+    }
+    return 1;
+  }
+
+  for (page = 0; page < cart->ram_page_count; ++page) {
+    child->cart.ram[page] = libyagbe_cow_share(cart->ram[page]);
+  }
+  return 1;
+}
+
+void libyagbe_cart_reset(struct libyagbe_gb* const gb) {
+  struct libyagbe_cart* const cart = &gb->cart;
+
+  if (cart->rom == NULL) {
+    return;
+  }
+
+  /* The clock keeps going while the system is off. This is called before
+   * the scheduler starts over from 0, so it's brought up to date first. */
+  update_rtc(gb);
+  cart->timestamp_rtc = 0;
+
+  reset_mbc(gb);
+}
+
+void libyagbe_cart_handle_register_write(struct libyagbe_gb* const gb,
+                                         const uint16_t address,
+                                         const uint8_t data) {
+  struct libyagbe_cart* const cart = &gb->cart;
+
+  switch (cart->header.mbc) {
+    case LIBYAGBE_CART_MBC1:
+      switch (address >> 13) {
+        case 0:
+          cart->ram_enabled = ((data & 0x0F) == 0x0A);
+          break;
+
+        case 1:
+          cart->rom_bank = data & 0x1F;
+          break;
+
+        case 2:
+          cart->ram_bank = data & 0x03;
+          break;
+
+        case 3:
+          cart->mode = data & 0x01;
+          break;
+      }
+      break;
+
+    case LIBYAGBE_CART_MBC2:
+      /* Only $0000-$3FFF is decoded, and bit 8 of the address tells the two
+       * registers apart. */
+      if (address >= 0x4000) {
+        return;
+      }
+
+      if (BIT_IS_SET(address, 8)) {
+        cart->rom_bank = data & 0x0F;
+      } else {
+        cart->ram_enabled = ((data & 0x0F) == 0x0A);
+      }
+      break;
+
+    case LIBYAGBE_CART_MBC3:
+      switch (address >> 13) {
+        case 0:
+          cart->ram_enabled = ((data & 0x0F) == 0x0A);
+          break;
+
+        case 1:
+          cart->rom_bank = data & 0x7F;
+          break;
+
+        case 2:
+          cart->ram_bank = data;
+          break;
+
+        case 3:
+          if (cart->rtc_latch_armed && (data == 0x01)) {
+            update_rtc(gb);
+            memcpy(cart->rtc_latched, cart->rtc, sizeof(cart->rtc_latched));
+          }
+          cart->rtc_latch_armed = (data == 0x00);
+          break;
+      }
+      break;
+
+    case LIBYAGBE_CART_MBC5:
+      switch (address >> 12) {
+        case 0x0:
+        case 0x1:
+          cart->ram_enabled = (data == 0x0A);
+          break;
+
+        case 0x2:
+          cart->rom_bank = (cart->rom_bank & 0x100) | data;
+          break;
+
+        case 0x3:
+          cart->rom_bank = (cart->rom_bank & 0xFF) | ((data & 0x01) << 8);
+          break;
+
+        case 0x4:
+        case 0x5:
+          cart->ram_bank = data & 0x0F;
+          break;
+
+        default:
+          break;
+      }
+      break;
+
+    default:
+      return;
+  }
+
+  update_banks(gb);
+}
+
+/* Returns the selected clock register, or -1 if there is none. */
+static int get_rtc_reg(const struct libyagbe_cart* const cart) {
+  if ((cart->header.mbc != LIBYAGBE_CART_MBC3) || !cart->header.has_rtc ||
+      !cart->ram_enabled || (cart->ram_bank < RTC_SELECT_FIRST) ||
+      (cart->ram_bank > RTC_SELECT_LAST)) {
+    return -1;
+  }
+  return cart->ram_bank - RTC_SELECT_FIRST;
+}
+
+uint8_t libyagbe_cart_read_ram(struct libyagbe_gb* const gb,
+                               const uint16_t address) {
+  const int reg = get_rtc_reg(&gb->cart);
+
+  (void)address;
+
+  if (reg < 0) {
+    return 0xFF;
+  }
+  return (uint8_t)(gb->cart.rtc_latched[reg] | ~rtc_masks[reg]);
+}
+
+void libyagbe_cart_write_ram(struct libyagbe_gb* const gb,
+                             const uint16_t address, const uint8_t data) {
+  struct libyagbe_cart* const cart = &gb->cart;
+  const int reg = get_rtc_reg(cart);
+
+  if (reg >= 0) {
+    update_rtc(gb);
+
+    /* Setting the seconds starts a new second. */
+    if (reg == LIBYAGBE_CART_RTC_REG_S) {
+      cart->rtc_cycles = 0;
+    }
+
+    cart->rtc[reg] = data & rtc_masks[reg];
+    return;
+  }
+
+  /* The MBC2's RAM only has the lower 4 bits, so every write comes through
+   * here; the upper bits read back as set. */
+  if ((cart->header.mbc == LIBYAGBE_CART_MBC2) && (cart->ram_page >= 0)) {
+    uint8_t* const page =
+        cart->ram[(cart->ram_page + ((address - 0xA000) >> 8)) %
+                  cart->ram_page_count];
+
+    page[address & 0xFF] = data | 0xF0;
+  }
+}
@@ -0,0 +1,97 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "cow.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "atomic.h"
+
+/* Precedes the memory of every block. The union keeps the memory following it
+ * as aligned as anything malloc() returns. */
+union header {
+  struct {
+    unsigned long refs;
+    size_t size;
+  } block;
+
+  void* align_pointer;
+  double align_double;
+  long align_long;
+};
+
+static union header* get_header(const uint8_t* const data) {
+  return (union header*)data - 1;
+}
+
+uint8_t* libyagbe_cow_alloc(const size_t size) {
+  union header* const header = calloc(1, sizeof(union header) + size);
+
+  if (header == NULL) {
+    return NULL;
+  }
+
+  header->block.refs = 1;
+  header->block.size = size;
+
+  return (uint8_t*)(header + 1);
+}
+
+uint8_t* libyagbe_cow_share(uint8_t* const data) {
+  ATOMIC_INCREMENT_RELAXED(&get_header(data)->block.refs);
+  return data;
+}
+
+void libyagbe_cow_release(uint8_t* const data) {
+  union header* header;
+
+  if (data == NULL) {
+    return;
+  }
+
+  header = get_header(data);
+
+  if (ATOMIC_DECREMENT_ACQ_REL(&header->block.refs) == 0) {
+    free(header);
+  }
+}
+
+bool libyagbe_cow_is_shared(const uint8_t* const data) {
+  /* Only the instances referring to a block can add references to it, so
+   * once this is the only one left, that stays true until it forks again. */
+  return ATOMIC_LOAD_ACQUIRE(&get_header(data)->block.refs) > 1;
+}
+
+bool libyagbe_cow_unshare(uint8_t** const data) {
+  const size_t size = get_header(*data)->block.size;
+  uint8_t* copy;
+
+  if (!libyagbe_cow_is_shared(*data)) {
+    return true;
+  }
+
+  copy = libyagbe_cow_alloc(size);
+
+  if (copy == NULL) {
+    return false;
+  }
+
+  memcpy(copy, *data, size);
+  libyagbe_cow_release(*data);
+
+  *data = copy;
+  return true;
+}
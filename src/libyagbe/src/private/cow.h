@@ -0,0 +1,47 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Memory shared between instances forked from one another. Each block of
+ * memory counts the instances referring to it, and an instance wanting to
+ * write to a block referred to by others has to make its own copy first. */
+
+#ifndef LIBYAGBE_COW_H
+#define LIBYAGBE_COW_H
+
+#include <stddef.h>
+
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/compat/compat_stdint.h"
+
+/* Allocates a zeroed block of memory with a single reference, returning NULL
+ * if out of memory. */
+uint8_t* libyagbe_cow_alloc(const size_t size);
+
+/* Adds a reference to a block, returning the block. */
+uint8_t* libyagbe_cow_share(uint8_t* const data);
+
+/* Drops a reference to a block, freeing it once there are none left. \p data
+ * may be NULL. */
+void libyagbe_cow_release(uint8_t* const data);
+
+/* Returns true if more than one instance refers to a block. */
+bool libyagbe_cow_is_shared(const uint8_t* const data);
+
+/* Replaces the block at \p data with a copy only the caller refers to, if the
+ * block is shared. Returns false if out of memory, in which case the block is
+ * left shared. */
+bool libyagbe_cow_unshare(uint8_t** const data);
+
+#endif /* LIBYAGBE_COW_H */
@@ -15,112 +15,25 @@
 
 #include "libyagbe/cpu.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug/log.h"
 #include "libyagbe/bus.h"
 #include "libyagbe/compat/compat_stdbool.h"
-#include "libyagbe/debug/logger.h"
+#include "libyagbe/gb.h"
 #include "libyagbe/scheduler.h"
 #include "utility.h"
 
-enum cpu_opcodes {
-  OP_NOP = 0x00,
-  OP_LD_BC_IMM16 = 0x01,
-  OP_INC_BC = 0x03,
-  OP_INC_B = 0x04,
-  OP_DEC_B = 0x05,
-  OP_LD_B_IMM8 = 0x06,
-  OP_DEC_C = 0x0D,
-  OP_LD_C_IMM8 = 0x0E,
-  OP_LD_DE_IMM16 = 0x11,
-  OP_LD_MEM_DE_A = 0x12,
-  OP_INC_DE = 0x13,
-  OP_INC_D = 0x14,
-  OP_JR_SIMM8 = 0x18,
-  OP_LD_A_MEM_DE = 0x1A,
-  OP_INC_E = 0x1C,
-  OP_DEC_E = 0x1D,
-  OP_RRA = 0x1F,
-  OP_JR_NZ_SIMM8 = 0x20,
-  OP_LD_HL_IMM16 = 0x21,
-  OP_LDI_MEM_HL_A = 0x22,
-  OP_INC_HL = 0x23,
-  OP_INC_H = 0x24,
-  OP_DEC_H = 0x25,
-  OP_LD_H_IMM8 = 0x26,
-  OP_JR_Z_SIMM8 = 0x28,
-  OP_ADD_HL_HL = 0x29,
-  OP_LDI_A_MEM_HL = 0x2A,
-  OP_INC_L = 0x2C,
-  OP_DEC_L = 0x2D,
-  OP_JR_NC_SIMM8 = 0x30,
-  OP_LD_SP_IMM16 = 0x31,
-  OP_LDD_MEM_HL_A = 0x32,
-  OP_DEC_MEM_HL = 0x35,
-  OP_JR_C_SIMM8 = 0x38,
-  OP_DEC_A = 0x3D,
-  OP_LD_A_IMM8 = 0x3E,
-  OP_LD_B_MEM_HL = 0x46,
-  OP_LD_B_A = 0x47,
-  OP_LD_C_MEM_HL = 0x4E,
-  OP_LD_C_A = 0x4F,
-  OP_LD_D_MEM_HL = 0x56,
-  OP_LD_D_A = 0x57,
-  OP_LD_E_A = 0x5F,
-  OP_LD_H_A = 0x67,
-  OP_LD_L_MEM_HL = 0x6E,
-  OP_LD_L_A = 0x6F,
-  OP_LD_MEM_HL_B = 0x70,
-  OP_LD_MEM_HL_C = 0x71,
-  OP_LD_MEM_HL_D = 0x72,
-  OP_LD_MEM_HL_A = 0x77,
-  OP_LD_A_B = 0x78,
-  OP_LD_A_C = 0x79,
-  OP_LD_A_D = 0x7A,
-  OP_LD_A_E = 0x7B,
-  OP_LD_A_H = 0x7C,
-  OP_LD_A_L = 0x7D,
-  OP_LD_A_MEM_HL = 0x7E,
-  OP_ADD_A_C = 0x81,
-  OP_SUB_C = 0x91,
-  OP_XOR_C = 0xA9,
-  OP_XOR_MEM_HL = 0xAE,
-  OP_OR_C = 0xB1,
-  OP_OR_MEM_HL = 0xB6,
-  OP_OR_A = 0xB7,
-  OP_CP_C = 0xB9,
-  OP_POP_BC = 0xC1,
-  OP_JP_NZ_IMM16 = 0xC2,
-  OP_JP_IMM16 = 0xC3,
-  OP_CALL_NZ_IMM16 = 0xC4,
-  OP_PUSH_BC = 0xC5,
-  OP_ADD_A_IMM8 = 0xC6,
-  OP_RET_Z = 0xC8,
-  OP_RET = 0xC9,
-  OP_JP_Z_IMM16 = 0xCA,
-  OP_PREFIX_CB = 0xCB,
-  OP_CALL_IMM16 = 0xCD,
-  OP_ADC_A_IMM8 = 0xCE,
-  OP_RET_NC = 0xD0,
-  OP_POP_DE = 0xD1,
-  OP_CALL_NC_IMM16 = 0xD4,
-  OP_PUSH_DE = 0xD5,
-  OP_SUB_IMM8 = 0xD6,
-  OP_RET_C = 0xD8,
-  OP_LDH_IMM8_A = 0xE0,
-  OP_POP_HL = 0xE1,
-  OP_PUSH_HL = 0xE5,
-  OP_AND_IMM8 = 0xE6,
-  OP_JP_HL = 0xE9,
-  OP_LD_MEM_IMM16_A = 0xEA,
-  OP_XOR_IMM8 = 0xEE,
-  OP_LDH_A_IMM8 = 0xF0,
-  OP_POP_AF = 0xF1,
-  OP_DI = 0xF3,
-  OP_PUSH_AF = 0xF5,
-  OP_LD_A_MEM_IMM16 = 0xFA,
-  OP_CP_IMM8 = 0xFE
-};
+#ifdef LIBYAGBE_CPU_JIT
+#include "jit.h"
+#endif /* LIBYAGBE_CPU_JIT */
 
-enum cb_opcodes { OP_RR_C = 0x19, OP_RR_D = 0x1A, OP_SRL_B = 0x38 };
+/* Evaluated before every instruction or block executed by
+ * libyagbe_cpu_run(). */
+#define KEEP_RUNNING(gb, end, breakpoint)     \
+  (((gb)->scheduler.timestamp_now < (end)) && \
+   ((gb)->cpu.reg.pc.value != (breakpoint)) && !(gb)->logger.critical_raised)
 
 enum cpu_flags { FLAG_Z = 7, FLAG_C = 4 };
 
@@ -131,812 +44,1958 @@ enum alu_flag {
   ALU_DISCARD_RESULT
 };
 
-static struct libyagbe_cpu cpu;
+static uintmax_t saturating_add(const uintmax_t a, const uintmax_t b) {
+  return (b > ((uintmax_t)-1 - a)) ? (uintmax_t)-1 : a + b;
+}
+
+/* The length in bytes of every primary opcode, including the opcode itself.
+ * Opcodes which don't exist on the SM83 are treated as being 1 byte long. */
+static const uint8_t instruction_lengths[256] = {
+    /* 0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F */
+    1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1, /* 0 */
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, /* 1 */
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, /* 2 */
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, /* 3 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 4 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 5 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 6 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 7 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 8 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 9 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* A */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* B */
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1, /* C */
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1, /* D */
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1, /* E */
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1  /* F */
+};
+
+/* Advances the program counter past an instruction once it's been decoded.
+ * Wherever the opcode is a constant, the length is known at compile time and
+ * the program counter doesn't have to wait on the opcode to be fetched. */
+#define ADVANCE_PC(gb, opcode) \
+  ((gb)->cpu.reg.pc.value += instruction_lengths[opcode])
+
+/* Fetches the instruction at the program counter through the bus, for when
+ * it doesn't lie entirely within a mapped page. */
+static void decode_slow(struct libyagbe_gb* const gb) {
+  const uint16_t pc = gb->cpu.reg.pc.value;
+  const uint8_t opcode = libyagbe_bus_read_memory(gb, pc);
+  const unsigned int length = instruction_lengths[opcode];
+
+  gb->cpu.instruction = opcode;
+
+  if (length == 3) {
+    const uint8_t lo = libyagbe_bus_read_memory(gb, (uint16_t)(pc + 1));
+    const uint8_t hi = libyagbe_bus_read_memory(gb, (uint16_t)(pc + 2));
+
+    gb->cpu.operand = (uint16_t)((hi << 8) | lo);
+  } else if (length == 2) {
+    gb->cpu.operand = libyagbe_bus_read_memory(gb, (uint16_t)(pc + 1));
+  }
+}
+
+/* Fetches the instruction at the program counter along with its operand.
+ * Handlers never touch the instruction stream themselves, which is what allows
+ * instructions to be decoded ahead of time by the block cache. The program
+ * counter is left alone; see ADVANCE_PC().
+ *
+ * Almost all code runs from mapped memory, where the longest possible
+ * instruction can be read in one go as long as it doesn't run off the end of
+ * the page. Whatever follows a shorter instruction is simply ignored. */
+static void decode(struct libyagbe_gb* const gb) {
+  const uint16_t pc = gb->cpu.reg.pc.value;
+  const uint8_t* const page = gb->bus.read_map[pc >> 8];
+
+  if ((page != NULL) && ((pc & 0xFF) <= (LIBYAGBE_BUS_PAGE_SIZE - 3))) {
+    const uint8_t* const code = &page[pc & 0xFF];
+
+    gb->cpu.instruction = code[0];
+    gb->cpu.operand = (uint16_t)((code[2] << 8) | code[1]);
+  } else {
+    decode_slow(gb);
+  }
+}
+
+static uint8_t read_imm8(struct libyagbe_gb* const gb) {
+  return (uint8_t)gb->cpu.operand;
+}
+
+#ifdef LIBYAGBE_CPU_LAZY_FLAGS
+
+/* Z and C are kept apart from F, as the result Z depends on and the value of C,
+ * so that setting them is a plain store rather than a read-modify-write of F.
+ * F is only brought up to date where something other than a flag test looks at
+ * it. */
+
+static void set_zero_flag(struct libyagbe_gb* const gb, const uint8_t value) {
+  gb->cpu.lazy_flags.zero_result = value;
+}
+
+static void clear_zero_flag(struct libyagbe_gb* const gb) {
+  gb->cpu.lazy_flags.zero_result = 1;
+}
+
+static void set_carry_flag(struct libyagbe_gb* const gb,
+                           const bool condition_met) {
+  gb->cpu.lazy_flags.carry = (uint8_t)condition_met;
+}
+
+static bool zero_flag_is_set(struct libyagbe_gb* const gb) {
+  return gb->cpu.lazy_flags.zero_result == 0;
+}
+
+static bool carry_flag_is_set(struct libyagbe_gb* const gb) {
+  return gb->cpu.lazy_flags.carry != 0;
+}
+
+/* Sets the flags after a logical operation: Z from A, C cleared, and the rest
+ * of F replaced by \p other_flags. */
+static void set_logic_flags(struct libyagbe_gb* const gb,
+                            const uint8_t other_flags) {
+  gb->cpu.reg.af.byte.lo = other_flags;
+  gb->cpu.lazy_flags.zero_result = gb->cpu.reg.af.byte.hi;
+  gb->cpu.lazy_flags.carry = 0;
+}
+
+/* Writes Z and C back into F. */
+static void materialize_flags(struct libyagbe_gb* const gb) {
+  uint8_t flags = gb->cpu.reg.af.byte.lo;
+
+  SET_BIT_IF(flags, FLAG_Z, gb->cpu.lazy_flags.zero_result == 0);
+  SET_BIT_IF(flags, FLAG_C, gb->cpu.lazy_flags.carry != 0);
+
+  gb->cpu.reg.af.byte.lo = flags;
+}
+
+/* Picks up Z and C from F, which may have been changed behind our back. */
+static void defer_flags(struct libyagbe_gb* const gb) {
+  gb->cpu.lazy_flags.zero_result = !BIT_IS_SET(gb->cpu.reg.af.byte.lo, FLAG_Z);
+  gb->cpu.lazy_flags.carry = BIT_IS_SET(gb->cpu.reg.af.byte.lo, FLAG_C);
+}
+
+#else
 
-static uint8_t read_imm8(void) {
-  return libyagbe_bus_read_memory(cpu.reg.pc.value++);
+static void set_zero_flag(struct libyagbe_gb* const gb, const uint8_t value) {
+  SET_BIT_IF(gb->cpu.reg.af.byte.lo, FLAG_Z, value == 0);
 }
 
-static void set_zero_flag(const uint8_t value) {
-  SET_BIT_IF(cpu.reg.af.byte.lo, FLAG_Z, value == 0);
+static void clear_zero_flag(struct libyagbe_gb* const gb) {
+  CLEAR_BIT(gb->cpu.reg.af.byte.lo, FLAG_Z);
 }
 
-static void set_carry_flag(const bool condition_met) {
-  SET_BIT_IF(cpu.reg.af.byte.lo, FLAG_C, condition_met);
+static void set_carry_flag(struct libyagbe_gb* const gb,
+                           const bool condition_met) {
+  SET_BIT_IF(gb->cpu.reg.af.byte.lo, FLAG_C, condition_met);
 }
 
-static bool zero_flag_is_set(void) {
-  return BIT_IS_SET(cpu.reg.af.byte.lo, FLAG_Z);
+static bool zero_flag_is_set(struct libyagbe_gb* const gb) {
+  return BIT_IS_SET(gb->cpu.reg.af.byte.lo, FLAG_Z);
 }
 
-static bool carry_flag_is_set(void) {
-  return BIT_IS_SET(cpu.reg.af.byte.lo, FLAG_C);
+static bool carry_flag_is_set(struct libyagbe_gb* const gb) {
+  return BIT_IS_SET(gb->cpu.reg.af.byte.lo, FLAG_C);
 }
 
-static uint8_t alu_inc(uint8_t value) {
+static void set_logic_flags(struct libyagbe_gb* const gb,
+                            const uint8_t other_flags) {
+  gb->cpu.reg.af.byte.lo =
+      (gb->cpu.reg.af.byte.hi == 0) ? (other_flags | 0x80) : other_flags;
+}
+
+/* F is always up to date. */
+static void materialize_flags(struct libyagbe_gb* const gb) { (void)gb; }
+static void defer_flags(struct libyagbe_gb* const gb) { (void)gb; }
+
+#endif /* LIBYAGBE_CPU_LAZY_FLAGS */
+
+static uint8_t alu_inc(struct libyagbe_gb* const gb, uint8_t value) {
   value++;
 
-  set_zero_flag(value);
+  set_zero_flag(gb, value);
   return value;
 }
 
-static uint8_t alu_dec(uint8_t value) {
+static uint8_t alu_dec(struct libyagbe_gb* const gb, uint8_t value) {
   value--;
 
-  set_zero_flag(value);
+  set_zero_flag(gb, value);
   return value;
 }
 
-static void alu_add(const int addend) {
+static void alu_add(struct libyagbe_gb* const gb, const int addend) {
   int sum;
   uint8_t result;
 
-  sum = cpu.reg.af.byte.hi + addend;
+  sum = gb->cpu.reg.af.byte.hi + addend;
 
   result = (uint8_t)sum;
 
-  set_zero_flag(result);
-  set_carry_flag(sum > 0xFF);
+  set_zero_flag(gb, result);
+  set_carry_flag(gb, sum > 0xFF);
 
-  cpu.reg.af.byte.hi = result;
+  gb->cpu.reg.af.byte.hi = result;
 }
 
-static void alu_adc(const uint8_t addend) {
-  const uint8_t carry_flag_value = carry_flag_is_set();
-  alu_add(addend + carry_flag_value);
+static void alu_adc(struct libyagbe_gb* const gb, const uint8_t addend) {
+  const uint8_t carry_flag_value = carry_flag_is_set(gb);
+  alu_add(gb, addend + carry_flag_value);
 }
 
-static void alu_add_hl(const uint16_t pair) {
+static void alu_add_hl(struct libyagbe_gb* const gb, const uint16_t pair) {
   int sum;
 
-  sum = cpu.reg.hl.value + pair;
-  set_carry_flag(sum > 0xFFFF);
+  sum = gb->cpu.reg.hl.value + pair;
+  set_carry_flag(gb, sum > 0xFFFF);
 
-  cpu.reg.hl.value = (uint16_t)sum;
+  gb->cpu.reg.hl.value = (uint16_t)sum;
 }
 
-static void alu_sub(const uint8_t subtrahend, const enum alu_flag flag) {
+static void alu_sub(struct libyagbe_gb* const gb, const uint8_t subtrahend,
+                    const enum alu_flag flag) {
   int diff;
   uint8_t result;
 
-  diff = cpu.reg.af.byte.hi - subtrahend;
+  diff = gb->cpu.reg.af.byte.hi - subtrahend;
   result = (uint8_t)diff;
 
-  set_zero_flag(result);
-  set_carry_flag(diff < 0);
+  set_zero_flag(gb, result);
+  set_carry_flag(gb, diff < 0);
 
   if (flag != ALU_DISCARD_RESULT) {
-    cpu.reg.af.byte.hi = result;
+    gb->cpu.reg.af.byte.hi = result;
   }
 }
 
-static uint8_t alu_srl(uint8_t reg) {
-  set_carry_flag(reg & 1);
+static uint8_t alu_srl(struct libyagbe_gb* const gb, uint8_t reg) {
+  set_carry_flag(gb, reg & 1);
   reg >>= 1;
-  set_zero_flag(reg);
+  set_zero_flag(gb, reg);
 
   return reg;
 }
 
-static uint8_t alu_rr(uint8_t reg, const enum alu_flag flag) {
+static uint8_t alu_rr(struct libyagbe_gb* const gb, uint8_t reg,
+                      const enum alu_flag flag) {
   uint8_t old_carry_flag_value;
 
-  old_carry_flag_value = carry_flag_is_set() ? 0x80 : 0x00;
+  old_carry_flag_value = carry_flag_is_set(gb) ? 0x80 : 0x00;
 
-  set_carry_flag(reg & 1);
+  set_carry_flag(gb, reg & 1);
 
   reg >>= 1;
   reg |= old_carry_flag_value;
 
   if (flag == ALU_CLEAR_ZERO) {
-    cpu.reg.af.byte.lo &= ~(1 << FLAG_Z);
+    clear_zero_flag(gb);
     return reg;
   }
 
-  set_zero_flag(reg);
+  set_zero_flag(gb, reg);
   return reg;
 }
 
-static uint16_t read_imm16(void) {
-  uint8_t lo;
-  uint8_t hi;
-
-  lo = read_imm8();
-  hi = read_imm8();
-
-  return (hi << 8) | lo;
+static uint16_t read_imm16(struct libyagbe_gb* const gb) {
+  return gb->cpu.operand;
 }
 
-static void jr_if(const bool condition_met) {
+static void jr_if(struct libyagbe_gb* const gb, const bool condition_met) {
   int8_t imm;
 
-  imm = (int8_t)read_imm8();
+  imm = (int8_t)read_imm8(gb);
 
   if (condition_met) {
-    cpu.reg.pc.value += imm;
-    libyagbe_scheduler_add_cycles(12);
+    gb->cpu.reg.pc.value += imm;
+    libyagbe_scheduler_add_cycles(gb, 12);
   } else {
-    libyagbe_scheduler_add_cycles(8);
+    libyagbe_scheduler_add_cycles(gb, 8);
   }
 }
 
-static void stack_push(const uint8_t hi, const uint8_t lo) {
-  libyagbe_bus_write_memory(--cpu.reg.sp.value, hi);
-  libyagbe_bus_write_memory(--cpu.reg.sp.value, lo);
+static void stack_push(struct libyagbe_gb* const gb, const uint8_t hi,
+                       const uint8_t lo) {
+  libyagbe_bus_write_memory(gb, --gb->cpu.reg.sp.value, hi);
+  libyagbe_bus_write_memory(gb, --gb->cpu.reg.sp.value, lo);
 }
 
-static uint16_t stack_pop(void) {
+static uint16_t stack_pop(struct libyagbe_gb* const gb) {
   uint8_t lo;
   uint8_t hi;
 
-  lo = libyagbe_bus_read_memory(cpu.reg.sp.value++);
-  hi = libyagbe_bus_read_memory(cpu.reg.sp.value++);
+  lo = libyagbe_bus_read_memory(gb, gb->cpu.reg.sp.value++);
+  hi = libyagbe_bus_read_memory(gb, gb->cpu.reg.sp.value++);
 
   return (hi << 8) | lo;
 }
 
-static void ret_if(const bool condition_met) {
+static void ret_if(struct libyagbe_gb* const gb, const bool condition_met) {
   if (condition_met) {
-    cpu.reg.pc.value = stack_pop();
+    gb->cpu.reg.pc.value = stack_pop(gb);
+    libyagbe_scheduler_add_cycles(gb, 20);
+  } else {
+    libyagbe_scheduler_add_cycles(gb, 8);
   }
 }
 
-static void jp_if(const bool condition_met) {
+static void jp_if(struct libyagbe_gb* const gb, const bool condition_met) {
   uint16_t address;
 
-  address = read_imm16();
+  address = read_imm16(gb);
 
   if (condition_met) {
-    cpu.reg.pc.value = address;
+    gb->cpu.reg.pc.value = address;
+    libyagbe_scheduler_add_cycles(gb, 16);
+  } else {
+    libyagbe_scheduler_add_cycles(gb, 12);
   }
 }
 
-static void call_if(const bool condition_met) {
+static void call_if(struct libyagbe_gb* const gb, const bool condition_met) {
   uint16_t address;
 
-  address = read_imm16();
+  address = read_imm16(gb);
 
   if (condition_met) {
-    stack_push(cpu.reg.pc.byte.hi, cpu.reg.pc.byte.lo);
-    cpu.reg.pc.value = address;
+    stack_push(gb, gb->cpu.reg.pc.byte.hi, gb->cpu.reg.pc.byte.lo);
+    gb->cpu.reg.pc.value = address;
+    libyagbe_scheduler_add_cycles(gb, 24);
+  } else {
+    libyagbe_scheduler_add_cycles(gb, 12);
   }
 }
 
-struct libyagbe_cpu* libyagbe_cpu_get_data(void) {
-  return &cpu;
+void libyagbe_cpu_reset(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.value = 0x0013;
+  gb->cpu.reg.de.value = 0x00D8;
+  gb->cpu.reg.hl.value = 0x014D;
+  gb->cpu.reg.af.value = 0x01B0;
+  gb->cpu.reg.sp.value = 0xFFFE;
+  gb->cpu.reg.pc.value = 0x0100;
+
+  gb->cpu.instruction = 0x00;
+  gb->cpu.operand = 0x0000;
+
+  libyagbe_cpu_flush_blocks(gb);
 }
 
-void libyagbe_cpu_reset(void) {
-  cpu.reg.bc.value = 0x0013;
-  cpu.reg.de.value = 0x00D8;
-  cpu.reg.hl.value = 0x014D;
-  cpu.reg.af.value = 0x01B0;
-  cpu.reg.sp.value = 0xFFFE;
-  cpu.reg.pc.value = 0x0100;
+static void op_nop(struct libyagbe_gb* const gb) {
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-  cpu.instruction = 0x00;
+static void op_ld_bc_imm16(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.value = read_imm16(gb);
+  libyagbe_scheduler_add_cycles(gb, 12);
 }
 
-void libyagbe_cpu_step(void) {
-  cpu.instruction = read_imm8();
+static void op_inc_bc(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.value++;
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-  switch (cpu.instruction) {
-    case OP_NOP:
-      libyagbe_scheduler_add_cycles(4);
-      return;
+static void op_inc_b(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.byte.hi = alu_inc(gb, gb->cpu.reg.bc.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_LD_BC_IMM16:
-      cpu.reg.bc.value = read_imm16();
-      libyagbe_scheduler_add_cycles(12);
+static void op_dec_b(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.byte.hi = alu_dec(gb, gb->cpu.reg.bc.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_ld_b_imm8(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.byte.hi = read_imm8(gb);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_INC_BC:
-      cpu.reg.bc.value++;
-      libyagbe_scheduler_add_cycles(8);
+static void op_dec_c(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.byte.lo = alu_dec(gb, gb->cpu.reg.bc.byte.lo);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_ld_c_imm8(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.byte.lo = read_imm8(gb);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_INC_B:
-      cpu.reg.bc.byte.hi = alu_inc(cpu.reg.bc.byte.hi);
-      libyagbe_scheduler_add_cycles(4);
+static void op_ld_de_imm16(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.de.value = read_imm16(gb);
+  libyagbe_scheduler_add_cycles(gb, 12);
+}
 
-      return;
+static void op_ld_mem_de_a(struct libyagbe_gb* const gb) {
+  libyagbe_bus_write_memory(gb, gb->cpu.reg.de.value, gb->cpu.reg.af.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_DEC_B:
-      cpu.reg.bc.byte.hi = alu_dec(cpu.reg.bc.byte.hi);
-      libyagbe_scheduler_add_cycles(4);
+static void op_inc_de(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.de.value++;
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_inc_d(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.de.byte.hi = alu_inc(gb, gb->cpu.reg.de.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_LD_B_IMM8:
-      cpu.reg.bc.byte.hi = read_imm8();
-      libyagbe_scheduler_add_cycles(8);
+static void op_jr_simm8(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.pc.value += (int8_t)read_imm8(gb);
+  libyagbe_scheduler_add_cycles(gb, 12);
+}
 
-      return;
+static void op_ld_a_mem_de(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi = libyagbe_bus_read_memory(gb, gb->cpu.reg.de.value);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_DEC_C:
-      cpu.reg.bc.byte.lo = alu_dec(cpu.reg.bc.byte.lo);
-      libyagbe_scheduler_add_cycles(4);
+static void op_inc_e(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.de.byte.lo = alu_inc(gb, gb->cpu.reg.de.byte.lo);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_dec_e(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.de.byte.lo = alu_dec(gb, gb->cpu.reg.de.byte.lo);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_LD_C_IMM8:
-      cpu.reg.bc.byte.lo = read_imm8();
-      libyagbe_scheduler_add_cycles(8);
+static void op_rra(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi = alu_rr(gb, gb->cpu.reg.af.byte.hi, ALU_CLEAR_ZERO);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_jr_nz_simm8(struct libyagbe_gb* const gb) {
+  jr_if(gb, !zero_flag_is_set(gb));
+}
 
-    case OP_LD_DE_IMM16:
-      cpu.reg.de.value = read_imm16();
-      libyagbe_scheduler_add_cycles(12);
+static void op_ld_hl_imm16(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.hl.value = read_imm16(gb);
+  libyagbe_scheduler_add_cycles(gb, 12);
+}
 
-      return;
+static void op_ldi_mem_hl_a(struct libyagbe_gb* const gb) {
+  libyagbe_bus_write_memory(gb, gb->cpu.reg.hl.value++, gb->cpu.reg.af.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_LD_MEM_DE_A:
-      libyagbe_bus_write_memory(cpu.reg.de.value, cpu.reg.af.byte.hi);
-      libyagbe_scheduler_add_cycles(8);
+static void op_inc_hl(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.hl.value++;
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_inc_h(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.hl.byte.hi = alu_inc(gb, gb->cpu.reg.hl.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_INC_DE:
-      cpu.reg.de.value++;
-      libyagbe_scheduler_add_cycles(8);
+static void op_dec_h(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.hl.byte.hi = alu_dec(gb, gb->cpu.reg.hl.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_ld_h_imm8(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.hl.byte.hi = read_imm8(gb);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_INC_D:
-      cpu.reg.de.byte.hi = alu_inc(cpu.reg.de.byte.hi);
-      libyagbe_scheduler_add_cycles(4);
+static void op_jr_z_simm8(struct libyagbe_gb* const gb) {
+  jr_if(gb, zero_flag_is_set(gb));
+}
 
-      return;
+static void op_add_hl_hl(struct libyagbe_gb* const gb) {
+  alu_add_hl(gb, gb->cpu.reg.hl.value);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_JR_SIMM8:
-      cpu.reg.pc.value += (int8_t)read_imm8();
-      libyagbe_scheduler_add_cycles(12);
+static void op_ldi_a_mem_hl(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi = libyagbe_bus_read_memory(gb, gb->cpu.reg.hl.value++);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_inc_l(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.hl.byte.lo = alu_inc(gb, gb->cpu.reg.hl.byte.lo);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_LD_A_MEM_DE:
-      cpu.reg.af.byte.hi = libyagbe_bus_read_memory(cpu.reg.de.value);
-      libyagbe_scheduler_add_cycles(8);
+static void op_dec_l(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.hl.byte.lo = alu_dec(gb, gb->cpu.reg.hl.byte.lo);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_jr_nc_simm8(struct libyagbe_gb* const gb) {
+  jr_if(gb, !carry_flag_is_set(gb));
+}
 
-    case OP_INC_E:
-      cpu.reg.de.byte.lo = alu_inc(cpu.reg.de.byte.lo);
-      libyagbe_scheduler_add_cycles(4);
+static void op_ld_sp_imm16(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.sp.value = read_imm16(gb);
+  libyagbe_scheduler_add_cycles(gb, 12);
+}
 
-      return;
+static void op_ldd_mem_hl_a(struct libyagbe_gb* const gb) {
+  libyagbe_bus_write_memory(gb, gb->cpu.reg.hl.value--, gb->cpu.reg.af.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_DEC_E:
-      cpu.reg.de.byte.lo = alu_dec(cpu.reg.de.byte.lo);
-      libyagbe_scheduler_add_cycles(4);
+static void op_dec_mem_hl(struct libyagbe_gb* const gb) {
+  uint8_t data = libyagbe_bus_read_memory(gb, gb->cpu.reg.hl.value);
+  data = alu_dec(gb, data);
+  libyagbe_bus_write_memory(gb, gb->cpu.reg.hl.value, data);
 
-      return;
+  libyagbe_scheduler_add_cycles(gb, 12);
+}
 
-    case OP_RRA:
-      cpu.reg.af.byte.hi = alu_rr(cpu.reg.af.byte.hi, ALU_CLEAR_ZERO);
-      libyagbe_scheduler_add_cycles(4);
+static void op_jr_c_simm8(struct libyagbe_gb* const gb) {
+  jr_if(gb, carry_flag_is_set(gb));
+}
 
-      return;
+static void op_dec_a(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi = alu_dec(gb, gb->cpu.reg.af.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_JR_NZ_SIMM8:
-      jr_if(!zero_flag_is_set());
-      return;
+static void op_ld_a_imm8(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi = read_imm8(gb);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_LD_HL_IMM16:
-      cpu.reg.hl.value = read_imm16();
-      libyagbe_scheduler_add_cycles(12);
+static void op_ld_b_mem_hl(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.byte.hi = libyagbe_bus_read_memory(gb, gb->cpu.reg.hl.value);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_ld_b_a(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.byte.hi = gb->cpu.reg.af.byte.hi;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_LDI_MEM_HL_A:
-      libyagbe_bus_write_memory(cpu.reg.hl.value++, cpu.reg.af.byte.hi);
-      libyagbe_scheduler_add_cycles(8);
+static void op_ld_c_mem_hl(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.byte.lo = libyagbe_bus_read_memory(gb, gb->cpu.reg.hl.value);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_ld_c_a(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.byte.lo = gb->cpu.reg.af.byte.hi;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_INC_HL:
-      cpu.reg.hl.value++;
-      libyagbe_scheduler_add_cycles(8);
+static void op_ld_d_mem_hl(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.de.byte.hi = libyagbe_bus_read_memory(gb, gb->cpu.reg.hl.value);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_ld_d_a(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.de.byte.hi = gb->cpu.reg.af.byte.hi;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_INC_H:
-      cpu.reg.hl.byte.hi = alu_inc(cpu.reg.hl.byte.hi);
-      libyagbe_scheduler_add_cycles(4);
+static void op_ld_e_a(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.de.byte.lo = gb->cpu.reg.af.byte.hi;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_ld_h_a(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.hl.byte.hi = gb->cpu.reg.af.byte.hi;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_DEC_H:
-      cpu.reg.hl.byte.hi = alu_dec(cpu.reg.hl.byte.hi);
-      libyagbe_scheduler_add_cycles(4);
+static void op_ld_l_mem_hl(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.hl.byte.lo = libyagbe_bus_read_memory(gb, gb->cpu.reg.hl.value);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_ld_l_a(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.hl.byte.lo = gb->cpu.reg.af.byte.hi;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_LD_H_IMM8:
-      cpu.reg.hl.byte.hi = read_imm8();
-      libyagbe_scheduler_add_cycles(8);
+static void op_ld_mem_hl_b(struct libyagbe_gb* const gb) {
+  libyagbe_bus_write_memory(gb, gb->cpu.reg.hl.value, gb->cpu.reg.bc.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_ld_mem_hl_c(struct libyagbe_gb* const gb) {
+  libyagbe_bus_write_memory(gb, gb->cpu.reg.hl.value, gb->cpu.reg.bc.byte.lo);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_JR_Z_SIMM8:
-      jr_if(zero_flag_is_set());
-      return;
+static void op_ld_mem_hl_d(struct libyagbe_gb* const gb) {
+  libyagbe_bus_write_memory(gb, gb->cpu.reg.hl.value, gb->cpu.reg.de.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_ADD_HL_HL:
-      alu_add_hl(cpu.reg.hl.value);
-      libyagbe_scheduler_add_cycles(8);
+static void op_ld_mem_hl_a(struct libyagbe_gb* const gb) {
+  libyagbe_bus_write_memory(gb, gb->cpu.reg.hl.value, gb->cpu.reg.af.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_ld_a_b(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi = gb->cpu.reg.bc.byte.hi;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_LDI_A_MEM_HL:
-      cpu.reg.af.byte.hi = libyagbe_bus_read_memory(cpu.reg.hl.value++);
-      libyagbe_scheduler_add_cycles(8);
+static void op_ld_a_c(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi = gb->cpu.reg.bc.byte.lo;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_ld_a_d(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi = gb->cpu.reg.de.byte.hi;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_INC_L:
-      cpu.reg.hl.byte.lo = alu_inc(cpu.reg.hl.byte.lo);
-      libyagbe_scheduler_add_cycles(4);
+static void op_ld_a_e(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi = gb->cpu.reg.de.byte.lo;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_ld_a_h(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi = gb->cpu.reg.hl.byte.hi;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_DEC_L:
-      cpu.reg.hl.byte.lo = alu_dec(cpu.reg.hl.byte.lo);
-      libyagbe_scheduler_add_cycles(4);
+static void op_ld_a_l(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi = gb->cpu.reg.hl.byte.lo;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_ld_a_mem_hl(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi = libyagbe_bus_read_memory(gb, gb->cpu.reg.hl.value);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_JR_NC_SIMM8:
-      jr_if(!carry_flag_is_set());
-      return;
+static void op_add_a_c(struct libyagbe_gb* const gb) {
+  alu_add(gb, gb->cpu.reg.bc.byte.lo);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_LD_SP_IMM16:
-      cpu.reg.sp.value = read_imm16();
-      libyagbe_scheduler_add_cycles(12);
+static void op_sub_c(struct libyagbe_gb* const gb) {
+  alu_sub(gb, gb->cpu.reg.bc.byte.lo, ALU_NORMAL);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_xor_c(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi ^= gb->cpu.reg.bc.byte.lo;
+  set_logic_flags(gb, 0x00);
 
-    case OP_LDD_MEM_HL_A:
-      libyagbe_bus_write_memory(cpu.reg.hl.value--, cpu.reg.af.byte.hi);
-      libyagbe_scheduler_add_cycles(8);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_xor_mem_hl(struct libyagbe_gb* const gb) {
+  const uint8_t data = libyagbe_bus_read_memory(gb, gb->cpu.reg.hl.value);
 
-    case OP_DEC_MEM_HL: {
-      uint8_t data = libyagbe_bus_read_memory(cpu.reg.hl.value);
-      data = alu_dec(data);
-      libyagbe_bus_write_memory(cpu.reg.hl.value, data);
+  gb->cpu.reg.af.byte.hi ^= data;
+  set_logic_flags(gb, 0x00);
 
-      libyagbe_scheduler_add_cycles(12);
-      return;
-    }
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_JR_C_SIMM8:
-      jr_if(carry_flag_is_set());
-      return;
+static void op_or_c(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.byte.hi |= gb->cpu.reg.bc.byte.lo;
+  set_logic_flags(gb, 0x00);
 
-    case OP_DEC_A:
-      cpu.reg.af.byte.hi = alu_dec(cpu.reg.af.byte.hi);
-      libyagbe_scheduler_add_cycles(4);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_or_mem_hl(struct libyagbe_gb* const gb) {
+  const uint8_t data = libyagbe_bus_read_memory(gb, gb->cpu.reg.hl.value);
 
-    case OP_LD_A_IMM8:
-      cpu.reg.af.byte.hi = read_imm8();
-      libyagbe_scheduler_add_cycles(8);
+  gb->cpu.reg.af.byte.hi |= data;
+  set_logic_flags(gb, 0x00);
 
-      return;
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_LD_B_MEM_HL:
-      cpu.reg.bc.byte.hi = libyagbe_bus_read_memory(cpu.reg.hl.value);
-      libyagbe_scheduler_add_cycles(8);
+static void op_or_a(struct libyagbe_gb* const gb) {
+  set_logic_flags(gb, 0x00);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-      return;
+static void op_cp_c(struct libyagbe_gb* const gb) {
+  alu_sub(gb, gb->cpu.reg.bc.byte.lo, ALU_DISCARD_RESULT);
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_LD_B_A:
-      cpu.reg.bc.byte.hi = cpu.reg.af.byte.hi;
-      libyagbe_scheduler_add_cycles(4);
+static void op_pop_bc(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.value = stack_pop(gb);
+  libyagbe_scheduler_add_cycles(gb, 12);
+}
 
-      return;
+static void op_jp_nz_imm16(struct libyagbe_gb* const gb) {
+  jp_if(gb, !zero_flag_is_set(gb));
+}
 
-    case OP_LD_C_MEM_HL:
-      cpu.reg.bc.byte.lo = libyagbe_bus_read_memory(cpu.reg.hl.value);
-      libyagbe_scheduler_add_cycles(8);
+static void op_jp_imm16(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.pc.value = read_imm16(gb);
+  libyagbe_scheduler_add_cycles(gb, 16);
+}
 
-      return;
+static void op_call_nz_imm16(struct libyagbe_gb* const gb) {
+  call_if(gb, !zero_flag_is_set(gb));
+}
 
-    case OP_LD_C_A:
-      cpu.reg.bc.byte.lo = cpu.reg.af.byte.hi;
-      libyagbe_scheduler_add_cycles(4);
+static void op_push_bc(struct libyagbe_gb* const gb) {
+  stack_push(gb, gb->cpu.reg.bc.byte.hi, gb->cpu.reg.bc.byte.lo);
+  libyagbe_scheduler_add_cycles(gb, 16);
+}
 
-      return;
+static void op_add_a_imm8(struct libyagbe_gb* const gb) {
+  const uint8_t imm8 = read_imm8(gb);
 
-    case OP_LD_D_MEM_HL:
-      cpu.reg.de.byte.hi = libyagbe_bus_read_memory(cpu.reg.hl.value);
-      libyagbe_scheduler_add_cycles(8);
+  alu_add(gb, imm8);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_ret_z(struct libyagbe_gb* const gb) {
+  ret_if(gb, zero_flag_is_set(gb));
+}
 
-    case OP_LD_D_A:
-      cpu.reg.de.byte.hi = cpu.reg.af.byte.hi;
-      libyagbe_scheduler_add_cycles(4);
+static void op_ret(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.pc.value = stack_pop(gb);
+  libyagbe_scheduler_add_cycles(gb, 16);
+}
 
-      return;
+static void op_jp_z_imm16(struct libyagbe_gb* const gb) {
+  jp_if(gb, zero_flag_is_set(gb));
+}
 
-    case OP_LD_E_A:
-      cpu.reg.de.byte.lo = cpu.reg.af.byte.hi;
-      libyagbe_scheduler_add_cycles(4);
+static void op_call_imm16(struct libyagbe_gb* const gb) {
+  const uint16_t address = read_imm16(gb);
 
-      return;
+  stack_push(gb, gb->cpu.reg.pc.byte.hi, gb->cpu.reg.pc.byte.lo);
+  gb->cpu.reg.pc.value = address;
 
-    case OP_LD_H_A:
-      cpu.reg.hl.byte.hi = cpu.reg.af.byte.hi;
-      libyagbe_scheduler_add_cycles(4);
+  libyagbe_scheduler_add_cycles(gb, 24);
+}
 
-      return;
+static void op_adc_a_imm8(struct libyagbe_gb* const gb) {
+  const uint8_t imm8 = read_imm8(gb);
 
-    case OP_LD_L_MEM_HL:
-      cpu.reg.hl.byte.lo = libyagbe_bus_read_memory(cpu.reg.hl.value);
-      libyagbe_scheduler_add_cycles(8);
+  alu_adc(gb, imm8);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_ret_nc(struct libyagbe_gb* const gb) {
+  ret_if(gb, !carry_flag_is_set(gb));
+}
 
-    case OP_LD_L_A:
-      cpu.reg.hl.byte.lo = cpu.reg.af.byte.hi;
-      libyagbe_scheduler_add_cycles(4);
+static void op_pop_de(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.de.value = stack_pop(gb);
+  libyagbe_scheduler_add_cycles(gb, 12);
+}
 
-      return;
+static void op_call_nc_imm16(struct libyagbe_gb* const gb) {
+  call_if(gb, !carry_flag_is_set(gb));
+}
 
-    case OP_LD_MEM_HL_B:
-      libyagbe_bus_write_memory(cpu.reg.hl.value, cpu.reg.bc.byte.hi);
-      libyagbe_scheduler_add_cycles(8);
+static void op_push_de(struct libyagbe_gb* const gb) {
+  stack_push(gb, gb->cpu.reg.de.byte.hi, gb->cpu.reg.de.byte.lo);
+  libyagbe_scheduler_add_cycles(gb, 16);
+}
 
-      return;
+static void op_sub_imm8(struct libyagbe_gb* const gb) {
+  const uint8_t imm8 = read_imm8(gb);
+  alu_sub(gb, imm8, ALU_NORMAL);
 
-    case OP_LD_MEM_HL_C:
-      libyagbe_bus_write_memory(cpu.reg.hl.value, cpu.reg.bc.byte.lo);
-      libyagbe_scheduler_add_cycles(8);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_ret_c(struct libyagbe_gb* const gb) {
+  ret_if(gb, carry_flag_is_set(gb));
+}
 
-    case OP_LD_MEM_HL_D:
-      libyagbe_bus_write_memory(cpu.reg.hl.value, cpu.reg.de.byte.hi);
-      libyagbe_scheduler_add_cycles(8);
+static void op_ldh_imm8_a(struct libyagbe_gb* const gb) {
+  const uint8_t imm8 = read_imm8(gb);
 
-      return;
+  libyagbe_bus_write_memory(gb, 0xFF00 + imm8, gb->cpu.reg.af.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 12);
+}
 
-    case OP_LD_MEM_HL_A:
-      libyagbe_bus_write_memory(cpu.reg.hl.value, cpu.reg.af.byte.hi);
-      libyagbe_scheduler_add_cycles(8);
+static void op_pop_hl(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.hl.value = stack_pop(gb);
+  libyagbe_scheduler_add_cycles(gb, 12);
+}
 
-      return;
+static void op_push_hl(struct libyagbe_gb* const gb) {
+  stack_push(gb, gb->cpu.reg.hl.byte.hi, gb->cpu.reg.hl.byte.lo);
+  libyagbe_scheduler_add_cycles(gb, 16);
+}
 
-    case OP_LD_A_B:
-      cpu.reg.af.byte.hi = cpu.reg.bc.byte.hi;
-      libyagbe_scheduler_add_cycles(4);
+static void op_and_imm8(struct libyagbe_gb* const gb) {
+  const uint8_t imm8 = read_imm8(gb);
 
-      return;
+  gb->cpu.reg.af.byte.hi &= imm8;
+  set_logic_flags(gb, 0x20);
 
-    case OP_LD_A_C:
-      cpu.reg.af.byte.hi = cpu.reg.bc.byte.lo;
-      libyagbe_scheduler_add_cycles(4);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_jp_hl(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.pc.value = gb->cpu.reg.hl.value;
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_LD_A_D:
-      cpu.reg.af.byte.hi = cpu.reg.de.byte.hi;
-      libyagbe_scheduler_add_cycles(4);
+static void op_ld_mem_imm16_a(struct libyagbe_gb* const gb) {
+  const uint16_t address = read_imm16(gb);
 
-      return;
+  libyagbe_bus_write_memory(gb, address, gb->cpu.reg.af.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 16);
+}
 
-    case OP_LD_A_E:
-      cpu.reg.af.byte.hi = cpu.reg.de.byte.lo;
-      libyagbe_scheduler_add_cycles(4);
+static void op_xor_imm8(struct libyagbe_gb* const gb) {
+  const uint8_t imm8 = read_imm8(gb);
 
-      return;
+  gb->cpu.reg.af.byte.hi ^= imm8;
+  set_logic_flags(gb, 0x00);
 
-    case OP_LD_A_H:
-      cpu.reg.af.byte.hi = cpu.reg.hl.byte.hi;
-      libyagbe_scheduler_add_cycles(4);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      return;
+static void op_ldh_a_imm8(struct libyagbe_gb* const gb) {
+  const uint8_t imm8 = read_imm8(gb);
 
-    case OP_LD_A_L:
-      cpu.reg.af.byte.hi = cpu.reg.hl.byte.lo;
-      libyagbe_scheduler_add_cycles(4);
+  gb->cpu.reg.af.byte.hi = libyagbe_bus_read_memory(gb, 0xFF00 + imm8);
+  libyagbe_scheduler_add_cycles(gb, 12);
+}
 
-      return;
+static void op_pop_af(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.af.value = stack_pop(gb);
+  gb->cpu.reg.af.byte.lo &= ~0x0F;
 
-    case OP_LD_A_MEM_HL:
-      cpu.reg.af.byte.hi = libyagbe_bus_read_memory(cpu.reg.hl.value);
-      libyagbe_scheduler_add_cycles(8);
+  defer_flags(gb);
+  libyagbe_scheduler_add_cycles(gb, 12);
+}
 
-      return;
+/* Interrupts are not supported yet, this is a NOP as such. */
+static void op_di(struct libyagbe_gb* const gb) {
+  libyagbe_scheduler_add_cycles(gb, 4);
+}
 
-    case OP_ADD_A_C:
-      alu_add(cpu.reg.bc.byte.lo);
-      libyagbe_scheduler_add_cycles(4);
+static void op_push_af(struct libyagbe_gb* const gb) {
+  materialize_flags(gb);
+  stack_push(gb, gb->cpu.reg.af.byte.hi, gb->cpu.reg.af.byte.lo);
+  libyagbe_scheduler_add_cycles(gb, 16);
+}
 
-      return;
+static void op_ld_a_mem_imm16(struct libyagbe_gb* const gb) {
+  const uint16_t address = read_imm16(gb);
 
-    case OP_SUB_C:
-      alu_sub(cpu.reg.bc.byte.lo, ALU_NORMAL);
-      libyagbe_scheduler_add_cycles(4);
+  gb->cpu.reg.af.byte.hi = libyagbe_bus_read_memory(gb, address);
+  libyagbe_scheduler_add_cycles(gb, 16);
+}
 
-      return;
+static void op_cp_imm8(struct libyagbe_gb* const gb) {
+  const uint8_t imm8 = read_imm8(gb);
 
-    case OP_XOR_C:
-      cpu.reg.af.byte.hi ^= cpu.reg.bc.byte.lo;
-      cpu.reg.af.byte.lo = (cpu.reg.af.byte.hi == 0) ? 0x80 : 0x00;
+  alu_sub(gb, imm8, ALU_DISCARD_RESULT);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      libyagbe_scheduler_add_cycles(4);
-      return;
+static void op_invalid(struct libyagbe_gb* const gb) {
+  LOG_CRITICAL(
+      (gb, "Invalid instruction $%02X reached at program counter $%04X.",
+       gb->cpu.instruction,
+       (uint16_t)(gb->cpu.reg.pc.value -
+                  instruction_lengths[gb->cpu.instruction])));
+}
 
-    case OP_XOR_MEM_HL: {
-      const uint8_t data = libyagbe_bus_read_memory(cpu.reg.hl.value);
+static void op_cb_rr_c(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.byte.lo = alu_rr(gb, gb->cpu.reg.bc.byte.lo, ALU_NORMAL);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      cpu.reg.af.byte.hi ^= data;
-      cpu.reg.af.byte.lo = (cpu.reg.af.byte.hi == 0) ? 0x80 : 0x00;
+static void op_cb_rr_d(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.de.byte.hi = alu_rr(gb, gb->cpu.reg.de.byte.hi, ALU_NORMAL);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-      libyagbe_scheduler_add_cycles(8);
-      return;
-    }
+static void op_cb_srl_b(struct libyagbe_gb* const gb) {
+  gb->cpu.reg.bc.byte.hi = alu_srl(gb, gb->cpu.reg.bc.byte.hi);
+  libyagbe_scheduler_add_cycles(gb, 8);
+}
 
-    case OP_OR_C:
-      cpu.reg.af.byte.hi |= cpu.reg.bc.byte.lo;
-      cpu.reg.af.byte.lo = (cpu.reg.af.byte.hi == 0) ? 0x80 : 0x00;
+static void op_cb_invalid(struct libyagbe_gb* const gb) {
+  LOG_CRITICAL(
+      (gb, "Invalid CB instruction $%02X reached at program counter $%04X.",
+       read_imm8(gb), (uint16_t)(gb->cpu.reg.pc.value - 2)));
+}
 
-      libyagbe_scheduler_add_cycles(4);
-      return;
+/* Maps every primary opcode to the function which implements it. This list is
+ * expanded into whichever dispatch mechanism was selected at build time. */
+#define CPU_PRIMARY_OPCODES(X) \
+  X(0x00, op_nop)              \
+  X(0x01, op_ld_bc_imm16)      \
+  X(0x02, op_invalid)          \
+  X(0x03, op_inc_bc)           \
+  X(0x04, op_inc_b)            \
+  X(0x05, op_dec_b)            \
+  X(0x06, op_ld_b_imm8)        \
+  X(0x07, op_invalid)          \
+  X(0x08, op_invalid)          \
+  X(0x09, op_invalid)          \
+  X(0x0A, op_invalid)          \
+  X(0x0B, op_invalid)          \
+  X(0x0C, op_invalid)          \
+  X(0x0D, op_dec_c)            \
+  X(0x0E, op_ld_c_imm8)        \
+  X(0x0F, op_invalid)          \
+  X(0x10, op_invalid)          \
+  X(0x11, op_ld_de_imm16)      \
+  X(0x12, op_ld_mem_de_a)      \
+  X(0x13, op_inc_de)           \
+  X(0x14, op_inc_d)            \
+  X(0x15, op_invalid)          \
+  X(0x16, op_invalid)          \
+  X(0x17, op_invalid)          \
+  X(0x18, op_jr_simm8)         \
+  X(0x19, op_invalid)          \
+  X(0x1A, op_ld_a_mem_de)      \
+  X(0x1B, op_invalid)          \
+  X(0x1C, op_inc_e)            \
+  X(0x1D, op_dec_e)            \
+  X(0x1E, op_invalid)          \
+  X(0x1F, op_rra)              \
+  X(0x20, op_jr_nz_simm8)      \
+  X(0x21, op_ld_hl_imm16)      \
+  X(0x22, op_ldi_mem_hl_a)     \
+  X(0x23, op_inc_hl)           \
+  X(0x24, op_inc_h)            \
+  X(0x25, op_dec_h)            \
+  X(0x26, op_ld_h_imm8)        \
+  X(0x27, op_invalid)          \
+  X(0x28, op_jr_z_simm8)       \
+  X(0x29, op_add_hl_hl)        \
+  X(0x2A, op_ldi_a_mem_hl)     \
+  X(0x2B, op_invalid)          \
+  X(0x2C, op_inc_l)            \
+  X(0x2D, op_dec_l)            \
+  X(0x2E, op_invalid)          \
+  X(0x2F, op_invalid)          \
+  X(0x30, op_jr_nc_simm8)      \
+  X(0x31, op_ld_sp_imm16)      \
+  X(0x32, op_ldd_mem_hl_a)     \
+  X(0x33, op_invalid)          \
+  X(0x34, op_invalid)          \
+  X(0x35, op_dec_mem_hl)       \
+  X(0x36, op_invalid)          \
+  X(0x37, op_invalid)          \
+  X(0x38, op_jr_c_simm8)       \
+  X(0x39, op_invalid)          \
+  X(0x3A, op_invalid)          \
+  X(0x3B, op_invalid)          \
+  X(0x3C, op_invalid)          \
+  X(0x3D, op_dec_a)            \
+  X(0x3E, op_ld_a_imm8)        \
+  X(0x3F, op_invalid)          \
+  X(0x40, op_invalid)          \
+  X(0x41, op_invalid)          \
+  X(0x42, op_invalid)          \
+  X(0x43, op_invalid)          \
+  X(0x44, op_invalid)          \
+  X(0x45, op_invalid)          \
+  X(0x46, op_ld_b_mem_hl)      \
+  X(0x47, op_ld_b_a)           \
+  X(0x48, op_invalid)          \
+  X(0x49, op_invalid)          \
+  X(0x4A, op_invalid)          \
+  X(0x4B, op_invalid)          \
+  X(0x4C, op_invalid)          \
+  X(0x4D, op_invalid)          \
+  X(0x4E, op_ld_c_mem_hl)      \
+  X(0x4F, op_ld_c_a)           \
+  X(0x50, op_invalid)          \
+  X(0x51, op_invalid)          \
+  X(0x52, op_invalid)          \
+  X(0x53, op_invalid)          \
+  X(0x54, op_invalid)          \
+  X(0x55, op_invalid)          \
+  X(0x56, op_ld_d_mem_hl)      \
+  X(0x57, op_ld_d_a)           \
+  X(0x58, op_invalid)          \
+  X(0x59, op_invalid)          \
+  X(0x5A, op_invalid)          \
+  X(0x5B, op_invalid)          \
+  X(0x5C, op_invalid)          \
+  X(0x5D, op_invalid)          \
+  X(0x5E, op_invalid)          \
+  X(0x5F, op_ld_e_a)           \
+  X(0x60, op_invalid)          \
+  X(0x61, op_invalid)          \
+  X(0x62, op_invalid)          \
+  X(0x63, op_invalid)          \
+  X(0x64, op_invalid)          \
+  X(0x65, op_invalid)          \
+  X(0x66, op_invalid)          \
+  X(0x67, op_ld_h_a)           \
+  X(0x68, op_invalid)          \
+  X(0x69, op_invalid)          \
+  X(0x6A, op_invalid)          \
+  X(0x6B, op_invalid)          \
+  X(0x6C, op_invalid)          \
+  X(0x6D, op_invalid)          \
+  X(0x6E, op_ld_l_mem_hl)      \
+  X(0x6F, op_ld_l_a)           \
+  X(0x70, op_ld_mem_hl_b)      \
+  X(0x71, op_ld_mem_hl_c)      \
+  X(0x72, op_ld_mem_hl_d)      \
+  X(0x73, op_invalid)          \
+  X(0x74, op_invalid)          \
+  X(0x75, op_invalid)          \
+  X(0x76, op_invalid)          \
+  X(0x77, op_ld_mem_hl_a)      \
+  X(0x78, op_ld_a_b)           \
+  X(0x79, op_ld_a_c)           \
+  X(0x7A, op_ld_a_d)           \
+  X(0x7B, op_ld_a_e)           \
+  X(0x7C, op_ld_a_h)           \
+  X(0x7D, op_ld_a_l)           \
+  X(0x7E, op_ld_a_mem_hl)      \
+  X(0x7F, op_invalid)          \
+  X(0x80, op_invalid)          \
+  X(0x81, op_add_a_c)          \
+  X(0x82, op_invalid)          \
+  X(0x83, op_invalid)          \
+  X(0x84, op_invalid)          \
+  X(0x85, op_invalid)          \
+  X(0x86, op_invalid)          \
+  X(0x87, op_invalid)          \
+  X(0x88, op_invalid)          \
+  X(0x89, op_invalid)          \
+  X(0x8A, op_invalid)          \
+  X(0x8B, op_invalid)          \
+  X(0x8C, op_invalid)          \
+  X(0x8D, op_invalid)          \
+  X(0x8E, op_invalid)          \
+  X(0x8F, op_invalid)          \
+  X(0x90, op_invalid)          \
+  X(0x91, op_sub_c)            \
+  X(0x92, op_invalid)          \
+  X(0x93, op_invalid)          \
+  X(0x94, op_invalid)          \
+  X(0x95, op_invalid)          \
+  X(0x96, op_invalid)          \
+  X(0x97, op_invalid)          \
+  X(0x98, op_invalid)          \
+  X(0x99, op_invalid)          \
+  X(0x9A, op_invalid)          \
+  X(0x9B, op_invalid)          \
+  X(0x9C, op_invalid)          \
+  X(0x9D, op_invalid)          \
+  X(0x9E, op_invalid)          \
+  X(0x9F, op_invalid)          \
+  X(0xA0, op_invalid)          \
+  X(0xA1, op_invalid)          \
+  X(0xA2, op_invalid)          \
+  X(0xA3, op_invalid)          \
+  X(0xA4, op_invalid)          \
+  X(0xA5, op_invalid)          \
+  X(0xA6, op_invalid)          \
+  X(0xA7, op_invalid)          \
+  X(0xA8, op_invalid)          \
+  X(0xA9, op_xor_c)            \
+  X(0xAA, op_invalid)          \
+  X(0xAB, op_invalid)          \
+  X(0xAC, op_invalid)          \
+  X(0xAD, op_invalid)          \
+  X(0xAE, op_xor_mem_hl)       \
+  X(0xAF, op_invalid)          \
+  X(0xB0, op_invalid)          \
+  X(0xB1, op_or_c)             \
+  X(0xB2, op_invalid)          \
+  X(0xB3, op_invalid)          \
+  X(0xB4, op_invalid)          \
+  X(0xB5, op_invalid)          \
+  X(0xB6, op_or_mem_hl)        \
+  X(0xB7, op_or_a)             \
+  X(0xB8, op_invalid)          \
+  X(0xB9, op_cp_c)             \
+  X(0xBA, op_invalid)          \
+  X(0xBB, op_invalid)          \
+  X(0xBC, op_invalid)          \
+  X(0xBD, op_invalid)          \
+  X(0xBE, op_invalid)          \
+  X(0xBF, op_invalid)          \
+  X(0xC0, op_invalid)          \
+  X(0xC1, op_pop_bc)           \
+  X(0xC2, op_jp_nz_imm16)      \
+  X(0xC3, op_jp_imm16)         \
+  X(0xC4, op_call_nz_imm16)    \
+  X(0xC5, op_push_bc)          \
+  X(0xC6, op_add_a_imm8)       \
+  X(0xC7, op_invalid)          \
+  X(0xC8, op_ret_z)            \
+  X(0xC9, op_ret)              \
+  X(0xCA, op_jp_z_imm16)       \
+  X(0xCB, op_prefix_cb)        \
+  X(0xCC, op_invalid)          \
+  X(0xCD, op_call_imm16)       \
+  X(0xCE, op_adc_a_imm8)       \
+  X(0xCF, op_invalid)          \
+  X(0xD0, op_ret_nc)           \
+  X(0xD1, op_pop_de)           \
+  X(0xD2, op_invalid)          \
+  X(0xD3, op_invalid)          \
+  X(0xD4, op_call_nc_imm16)    \
+  X(0xD5, op_push_de)          \
+  X(0xD6, op_sub_imm8)         \
+  X(0xD7, op_invalid)          \
+  X(0xD8, op_ret_c)            \
+  X(0xD9, op_invalid)          \
+  X(0xDA, op_invalid)          \
+  X(0xDB, op_invalid)          \
+  X(0xDC, op_invalid)          \
+  X(0xDD, op_invalid)          \
+  X(0xDE, op_invalid)          \
+  X(0xDF, op_invalid)          \
+  X(0xE0, op_ldh_imm8_a)       \
+  X(0xE1, op_pop_hl)           \
+  X(0xE2, op_invalid)          \
+  X(0xE3, op_invalid)          \
+  X(0xE4, op_invalid)          \
+  X(0xE5, op_push_hl)          \
+  X(0xE6, op_and_imm8)         \
+  X(0xE7, op_invalid)          \
+  X(0xE8, op_invalid)          \
+  X(0xE9, op_jp_hl)            \
+  X(0xEA, op_ld_mem_imm16_a)   \
+  X(0xEB, op_invalid)          \
+  X(0xEC, op_invalid)          \
+  X(0xED, op_invalid)          \
+  X(0xEE, op_xor_imm8)         \
+  X(0xEF, op_invalid)          \
+  X(0xF0, op_ldh_a_imm8)       \
+  X(0xF1, op_pop_af)           \
+  X(0xF2, op_invalid)          \
+  X(0xF3, op_di)               \
+  X(0xF4, op_invalid)          \
+  X(0xF5, op_push_af)          \
+  X(0xF6, op_invalid)          \
+  X(0xF7, op_invalid)          \
+  X(0xF8, op_invalid)          \
+  X(0xF9, op_invalid)          \
+  X(0xFA, op_ld_a_mem_imm16)   \
+  X(0xFB, op_invalid)          \
+  X(0xFC, op_invalid)          \
+  X(0xFD, op_invalid)          \
+  X(0xFE, op_cp_imm8)          \
+  X(0xFF, op_invalid)
+
+/* Same as above, but for opcodes prefixed with $CB. */
+#define CPU_CB_OPCODES(X) \
+  X(0x00, op_cb_invalid)  \
+  X(0x01, op_cb_invalid)  \
+  X(0x02, op_cb_invalid)  \
+  X(0x03, op_cb_invalid)  \
+  X(0x04, op_cb_invalid)  \
+  X(0x05, op_cb_invalid)  \
+  X(0x06, op_cb_invalid)  \
+  X(0x07, op_cb_invalid)  \
+  X(0x08, op_cb_invalid)  \
+  X(0x09, op_cb_invalid)  \
+  X(0x0A, op_cb_invalid)  \
+  X(0x0B, op_cb_invalid)  \
+  X(0x0C, op_cb_invalid)  \
+  X(0x0D, op_cb_invalid)  \
+  X(0x0E, op_cb_invalid)  \
+  X(0x0F, op_cb_invalid)  \
+  X(0x10, op_cb_invalid)  \
+  X(0x11, op_cb_invalid)  \
+  X(0x12, op_cb_invalid)  \
+  X(0x13, op_cb_invalid)  \
+  X(0x14, op_cb_invalid)  \
+  X(0x15, op_cb_invalid)  \
+  X(0x16, op_cb_invalid)  \
+  X(0x17, op_cb_invalid)  \
+  X(0x18, op_cb_invalid)  \
+  X(0x19, op_cb_rr_c)     \
+  X(0x1A, op_cb_rr_d)     \
+  X(0x1B, op_cb_invalid)  \
+  X(0x1C, op_cb_invalid)  \
+  X(0x1D, op_cb_invalid)  \
+  X(0x1E, op_cb_invalid)  \
+  X(0x1F, op_cb_invalid)  \
+  X(0x20, op_cb_invalid)  \
+  X(0x21, op_cb_invalid)  \
+  X(0x22, op_cb_invalid)  \
+  X(0x23, op_cb_invalid)  \
+  X(0x24, op_cb_invalid)  \
+  X(0x25, op_cb_invalid)  \
+  X(0x26, op_cb_invalid)  \
+  X(0x27, op_cb_invalid)  \
+  X(0x28, op_cb_invalid)  \
+  X(0x29, op_cb_invalid)  \
+  X(0x2A, op_cb_invalid)  \
+  X(0x2B, op_cb_invalid)  \
+  X(0x2C, op_cb_invalid)  \
+  X(0x2D, op_cb_invalid)  \
+  X(0x2E, op_cb_invalid)  \
+  X(0x2F, op_cb_invalid)  \
+  X(0x30, op_cb_invalid)  \
+  X(0x31, op_cb_invalid)  \
+  X(0x32, op_cb_invalid)  \
+  X(0x33, op_cb_invalid)  \
+  X(0x34, op_cb_invalid)  \
+  X(0x35, op_cb_invalid)  \
+  X(0x36, op_cb_invalid)  \
+  X(0x37, op_cb_invalid)  \
+  X(0x38, op_cb_srl_b)    \
+  X(0x39, op_cb_invalid)  \
+  X(0x3A, op_cb_invalid)  \
+  X(0x3B, op_cb_invalid)  \
+  X(0x3C, op_cb_invalid)  \
+  X(0x3D, op_cb_invalid)  \
+  X(0x3E, op_cb_invalid)  \
+  X(0x3F, op_cb_invalid)  \
+  X(0x40, op_cb_invalid)  \
+  X(0x41, op_cb_invalid)  \
+  X(0x42, op_cb_invalid)  \
+  X(0x43, op_cb_invalid)  \
+  X(0x44, op_cb_invalid)  \
+  X(0x45, op_cb_invalid)  \
+  X(0x46, op_cb_invalid)  \
+  X(0x47, op_cb_invalid)  \
+  X(0x48, op_cb_invalid)  \
+  X(0x49, op_cb_invalid)  \
+  X(0x4A, op_cb_invalid)  \
+  X(0x4B, op_cb_invalid)  \
+  X(0x4C, op_cb_invalid)  \
+  X(0x4D, op_cb_invalid)  \
+  X(0x4E, op_cb_invalid)  \
+  X(0x4F, op_cb_invalid)  \
+  X(0x50, op_cb_invalid)  \
+  X(0x51, op_cb_invalid)  \
+  X(0x52, op_cb_invalid)  \
+  X(0x53, op_cb_invalid)  \
+  X(0x54, op_cb_invalid)  \
+  X(0x55, op_cb_invalid)  \
+  X(0x56, op_cb_invalid)  \
+  X(0x57, op_cb_invalid)  \
+  X(0x58, op_cb_invalid)  \
+  X(0x59, op_cb_invalid)  \
+  X(0x5A, op_cb_invalid)  \
+  X(0x5B, op_cb_invalid)  \
+  X(0x5C, op_cb_invalid)  \
+  X(0x5D, op_cb_invalid)  \
+  X(0x5E, op_cb_invalid)  \
+  X(0x5F, op_cb_invalid)  \
+  X(0x60, op_cb_invalid)  \
+  X(0x61, op_cb_invalid)  \
+  X(0x62, op_cb_invalid)  \
+  X(0x63, op_cb_invalid)  \
+  X(0x64, op_cb_invalid)  \
+  X(0x65, op_cb_invalid)  \
+  X(0x66, op_cb_invalid)  \
+  X(0x67, op_cb_invalid)  \
+  X(0x68, op_cb_invalid)  \
+  X(0x69, op_cb_invalid)  \
+  X(0x6A, op_cb_invalid)  \
+  X(0x6B, op_cb_invalid)  \
+  X(0x6C, op_cb_invalid)  \
+  X(0x6D, op_cb_invalid)  \
+  X(0x6E, op_cb_invalid)  \
+  X(0x6F, op_cb_invalid)  \
+  X(0x70, op_cb_invalid)  \
+  X(0x71, op_cb_invalid)  \
+  X(0x72, op_cb_invalid)  \
+  X(0x73, op_cb_invalid)  \
+  X(0x74, op_cb_invalid)  \
+  X(0x75, op_cb_invalid)  \
+  X(0x76, op_cb_invalid)  \
+  X(0x77, op_cb_invalid)  \
+  X(0x78, op_cb_invalid)  \
+  X(0x79, op_cb_invalid)  \
+  X(0x7A, op_cb_invalid)  \
+  X(0x7B, op_cb_invalid)  \
+  X(0x7C, op_cb_invalid)  \
+  X(0x7D, op_cb_invalid)  \
+  X(0x7E, op_cb_invalid)  \
+  X(0x7F, op_cb_invalid)  \
+  X(0x80, op_cb_invalid)  \
+  X(0x81, op_cb_invalid)  \
+  X(0x82, op_cb_invalid)  \
+  X(0x83, op_cb_invalid)  \
+  X(0x84, op_cb_invalid)  \
+  X(0x85, op_cb_invalid)  \
+  X(0x86, op_cb_invalid)  \
+  X(0x87, op_cb_invalid)  \
+  X(0x88, op_cb_invalid)  \
+  X(0x89, op_cb_invalid)  \
+  X(0x8A, op_cb_invalid)  \
+  X(0x8B, op_cb_invalid)  \
+  X(0x8C, op_cb_invalid)  \
+  X(0x8D, op_cb_invalid)  \
+  X(0x8E, op_cb_invalid)  \
+  X(0x8F, op_cb_invalid)  \
+  X(0x90, op_cb_invalid)  \
+  X(0x91, op_cb_invalid)  \
+  X(0x92, op_cb_invalid)  \
+  X(0x93, op_cb_invalid)  \
+  X(0x94, op_cb_invalid)  \
+  X(0x95, op_cb_invalid)  \
+  X(0x96, op_cb_invalid)  \
+  X(0x97, op_cb_invalid)  \
+  X(0x98, op_cb_invalid)  \
+  X(0x99, op_cb_invalid)  \
+  X(0x9A, op_cb_invalid)  \
+  X(0x9B, op_cb_invalid)  \
+  X(0x9C, op_cb_invalid)  \
+  X(0x9D, op_cb_invalid)  \
+  X(0x9E, op_cb_invalid)  \
+  X(0x9F, op_cb_invalid)  \
+  X(0xA0, op_cb_invalid)  \
+  X(0xA1, op_cb_invalid)  \
+  X(0xA2, op_cb_invalid)  \
+  X(0xA3, op_cb_invalid)  \
+  X(0xA4, op_cb_invalid)  \
+  X(0xA5, op_cb_invalid)  \
+  X(0xA6, op_cb_invalid)  \
+  X(0xA7, op_cb_invalid)  \
+  X(0xA8, op_cb_invalid)  \
+  X(0xA9, op_cb_invalid)  \
+  X(0xAA, op_cb_invalid)  \
+  X(0xAB, op_cb_invalid)  \
+  X(0xAC, op_cb_invalid)  \
+  X(0xAD, op_cb_invalid)  \
+  X(0xAE, op_cb_invalid)  \
+  X(0xAF, op_cb_invalid)  \
+  X(0xB0, op_cb_invalid)  \
+  X(0xB1, op_cb_invalid)  \
+  X(0xB2, op_cb_invalid)  \
+  X(0xB3, op_cb_invalid)  \
+  X(0xB4, op_cb_invalid)  \
+  X(0xB5, op_cb_invalid)  \
+  X(0xB6, op_cb_invalid)  \
+  X(0xB7, op_cb_invalid)  \
+  X(0xB8, op_cb_invalid)  \
+  X(0xB9, op_cb_invalid)  \
+  X(0xBA, op_cb_invalid)  \
+  X(0xBB, op_cb_invalid)  \
+  X(0xBC, op_cb_invalid)  \
+  X(0xBD, op_cb_invalid)  \
+  X(0xBE, op_cb_invalid)  \
+  X(0xBF, op_cb_invalid)  \
+  X(0xC0, op_cb_invalid)  \
+  X(0xC1, op_cb_invalid)  \
+  X(0xC2, op_cb_invalid)  \
+  X(0xC3, op_cb_invalid)  \
+  X(0xC4, op_cb_invalid)  \
+  X(0xC5, op_cb_invalid)  \
+  X(0xC6, op_cb_invalid)  \
+  X(0xC7, op_cb_invalid)  \
+  X(0xC8, op_cb_invalid)  \
+  X(0xC9, op_cb_invalid)  \
+  X(0xCA, op_cb_invalid)  \
+  X(0xCB, op_cb_invalid)  \
+  X(0xCC, op_cb_invalid)  \
+  X(0xCD, op_cb_invalid)  \
+  X(0xCE, op_cb_invalid)  \
+  X(0xCF, op_cb_invalid)  \
+  X(0xD0, op_cb_invalid)  \
+  X(0xD1, op_cb_invalid)  \
+  X(0xD2, op_cb_invalid)  \
+  X(0xD3, op_cb_invalid)  \
+  X(0xD4, op_cb_invalid)  \
+  X(0xD5, op_cb_invalid)  \
+  X(0xD6, op_cb_invalid)  \
+  X(0xD7, op_cb_invalid)  \
+  X(0xD8, op_cb_invalid)  \
+  X(0xD9, op_cb_invalid)  \
+  X(0xDA, op_cb_invalid)  \
+  X(0xDB, op_cb_invalid)  \
+  X(0xDC, op_cb_invalid)  \
+  X(0xDD, op_cb_invalid)  \
+  X(0xDE, op_cb_invalid)  \
+  X(0xDF, op_cb_invalid)  \
+  X(0xE0, op_cb_invalid)  \
+  X(0xE1, op_cb_invalid)  \
+  X(0xE2, op_cb_invalid)  \
+  X(0xE3, op_cb_invalid)  \
+  X(0xE4, op_cb_invalid)  \
+  X(0xE5, op_cb_invalid)  \
+  X(0xE6, op_cb_invalid)  \
+  X(0xE7, op_cb_invalid)  \
+  X(0xE8, op_cb_invalid)  \
+  X(0xE9, op_cb_invalid)  \
+  X(0xEA, op_cb_invalid)  \
+  X(0xEB, op_cb_invalid)  \
+  X(0xEC, op_cb_invalid)  \
+  X(0xED, op_cb_invalid)  \
+  X(0xEE, op_cb_invalid)  \
+  X(0xEF, op_cb_invalid)  \
+  X(0xF0, op_cb_invalid)  \
+  X(0xF1, op_cb_invalid)  \
+  X(0xF2, op_cb_invalid)  \
+  X(0xF3, op_cb_invalid)  \
+  X(0xF4, op_cb_invalid)  \
+  X(0xF5, op_cb_invalid)  \
+  X(0xF6, op_cb_invalid)  \
+  X(0xF7, op_cb_invalid)  \
+  X(0xF8, op_cb_invalid)  \
+  X(0xF9, op_cb_invalid)  \
+  X(0xFA, op_cb_invalid)  \
+  X(0xFB, op_cb_invalid)  \
+  X(0xFC, op_cb_invalid)  \
+  X(0xFD, op_cb_invalid)  \
+  X(0xFE, op_cb_invalid)  \
+  X(0xFF, op_cb_invalid)
+
+/* Computed gotos are a GNU extension; any other compiler gets the portable
+ * switch instead. */
+#if defined(LIBYAGBE_CPU_DISPATCH_THREADED) && !defined(__GNUC__)
+#undef LIBYAGBE_CPU_DISPATCH_THREADED
+#endif
+
+#define HANDLER_ENTRY(opcode, handler) handler,
+
+#if defined(LIBYAGBE_CPU_DISPATCH_TABLE) ||    \
+    defined(LIBYAGBE_CPU_DISPATCH_THREADED) || \
+    defined(LIBYAGBE_CPU_BLOCK_CACHE)
+static const libyagbe_cpu_opcode_handler cb_table[256] = {
+    CPU_CB_OPCODES(HANDLER_ENTRY)};
+#endif /* defined(LIBYAGBE_CPU_DISPATCH_TABLE) || \
+          defined(LIBYAGBE_CPU_DISPATCH_THREADED) || \
+          defined(LIBYAGBE_CPU_BLOCK_CACHE) */
+
+#if defined(LIBYAGBE_CPU_DISPATCH_TABLE) || \
+    defined(LIBYAGBE_CPU_DISPATCH_THREADED)
+
+static void op_prefix_cb(struct libyagbe_gb* const gb) {
+  cb_table[read_imm8(gb)](gb);
+}
 
-    case OP_OR_MEM_HL: {
-      const uint8_t data = libyagbe_bus_read_memory(cpu.reg.hl.value);
+#else
 
-      cpu.reg.af.byte.hi |= data;
-      cpu.reg.af.byte.lo = (cpu.reg.af.byte.hi == 0) ? 0x80 : 0x00;
+#define SWITCH_CASE(opcode, handler) \
+  case opcode:                       \
+    handler(gb);                     \
+    return;
 
-      libyagbe_scheduler_add_cycles(8);
-      return;
-    }
+#define PRIMARY_SWITCH_CASE(opcode, handler) \
+  case opcode:                               \
+    ADVANCE_PC(gb, opcode);                  \
+    handler(gb);                             \
+    return;
 
-    case OP_OR_A:
-      cpu.reg.af.byte.lo = (cpu.reg.af.byte.hi == 0) ? 0x80 : 0x00;
-      libyagbe_scheduler_add_cycles(4);
+static void op_prefix_cb(struct libyagbe_gb* const gb) {
+  switch (read_imm8(gb)) { CPU_CB_OPCODES(SWITCH_CASE) }
+}
 
-      return;
+#endif /* defined(LIBYAGBE_CPU_DISPATCH_TABLE) || \
+          defined(LIBYAGBE_CPU_DISPATCH_THREADED) */
 
-    case OP_CP_C:
-      alu_sub(cpu.reg.bc.byte.lo, ALU_DISCARD_RESULT);
-      libyagbe_scheduler_add_cycles(4);
+#if defined(LIBYAGBE_CPU_BLOCK_CACHE)
+static const libyagbe_cpu_opcode_handler primary_table[256] = {
+    CPU_PRIMARY_OPCODES(HANDLER_ENTRY)};
+#endif /* defined(LIBYAGBE_CPU_BLOCK_CACHE) */
 
-      return;
+#if defined(LIBYAGBE_CPU_DISPATCH_THREADED)
 
-    case OP_POP_BC:
-      cpu.reg.bc.value = stack_pop();
-      libyagbe_scheduler_add_cycles(12);
+#define LABEL_ADDRESS(opcode, handler) &&primary_##opcode,
 
-      return;
+#define LABEL_BODY(opcode, handler) \
+  primary_##opcode:                 \
+  ADVANCE_PC(gb, opcode);           \
+  handler(gb);                      \
+  return;
 
-    case OP_JP_NZ_IMM16:
-      jp_if(!zero_flag_is_set());
-      return;
+/* Taking the address of a label and jumping through it is not valid ISO C,
+ * and we compile with -pedantic-errors in debug builds. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
 
-    case OP_JP_IMM16:
-      cpu.reg.pc.value = read_imm16();
-      libyagbe_scheduler_add_cycles(16);
+static void step(struct libyagbe_gb* const gb) {
+  static const void* const labels[256] = {CPU_PRIMARY_OPCODES(LABEL_ADDRESS)};
 
-      return;
+  decode(gb);
+  goto *labels[gb->cpu.instruction];
 
-    case OP_CALL_NZ_IMM16:
-      call_if(!zero_flag_is_set());
-      return;
+  CPU_PRIMARY_OPCODES(LABEL_BODY)
+}
 
-    case OP_PUSH_BC:
-      stack_push(cpu.reg.bc.byte.hi, cpu.reg.bc.byte.lo);
-      libyagbe_scheduler_add_cycles(16);
+#if !defined(LIBYAGBE_CPU_BLOCK_CACHE)
+
+/* Every handler gets its own copy of the dispatch jump, which is the entire
+ * point of threaded code: the host's branch predictor sees one indirect jump
+ * per opcode rather than a single shared one. */
+#define RUN_LABEL_BODY(opcode, handler)         \
+  run_##opcode:                                 \
+  ADVANCE_PC(gb, opcode);                       \
+  handler(gb);                                  \
+                                                \
+  if (KEEP_RUNNING(gb, end, breakpoint)) {      \
+    decode(gb);                                 \
+    goto *run_labels[gb->cpu.instruction];      \
+  }                                             \
+  materialize_flags(gb);                        \
+  return gb->scheduler.timestamp_now - start;
+
+#define RUN_LABEL_ADDRESS(opcode, handler) &&run_##opcode,
+
+uintmax_t libyagbe_cpu_run(struct libyagbe_gb* const gb, const uintmax_t cycles,
+                           const unsigned long breakpoint) {
+  static const void* const run_labels[256] = {
+      CPU_PRIMARY_OPCODES(RUN_LABEL_ADDRESS)};
+
+  const uintmax_t start = gb->scheduler.timestamp_now;
+  const uintmax_t end = saturating_add(start, cycles);
+
+  if (!KEEP_RUNNING(gb, end, breakpoint)) {
+    return 0;
+  }
 
-      return;
+  defer_flags(gb);
 
-    case OP_ADD_A_IMM8: {
-      const uint8_t imm8 = read_imm8();
+  decode(gb);
+  goto *run_labels[gb->cpu.instruction];
 
-      alu_add(imm8);
-      libyagbe_scheduler_add_cycles(8);
+  CPU_PRIMARY_OPCODES(RUN_LABEL_BODY)
+}
 
-      return;
-    }
+#endif /* !defined(LIBYAGBE_CPU_BLOCK_CACHE) */
 
-    case OP_RET_Z:
-      ret_if(zero_flag_is_set());
-      return;
+#pragma GCC diagnostic pop
 
-    case OP_RET:
-      cpu.reg.pc.value = stack_pop();
-      libyagbe_scheduler_add_cycles(16);
+#elif defined(LIBYAGBE_CPU_DISPATCH_TABLE)
 
-      return;
+/* Every opcode gets a wrapper around its handler, so that the length of the
+ * instruction is known at compile time. */
+#define WRAPPER_DEFINITION(opcode, handler)                      \
+  static void primary_##opcode(struct libyagbe_gb* const gb) { \
+    ADVANCE_PC(gb, opcode);                                     \
+    handler(gb);                                                \
+  }
 
-    case OP_JP_Z_IMM16:
-      jp_if(zero_flag_is_set());
-      return;
+#define WRAPPER_ENTRY(opcode, handler) primary_##opcode,
 
-    case OP_PREFIX_CB: {
-      const uint8_t cb_instruction = read_imm8();
+CPU_PRIMARY_OPCODES(WRAPPER_DEFINITION)
 
-      switch (cb_instruction) {
-        case OP_RR_C:
-          cpu.reg.bc.byte.lo = alu_rr(cpu.reg.bc.byte.lo, ALU_NORMAL);
-          libyagbe_scheduler_add_cycles(8);
+static const libyagbe_cpu_opcode_handler primary_wrappers[256] = {
+    CPU_PRIMARY_OPCODES(WRAPPER_ENTRY)};
 
-          return;
+static void step(struct libyagbe_gb* const gb) {
+  decode(gb);
+  primary_wrappers[gb->cpu.instruction](gb);
+}
 
-        case OP_RR_D:
-          cpu.reg.de.byte.hi = alu_rr(cpu.reg.de.byte.hi, ALU_NORMAL);
-          libyagbe_scheduler_add_cycles(8);
+#else
 
-          return;
+static void step(struct libyagbe_gb* const gb) {
+  decode(gb);
 
-        case OP_SRL_B:
-          cpu.reg.bc.byte.hi = alu_srl(cpu.reg.bc.byte.hi);
-          libyagbe_scheduler_add_cycles(8);
+  switch (gb->cpu.instruction) { CPU_PRIMARY_OPCODES(PRIMARY_SWITCH_CASE) }
+}
 
-          return;
+#endif /* defined(LIBYAGBE_CPU_DISPATCH_THREADED) */
 
-        default:
-          libyagbe_log(
-              LIBYAGBE_LOG_LEVEL_CRITICAL,
-              "Invalid CB instruction $%02X reached at program counter $%04X.",
-              cb_instruction, cpu.reg.pc.value);
-          return;
-      }
-    }
+void libyagbe_cpu_step(struct libyagbe_gb* const gb) {
+  defer_flags(gb);
+  step(gb);
+  materialize_flags(gb);
+}
 
-    case OP_CALL_IMM16: {
-      const uint16_t address = read_imm16();
+#if defined(LIBYAGBE_CPU_BLOCK_CACHE)
+
+/* Blocks at addresses 1KiB apart would otherwise always collide, and banked
+ * code tends to be laid out at exactly such distances. */
+#define BLOCK_INDEX(pc) \
+  (((pc) ^ ((pc) >> 10)) & (LIBYAGBE_CPU_BLOCK_COUNT - 1))
+
+/* Instructions after which execution may continue somewhere other than the
+ * next instruction, or after which pending interrupts have to be looked at. */
+static bool ends_block(const uint8_t opcode) {
+  switch (opcode) {
+    case 0x10: /* STOP */
+    case 0x18: /* JR s8 */
+    case 0x20: /* JR NZ, s8 */
+    case 0x28: /* JR Z, s8 */
+    case 0x30: /* JR NC, s8 */
+    case 0x38: /* JR C, s8 */
+    case 0x76: /* HALT */
+    case 0xC0: /* RET NZ */
+    case 0xC2: /* JP NZ, a16 */
+    case 0xC3: /* JP a16 */
+    case 0xC4: /* CALL NZ, a16 */
+    case 0xC7: /* RST $00 */
+    case 0xC8: /* RET Z */
+    case 0xC9: /* RET */
+    case 0xCA: /* JP Z, a16 */
+    case 0xCC: /* CALL Z, a16 */
+    case 0xCD: /* CALL a16 */
+    case 0xCF: /* RST $08 */
+    case 0xD0: /* RET NC */
+    case 0xD2: /* JP NC, a16 */
+    case 0xD4: /* CALL NC, a16 */
+    case 0xD7: /* RST $10 */
+    case 0xD8: /* RET C */
+    case 0xD9: /* RETI */
+    case 0xDA: /* JP C, a16 */
+    case 0xDC: /* CALL C, a16 */
+    case 0xDF: /* RST $18 */
+    case 0xE7: /* RST $20 */
+    case 0xE9: /* JP HL */
+    case 0xEF: /* RST $28 */
+    case 0xF3: /* DI */
+    case 0xF7: /* RST $30 */
+    case 0xFB: /* EI */
+    case 0xFF: /* RST $38 */
+      return true;
 
-      stack_push(cpu.reg.pc.byte.hi, cpu.reg.pc.byte.lo);
-      cpu.reg.pc.value = address;
+    default:
+      return false;
+  }
+}
 
-      libyagbe_scheduler_add_cycles(24);
-      return;
+/* Decodes the instructions starting at the program counter into \p block.
+ * Decoding stops after an instruction which ends a block, or before one which
+ * crosses into the next page, as a page is the unit code is invalidated in.
+ * Returns false if not even the first instruction could be decoded. */
+static bool build_block(struct libyagbe_gb* const gb,
+                        struct libyagbe_cpu_block* const block,
+                        const uint8_t* const page, const uint16_t pc) {
+  const unsigned int start = pc & 0xFF;
+  unsigned int offset = start;
+  unsigned int count = 0;
+
+  while (count < LIBYAGBE_CPU_BLOCK_MAX_INSTRUCTIONS) {
+    struct libyagbe_cpu_decoded_instruction* const instruction =
+        &block->instructions[count];
+    const uint8_t opcode = page[offset];
+    const unsigned int length = instruction_lengths[opcode];
+
+    if ((offset + length) > LIBYAGBE_BUS_PAGE_SIZE) {
+      break;
     }
 
-    case OP_ADC_A_IMM8: {
-      const uint8_t imm8 = read_imm8();
+    instruction->opcode = opcode;
+    instruction->length = (uint8_t)length;
+    instruction->handler = primary_table[opcode];
 
-      alu_adc(imm8);
-      libyagbe_scheduler_add_cycles(8);
+    if (length == 3) {
+      instruction->operand =
+          (uint16_t)((page[offset + 2] << 8) | page[offset + 1]);
+    } else if (length == 2) {
+      instruction->operand = page[offset + 1];
+    }
 
-      return;
+    /* There's no point in dispatching on the prefix every time. */
+    if (opcode == 0xCB) {
+      instruction->handler = cb_table[instruction->operand];
     }
 
-    case OP_RET_NC:
-      ret_if(!carry_flag_is_set());
-      return;
+    count++;
+    offset += length;
 
-    case OP_POP_DE:
-      cpu.reg.de.value = stack_pop();
-      libyagbe_scheduler_add_cycles(12);
+    if (ends_block(opcode) || (instruction->handler == &op_invalid) ||
+        (instruction->handler == &op_cb_invalid)) {
+      break;
+    }
+  }
 
-      return;
+  if (count == 0) {
+    return false;
+  }
 
-    case OP_CALL_NC_IMM16:
-      call_if(!carry_flag_is_set());
-      return;
+  /* Writes to writable memory now go through the slow path, which moves the
+   * page on to its next generation. */
+  libyagbe_bus_watch_page(gb, pc >> 8);
 
-    case OP_PUSH_DE:
-      stack_push(cpu.reg.de.byte.hi, cpu.reg.de.byte.lo);
-      libyagbe_scheduler_add_cycles(16);
+  block->code = &page[start];
+  block->pc = pc;
+  block->size = (uint16_t)(offset - start);
+  block->instruction_count = (uint8_t)count;
+  block->generation = gb->cpu.block_cache->page_generations[pc >> 8];
+  block->runs = 0;
+  block->native = NULL;
 
-      return;
+  return true;
+}
 
-    case OP_SUB_IMM8: {
-      const uint8_t imm8 = read_imm8();
-      alu_sub(imm8, ALU_NORMAL);
+/* Whether a block still matches what's in memory: its page hasn't been
+ * written to since, nor has other memory been mapped there, e.g. by switching
+ * ROM banks. */
+static bool block_is_current(const struct libyagbe_gb* const gb,
+                             const struct libyagbe_cpu_block* const block) {
+  const unsigned int page = block->pc >> 8;
+  const uint8_t* const memory = gb->bus.read_map[page];
 
-      libyagbe_scheduler_add_cycles(8);
-      return;
-    }
+  return (memory != NULL) && (block->code == &memory[block->pc & 0xFF]) &&
+         (block->generation == gb->cpu.block_cache->page_generations[page]);
+}
 
-    case OP_RET_C:
-      ret_if(carry_flag_is_set());
-      return;
+/* Returns the block starting at the program counter, decoding it first if
+ * needed, or NULL if the code there can't be cached, e.g. because it lives in
+ * HRAM. */
+static struct libyagbe_cpu_block* find_block(struct libyagbe_gb* const gb) {
+  const uint16_t pc = gb->cpu.reg.pc.value;
+  const uint8_t* const page = gb->bus.read_map[pc >> 8];
+  struct libyagbe_cpu_block* block;
 
-    case OP_LDH_IMM8_A: {
-      const uint8_t imm8 = read_imm8();
+  if ((page == NULL) || (gb->cpu.block_cache == NULL)) {
+    return NULL;
+  }
 
-      libyagbe_bus_write_memory(0xFF00 + imm8, cpu.reg.af.byte.hi);
-      libyagbe_scheduler_add_cycles(12);
+  block = &gb->cpu.block_cache->blocks[BLOCK_INDEX(pc)];
 
-      return;
+  if ((block->pc == pc) && block_is_current(gb, block)) {
+    return block;
+  }
+  return build_block(gb, block, page, pc) ? block : NULL;
+}
+
+/* Whether the breakpoint lies past the start of a block but within it. It
+ * can't be at the start, as that's checked before a block is run. */
+static bool breakpoint_in_block(const struct libyagbe_cpu_block* const block,
+                                const unsigned long breakpoint) {
+  return (breakpoint > block->pc) &&
+         (breakpoint < ((unsigned long)block->pc + block->size));
+}
+
+static void run_block(struct libyagbe_gb* const gb,
+                      const struct libyagbe_cpu_block* const block,
+                      const unsigned long breakpoint) {
+  const struct libyagbe_cpu_decoded_instruction* instruction =
+      block->instructions;
+  const struct libyagbe_cpu_decoded_instruction* end =
+      &block->instructions[block->instruction_count];
+
+  /* The block is current to begin with, so it's enough to look for changes to
+   * its page as it runs. */
+  const unsigned int page = block->pc >> 8;
+  const uint8_t* const memory = gb->bus.read_map[page];
+  const uint32_t* const generation =
+      &gb->cpu.block_cache->page_generations[page];
+  const uint32_t block_generation = block->generation;
+
+  /* The breakpoint can only be hit in the middle of a block by running it up
+   * to there. */
+  if (breakpoint_in_block(block, breakpoint)) {
+    unsigned long address = block->pc;
+
+    for (end = block->instructions; address < breakpoint; ++end) {
+      address += end->length;
     }
+  }
+
+  for (; instruction != end; ++instruction) {
+    gb->cpu.instruction = instruction->opcode;
+    gb->cpu.operand = instruction->operand;
+    gb->cpu.reg.pc.value += instruction->length;
 
-    case OP_POP_HL:
-      cpu.reg.hl.value = stack_pop();
-      libyagbe_scheduler_add_cycles(12);
+    instruction->handler(gb);
 
+    /* The instruction overwrote code in the block or switched banks, so the
+     * rest of it is no longer what's in memory. */
+    if ((gb->bus.read_map[page] != memory) ||
+        (*generation != block_generation)) {
       return;
+    }
+  }
+}
 
-    case OP_PUSH_HL:
-      stack_push(cpu.reg.hl.byte.hi, cpu.reg.hl.byte.lo);
-      libyagbe_scheduler_add_cycles(16);
+#ifdef LIBYAGBE_CPU_JIT
+
+/* The number of times a block is interpreted before it's worth compiling. */
+#define JIT_THRESHOLD 16
+
+/* Reports a register the JIT compiler and the interpreter disagree on. */
+#define VERIFY_REGISTER(gb, pc, compiled, pair, name)                        \
+  do {                                                                       \
+    if ((compiled).pair.value != (gb)->cpu.reg.pair.value) {                 \
+      LOG_CRITICAL(((gb),                                                    \
+                    "JIT block at $%04X: " name " is $%04X compiled, "       \
+                    "$%04X interpreted.",                                    \
+                    (pc), (compiled).pair.value, (gb)->cpu.reg.pair.value)); \
+    }                                                                        \
+  } while (0)
+
+/* Compiled blocks work on F itself, so it has to be up to date. Returns the
+ * cycles taken. */
+static unsigned int call_native(struct libyagbe_gb* const gb,
+                                const struct libyagbe_cpu_block* const block) {
+  unsigned int cycles;
+
+  materialize_flags(gb);
+  cycles = block->native(gb);
+  defer_flags(gb);
+
+  return cycles;
+}
 
-      return;
+/* Runs a compiled block, then runs it again through the interpreter from the
+ * same starting point and compares the results. */
+static void verify_native(struct libyagbe_gb* const gb,
+                          const struct libyagbe_cpu_block* const block) {
+  struct libyagbe_cpu_registers initial;
+  struct libyagbe_cpu_registers compiled;
+  unsigned int compiled_cycles;
+  uintmax_t start;
+
+  materialize_flags(gb);
+  initial = gb->cpu.reg;
+
+  compiled_cycles = call_native(gb, block);
+  compiled = gb->cpu.reg;
+  gb->cpu.reg = initial;
+  defer_flags(gb);
+
+  start = gb->scheduler.timestamp_now;
+  run_block(gb, block, LIBYAGBE_CPU_NO_BREAKPOINT);
+  materialize_flags(gb);
+
+  VERIFY_REGISTER(gb, block->pc, compiled, af, "AF");
+  VERIFY_REGISTER(gb, block->pc, compiled, bc, "BC");
+  VERIFY_REGISTER(gb, block->pc, compiled, de, "DE");
+  VERIFY_REGISTER(gb, block->pc, compiled, hl, "HL");
+  VERIFY_REGISTER(gb, block->pc, compiled, sp, "SP");
+  VERIFY_REGISTER(gb, block->pc, compiled, pc, "PC");
+
+  if (compiled_cycles != (gb->scheduler.timestamp_now - start)) {
+    LOG_CRITICAL((gb, "JIT block at $%04X: took %u cycles compiled, %u "
+                      "interpreted.",
+                  block->pc, compiled_cycles,
+                  (unsigned int)(gb->scheduler.timestamp_now - start)));
+  }
+}
 
-    case OP_AND_IMM8: {
-      const uint8_t imm8 = read_imm8();
+/* Runs a block as native code, compiling it first if it's been run often
+ * enough. Returns false if the block has to be interpreted instead. */
+static bool run_native(struct libyagbe_gb* const gb,
+                       struct libyagbe_cpu_block* const block,
+                       const unsigned long breakpoint) {
+  if ((gb->cpu.jit.mode == LIBYAGBE_CPU_JIT_DISABLED) ||
+      breakpoint_in_block(block, breakpoint)) {
+    return false;
+  }
 
-      cpu.reg.af.byte.hi &= imm8;
-      cpu.reg.af.byte.lo = (cpu.reg.af.byte.hi == 0) ? 0xA0 : 0x20;
+  if (block->native == NULL) {
+    /* Blocks which couldn't be compiled are left at one past the threshold,
+     * so that compiling them isn't attempted again. */
+    if (block->runs != JIT_THRESHOLD) {
+      if (block->runs < JIT_THRESHOLD) {
+        block->runs++;
+      }
+      return false;
+    }
 
-      return;
+    block->native = libyagbe_jit_compile(gb, block);
+
+    if (block->native == NULL) {
+      block->runs++;
+      return false;
     }
+  }
 
-    case OP_JP_HL:
-      cpu.reg.pc.value = cpu.reg.hl.value;
-      libyagbe_scheduler_add_cycles(4);
+  if (gb->cpu.jit.mode == LIBYAGBE_CPU_JIT_VERIFY) {
+    verify_native(gb, block);
+  } else {
+    libyagbe_scheduler_add_cycles(gb, call_native(gb, block));
+  }
+  return true;
+}
 
-      return;
+#endif /* LIBYAGBE_CPU_JIT */
 
-    case OP_LD_MEM_IMM16_A: {
-      const uint16_t address = read_imm16();
+uintmax_t libyagbe_cpu_run(struct libyagbe_gb* const gb, const uintmax_t cycles,
+                           const unsigned long breakpoint) {
+  const uintmax_t start = gb->scheduler.timestamp_now;
+  const uintmax_t end = saturating_add(start, cycles);
 
-      libyagbe_bus_write_memory(address, cpu.reg.af.byte.hi);
-      return;
-    }
+  /* Instances which are never run, e.g. most forks, don't pay for the cache.
+   * If it can't be allocated, every instruction is stepped through instead. */
+  if (gb->cpu.block_cache == NULL) {
+    gb->cpu.block_cache = calloc(1, sizeof(struct libyagbe_cpu_block_cache));
+  }
 
-    case OP_XOR_IMM8: {
-      const uint8_t imm8 = read_imm8();
+  defer_flags(gb);
 
-      cpu.reg.af.byte.hi ^= imm8;
-      cpu.reg.af.byte.lo = (cpu.reg.af.byte.hi == 0) ? 0x80 : 0x00;
+  while (KEEP_RUNNING(gb, end, breakpoint)) {
+    struct libyagbe_cpu_block* const block = find_block(gb);
 
-      return;
+    if (block == NULL) {
+      step(gb);
+      continue;
     }
 
-    case OP_LDH_A_IMM8: {
-      const uint8_t imm8 = read_imm8();
-
-      cpu.reg.af.byte.hi = libyagbe_bus_read_memory(0xFF00 + imm8);
-      return;
+#ifdef LIBYAGBE_CPU_JIT
+    if (run_native(gb, block, breakpoint)) {
+      continue;
     }
+#endif /* LIBYAGBE_CPU_JIT */
 
-    case OP_POP_AF:
-      cpu.reg.af.value = stack_pop();
-      cpu.reg.af.byte.lo &= ~0x0F;
+    run_block(gb, block, breakpoint);
+  }
 
-      return;
+  materialize_flags(gb);
+  return gb->scheduler.timestamp_now - start;
+}
 
-    /* Interrupts are not supported yet, this is a NOP as such. */
-    case OP_DI:
-      return;
+#elif !defined(LIBYAGBE_CPU_DISPATCH_THREADED)
 
-    case OP_PUSH_AF:
-      stack_push(cpu.reg.af.byte.hi, cpu.reg.af.byte.lo);
-      return;
+uintmax_t libyagbe_cpu_run(struct libyagbe_gb* const gb, const uintmax_t cycles,
+                           const unsigned long breakpoint) {
+  const uintmax_t start = gb->scheduler.timestamp_now;
+  const uintmax_t end = saturating_add(start, cycles);
 
-    case OP_LD_A_MEM_IMM16: {
-      const uint16_t address = read_imm16();
+  defer_flags(gb);
 
-      cpu.reg.af.byte.hi = libyagbe_bus_read_memory(address);
-      return;
-    }
+  while (KEEP_RUNNING(gb, end, breakpoint)) {
+    step(gb);
+  }
 
-    case OP_CP_IMM8: {
-      const uint8_t imm8 = read_imm8();
+  materialize_flags(gb);
+  return gb->scheduler.timestamp_now - start;
+}
 
-      alu_sub(imm8, ALU_DISCARD_RESULT);
-      return;
-    }
+#endif /* defined(LIBYAGBE_CPU_BLOCK_CACHE) */
 
-    default:
-      break;
+void libyagbe_cpu_invalidate_page(struct libyagbe_gb* const gb,
+                                  const unsigned int page) {
+#ifdef LIBYAGBE_CPU_BLOCK_CACHE
+  struct libyagbe_cpu_block_cache* const cache = gb->cpu.block_cache;
+
+  if (cache == NULL) {
+    return;
   }
 
-  libyagbe_log(LIBYAGBE_LOG_LEVEL_CRITICAL,
-               "Invalid instruction $%02X reached at program counter $%04X.",
-               cpu.instruction, cpu.reg.pc.value);
-}
\ No newline at end of file
+  /* A block left over from 2^32 generations ago would look current again. */
+  if (++cache->page_generations[page] == 0) {
+    libyagbe_cpu_flush_blocks(gb);
+  }
+#else
+  (void)gb;
+  (void)page;
+#endif /* LIBYAGBE_CPU_BLOCK_CACHE */
+}
+
+void libyagbe_cpu_flush_blocks(struct libyagbe_gb* const gb) {
+#ifdef LIBYAGBE_CPU_BLOCK_CACHE
+  if (gb->cpu.block_cache != NULL) {
+    memset(gb->cpu.block_cache, 0, sizeof(struct libyagbe_cpu_block_cache));
+  }
+#else
+  (void)gb;
+#endif /* LIBYAGBE_CPU_BLOCK_CACHE */
+
+#ifdef LIBYAGBE_CPU_JIT
+  libyagbe_jit_reset(gb);
+#endif /* LIBYAGBE_CPU_JIT */
+}
+
+void libyagbe_cpu_release_blocks(struct libyagbe_gb* const gb) {
+#ifdef LIBYAGBE_CPU_BLOCK_CACHE
+  free(gb->cpu.block_cache);
+  gb->cpu.block_cache = NULL;
+#else
+  (void)gb;
+#endif /* LIBYAGBE_CPU_BLOCK_CACHE */
+}
+
+int libyagbe_cpu_set_jit_mode(struct libyagbe_gb* const gb,
+                              const enum libyagbe_cpu_jit_mode mode) {
+#ifdef LIBYAGBE_CPU_JIT
+  gb->cpu.jit.mode = (uint8_t)mode;
+  return 1;
+#else
+  (void)gb;
+  (void)mode;
+
+  return 0;
+#endif /* LIBYAGBE_CPU_JIT */
+}
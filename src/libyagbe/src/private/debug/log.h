@@ -0,0 +1,63 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Logging from within the core. Messages are logged through the macros below
+ * rather than by calling libyagbe_log() directly, so that messages below the
+ * minimum log level can be compiled out entirely.
+ *
+ * C90 has no variadic macros, hence the double parentheses:
+ *
+ *   LOG_WARNING((gb, "Unhandled memory read: $%04X", address));
+ */
+
+#ifndef LIBYAGBE_DEBUG_LOG_H
+#define LIBYAGBE_DEBUG_LOG_H
+
+#include "libyagbe/debug/logger.h"
+
+/* Set through the YAGBE_LOG_MIN_LEVEL CMake option; matches the values of
+ * enum libyagbe_log_level, which can't be used by the preprocessor. Critical
+ * messages are never compiled out, as the core relies on them to stop. */
+#ifndef LIBYAGBE_LOG_MIN_LEVEL
+#define LIBYAGBE_LOG_MIN_LEVEL 0
+#endif /* LIBYAGBE_LOG_MIN_LEVEL */
+
+#if LIBYAGBE_LOG_MIN_LEVEL <= 0
+#define LOG_INFO(args) libyagbe_log_info args
+#else
+#define LOG_INFO(args) ((void)0)
+#endif /* LIBYAGBE_LOG_MIN_LEVEL <= 0 */
+
+#if LIBYAGBE_LOG_MIN_LEVEL <= 1
+#define LOG_WARNING(args) libyagbe_log_warning args
+#else
+#define LOG_WARNING(args) ((void)0)
+#endif /* LIBYAGBE_LOG_MIN_LEVEL <= 1 */
+
+#define LOG_CRITICAL(args) libyagbe_log_critical args
+
+/* Forward declaration. */
+struct libyagbe_gb;
+
+void libyagbe_log_info(struct libyagbe_gb* const gb, const char* const str,
+                       ...);
+
+void libyagbe_log_warning(struct libyagbe_gb* const gb, const char* const str,
+                          ...);
+
+void libyagbe_log_critical(struct libyagbe_gb* const gb, const char* const str,
+                           ...);
+
+#endif /* LIBYAGBE_DEBUG_LOG_H */
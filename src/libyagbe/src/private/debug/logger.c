@@ -16,48 +16,290 @@
 #include "libyagbe/debug/logger.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-static libyagbe_log_cb info_cb;
-static libyagbe_log_cb warning_cb;
-static libyagbe_log_cb critical_cb;
+#include "../atomic.h"
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/gb.h"
+#include "log.h"
 
-void libyagbe_logger_set_log_level_cb(const enum libyagbe_log_level log_level,
+void libyagbe_logger_set_log_level_cb(struct libyagbe_gb* const gb,
+                                      const enum libyagbe_log_level log_level,
                                       const libyagbe_log_cb cb_func) {
   switch (log_level) {
     case LIBYAGBE_LOG_LEVEL_INFO:
-      info_cb = cb_func;
+      gb->logger.info_cb = cb_func;
       return;
 
     case LIBYAGBE_LOG_LEVEL_WARNING:
-      warning_cb = cb_func;
+      gb->logger.warning_cb = cb_func;
       return;
 
     case LIBYAGBE_LOG_LEVEL_CRITICAL:
-      critical_cb = cb_func;
+      gb->logger.critical_cb = cb_func;
       return;
   }
 }
 
-void libyagbe_log(const enum libyagbe_log_level log_level,
-                  const char* const str, ...) {
-  char buf[128];
-  va_list args;
+/* The size of the buffer deferred messages are formatted into, and how close
+ * to its end formatting stops; no single conversion the core uses comes
+ * anywhere near that long. */
+#define DEFERRED_BUF_SIZE 256
+#define DEFERRED_BUF_SLACK 32
 
-  va_start(args, str);
-  vsprintf(buf, str, args);
-  va_end(args);
+/* The longest conversion specification that will be deferred, e.g. "%04lX". */
+#define MAX_SPEC_LENGTH 15
 
+static libyagbe_log_cb get_log_cb(const struct libyagbe_gb* const gb,
+                                  const unsigned int log_level) {
   switch (log_level) {
     case LIBYAGBE_LOG_LEVEL_INFO:
-      info_cb(buf);
-      return;
+      return gb->logger.info_cb;
 
     case LIBYAGBE_LOG_LEVEL_WARNING:
-      warning_cb(buf);
-      return;
+      return gb->logger.warning_cb;
 
     case LIBYAGBE_LOG_LEVEL_CRITICAL:
-      critical_cb(buf);
-      return;
+      return gb->logger.critical_cb;
+  }
+  return NULL;
+}
+
+/* Skips over the flags, width, precision and length modifier of the
+ * conversion specification following a '%', returning a pointer to the
+ * conversion specifier. */
+static const char* parse_spec(const char* str, bool* const is_long) {
+  str += strspn(str, "-+ #0123456789.");
+  *is_long = (*str == 'l');
+
+  if ((*str == 'l') || (*str == 'h')) {
+    str++;
   }
-}
\ No newline at end of file
+  return str;
+}
+
+/* Copies the arguments of a message into a record. Returns false if the
+ * message can't be deferred. */
+static bool collect_args(const char* str, va_list args,
+                         unsigned long* const out) {
+  unsigned int num_args = 0;
+  const char* spec;
+  bool is_long;
+
+  while ((str = strchr(str, '%')) != NULL) {
+    if (str[1] == '%') {
+      str += 2;
+      continue;
+    }
+
+    spec = parse_spec(str + 1, &is_long);
+
+    if ((num_args == LIBYAGBE_LOGGER_MAX_ARGS) || (*spec == '\0') ||
+        (strchr("diouxXc", *spec) == NULL) ||
+        ((size_t)(spec - str) >= MAX_SPEC_LENGTH)) {
+      return false;
+    }
+
+    out[num_args++] =
+        is_long ? va_arg(args, unsigned long) : va_arg(args, unsigned int);
+    str = spec + 1;
+  }
+  return true;
+}
+
+static void format_record(char* const buf,
+                          const struct libyagbe_log_record* const record) {
+  const char* src = record->str;
+  char* dst = buf;
+  char spec[MAX_SPEC_LENGTH + 1];
+  unsigned int arg = 0;
+
+  while ((*src != '\0') &&
+         (dst < &buf[DEFERRED_BUF_SIZE - DEFERRED_BUF_SLACK])) {
+    const char* end;
+    bool is_long;
+
+    if ((*src != '%') || record->raw) {
+      *dst++ = *src++;
+      continue;
+    }
+
+    if (src[1] == '%') {
+      *dst++ = '%';
+      src += 2;
+
+      continue;
+    }
+
+    end = parse_spec(src + 1, &is_long) + 1;
+
+    memcpy(spec, src, end - src);
+    spec[end - src] = '\0';
+
+    if (is_long) {
+      dst += sprintf(dst, spec, record->args[arg]);
+    } else {
+      dst += sprintf(dst, spec, (unsigned int)record->args[arg]);
+    }
+
+    arg++;
+    src = end;
+  }
+  *dst = '\0';
+}
+
+/* Called from the emulation thread only. */
+static void push_record(struct libyagbe_gb* const gb,
+                        const enum libyagbe_log_level log_level,
+                        const char* const str, va_list args) {
+  struct libyagbe_logger* const logger = &gb->logger;
+  const unsigned long head = logger->ring_head;
+  struct libyagbe_log_record* record;
+
+  /* Acquiring the tail makes sure the draining thread is done with the slot
+   * before it's overwritten. */
+  if ((head - ATOMIC_LOAD_ACQUIRE(&logger->ring_tail)) ==
+      LIBYAGBE_LOGGER_RING_SIZE) {
+    ATOMIC_STORE_RELEASE(&logger->dropped, logger->dropped + 1);
+    return;
+  }
+
+  record = &logger->ring[head & (LIBYAGBE_LOGGER_RING_SIZE - 1)];
+
+  record->str = str;
+  record->timestamp = gb->scheduler.timestamp_now;
+  record->level = log_level;
+  record->raw = !collect_args(str, args, record->args);
+
+  ATOMIC_STORE_RELEASE(&logger->ring_head, head + 1);
+}
+
+static void log_va(struct libyagbe_gb* const gb,
+                   const enum libyagbe_log_level log_level,
+                   const char* const str, va_list args) {
+  const libyagbe_log_cb cb_func = get_log_cb(gb, log_level);
+  char buf[128];
+
+  if (log_level == LIBYAGBE_LOG_LEVEL_CRITICAL) {
+    gb->logger.critical_raised = 1;
+  }
+
+  /* Nobody is listening, so don't bother formatting the message. */
+  if (cb_func == NULL) {
+    return;
+  }
+
+  if (gb->logger.async) {
+    push_record(gb, log_level, str, args);
+    return;
+  }
+
+  vsprintf(buf, str, args);
+
+  gb->logger.message_timestamp = gb->scheduler.timestamp_now;
+  cb_func(gb, buf);
+}
+
+int libyagbe_logger_set_async(struct libyagbe_gb* const gb, const int async) {
+#ifdef LIBYAGBE_HAVE_ATOMICS
+  struct libyagbe_logger* const logger = &gb->logger;
+
+  if (async && (logger->ring == NULL)) {
+    logger->ring =
+        malloc(LIBYAGBE_LOGGER_RING_SIZE * sizeof(struct libyagbe_log_record));
+
+    if (logger->ring == NULL) {
+      return 0;
+    }
+  }
+
+  logger->async = (async != 0);
+  return 1;
+#else
+  gb->logger.async = 0;
+  return !async;
+#endif /* LIBYAGBE_HAVE_ATOMICS */
+}
+
+unsigned long libyagbe_logger_drain(struct libyagbe_gb* const gb) {
+  struct libyagbe_logger* const logger = &gb->logger;
+  const unsigned long head = ATOMIC_LOAD_ACQUIRE(&logger->ring_head);
+  const unsigned long dropped = ATOMIC_LOAD_RELAXED(&logger->dropped);
+  unsigned long tail = logger->ring_tail;
+  unsigned long num_delivered = 0;
+  char buf[DEFERRED_BUF_SIZE];
+
+  for (; tail != head; ++tail) {
+    const struct libyagbe_log_record* const record =
+        &logger->ring[tail & (LIBYAGBE_LOGGER_RING_SIZE - 1)];
+    const libyagbe_log_cb cb_func = get_log_cb(gb, record->level);
+
+    if (cb_func != NULL) {
+      format_record(buf, record);
+
+      logger->message_timestamp = record->timestamp;
+      cb_func(gb, buf);
+
+      num_delivered++;
+    }
+
+    /* Hand the slot back to the emulation thread. */
+    ATOMIC_STORE_RELEASE(&logger->ring_tail, tail + 1);
+  }
+
+  if ((dropped != logger->dropped_reported) && (logger->warning_cb != NULL)) {
+    sprintf(buf, "%lu log messages were dropped as the log ring was full.",
+            dropped - logger->dropped_reported);
+
+    logger->dropped_reported = dropped;
+    logger->warning_cb(gb, buf);
+  }
+  return num_delivered;
+}
+
+void libyagbe_logger_release(struct libyagbe_gb* const gb) {
+  free(gb->logger.ring);
+  gb->logger.ring = NULL;
+}
+
+uintmax_t libyagbe_logger_get_timestamp(const struct libyagbe_gb* const gb) {
+  return gb->logger.message_timestamp;
+}
+
+void libyagbe_log(struct libyagbe_gb* const gb,
+                  const enum libyagbe_log_level log_level,
+                  const char* const str, ...) {
+  va_list args;
+
+  va_start(args, str);
+  log_va(gb, log_level, str, args);
+  va_end(args);
+}
+
+void libyagbe_log_info(struct libyagbe_gb* const gb, const char* const str,
+                       ...) {
+  va_list args;
+
+  va_start(args, str);
+  log_va(gb, LIBYAGBE_LOG_LEVEL_INFO, str, args);
+  va_end(args);
+}
+
+void libyagbe_log_warning(struct libyagbe_gb* const gb, const char* const str,
+                          ...) {
+  va_list args;
+
+  va_start(args, str);
+  log_va(gb, LIBYAGBE_LOG_LEVEL_WARNING, str, args);
+  va_end(args);
+}
+
+void libyagbe_log_critical(struct libyagbe_gb* const gb, const char* const str,
+                           ...) {
+  va_list args;
+
+  va_start(args, str);
+  log_va(gb, LIBYAGBE_LOG_LEVEL_CRITICAL, str, args);
+  va_end(args);
+}
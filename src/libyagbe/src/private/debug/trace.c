@@ -0,0 +1,117 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/debug/trace.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "libyagbe/gb.h"
+
+static void write_u16(uint8_t* const dst, const uint16_t value) {
+  dst[0] = value & 0xFF;
+  dst[1] = value >> 8;
+}
+
+static uint16_t read_u16(const uint8_t* const src) {
+  return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+void libyagbe_trace_start(struct libyagbe_gb* const gb, uint8_t* const buffer,
+                          const size_t buffer_size,
+                          const libyagbe_trace_sink_cb sink_cb) {
+  assert(buffer != NULL);
+  assert(buffer_size >= LIBYAGBE_TRACE_RECORD_SIZE);
+  assert(sink_cb != NULL);
+
+  gb->trace.sink_cb = sink_cb;
+  gb->trace.buffer = buffer;
+  gb->trace.buffer_size =
+      buffer_size - (buffer_size % LIBYAGBE_TRACE_RECORD_SIZE);
+  gb->trace.buffer_used = 0;
+
+  sink_cb(gb, (const uint8_t*)LIBYAGBE_TRACE_MAGIC, LIBYAGBE_TRACE_MAGIC_SIZE);
+}
+
+void libyagbe_trace_stop(struct libyagbe_gb* const gb) {
+  libyagbe_trace_flush(gb);
+  memset(&gb->trace, 0, sizeof(struct libyagbe_trace));
+}
+
+void libyagbe_trace_flush(struct libyagbe_gb* const gb) {
+  if ((gb->trace.sink_cb != NULL) && (gb->trace.buffer_used != 0)) {
+    gb->trace.sink_cb(gb, gb->trace.buffer, gb->trace.buffer_used);
+    gb->trace.buffer_used = 0;
+  }
+}
+
+void libyagbe_trace_record(struct libyagbe_gb* const gb) {
+  uint8_t* record;
+  uintmax_t timestamp;
+  unsigned int i;
+
+  if (gb->trace.sink_cb == NULL) {
+    return;
+  }
+
+  if (gb->trace.buffer_used == gb->trace.buffer_size) {
+    libyagbe_trace_flush(gb);
+  }
+
+  record = &gb->trace.buffer[gb->trace.buffer_used];
+  gb->trace.buffer_used += LIBYAGBE_TRACE_RECORD_SIZE;
+
+  write_u16(&record[LIBYAGBE_TRACE_OFFSET_REGS + 0], gb->cpu.reg.bc.value);
+  write_u16(&record[LIBYAGBE_TRACE_OFFSET_REGS + 2], gb->cpu.reg.de.value);
+  write_u16(&record[LIBYAGBE_TRACE_OFFSET_REGS + 4], gb->cpu.reg.hl.value);
+  write_u16(&record[LIBYAGBE_TRACE_OFFSET_REGS + 6], gb->cpu.reg.af.value);
+  write_u16(&record[LIBYAGBE_TRACE_OFFSET_REGS + 8], gb->cpu.reg.sp.value);
+  write_u16(&record[LIBYAGBE_TRACE_OFFSET_REGS + 10], gb->cpu.reg.pc.value);
+
+  record[LIBYAGBE_TRACE_OFFSET_OPCODE + 0] =
+      libyagbe_bus_read_memory(gb, gb->cpu.reg.pc.value);
+  record[LIBYAGBE_TRACE_OFFSET_OPCODE + 1] = 0x00;
+  record[LIBYAGBE_TRACE_OFFSET_OPCODE + 2] = 0x00;
+  record[LIBYAGBE_TRACE_OFFSET_OPCODE + 3] = 0x00;
+
+  /* uintmax_t may only be 32 bits wide under C90, in which case the upper
+   * bytes are simply zero. */
+  timestamp = gb->scheduler.timestamp_now;
+
+  for (i = 0; i < 8; ++i) {
+    record[LIBYAGBE_TRACE_OFFSET_TIMESTAMP + i] = timestamp & 0xFF;
+    timestamp >>= 8;
+  }
+}
+
+void libyagbe_trace_decode(const uint8_t* const data,
+                           struct libyagbe_trace_record* const record) {
+  int i;
+
+  record->bc = read_u16(&data[LIBYAGBE_TRACE_OFFSET_REGS + 0]);
+  record->de = read_u16(&data[LIBYAGBE_TRACE_OFFSET_REGS + 2]);
+  record->hl = read_u16(&data[LIBYAGBE_TRACE_OFFSET_REGS + 4]);
+  record->af = read_u16(&data[LIBYAGBE_TRACE_OFFSET_REGS + 6]);
+  record->sp = read_u16(&data[LIBYAGBE_TRACE_OFFSET_REGS + 8]);
+  record->pc = read_u16(&data[LIBYAGBE_TRACE_OFFSET_REGS + 10]);
+
+  record->opcode = data[LIBYAGBE_TRACE_OFFSET_OPCODE];
+  record->timestamp = 0;
+
+  for (i = 7; i >= 0; --i) {
+    record->timestamp <<= 8;
+    record->timestamp |= data[LIBYAGBE_TRACE_OFFSET_TIMESTAMP + i];
+  }
+}
@@ -15,12 +15,202 @@
 
 #include "libyagbe/gb.h"
 
-#include "libyagbe/cpu.h"
-#include "libyagbe/scheduler.h"
+#include <stdlib.h>
+#include <string.h>
 
-void libyagbe_system_reset(void) {
-  libyagbe_scheduler_reset();
-  libyagbe_cpu_reset();
+#ifdef LIBYAGBE_CPU_JIT
+#include "jit.h"
+#endif /* LIBYAGBE_CPU_JIT */
+
+struct libyagbe_gb* libyagbe_gb_create(void) {
+  struct libyagbe_gb* const gb = calloc(1, sizeof(struct libyagbe_gb));
+
+  if (gb == NULL) {
+    return NULL;
+  }
+
+  if (!libyagbe_bus_alloc_memory(gb)) {
+    libyagbe_gb_destroy(gb);
+    return NULL;
+  }
+  return gb;
+}
+
+void libyagbe_gb_destroy(struct libyagbe_gb* const gb) {
+  if (gb == NULL) {
+    return;
+  }
+
+#ifdef LIBYAGBE_CPU_JIT
+  libyagbe_jit_release(gb);
+#endif /* LIBYAGBE_CPU_JIT */
+
+  libyagbe_cpu_release_blocks(gb);
+  libyagbe_ppu_release(gb);
+  libyagbe_apu_release(gb);
+  libyagbe_output_release(gb);
+  libyagbe_logger_release(gb);
+  libyagbe_cart_release(gb);
+  libyagbe_bus_release_memory(gb);
+  free(gb);
+}
+
+/* The block cache is left for the child to allocate once it's run, as is the
+ * JIT's code buffer, which is only allocated once something is compiled. */
+static void fork_cpu(struct libyagbe_cpu* const child,
+                     const struct libyagbe_cpu* const cpu) {
+  child->reg = cpu->reg;
+  child->lazy_flags = cpu->lazy_flags;
+  child->instruction = cpu->instruction;
+  child->operand = cpu->operand;
+  child->jit.mode = cpu->jit.mode;
+}
+
+/* VRAM is taken care of by the bus. */
+static void fork_ppu(struct libyagbe_ppu* const child,
+                     const struct libyagbe_ppu* const ppu) {
+  memcpy(child->oam, ppu->oam, sizeof(child->oam));
+
+  /* Decoding every tile again is left until the next line is drawn, which
+   * may well be never. */
+  memset(child->dirty_tiles, 0xFF, sizeof(child->dirty_tiles));
+  child->tiles_dirty = true;
+
+  child->lcdc = ppu->lcdc;
+  child->stat = ppu->stat;
+  child->scy = ppu->scy;
+  child->scx = ppu->scx;
+  child->ly = ppu->ly;
+  child->lyc = ppu->lyc;
+  child->dma = ppu->dma;
+  child->bgp = ppu->bgp;
+  child->obp0 = ppu->obp0;
+  child->obp1 = ppu->obp1;
+  child->wy = ppu->wy;
+  child->wx = ppu->wx;
+
+  child->mode = ppu->mode;
+  child->window_line = ppu->window_line;
+  child->stat_line = ppu->stat_line;
+  child->frame_count = ppu->frame_count;
+  child->frame_drawn = ppu->frame_drawn;
+
+  child->pixel_format = ppu->pixel_format;
+  child->rgba_colors = ppu->rgba_colors;
+  child->frame_cb = ppu->frame_cb;
+  child->render_mode = ppu->render_mode;
+  child->frame_interval = ppu->frame_interval;
+}
+
+/* The samples the parent has yet to hand out stay with it; the child starts
+ * with silence, like after loading a state. */
+static void fork_apu(struct libyagbe_apu* const child,
+                     const struct libyagbe_apu* const apu) {
+  memcpy(child->regs, apu->regs, sizeof(child->regs));
+  memcpy(child->wave_ram, apu->wave_ram, sizeof(child->wave_ram));
+  memcpy(child->channels, apu->channels, sizeof(child->channels));
+
+  child->sweep_frequency = apu->sweep_frequency;
+  child->sweep_timer = apu->sweep_timer;
+  child->sweep_enabled = apu->sweep_enabled;
+  child->sequencer_step = apu->sequencer_step;
+  child->timestamp_sequencer = apu->timestamp_sequencer;
+
+  child->sample_rate = apu->sample_rate;
+  child->sample_factor = apu->sample_factor;
+}
+
+struct libyagbe_gb* libyagbe_gb_fork(struct libyagbe_gb* const gb) {
+  /* The block cache, decoded tiles and sample buffers are only allocated
+   * once the child gets to use them, and memory is shared below, so forking
+   * costs little more than the pages either instance goes on to write to. */
+  struct libyagbe_gb* const child = calloc(1, sizeof(struct libyagbe_gb));
+
+  if (child == NULL) {
+    return NULL;
+  }
+
+  fork_cpu(&child->cpu, &gb->cpu);
+
+  /* The bus maps the cartridge's RAM, so it has to be shared first. */
+  if (!libyagbe_cart_fork(child, gb)) {
+    libyagbe_gb_destroy(child);
+    return NULL;
+  }
+  libyagbe_bus_fork(child, gb);
+
+  child->scheduler = gb->scheduler;
+  child->timer = gb->timer;
+
+  fork_ppu(&child->ppu, &gb->ppu);
+  fork_apu(&child->apu, &gb->apu);
+
+  /* Neither instance is caught up, and the child starts out with no samples
+   * of its own. */
+  libyagbe_apu_restart_output(child);
+
+  child->logger.info_cb = gb->logger.info_cb;
+  child->logger.warning_cb = gb->logger.warning_cb;
+  child->logger.critical_cb = gb->logger.critical_cb;
+  child->logger.critical_raised = gb->logger.critical_raised;
+
+  child->userdata = gb->userdata;
+
+  return child;
+}
+
+void libyagbe_system_reset(struct libyagbe_gb* const gb) {
+  gb->logger.critical_raised = 0;
+
+  libyagbe_cart_reset(gb);
+  libyagbe_scheduler_reset(gb);
+  libyagbe_bus_reset(gb);
+  libyagbe_timer_reset(gb);
+  libyagbe_ppu_reset(gb);
+  libyagbe_apu_reset(gb);
+  libyagbe_cpu_reset(gb);
+}
+
+/* Like libyagbe_cpu_run(), but records every instruction before it's
+ * executed. */
+static uintmax_t run_traced(struct libyagbe_gb* const gb,
+                            const uintmax_t budget,
+                            const unsigned long breakpoint) {
+  const uintmax_t start = gb->scheduler.timestamp_now;
+
+  while (((gb->scheduler.timestamp_now - start) < budget) &&
+         (gb->cpu.reg.pc.value != breakpoint) && !gb->logger.critical_raised) {
+    libyagbe_trace_record(gb);
+    libyagbe_cpu_step(gb);
+  }
+  return gb->scheduler.timestamp_now - start;
+}
+
+static uintmax_t run(struct libyagbe_gb* const gb, const uintmax_t budget,
+                     const unsigned long breakpoint) {
+  if (gb->trace.sink_cb != NULL) {
+    return run_traced(gb, budget, breakpoint);
+  }
+  return libyagbe_cpu_run(gb, budget, breakpoint);
+}
+
+void libyagbe_system_step(struct libyagbe_gb* const gb) {
+  libyagbe_trace_record(gb);
+  libyagbe_cpu_step(gb);
+}
+
+uintmax_t libyagbe_system_run_cycles(struct libyagbe_gb* const gb,
+                                     const uintmax_t budget) {
+  return run(gb, budget, LIBYAGBE_CPU_NO_BREAKPOINT);
+}
+
+uintmax_t libyagbe_system_run_until(struct libyagbe_gb* const gb,
+                                    const uint16_t pc) {
+  return run(gb, (uintmax_t)-1, pc);
 }
 
-void libyagbe_system_step(void) { libyagbe_cpu_step(); }
\ No newline at end of file
+uintmax_t libyagbe_system_run_cycles_until(struct libyagbe_gb* const gb,
+                                           const uintmax_t budget,
+                                           const uint16_t pc) {
+  return run(gb, budget, pc);
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* The interface between the CPU core and the JIT compiler, which turns cached
+ * blocks into native code. Only built with the YAGBE_CPU_JIT CMake option. */
+
+#ifndef LIBYAGBE_JIT_H
+#define LIBYAGBE_JIT_H
+
+#include "libyagbe/cpu.h"
+
+/* Forward declaration. */
+struct libyagbe_gb;
+
+/* Compiles a block to native code. Returns NULL if the block uses an
+ * instruction the compiler doesn't handle, or if no executable memory could be
+ * allocated. Whenever the code buffer fills up, every compiled block is
+ * discarded to make room. */
+libyagbe_cpu_native_block libyagbe_jit_compile(
+    struct libyagbe_gb* const gb, const struct libyagbe_cpu_block* const block);
+
+/* Discards every compiled block, keeping the code buffer around. The caller
+ * is responsible for dropping its pointers to the blocks. */
+void libyagbe_jit_reset(struct libyagbe_gb* const gb);
+
+/* Frees the code buffer. */
+void libyagbe_jit_release(struct libyagbe_gb* const gb);
+
+#endif /* LIBYAGBE_JIT_H */
@@ -0,0 +1,897 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* A JIT compiler for x86-64 hosts using the System V calling convention.
+ *
+ * Only blocks which never touch memory are compiled: everything else needs the
+ * bus, and calling back into C from generated code would cost most of what's
+ * gained. Such blocks are exactly the tight register loops (delays, counters,
+ * arithmetic) which dominate bulk runs, so little is lost.
+ *
+ * For the duration of a block the register pairs live in host registers:
+ *
+ *   AF - R8D, BC - R9D, DE - R10D, HL - R11D, SP - ESI
+ *
+ * each always holding a 16-bit value. RDI holds the instance, as passed, and
+ * EAX, ECX and EDX are scratch registers. All of them are caller-saved, so
+ * compiled blocks need neither a prologue nor to save anything.
+ *
+ * Flags are only computed where a later instruction in the block could look at
+ * them. Every flag is assumed to be looked at once the block ends. */
+
+#define _DEFAULT_SOURCE
+
+#include "jit.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "debug/log.h"
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/gb.h"
+
+/* The size of the buffer compiled blocks are written to. */
+#define CODE_BUFFER_SIZE (1024UL * 1024UL)
+
+/* A block is only compiled if at least this much of the buffer is left. Even
+ * the largest possible block comes nowhere near it. */
+#define MAX_BLOCK_CODE_SIZE 4096UL
+
+/* Offsets of the registers from the instance pointer. */
+#define REGISTER_OFFSET(pair)                                               \
+  (offsetof(struct libyagbe_gb, cpu) + offsetof(struct libyagbe_cpu, reg) + \
+   offsetof(struct libyagbe_cpu_registers, pair))
+
+enum host_register {
+  HOST_EAX = 0,
+  HOST_ECX = 1,
+  HOST_EDX = 2,
+  HOST_ESI = 6,
+  HOST_EDI = 7,
+  HOST_R8D = 8,
+  HOST_R9D = 9,
+  HOST_R10D = 10,
+  HOST_R11D = 11
+};
+
+/* Where each register pair lives; see above. */
+#define HOST_AF HOST_R8D
+#define HOST_BC HOST_R9D
+#define HOST_DE HOST_R10D
+#define HOST_HL HOST_R11D
+#define HOST_SP HOST_ESI
+
+/* The /digit in the ModRM byte of the 0x81 (immediate ALU) and 0xC1 (shift)
+ * opcodes. */
+enum host_opcode_extension {
+  EXT_ADD = 0,
+  EXT_OR = 1,
+  EXT_AND = 4,
+  EXT_SUB = 5,
+  EXT_XOR = 6,
+  EXT_CMP = 7,
+  EXT_SHL = 4,
+  EXT_SHR = 5
+};
+
+/* Opcodes of the "op r/m32, r32" form. */
+enum host_rr_opcode {
+  RR_ADD = 0x01,
+  RR_OR = 0x09,
+  RR_AND = 0x21,
+  RR_SUB = 0x29,
+  RR_XOR = 0x31,
+  RR_MOV = 0x89
+};
+
+enum host_condition { CC_B = 0x2, CC_Z = 0x4, CC_NZ = 0x5, CC_A = 0x7 };
+
+enum sm83_flag_bits { FLAG_BIT_Z = 7, FLAG_BIT_C = 4 };
+
+/* Sets of flags, as tracked while compiling. Everything in F other than Z and
+ * C only ever changes when F is overwritten as a whole. */
+enum flag_set {
+  FLAGS_Z = 1 << 0,
+  FLAGS_C = 1 << 1,
+  FLAGS_REST = 1 << 2,
+  FLAGS_ALL = FLAGS_Z | FLAGS_C | FLAGS_REST
+};
+
+/* Registers in the order they're encoded in opcodes. */
+enum sm83_register {
+  REG_B,
+  REG_C,
+  REG_D,
+  REG_E,
+  REG_H,
+  REG_L,
+  REG_NONE,
+  REG_A
+};
+
+struct op_info {
+  /* The cycles taken, not counting a taken conditional jump. */
+  unsigned int cycles;
+
+  unsigned int flags_read;
+  unsigned int flags_written;
+};
+
+struct emitter {
+  uint8_t* cur;
+};
+
+/* Looks up what the compiler needs to know about an instruction. Returns false
+ * if the compiler doesn't handle it. The cycle counts match those of the
+ * interpreter. */
+static bool describe(const struct libyagbe_cpu_decoded_instruction* const insn,
+                     struct op_info* const info) {
+  info->flags_read = 0;
+  info->flags_written = 0;
+
+  switch (insn->opcode) {
+    case 0x00: /* NOP */
+      info->cycles = 4;
+      return true;
+
+    case 0xF3: /* DI */
+      info->cycles = 4;
+      return true;
+
+    case 0x01: /* LD BC, d16 */
+    case 0x11: /* LD DE, d16 */
+    case 0x21: /* LD HL, d16 */
+    case 0x31: /* LD SP, d16 */
+      info->cycles = 12;
+      return true;
+
+    case 0x03: /* INC BC */
+    case 0x13: /* INC DE */
+    case 0x23: /* INC HL */
+      info->cycles = 8;
+      return true;
+
+    case 0x04: /* INC B */
+    case 0x14: /* INC D */
+    case 0x1C: /* INC E */
+    case 0x24: /* INC H */
+    case 0x2C: /* INC L */
+    case 0x05: /* DEC B */
+    case 0x0D: /* DEC C */
+    case 0x1D: /* DEC E */
+    case 0x25: /* DEC H */
+    case 0x2D: /* DEC L */
+    case 0x3D: /* DEC A */
+      info->cycles = 4;
+      info->flags_written = FLAGS_Z;
+      return true;
+
+    case 0x06: /* LD B, d8 */
+    case 0x0E: /* LD C, d8 */
+    case 0x26: /* LD H, d8 */
+    case 0x3E: /* LD A, d8 */
+      info->cycles = 8;
+      return true;
+
+    case 0x18: /* JR s8 */
+      info->cycles = 12;
+      return true;
+
+    case 0x20: /* JR NZ, s8 */
+    case 0x28: /* JR Z, s8 */
+      info->cycles = 8;
+      info->flags_read = FLAGS_Z;
+      return true;
+
+    case 0x30: /* JR NC, s8 */
+    case 0x38: /* JR C, s8 */
+      info->cycles = 8;
+      info->flags_read = FLAGS_C;
+      return true;
+
+    case 0x1F: /* RRA */
+      info->cycles = 4;
+      info->flags_read = FLAGS_C;
+      info->flags_written = FLAGS_Z | FLAGS_C;
+      return true;
+
+    case 0x29: /* ADD HL, HL */
+      info->cycles = 8;
+      info->flags_written = FLAGS_C;
+      return true;
+
+    case 0x47: /* LD B, A */
+    case 0x4F: /* LD C, A */
+    case 0x57: /* LD D, A */
+    case 0x5F: /* LD E, A */
+    case 0x67: /* LD H, A */
+    case 0x6F: /* LD L, A */
+    case 0x78: /* LD A, B */
+    case 0x79: /* LD A, C */
+    case 0x7A: /* LD A, D */
+    case 0x7B: /* LD A, E */
+    case 0x7C: /* LD A, H */
+    case 0x7D: /* LD A, L */
+      info->cycles = 4;
+      return true;
+
+    case 0x81: /* ADD A, C */
+    case 0x91: /* SUB C */
+    case 0xB9: /* CP C */
+      info->cycles = 4;
+      info->flags_written = FLAGS_Z | FLAGS_C;
+      return true;
+
+    case 0xC6: /* ADD A, d8 */
+    case 0xD6: /* SUB d8 */
+      info->cycles = 8;
+      info->flags_written = FLAGS_Z | FLAGS_C;
+      return true;
+
+    case 0xCE: /* ADC A, d8 */
+      info->cycles = 8;
+      info->flags_read = FLAGS_C;
+      info->flags_written = FLAGS_Z | FLAGS_C;
+      return true;
+
+    case 0xFE: /* CP d8 */
+      info->cycles = 8;
+      info->flags_written = FLAGS_Z | FLAGS_C;
+      return true;
+
+    case 0xA9: /* XOR C */
+    case 0xB1: /* OR C */
+    case 0xB7: /* OR A */
+      info->cycles = 4;
+      info->flags_written = FLAGS_ALL;
+      return true;
+
+    case 0xE6: /* AND d8 */
+    case 0xEE: /* XOR d8 */
+      info->cycles = 8;
+      info->flags_written = FLAGS_ALL;
+      return true;
+
+    case 0xC2: /* JP NZ, a16 */
+    case 0xCA: /* JP Z, a16 */
+      info->cycles = 12;
+      info->flags_read = FLAGS_Z;
+      return true;
+
+    case 0xC3: /* JP a16 */
+      info->cycles = 16;
+      return true;
+
+    case 0xE9: /* JP HL */
+      info->cycles = 4;
+      return true;
+
+    case 0xCB:
+      switch (insn->operand & 0xFF) {
+        case 0x19: /* RR C */
+        case 0x1A: /* RR D */
+          info->cycles = 8;
+          info->flags_read = FLAGS_C;
+          info->flags_written = FLAGS_Z | FLAGS_C;
+          return true;
+
+        case 0x38: /* SRL B */
+          info->cycles = 8;
+          info->flags_written = FLAGS_Z | FLAGS_C;
+          return true;
+
+        default:
+          return false;
+      }
+
+    default:
+      return false;
+  }
+}
+
+static void emit8(struct emitter* const e, const unsigned int byte) {
+  *e->cur++ = (uint8_t)byte;
+}
+
+static void emit16(struct emitter* const e, const unsigned int value) {
+  emit8(e, value & 0xFF);
+  emit8(e, (value >> 8) & 0xFF);
+}
+
+static void emit32(struct emitter* const e, const unsigned long value) {
+  emit16(e, (unsigned int)(value & 0xFFFF));
+  emit16(e, (unsigned int)((value >> 16) & 0xFFFF));
+}
+
+/* Emits a REX prefix if either operand is one of R8-R15, or if \p force is set,
+ * which is needed to address the low byte of ESI or EDI. */
+static void emit_rex(struct emitter* const e, const unsigned int reg,
+                     const unsigned int rm, const bool force) {
+  const unsigned int rex =
+      0x40 | ((reg >= HOST_R8D) ? 0x04 : 0x00) | ((rm >= HOST_R8D) ? 0x01 : 0);
+
+  if ((rex != 0x40) || force) {
+    emit8(e, rex);
+  }
+}
+
+/* <op> dst, src */
+static void emit_rr(struct emitter* const e, const enum host_rr_opcode opcode,
+                    const unsigned int dst, const unsigned int src) {
+  emit_rex(e, src, dst, false);
+  emit8(e, opcode);
+  emit8(e, 0xC0 | ((src & 7) << 3) | (dst & 7));
+}
+
+/* <op> dst, imm32 */
+static void emit_ri(struct emitter* const e,
+                    const enum host_opcode_extension ext,
+                    const unsigned int dst, const unsigned long imm) {
+  emit_rex(e, 0, dst, false);
+  emit8(e, 0x81);
+  emit8(e, 0xC0 | (ext << 3) | (dst & 7));
+  emit32(e, imm);
+}
+
+/* shl/shr dst, count */
+static void emit_shift(struct emitter* const e,
+                       const enum host_opcode_extension ext,
+                       const unsigned int dst, const unsigned int count) {
+  emit_rex(e, 0, dst, false);
+  emit8(e, 0xC1);
+  emit8(e, 0xC0 | (ext << 3) | (dst & 7));
+  emit8(e, count);
+}
+
+/* mov dst, imm32 */
+static void emit_mov_ri(struct emitter* const e, const unsigned int dst,
+                        const unsigned long imm) {
+  emit_rex(e, 0, dst, false);
+  emit8(e, 0xB8 + (dst & 7));
+  emit32(e, imm);
+}
+
+/* movzx dst, src8 */
+static void emit_movzx8(struct emitter* const e, const unsigned int dst,
+                        const unsigned int src) {
+  emit_rex(e, dst, src, (src >= 4) && (src < HOST_R8D));
+  emit8(e, 0x0F);
+  emit8(e, 0xB6);
+  emit8(e, 0xC0 | ((dst & 7) << 3) | (src & 7));
+}
+
+/* set<cc> dst8, where dst is one of EAX, ECX or EDX. */
+static void emit_setcc(struct emitter* const e,
+                       const enum host_condition condition,
+                       const unsigned int dst) {
+  emit8(e, 0x0F);
+  emit8(e, 0x90 | condition);
+  emit8(e, 0xC0 | dst);
+}
+
+/* test al, al */
+static void emit_test_al(struct emitter* const e) {
+  emit8(e, 0x84);
+  emit8(e, 0xC0);
+}
+
+/* movzx dst, word [rdi + offset] */
+static void emit_load_pair(struct emitter* const e, const unsigned int dst,
+                           const size_t offset) {
+  emit_rex(e, dst, 0, false);
+  emit8(e, 0x0F);
+  emit8(e, 0xB7);
+  emit8(e, 0x80 | ((dst & 7) << 3) | HOST_EDI);
+  emit32(e, offset);
+}
+
+/* mov word [rdi + offset], src16 */
+static void emit_store_pair(struct emitter* const e, const size_t offset,
+                            const unsigned int src) {
+  emit8(e, 0x66);
+  emit_rex(e, src, 0, false);
+  emit8(e, 0x89);
+  emit8(e, 0x80 | ((src & 7) << 3) | HOST_EDI);
+  emit32(e, offset);
+}
+
+/* Sets the program counter and returns the cycles taken from the block. */
+static void emit_exit(struct emitter* const e, const unsigned int pc,
+                      const unsigned int cycles) {
+  /* mov word [rdi + pc], imm16 */
+  emit8(e, 0x66);
+  emit8(e, 0xC7);
+  emit8(e, 0x80 | HOST_EDI);
+  emit32(e, REGISTER_OFFSET(pc));
+  emit16(e, pc);
+
+  emit_mov_ri(e, HOST_EAX, cycles);
+  emit8(e, 0xC3); /* ret */
+}
+
+/* The host register holding an 8-bit register, and whether it's the high
+ * byte. */
+static unsigned int host_pair_of(const unsigned int reg, bool* const high) {
+  static const uint8_t pairs[8] = {HOST_BC, HOST_BC, HOST_DE, HOST_DE,
+                                   HOST_HL, HOST_HL, 0,       HOST_AF};
+
+  *high = (reg % 2 == 0) || (reg == REG_A);
+  return pairs[reg];
+}
+
+/* Loads an 8-bit register into \p dst, zero extended. */
+static void emit_load_reg(struct emitter* const e, const unsigned int dst,
+                          const unsigned int reg) {
+  bool high;
+  const unsigned int pair = host_pair_of(reg, &high);
+
+  if (high) {
+    emit_rr(e, RR_MOV, dst, pair);
+    emit_shift(e, EXT_SHR, dst, 8);
+  } else {
+    emit_movzx8(e, dst, pair);
+  }
+}
+
+/* Stores \p src, which must be zero extended, into an 8-bit register. \p src
+ * is clobbered, as are the host flags. */
+static void emit_store_reg(struct emitter* const e, const unsigned int reg,
+                           const unsigned int src) {
+  bool high;
+  const unsigned int pair = host_pair_of(reg, &high);
+
+  if (high) {
+    emit_shift(e, EXT_SHL, src, 8);
+    emit_ri(e, EXT_AND, pair, 0x00FF);
+  } else {
+    emit_ri(e, EXT_AND, pair, 0xFF00);
+  }
+  emit_rr(e, RR_OR, pair, src);
+}
+
+/* Moves a flag, held as 0 or 1 in the low byte of \p src, into F. */
+static void emit_merge_flag(struct emitter* const e, const unsigned int src,
+                            const unsigned int bit) {
+  emit_movzx8(e, src, src);
+  emit_shift(e, EXT_SHL, src, bit);
+  emit_ri(e, EXT_AND, HOST_AF, ~(1UL << bit) & 0xFFFFFFFFUL);
+  emit_rr(e, RR_OR, HOST_AF, src);
+}
+
+/* Replaces F as a whole with \p rest, plus Z if the low byte of ECX is 1. */
+static void emit_replace_flags(struct emitter* const e,
+                               const unsigned long rest) {
+  emit_movzx8(e, HOST_ECX, HOST_ECX);
+  emit_shift(e, EXT_SHL, HOST_ECX, FLAG_BIT_Z);
+
+  if (rest != 0) {
+    emit_ri(e, EXT_OR, HOST_ECX, rest);
+  }
+  emit_ri(e, EXT_AND, HOST_AF, 0xFF00);
+  emit_rr(e, RR_OR, HOST_AF, HOST_ECX);
+}
+
+/* Rotates the register in EAX right through the carry flag, leaving the old
+ * bit 0 in the low byte of EDX if \p live includes C. */
+static void emit_rotate_right(struct emitter* const e,
+                              const unsigned int live) {
+  emit_rr(e, RR_MOV, HOST_ECX, HOST_AF);
+  emit_ri(e, EXT_AND, HOST_ECX, 1UL << FLAG_BIT_C);
+  emit_shift(e, EXT_SHL, HOST_ECX, 7 - FLAG_BIT_C);
+  emit_shift(e, EXT_SHR, HOST_EAX, 1);
+
+  if (live & FLAGS_C) {
+    emit_setcc(e, CC_B, HOST_EDX);
+  }
+  emit_rr(e, RR_OR, HOST_EAX, HOST_ECX);
+}
+
+/* Emits the code for an instruction, other than any change of the program
+ * counter. \p live is the set of flags which may be looked at afterwards. */
+static void emit_instruction(
+    struct emitter* const e,
+    const struct libyagbe_cpu_decoded_instruction* const insn,
+    const unsigned int live) {
+  static const uint8_t pairs[4] = {HOST_BC, HOST_DE, HOST_HL, HOST_SP};
+  const unsigned int opcode = insn->opcode;
+
+  switch (opcode) {
+    case 0x01: /* LD rr, d16 */
+    case 0x11:
+    case 0x21:
+    case 0x31:
+      emit_mov_ri(e, pairs[opcode >> 4], insn->operand);
+      return;
+
+    case 0x03: /* INC rr */
+    case 0x13:
+    case 0x23:
+      emit_ri(e, EXT_ADD, pairs[opcode >> 4], 1);
+      emit_ri(e, EXT_AND, pairs[opcode >> 4], 0xFFFF);
+      return;
+
+    case 0x04: /* INC r */
+    case 0x14:
+    case 0x1C:
+    case 0x24:
+    case 0x2C:
+    case 0x05: /* DEC r */
+    case 0x0D:
+    case 0x1D:
+    case 0x25:
+    case 0x2D:
+    case 0x3D:
+      emit_load_reg(e, HOST_EAX, opcode >> 3);
+
+      /* inc al / dec al */
+      emit8(e, 0xFE);
+      emit8(e, ((opcode & 7) == 4) ? 0xC0 : 0xC8);
+
+      if (live & FLAGS_Z) {
+        emit_setcc(e, CC_Z, HOST_ECX);
+      }
+      emit_store_reg(e, opcode >> 3, HOST_EAX);
+
+      if (live & FLAGS_Z) {
+        emit_merge_flag(e, HOST_ECX, FLAG_BIT_Z);
+      }
+      return;
+
+    case 0x06: /* LD r, d8 */
+    case 0x0E:
+    case 0x26:
+    case 0x3E:
+      emit_mov_ri(e, HOST_EAX, insn->operand & 0xFF);
+      emit_store_reg(e, opcode >> 3, HOST_EAX);
+      return;
+
+    case 0x1F: /* RRA */
+      emit_load_reg(e, HOST_EAX, REG_A);
+      emit_rotate_right(e, live);
+      emit_store_reg(e, REG_A, HOST_EAX);
+
+      if (live & FLAGS_Z) {
+        emit_ri(e, EXT_AND, HOST_AF, ~(1UL << FLAG_BIT_Z) & 0xFFFFFFFFUL);
+      }
+
+      if (live & FLAGS_C) {
+        emit_merge_flag(e, HOST_EDX, FLAG_BIT_C);
+      }
+      return;
+
+    case 0x29: /* ADD HL, HL */
+      emit_rr(e, RR_ADD, HOST_HL, HOST_HL);
+
+      if (live & FLAGS_C) {
+        emit_ri(e, EXT_CMP, HOST_HL, 0xFFFF);
+        emit_setcc(e, CC_A, HOST_EDX);
+      }
+      emit_ri(e, EXT_AND, HOST_HL, 0xFFFF);
+
+      if (live & FLAGS_C) {
+        emit_merge_flag(e, HOST_EDX, FLAG_BIT_C);
+      }
+      return;
+
+    case 0x81: /* ADD A, r */
+    case 0x91: /* SUB r */
+    case 0xB9: /* CP r */
+    case 0xC6: /* ADD A, d8 */
+    case 0xD6: /* SUB d8 */
+    case 0xCE: /* ADC A, d8 */
+    case 0xFE: /* CP d8 */
+      emit_load_reg(e, HOST_EAX, REG_A);
+
+      if (opcode >= 0xC0) {
+        emit_mov_ri(e, HOST_ECX, insn->operand & 0xFF);
+      } else {
+        emit_load_reg(e, HOST_ECX, opcode & 7);
+      }
+
+      if (opcode == 0xCE) {
+        emit_rr(e, RR_MOV, HOST_EDX, HOST_AF);
+        emit_shift(e, EXT_SHR, HOST_EDX, FLAG_BIT_C);
+        emit_ri(e, EXT_AND, HOST_EDX, 1);
+        emit_rr(e, RR_ADD, HOST_ECX, HOST_EDX);
+      }
+
+      /* The carry falls out of the full width result, as in alu_add() and
+       * alu_sub(). */
+      if ((opcode == 0x81) || (opcode == 0xC6) || (opcode == 0xCE)) {
+        emit_rr(e, RR_ADD, HOST_EAX, HOST_ECX);
+
+        if (live & FLAGS_C) {
+          emit_ri(e, EXT_CMP, HOST_EAX, 0xFF);
+          emit_setcc(e, CC_A, HOST_EDX);
+        }
+      } else {
+        emit_rr(e, RR_SUB, HOST_EAX, HOST_ECX);
+
+        if (live & FLAGS_C) {
+          emit_setcc(e, CC_B, HOST_EDX);
+        }
+      }
+
+      if (live & FLAGS_Z) {
+        emit_test_al(e);
+        emit_setcc(e, CC_Z, HOST_ECX);
+      }
+
+      if ((opcode != 0xB9) && (opcode != 0xFE)) {
+        emit_movzx8(e, HOST_EAX, HOST_EAX);
+        emit_store_reg(e, REG_A, HOST_EAX);
+      }
+
+      if (live & FLAGS_Z) {
+        emit_merge_flag(e, HOST_ECX, FLAG_BIT_Z);
+      }
+
+      if (live & FLAGS_C) {
+        emit_merge_flag(e, HOST_EDX, FLAG_BIT_C);
+      }
+      return;
+
+    case 0xA9: /* XOR r */
+    case 0xB1: /* OR r */
+    case 0xB7:
+    case 0xE6: /* AND d8 */
+    case 0xEE: /* XOR d8 */
+      emit_load_reg(e, HOST_EAX, REG_A);
+
+      if (opcode >= 0xC0) {
+        emit_mov_ri(e, HOST_ECX, insn->operand & 0xFF);
+      } else {
+        emit_load_reg(e, HOST_ECX, opcode & 7);
+      }
+
+      if (opcode == 0xE6) {
+        emit_rr(e, RR_AND, HOST_EAX, HOST_ECX);
+      } else if ((opcode == 0xA9) || (opcode == 0xEE)) {
+        emit_rr(e, RR_XOR, HOST_EAX, HOST_ECX);
+      } else {
+        emit_rr(e, RR_OR, HOST_EAX, HOST_ECX);
+      }
+
+      if (live & FLAGS_ALL) {
+        emit_test_al(e);
+        emit_setcc(e, CC_Z, HOST_ECX);
+      }
+      emit_store_reg(e, REG_A, HOST_EAX);
+
+      /* AND also sets H, which isn't modelled otherwise. */
+      if (live & FLAGS_ALL) {
+        emit_replace_flags(e, (opcode == 0xE6) ? 0x20 : 0x00);
+      }
+      return;
+
+    case 0x47: /* LD r, A */
+    case 0x4F:
+    case 0x57:
+    case 0x5F:
+    case 0x67:
+    case 0x6F:
+    case 0x78: /* LD A, r */
+    case 0x79:
+    case 0x7A:
+    case 0x7B:
+    case 0x7C:
+    case 0x7D:
+      emit_load_reg(e, HOST_EAX, opcode & 7);
+      emit_store_reg(e, (opcode >> 3) & 7, HOST_EAX);
+      return;
+
+    case 0xCB:
+      if ((insn->operand & 0xFF) == 0x38) { /* SRL B */
+        emit_load_reg(e, HOST_EAX, REG_B);
+        emit_shift(e, EXT_SHR, HOST_EAX, 1);
+        emit_setcc(e, CC_B, HOST_EDX);
+        emit_setcc(e, CC_Z, HOST_ECX);
+        emit_store_reg(e, REG_B, HOST_EAX);
+      } else { /* RR r */
+        const unsigned int reg = insn->operand & 7;
+
+        emit_load_reg(e, HOST_EAX, reg);
+        emit_rotate_right(e, live);
+        emit_test_al(e);
+        emit_setcc(e, CC_Z, HOST_ECX);
+        emit_store_reg(e, reg, HOST_EAX);
+      }
+
+      if (live & FLAGS_Z) {
+        emit_merge_flag(e, HOST_ECX, FLAG_BIT_Z);
+      }
+
+      if (live & FLAGS_C) {
+        emit_merge_flag(e, HOST_EDX, FLAG_BIT_C);
+      }
+      return;
+
+    default:
+      /* NOP, DI and the jumps, which are taken care of when the block
+       * exits. */
+      return;
+  }
+}
+
+/* Writes the registers back and leaves the block through its last
+ * instruction. */
+static void emit_epilogue(
+    struct emitter* const e, const struct libyagbe_cpu_block* const block,
+    const struct libyagbe_cpu_decoded_instruction* const last,
+    const unsigned int cycles) {
+  const unsigned int next = (block->pc + block->size) & 0xFFFF;
+  const unsigned int relative =
+      (next + (unsigned int)(int8_t)(last->operand & 0xFF)) & 0xFFFF;
+
+  emit_store_pair(e, REGISTER_OFFSET(af), HOST_AF);
+  emit_store_pair(e, REGISTER_OFFSET(bc), HOST_BC);
+  emit_store_pair(e, REGISTER_OFFSET(de), HOST_DE);
+  emit_store_pair(e, REGISTER_OFFSET(hl), HOST_HL);
+  emit_store_pair(e, REGISTER_OFFSET(sp), HOST_SP);
+
+  switch (last->opcode) {
+    case 0x18: /* JR s8 */
+      emit_exit(e, relative, cycles);
+      return;
+
+    case 0xC3: /* JP a16 */
+      emit_exit(e, last->operand, cycles);
+      return;
+
+    case 0xE9: /* JP HL */
+      emit_store_pair(e, REGISTER_OFFSET(pc), HOST_HL);
+      emit_mov_ri(e, HOST_EAX, cycles);
+      emit8(e, 0xC3); /* ret */
+      return;
+
+    case 0x20: /* JR cc, s8 */
+    case 0x28:
+    case 0x30:
+    case 0x38:
+    case 0xC2: /* JP cc, a16 */
+    case 0xCA: {
+      const bool jr = last->opcode < 0xC0;
+      const unsigned int bit =
+          ((last->opcode & 0xF0) == 0x30) ? FLAG_BIT_C : FLAG_BIT_Z;
+      uint8_t* branch;
+
+      /* test r8d, imm32 */
+      emit_rex(e, 0, HOST_AF, false);
+      emit8(e, 0xF7);
+      emit8(e, 0xC0 | (HOST_AF & 7));
+      emit32(e, 1UL << bit);
+
+      /* Jump if the flag is set for Z and C, or clear for NZ and NC. */
+      emit8(e, 0x70 | ((last->opcode & 0x08) ? CC_NZ : CC_Z));
+      branch = e->cur;
+      emit8(e, 0);
+
+      emit_exit(e, next, cycles);
+      *branch = (uint8_t)(e->cur - branch - 1);
+      emit_exit(e, jr ? relative : last->operand, cycles + 4);
+      return;
+    }
+
+    default:
+      emit_exit(e, next, cycles);
+      return;
+  }
+}
+
+/* Makes sure there's room for another block in the code buffer. */
+static bool reserve_code(struct libyagbe_gb* const gb) {
+  struct libyagbe_cpu_jit* const jit = &gb->cpu.jit;
+  unsigned int index;
+
+  if (jit->code == NULL) {
+    void* const code = mmap(NULL, CODE_BUFFER_SIZE, PROT_READ | PROT_EXEC,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (code == MAP_FAILED) {
+      LOG_WARNING((gb, "Unable to allocate memory for the JIT compiler."));
+      return false;
+    }
+
+    jit->code = code;
+    jit->code_size = CODE_BUFFER_SIZE;
+    jit->code_used = 0;
+  }
+
+  if ((jit->code_size - jit->code_used) < MAX_BLOCK_CODE_SIZE) {
+    LOG_INFO((gb, "JIT code buffer full, discarding compiled blocks."));
+    libyagbe_jit_reset(gb);
+
+    for (index = 0; index < LIBYAGBE_CPU_BLOCK_COUNT; ++index) {
+      gb->cpu.block_cache->blocks[index].native = NULL;
+      gb->cpu.block_cache->blocks[index].runs = 0;
+    }
+  }
+  return true;
+}
+
+libyagbe_cpu_native_block libyagbe_jit_compile(
+    struct libyagbe_gb* const gb,
+    const struct libyagbe_cpu_block* const block) {
+  struct libyagbe_cpu_jit* const jit = &gb->cpu.jit;
+  unsigned int live[LIBYAGBE_CPU_BLOCK_MAX_INSTRUCTIONS];
+  unsigned int live_flags = FLAGS_ALL;
+  unsigned int cycles = 0;
+  unsigned int index;
+  struct emitter e;
+  uint8_t* entry;
+  libyagbe_cpu_native_block native;
+
+  /* Working backwards, a flag is live after an instruction if a later one
+   * reads it before anything overwrites it. */
+  for (index = block->instruction_count; index-- > 0;) {
+    struct op_info info;
+
+    if (!describe(&block->instructions[index], &info)) {
+      return NULL;
+    }
+
+    live[index] = live_flags;
+    live_flags = (live_flags & ~info.flags_written) | info.flags_read;
+    cycles += info.cycles;
+  }
+
+  if (!reserve_code(gb)) {
+    return NULL;
+  }
+
+  /* The buffer is never writable and executable at the same time. */
+  if (mprotect(jit->code, jit->code_size, PROT_READ | PROT_WRITE) != 0) {
+    return NULL;
+  }
+
+  entry = &jit->code[jit->code_used];
+  e.cur = entry;
+
+  emit_load_pair(&e, HOST_AF, REGISTER_OFFSET(af));
+  emit_load_pair(&e, HOST_BC, REGISTER_OFFSET(bc));
+  emit_load_pair(&e, HOST_DE, REGISTER_OFFSET(de));
+  emit_load_pair(&e, HOST_HL, REGISTER_OFFSET(hl));
+  emit_load_pair(&e, HOST_SP, REGISTER_OFFSET(sp));
+
+  for (index = 0; index < block->instruction_count; ++index) {
+    emit_instruction(&e, &block->instructions[index], live[index]);
+  }
+
+  emit_epilogue(&e, block,
+                &block->instructions[block->instruction_count - 1], cycles);
+
+  if (mprotect(jit->code, jit->code_size, PROT_READ | PROT_EXEC) != 0) {
+    return NULL;
+  }
+
+  /* ISO C has no conversion between object and function pointers, but POSIX
+   * guarantees they're the same size. */
+  memcpy(&native, &entry, sizeof(native));
+
+  jit->code_used = (size_t)(e.cur - jit->code);
+  return native;
+}
+
+void libyagbe_jit_reset(struct libyagbe_gb* const gb) {
+  gb->cpu.jit.code_used = 0;
+}
+
+void libyagbe_jit_release(struct libyagbe_gb* const gb) {
+  if (gb->cpu.jit.code != NULL) {
+    munmap(gb->cpu.jit.code, gb->cpu.jit.code_size);
+    gb->cpu.jit.code = NULL;
+  }
+}
@@ -0,0 +1,233 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/output.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "atomic.h"
+#include "libyagbe/apu.h"
+#include "libyagbe/gb.h"
+#include "libyagbe/ppu.h"
+
+/* The clock rate in Hz. */
+#define CLOCK_RATE 4194304UL
+
+/* Returns how many cycles a number of samples last. This is split up so that
+ * nothing overflows even where unsigned long is 32 bits wide. */
+static uintmax_t get_sample_cycles(const size_t count,
+                                   const unsigned long sample_rate) {
+  return ((uintmax_t)count * (CLOCK_RATE / sample_rate)) +
+         (((uintmax_t)count * (CLOCK_RATE % sample_rate)) / sample_rate);
+}
+
+/* Swaps the framebuffer in the middle for another one, returning the one
+ * that was there. */
+static unsigned int swap_middle(struct libyagbe_output* const output,
+                                const unsigned int index) {
+#ifdef LIBYAGBE_HAVE_ATOMICS
+  return ATOMIC_EXCHANGE_ACQ_REL(&output->middle, index);
+#else
+  const unsigned int previous = output->middle;
+
+  output->middle = index;
+  return previous;
+#endif /* LIBYAGBE_HAVE_ATOMICS */
+}
+
+int libyagbe_output_set_video(
+    struct libyagbe_gb* const gb, void* const framebuffers,
+    const enum libyagbe_ppu_pixel_formats pixel_format, const size_t pitch) {
+  struct libyagbe_output* const output = &gb->output;
+  unsigned int i;
+
+#ifndef LIBYAGBE_HAVE_ATOMICS
+  if (framebuffers != NULL) {
+    return 0;
+  }
+#endif /* LIBYAGBE_HAVE_ATOMICS */
+
+  libyagbe_ppu_set_framebuffer(gb, framebuffers, pixel_format, pitch);
+
+  for (i = 0; i < LIBYAGBE_OUTPUT_FRAME_COUNT; ++i) {
+    output->frames[i] =
+        (framebuffers != NULL)
+            ? (uint8_t*)framebuffers +
+                  (i * gb->ppu.pitch * LIBYAGBE_PPU_SCREEN_HEIGHT)
+            : NULL;
+    output->frame_timestamps[i] = 0;
+  }
+
+  output->back = 0;
+  output->middle = 1;
+  output->front = 2;
+  output->front_valid = 0;
+  output->frames_skipped = 0;
+
+  return 1;
+}
+
+void libyagbe_output_release(struct libyagbe_gb* const gb) {
+  free(gb->output.audio_blocks);
+  gb->output.audio_blocks = NULL;
+}
+
+int libyagbe_output_set_audio(struct libyagbe_gb* const gb,
+                              const unsigned long sample_rate) {
+  struct libyagbe_output* const output = &gb->output;
+
+#ifndef LIBYAGBE_HAVE_ATOMICS
+  if (sample_rate != 0) {
+    return 0;
+  }
+#endif /* LIBYAGBE_HAVE_ATOMICS */
+
+  if ((sample_rate != 0) && (output->audio_blocks == NULL)) {
+    output->audio_blocks =
+        malloc(LIBYAGBE_OUTPUT_AUDIO_BLOCK_COUNT *
+               sizeof(struct libyagbe_output_audio_block));
+
+    if (output->audio_blocks == NULL) {
+      return 0;
+    }
+  }
+
+  if (!libyagbe_apu_set_sample_rate(gb, sample_rate)) {
+    return 0;
+  }
+
+  output->audio_head = 0;
+  output->audio_tail = 0;
+  output->audio_offset = 0;
+  output->sample_rate = sample_rate;
+
+  return 1;
+}
+
+const void* libyagbe_output_acquire_frame(struct libyagbe_gb* const gb,
+                                          uintmax_t* const timestamp) {
+  struct libyagbe_output* const output = &gb->output;
+
+  /* Only the emulation thread sets the flag, so if it's set it stays set
+   * until the swap below. */
+  if ((ATOMIC_LOAD_RELAXED(&output->middle) & LIBYAGBE_OUTPUT_FRAME_FRESH) !=
+      0) {
+    output->front = swap_middle(output, output->front) &
+                    ~LIBYAGBE_OUTPUT_FRAME_FRESH;
+    output->front_valid = 1;
+  }
+
+  if (!output->front_valid) {
+    return NULL;
+  }
+
+  if (timestamp != NULL) {
+    *timestamp = output->frame_timestamps[output->front];
+  }
+  return output->frames[output->front];
+}
+
+size_t libyagbe_output_read_samples(struct libyagbe_gb* const gb,
+                                    int16_t* const samples, const size_t count,
+                                    uintmax_t* const timestamp) {
+  struct libyagbe_output* const output = &gb->output;
+  const unsigned long head = ATOMIC_LOAD_ACQUIRE(&output->audio_head);
+  unsigned long tail = output->audio_tail;
+  size_t num_read = 0;
+
+  while ((num_read < count) && (tail != head)) {
+    const struct libyagbe_output_audio_block* const block =
+        &output->audio_blocks[tail & (LIBYAGBE_OUTPUT_AUDIO_BLOCK_COUNT - 1)];
+    size_t length = block->count - output->audio_offset;
+
+    if (length > (count - num_read)) {
+      length = count - num_read;
+    }
+
+    if ((num_read == 0) && (timestamp != NULL)) {
+      *timestamp = block->timestamp + get_sample_cycles(output->audio_offset,
+                                                        output->sample_rate);
+    }
+
+    memcpy(&samples[num_read * 2], &block->samples[output->audio_offset * 2],
+           length * 2 * sizeof(samples[0]));
+
+    num_read += length;
+    output->audio_offset += length;
+
+    if (output->audio_offset == block->count) {
+      output->audio_offset = 0;
+
+      /* Hand the block back to the emulation thread. */
+      ATOMIC_STORE_RELEASE(&output->audio_tail, ++tail);
+    }
+  }
+  return num_read;
+}
+
+void libyagbe_output_handle_frame(struct libyagbe_gb* const gb) {
+  struct libyagbe_output* const output = &gb->output;
+  unsigned int previous;
+
+  if (output->frames[0] == NULL) {
+    return;
+  }
+
+  output->frame_timestamps[output->back] = gb->scheduler.timestamp_now;
+
+  previous = swap_middle(output, output->back | LIBYAGBE_OUTPUT_FRAME_FRESH);
+
+  if ((previous & LIBYAGBE_OUTPUT_FRAME_FRESH) != 0) {
+    ATOMIC_STORE_RELEASE(&output->frames_skipped, output->frames_skipped + 1);
+  }
+
+  /* Whichever frame the host isn't presenting is drawn into next. */
+  output->back = previous & ~LIBYAGBE_OUTPUT_FRAME_FRESH;
+  gb->ppu.framebuffer = output->frames[output->back];
+}
+
+void libyagbe_output_handle_samples(struct libyagbe_gb* const gb) {
+  struct libyagbe_output* const output = &gb->output;
+  unsigned long head = output->audio_head;
+
+  if (output->sample_rate == 0) {
+    return;
+  }
+
+  /* Acquiring the tail makes sure the host is done with a block before it's
+   * overwritten. */
+  while ((head - ATOMIC_LOAD_ACQUIRE(&output->audio_tail)) !=
+         LIBYAGBE_OUTPUT_AUDIO_BLOCK_COUNT) {
+    struct libyagbe_output_audio_block* const block =
+        &output->audio_blocks[head & (LIBYAGBE_OUTPUT_AUDIO_BLOCK_COUNT - 1)];
+
+    block->count = libyagbe_apu_read_samples(gb, block->samples,
+                                             LIBYAGBE_OUTPUT_AUDIO_BLOCK_SIZE);
+
+    if (block->count == 0) {
+      break;
+    }
+
+    /* The APU has caught up to now, so the samples it has left come right
+     * before now. */
+    block->timestamp =
+        gb->scheduler.timestamp_now -
+        get_sample_cycles(block->count + gb->apu.samples_available,
+                          output->sample_rate);
+
+    ATOMIC_STORE_RELEASE(&output->audio_head, ++head);
+  }
+}
@@ -13,4 +13,649 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include "libyagbe/ppu.h"
\ No newline at end of file
+#include "libyagbe/ppu.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cow.h"
+#include "debug/log.h"
+#include "libyagbe/bus.h"
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/gb.h"
+#include "libyagbe/output.h"
+#include "libyagbe/scheduler.h"
+#include "ppu_simd.h"
+#include "utility.h"
+
+/* The length of each mode in cycles. How long drawing takes actually depends
+ * on what's being drawn, which isn't modeled; HBlank makes up the rest of the
+ * line either way. VBlank lasts a whole line at a time. */
+enum mode_lengths {
+  OAM_SCAN_LENGTH = 80,
+  DRAWING_LENGTH = 172,
+  HBLANK_LENGTH = 204,
+  LINE_LENGTH = 456
+};
+
+/* The number of lines in a frame, including those in VBlank. */
+enum frame_sizes { LINE_COUNT = 154 };
+
+/* OAM holds 40 sprites of 4 bytes each, but only the first 10 found on a line
+ * are drawn. */
+enum sprite_limits { SPRITE_COUNT = 40, SPRITES_PER_LINE = 10 };
+
+enum sprite_attribute_bits {
+  SPRITE_PALETTE = 4,
+  SPRITE_X_FLIP = 5,
+  SPRITE_Y_FLIP = 6,
+  SPRITE_BEHIND_BG = 7
+};
+
+/* The window is drawn from this far to the left of WX. */
+#define WINDOW_X_OFFSET 7
+
+static const uint32_t default_rgba_colors[4] = {0xFFFFFFFF, 0xAAAAAAFF,
+                                                0x555555FF, 0x000000FF};
+
+static bool lcd_is_enabled(const struct libyagbe_ppu* const ppu) {
+  return BIT_IS_SET(ppu->lcdc, LIBYAGBE_PPU_LCDC_LCD_ENABLED);
+}
+
+/* Requests the STAT interrupt if one of the selected sources just became
+ * active. */
+static void update_stat_line(struct libyagbe_gb* const gb) {
+  struct libyagbe_ppu* const ppu = &gb->ppu;
+  uint8_t stat_line = false;
+
+  if (lcd_is_enabled(ppu)) {
+    /* The interrupt select bits for modes 0 through 2 are in mode order. */
+    stat_line = (BIT_IS_SET(ppu->stat, LIBYAGBE_PPU_STAT_LYC_INT) &&
+                 (ppu->ly == ppu->lyc)) ||
+                ((ppu->mode != LIBYAGBE_PPU_MODE_DRAWING) &&
+                 BIT_IS_SET(ppu->stat,
+                            (LIBYAGBE_PPU_STAT_HBLANK_INT + ppu->mode)));
+  }
+
+  if (stat_line && !ppu->stat_line) {
+    libyagbe_bus_set_interrupt(gb, LIBYAGBE_BUS_IF_LCD_STAT);
+  }
+  ppu->stat_line = stat_line;
+}
+
+static void enter_mode(struct libyagbe_gb* const gb,
+                       const enum libyagbe_ppu_modes mode,
+                       const unsigned int length) {
+  gb->ppu.mode = mode;
+
+  libyagbe_scheduler_schedule_event(gb, LIBYAGBE_SCHEDULER_EVENT_PPU_MODE_END,
+                                    gb->scheduler.timestamp_now + length);
+  update_stat_line(gb);
+}
+
+static void start_frame(struct libyagbe_gb* const gb) {
+  struct libyagbe_ppu* const ppu = &gb->ppu;
+
+  ppu->ly = 0;
+  ppu->window_line = 0;
+
+  switch (ppu->render_mode) {
+    case LIBYAGBE_PPU_RENDER_EVERY_NTH:
+      ppu->frame_drawn = (ppu->frame_count % ppu->frame_interval) == 0;
+      break;
+
+    case LIBYAGBE_PPU_RENDER_NONE:
+      ppu->frame_drawn = false;
+      break;
+
+    default:
+      ppu->frame_drawn = true;
+      break;
+  }
+  ppu->frame_count++;
+
+  enter_mode(gb, LIBYAGBE_PPU_MODE_OAM_SCAN, OAM_SCAN_LENGTH);
+}
+
+/* Decodes the tiles written to since they were last drawn, making room for
+ * them first if nothing was drawn yet. Returns false if out of memory. */
+static bool update_tiles(struct libyagbe_ppu* const ppu) {
+  unsigned int index;
+  unsigned int tile;
+
+  if (ppu->tiles == NULL) {
+    ppu->tiles = malloc(LIBYAGBE_PPU_TILE_COUNT * sizeof(ppu->tiles[0]));
+
+    if (ppu->tiles == NULL) {
+      return false;
+    }
+    memset(ppu->dirty_tiles, 0xFF, sizeof(ppu->dirty_tiles));
+    ppu->tiles_dirty = true;
+  }
+
+  if (!ppu->tiles_dirty) {
+    return true;
+  }
+
+  for (index = 0; index < sizeof(ppu->dirty_tiles); ++index) {
+    for (tile = index * 8; ppu->dirty_tiles[index] != 0; ++tile) {
+      if (ppu->dirty_tiles[index] & 1) {
+        libyagbe_ppu_simd_decode_tile(
+            &ppu->vram[tile * LIBYAGBE_PPU_TILE_SIZE], ppu->tiles[tile]);
+      }
+      ppu->dirty_tiles[index] >>= 1;
+    }
+  }
+  ppu->tiles_dirty = false;
+
+  return true;
+}
+
+/* BG and window tiles are either numbered up from $8000, or both ways from
+ * $9000, reaching down to $8800. */
+static unsigned int get_bg_tile(const struct libyagbe_ppu* const ppu,
+                                const uint8_t tile) {
+  if (BIT_IS_SET(ppu->lcdc, LIBYAGBE_PPU_LCDC_TILE_DATA) || (tile >= 0x80)) {
+    return tile;
+  }
+  return tile + 0x100;
+}
+
+/* Fetches the color numbers of a line of a tile map from pixel \p x to the
+ * right edge of the screen. Tile maps are 256x256 pixels and wrap around. */
+static void fetch_tile_map_line(const struct libyagbe_ppu* const ppu,
+                                uint8_t* const colors, const unsigned int x,
+                                const unsigned int map_offset,
+                                const unsigned int map_x,
+                                const unsigned int map_y) {
+  const unsigned int row_offset = map_offset + ((map_y / 8) * 32);
+  const unsigned int fine_x = map_x % 8;
+  unsigned int tile_x = map_x / 8;
+  unsigned int offset;
+
+  /* Whole rows of tiles are copied, starting with the one the first pixel is
+   * in, so there's room for one more than fits on the screen. */
+  uint8_t pixels[LIBYAGBE_PPU_SCREEN_WIDTH + 8];
+
+  for (offset = 0; offset < (LIBYAGBE_PPU_SCREEN_WIDTH - x) + fine_x;
+       offset += 8, ++tile_x) {
+    const uint8_t* const tile =
+        ppu->tiles[get_bg_tile(ppu, ppu->vram[row_offset + (tile_x % 32)])];
+
+    memcpy(&pixels[offset], &tile[(map_y % 8) * 8], 8);
+  }
+  memcpy(&colors[x], &pixels[fine_x], LIBYAGBE_PPU_SCREEN_WIDTH - x);
+}
+
+static unsigned int get_map_offset(const struct libyagbe_ppu* const ppu,
+                                   const enum libyagbe_ppu_lcdc_bits bit) {
+  return BIT_IS_SET(ppu->lcdc, bit) ? 0x1C00 : 0x1800;
+}
+
+static void draw_sprites(const struct libyagbe_ppu* const ppu,
+                         const uint8_t* const bg_colors,
+                         uint8_t* const shades) {
+  const unsigned int height =
+      BIT_IS_SET(ppu->lcdc, LIBYAGBE_PPU_LCDC_OBJ_TALL) ? 16 : 8;
+  unsigned int found[SPRITES_PER_LINE];
+  unsigned int count = 0;
+  unsigned int index;
+  bool claimed[LIBYAGBE_PPU_SCREEN_WIDTH];
+
+  for (index = 0; (index < SPRITE_COUNT) && (count < SPRITES_PER_LINE);
+       ++index) {
+    /* Sprite Y positions are offset by 16, so that sprites can be partially
+     * off the top of the screen. Those above the line wrap around here. */
+    const unsigned int row = ppu->ly + 16u - ppu->oam[index * 4];
+
+    if (row < height) {
+      found[count++] = index * 4;
+    }
+  }
+
+  /* The sprite furthest to the left wins where sprites overlap, or the one
+   * found first if they're at the same position. */
+  for (index = 1; index < count; ++index) {
+    const unsigned int sprite = found[index];
+    unsigned int slot = index;
+
+    for (; slot > 0; --slot) {
+      if (ppu->oam[found[slot - 1] + 1] <= ppu->oam[sprite + 1]) {
+        break;
+      }
+      found[slot] = found[slot - 1];
+    }
+    found[slot] = sprite;
+  }
+
+  memset(claimed, false, sizeof(claimed));
+
+  for (index = 0; index < count; ++index) {
+    const uint8_t* const sprite = &ppu->oam[found[index]];
+    const uint8_t flags = sprite[3];
+    const uint8_t palette =
+        BIT_IS_SET(flags, SPRITE_PALETTE) ? ppu->obp1 : ppu->obp0;
+    const uint8_t* pixels;
+    unsigned int tile = sprite[2];
+    unsigned int row = ppu->ly + 16u - sprite[0];
+    unsigned int column;
+
+    if (height == 16) {
+      tile &= 0xFE;
+    }
+
+    if (BIT_IS_SET(flags, SPRITE_Y_FLIP)) {
+      row = (height - 1) - row;
+    }
+
+    /* The bottom half of a tall sprite is the tile after the top half. */
+    pixels = &ppu->tiles[tile + (row / 8)][(row % 8) * 8];
+
+    for (column = 0; column < 8; ++column) {
+      /* X positions are offset by 8 the same way. */
+      const unsigned int x = sprite[1] + column - 8u;
+      unsigned int color;
+
+      if ((x >= LIBYAGBE_PPU_SCREEN_WIDTH) || claimed[x]) {
+        continue;
+      }
+
+      color = pixels[BIT_IS_SET(flags, SPRITE_X_FLIP) ? (7 - column) : column];
+
+      /* Color 0 is transparent, letting whatever is underneath through. */
+      if (color == 0) {
+        continue;
+      }
+
+      /* Even when hidden behind the BG, a sprite still covers up any sprites
+       * of lower priority. */
+      claimed[x] = true;
+
+      if (!BIT_IS_SET(flags, SPRITE_BEHIND_BG) || (bg_colors[x] == 0)) {
+        shades[x] = (palette >> (color * 2)) & 0x03;
+      }
+    }
+  }
+}
+
+static void write_line(const struct libyagbe_ppu* const ppu,
+                       const uint8_t* const shades) {
+  uint8_t* const line = (uint8_t*)ppu->framebuffer + (ppu->ly * ppu->pitch);
+
+  switch (ppu->pixel_format) {
+    case LIBYAGBE_PPU_PIXEL_FORMAT_2BPP:
+      libyagbe_ppu_simd_write_2bpp(shades, line);
+      return;
+
+    case LIBYAGBE_PPU_PIXEL_FORMAT_INDEX8:
+      memcpy(line, shades, LIBYAGBE_PPU_SCREEN_WIDTH);
+      return;
+
+    case LIBYAGBE_PPU_PIXEL_FORMAT_RGBA32:
+      libyagbe_ppu_simd_write_rgba32(
+          shades, (uint32_t*)line,
+          (ppu->rgba_colors != NULL) ? ppu->rgba_colors : default_rgba_colors);
+      return;
+
+    default:
+      return;
+  }
+}
+
+static bool window_is_visible(const struct libyagbe_ppu* const ppu) {
+  return BIT_IS_SET(ppu->lcdc, LIBYAGBE_PPU_LCDC_BG_ENABLED) &&
+         BIT_IS_SET(ppu->lcdc, LIBYAGBE_PPU_LCDC_WINDOW_ENABLED) &&
+         (ppu->wy <= ppu->ly) &&
+         (ppu->wx < (LIBYAGBE_PPU_SCREEN_WIDTH + WINDOW_X_OFFSET));
+}
+
+/* Draws the current line into the framebuffer, which must be set. */
+static void draw_line(struct libyagbe_ppu* const ppu) {
+  const bool bg_enabled = BIT_IS_SET(ppu->lcdc, LIBYAGBE_PPU_LCDC_BG_ENABLED);
+  const bool window_visible = window_is_visible(ppu);
+  uint8_t colors[LIBYAGBE_PPU_SCREEN_WIDTH];
+  uint8_t shades[LIBYAGBE_PPU_SCREEN_WIDTH];
+
+  /* There's nothing to draw from, so the line is left as it was. */
+  if (!update_tiles(ppu)) {
+    return;
+  }
+
+  if (bg_enabled) {
+    fetch_tile_map_line(ppu, colors, 0,
+                        get_map_offset(ppu, LIBYAGBE_PPU_LCDC_BG_MAP), ppu->scx,
+                        (ppu->ly + ppu->scy) & 0xFF);
+
+    if (window_visible) {
+      /* The window can start partially off the left of the screen. */
+      const unsigned int window_x =
+          (ppu->wx > WINDOW_X_OFFSET) ? (ppu->wx - WINDOW_X_OFFSET) : 0;
+
+      fetch_tile_map_line(ppu, colors, window_x,
+                          get_map_offset(ppu, LIBYAGBE_PPU_LCDC_WINDOW_MAP),
+                          window_x + WINDOW_X_OFFSET - ppu->wx,
+                          ppu->window_line++);
+    }
+
+    libyagbe_ppu_simd_apply_palette(colors, shades, ppu->bgp);
+  } else {
+    /* With the BG off, only sprites are drawn, onto white. */
+    memset(colors, 0, sizeof(colors));
+    memset(shades, 0, sizeof(shades));
+  }
+
+  if (BIT_IS_SET(ppu->lcdc, LIBYAGBE_PPU_LCDC_OBJ_ENABLED)) {
+    draw_sprites(ppu, colors, shades);
+  }
+  write_line(ppu, shades);
+}
+
+static bool frame_is_drawn(const struct libyagbe_ppu* const ppu) {
+  return (ppu->framebuffer != NULL) && ppu->frame_drawn;
+}
+
+static void handle_mode_end(struct libyagbe_gb* const gb) {
+  struct libyagbe_ppu* const ppu = &gb->ppu;
+
+  switch (ppu->mode) {
+    case LIBYAGBE_PPU_MODE_OAM_SCAN:
+      enter_mode(gb, LIBYAGBE_PPU_MODE_DRAWING, DRAWING_LENGTH);
+      return;
+
+    case LIBYAGBE_PPU_MODE_DRAWING:
+      if (frame_is_drawn(ppu)) {
+        draw_line(ppu);
+      } else {
+        /* Nothing is drawn, but where the window is up to still has to be
+         * kept track of, in case the next frame is. */
+        ppu->window_line += window_is_visible(ppu);
+      }
+      enter_mode(gb, LIBYAGBE_PPU_MODE_HBLANK, HBLANK_LENGTH);
+      return;
+
+    case LIBYAGBE_PPU_MODE_HBLANK:
+      ppu->ly++;
+
+      if (ppu->ly < LIBYAGBE_PPU_SCREEN_HEIGHT) {
+        enter_mode(gb, LIBYAGBE_PPU_MODE_OAM_SCAN, OAM_SCAN_LENGTH);
+        return;
+      }
+
+      libyagbe_bus_set_interrupt(gb, LIBYAGBE_BUS_IF_VBLANK);
+      enter_mode(gb, LIBYAGBE_PPU_MODE_VBLANK, LINE_LENGTH);
+
+      if (frame_is_drawn(ppu)) {
+        if (ppu->frame_cb != NULL) {
+          ppu->frame_cb(gb);
+        }
+        libyagbe_output_handle_frame(gb);
+      }
+      return;
+
+    case LIBYAGBE_PPU_MODE_VBLANK:
+      ppu->ly++;
+
+      if (ppu->ly < LINE_COUNT) {
+        enter_mode(gb, LIBYAGBE_PPU_MODE_VBLANK, LINE_LENGTH);
+        return;
+      }
+      start_frame(gb);
+      return;
+
+    default:
+      return;
+  }
+}
+
+static void handle_lcdc_write(struct libyagbe_gb* const gb,
+                              const uint8_t data) {
+  struct libyagbe_ppu* const ppu = &gb->ppu;
+  const bool was_enabled = lcd_is_enabled(ppu);
+
+  ppu->lcdc = data;
+
+  if (!was_enabled && lcd_is_enabled(ppu)) {
+    LOG_INFO((gb, "LCD became enabled."));
+    start_frame(gb);
+  } else if (was_enabled && !lcd_is_enabled(ppu)) {
+    LOG_INFO((gb, "LCD became disabled."));
+
+    /* The PPU stops dead, and starts again from the top once re-enabled. */
+    libyagbe_scheduler_delete_event_group(gb,
+                                          LIBYAGBE_SCHEDULER_EVENT_GROUP_PPU);
+    ppu->ly = 0;
+    ppu->mode = LIBYAGBE_PPU_MODE_HBLANK;
+
+    update_stat_line(gb);
+  }
+}
+
+/* The transfer happens all at once, rather than over the 160 cycles it takes
+ * on hardware, during which the CPU can only access HRAM anyway. */
+static void handle_dma_write(struct libyagbe_gb* const gb, const uint8_t data) {
+  unsigned int index;
+
+  gb->ppu.dma = data;
+
+  for (index = 0; index < LIBYAGBE_PPU_MEM_SIZE_OAM; ++index) {
+    gb->ppu.oam[index] =
+        libyagbe_bus_read_memory(gb, (uint16_t)((data << 8) | index));
+  }
+}
+
+void libyagbe_ppu_reset(struct libyagbe_gb* const gb) {
+  struct libyagbe_ppu* const ppu = &gb->ppu;
+
+  /* The bus stops sharing VRAM before this is called, unless it ran out of
+   * memory. */
+  if (!libyagbe_cow_is_shared(ppu->vram)) {
+    memset(ppu->vram, 0, LIBYAGBE_PPU_MEM_SIZE_VRAM);
+  }
+  memset(ppu->oam, 0, sizeof(ppu->oam));
+
+  /* Blank tiles decode to all zeroes, too. */
+  if (ppu->tiles != NULL) {
+    memset(ppu->tiles, 0, LIBYAGBE_PPU_TILE_COUNT * sizeof(ppu->tiles[0]));
+  }
+  memset(ppu->dirty_tiles, 0, sizeof(ppu->dirty_tiles));
+  ppu->tiles_dirty = false;
+
+  ppu->lcdc = 0x91;
+  ppu->stat = 0x00;
+  ppu->scy = 0x00;
+  ppu->scx = 0x00;
+  ppu->lyc = 0x00;
+  ppu->dma = 0xFF;
+  ppu->bgp = 0xFC;
+  ppu->obp0 = 0xFF;
+  ppu->obp1 = 0xFF;
+  ppu->wy = 0x00;
+  ppu->wx = 0x00;
+  ppu->stat_line = false;
+  ppu->frame_count = 0;
+
+  libyagbe_scheduler_register_event(gb, LIBYAGBE_SCHEDULER_EVENT_PPU_MODE_END,
+                                    LIBYAGBE_SCHEDULER_EVENT_GROUP_PPU,
+                                    &handle_mode_end);
+  start_frame(gb);
+}
+
+void libyagbe_ppu_release(struct libyagbe_gb* const gb) {
+  free(gb->ppu.tiles);
+  gb->ppu.tiles = NULL;
+}
+
+void libyagbe_ppu_set_framebuffer(
+    struct libyagbe_gb* const gb, void* const framebuffer,
+    const enum libyagbe_ppu_pixel_formats pixel_format, const size_t pitch) {
+  static const size_t line_sizes[3] = {LIBYAGBE_PPU_SCREEN_WIDTH / 4,
+                                       LIBYAGBE_PPU_SCREEN_WIDTH,
+                                       LIBYAGBE_PPU_SCREEN_WIDTH * 4};
+
+  gb->ppu.framebuffer = framebuffer;
+  gb->ppu.pixel_format = pixel_format;
+  gb->ppu.pitch = (pitch != 0) ? pitch : line_sizes[pixel_format];
+}
+
+void libyagbe_ppu_set_rgba_colors(struct libyagbe_gb* const gb,
+                                  const uint32_t* const colors) {
+  gb->ppu.rgba_colors = colors;
+}
+
+void libyagbe_ppu_set_frame_cb(struct libyagbe_gb* const gb,
+                               const libyagbe_ppu_frame_cb cb_func) {
+  gb->ppu.frame_cb = cb_func;
+}
+
+void libyagbe_ppu_set_render_mode(struct libyagbe_gb* const gb,
+                                  const enum libyagbe_ppu_render_modes mode,
+                                  const unsigned int interval) {
+  gb->ppu.render_mode = mode;
+  gb->ppu.frame_interval = (interval != 0) ? interval : 1;
+}
+
+void libyagbe_ppu_draw_frame(struct libyagbe_gb* const gb) {
+  struct libyagbe_ppu* const ppu = &gb->ppu;
+  const uint8_t ly = ppu->ly;
+  const uint8_t window_line = ppu->window_line;
+
+  if (ppu->framebuffer == NULL) {
+    return;
+  }
+
+  ppu->window_line = 0;
+
+  for (ppu->ly = 0; ppu->ly < LIBYAGBE_PPU_SCREEN_HEIGHT; ppu->ly++) {
+    draw_line(ppu);
+  }
+
+  ppu->ly = ly;
+  ppu->window_line = window_line;
+}
+
+void libyagbe_ppu_handle_vram_write(struct libyagbe_gb* const gb,
+                                    const uint16_t address,
+                                    const uint8_t data) {
+  struct libyagbe_ppu* const ppu = &gb->ppu;
+  const unsigned int offset = address - 0x8000u;
+
+  /* Tiles are often loaded again as they are. */
+  if (ppu->vram[offset] == data) {
+    return;
+  }
+  ppu->vram[offset] = data;
+
+  if (offset < LIBYAGBE_PPU_MEM_SIZE_TILE_DATA) {
+    const unsigned int tile = offset / LIBYAGBE_PPU_TILE_SIZE;
+
+    SET_BIT(ppu->dirty_tiles[tile / 8], tile % 8);
+    ppu->tiles_dirty = true;
+  }
+}
+
+uint8_t libyagbe_ppu_read_register(struct libyagbe_gb* const gb,
+                                   const enum libyagbe_ppu_io_regs reg) {
+  const struct libyagbe_ppu* const ppu = &gb->ppu;
+
+  switch (reg) {
+    case LIBYAGBE_PPU_IO_REG_LCDC:
+      return ppu->lcdc;
+
+    case LIBYAGBE_PPU_IO_REG_STAT:
+      return 0x80 | ppu->stat | ((ppu->ly == ppu->lyc) << 2) | ppu->mode;
+
+    case LIBYAGBE_PPU_IO_REG_SCY:
+      return ppu->scy;
+
+    case LIBYAGBE_PPU_IO_REG_SCX:
+      return ppu->scx;
+
+    case LIBYAGBE_PPU_IO_REG_LY:
+      return ppu->ly;
+
+    case LIBYAGBE_PPU_IO_REG_LYC:
+      return ppu->lyc;
+
+    case LIBYAGBE_PPU_IO_REG_DMA:
+      return ppu->dma;
+
+    case LIBYAGBE_PPU_IO_REG_BGP:
+      return ppu->bgp;
+
+    case LIBYAGBE_PPU_IO_REG_OBP0:
+      return ppu->obp0;
+
+    case LIBYAGBE_PPU_IO_REG_OBP1:
+      return ppu->obp1;
+
+    case LIBYAGBE_PPU_IO_REG_WY:
+      return ppu->wy;
+
+    case LIBYAGBE_PPU_IO_REG_WX:
+      return ppu->wx;
+
+    default:
+      return 0xFF;
+  }
+}
+
+void libyagbe_ppu_handle_register_write(struct libyagbe_gb* const gb,
+                                        const enum libyagbe_ppu_io_regs reg,
+                                        const uint8_t data) {
+  struct libyagbe_ppu* const ppu = &gb->ppu;
+
+  switch (reg) {
+    case LIBYAGBE_PPU_IO_REG_LCDC:
+      handle_lcdc_write(gb, data);
+      return;
+
+    case LIBYAGBE_PPU_IO_REG_STAT:
+      ppu->stat = data & 0x78;
+      update_stat_line(gb);
+      return;
+
+    case LIBYAGBE_PPU_IO_REG_SCY:
+      ppu->scy = data;
+      return;
+
+    case LIBYAGBE_PPU_IO_REG_SCX:
+      ppu->scx = data;
+      return;
+
+    /* Read-only. */
+    case LIBYAGBE_PPU_IO_REG_LY:
+      return;
+
+    case LIBYAGBE_PPU_IO_REG_LYC:
+      ppu->lyc = data;
+      update_stat_line(gb);
+      return;
+
+    case LIBYAGBE_PPU_IO_REG_DMA:
+      handle_dma_write(gb, data);
+      return;
+
+    case LIBYAGBE_PPU_IO_REG_BGP:
+      ppu->bgp = data;
+      return;
+
+    case LIBYAGBE_PPU_IO_REG_OBP0:
+      ppu->obp0 = data;
+      return;
+
+    case LIBYAGBE_PPU_IO_REG_OBP1:
+      ppu->obp1 = data;
+      return;
+
+    case LIBYAGBE_PPU_IO_REG_WY:
+      ppu->wy = data;
+      return;
+
+    case LIBYAGBE_PPU_IO_REG_WX:
+      ppu->wx = data;
+      return;
+
+    default:
+      return;
+  }
+}
@@ -0,0 +1,302 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "ppu_simd.h"
+
+#include <string.h>
+
+#include "libyagbe/ppu.h"
+
+#ifdef LIBYAGBE_PPU_SIMD
+#ifdef __AVX2__
+#define PPU_SIMD_AVX2
+#endif /* __AVX2__ */
+
+/* SSE2 is part of x86-64, and AVX2 builds use it wherever the wider registers
+ * don't help. */
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define PPU_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define PPU_SIMD_NEON
+#include <arm_neon.h>
+#endif /* defined(__SSE2__) || defined(_M_X64) || \
+          (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) */
+
+#ifdef PPU_SIMD_AVX2
+#include <immintrin.h>
+#endif /* PPU_SIMD_AVX2 */
+#endif /* LIBYAGBE_PPU_SIMD */
+
+#if defined(PPU_SIMD_SSE2) || defined(PPU_SIMD_NEON)
+/* Selects each bit of a byte, leftmost pixel first. */
+static const uint8_t bit_masks[16] = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04,
+                                      0x02, 0x01, 0x80, 0x40, 0x20, 0x10,
+                                      0x08, 0x04, 0x02, 0x01};
+#endif /* defined(PPU_SIMD_SSE2) || defined(PPU_SIMD_NEON) */
+
+#ifdef PPU_SIMD_SSE2
+/* Decodes a row from a register holding its low byte 8 times followed by its
+ * high byte 8 times. */
+static void decode_row_sse2(const __m128i row, const __m128i masks,
+                            uint8_t* const pixels) {
+  const __m128i bits = _mm_cmpeq_epi8(_mm_and_si128(row, masks), masks);
+
+  _mm_storel_epi64(
+      (__m128i*)pixels,
+      _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi8(1)),
+                   _mm_and_si128(_mm_srli_si128(bits, 8), _mm_set1_epi8(2))));
+}
+
+/* Decodes 4 rows from a register holding the bytes of each one twice. */
+static void decode_rows_sse2(const __m128i rows, const __m128i masks,
+                             uint8_t* const pixels) {
+  const __m128i low = _mm_unpacklo_epi16(rows, rows);
+  const __m128i high = _mm_unpackhi_epi16(rows, rows);
+
+  decode_row_sse2(_mm_unpacklo_epi32(low, low), masks, &pixels[0]);
+  decode_row_sse2(_mm_unpackhi_epi32(low, low), masks, &pixels[8]);
+  decode_row_sse2(_mm_unpacklo_epi32(high, high), masks, &pixels[16]);
+  decode_row_sse2(_mm_unpackhi_epi32(high, high), masks, &pixels[24]);
+}
+#endif /* PPU_SIMD_SSE2 */
+
+void libyagbe_ppu_simd_decode_tile(const uint8_t* const data,
+                                   uint8_t* const pixels) {
+#if defined(PPU_SIMD_SSE2)
+  const __m128i masks = _mm_loadu_si128((const __m128i*)bit_masks);
+  const __m128i bytes = _mm_loadu_si128((const __m128i*)data);
+
+  /* Spreads each byte out until a register holds a whole row. */
+  decode_rows_sse2(_mm_unpacklo_epi8(bytes, bytes), masks, &pixels[0]);
+  decode_rows_sse2(_mm_unpackhi_epi8(bytes, bytes), masks, &pixels[32]);
+#elif defined(PPU_SIMD_NEON)
+  const uint8x8_t masks = vld1_u8(bit_masks);
+  unsigned int row;
+
+  for (row = 0; row < 8; ++row) {
+    const uint8x8_t low = vtst_u8(vdup_n_u8(data[row * 2]), masks);
+    const uint8x8_t high = vtst_u8(vdup_n_u8(data[(row * 2) + 1]), masks);
+
+    vst1_u8(&pixels[row * 8], vorr_u8(vand_u8(low, vdup_n_u8(1)),
+                                      vand_u8(high, vdup_n_u8(2))));
+  }
+#else
+  unsigned int row;
+  unsigned int column;
+
+  for (row = 0; row < 8; ++row) {
+    const uint8_t low = data[row * 2];
+    const uint8_t high = data[(row * 2) + 1];
+
+    for (column = 0; column < 8; ++column) {
+      const unsigned int shift = 7 - column;
+
+      pixels[(row * 8) + column] =
+          (uint8_t)((((high >> shift) & 1) << 1) | ((low >> shift) & 1));
+    }
+  }
+#endif /* defined(PPU_SIMD_SSE2) */
+}
+
+void libyagbe_ppu_simd_apply_palette(const uint8_t* const colors,
+                                     uint8_t* const shades,
+                                     const uint8_t palette) {
+  unsigned int x;
+
+#if defined(PPU_SIMD_AVX2)
+  const __m256i table = _mm256_setr_epi8(
+      palette & 3, (palette >> 2) & 3, (palette >> 4) & 3, (palette >> 6) & 3,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, palette & 3, (palette >> 2) & 3,
+      (palette >> 4) & 3, (palette >> 6) & 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0);
+
+  for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; x += 32) {
+    _mm256_storeu_si256(
+        (__m256i*)&shades[x],
+        _mm256_shuffle_epi8(table,
+                            _mm256_loadu_si256((const __m256i*)&colors[x])));
+  }
+#elif defined(PPU_SIMD_SSE2)
+  /* Without a byte shuffle, every color number is compared against instead. */
+  const __m128i shade0 = _mm_set1_epi8((char)(palette & 3));
+  const __m128i shade1 = _mm_set1_epi8((char)((palette >> 2) & 3));
+  const __m128i shade2 = _mm_set1_epi8((char)((palette >> 4) & 3));
+  const __m128i shade3 = _mm_set1_epi8((char)((palette >> 6) & 3));
+
+  for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; x += 16) {
+    const __m128i color = _mm_loadu_si128((const __m128i*)&colors[x]);
+
+    _mm_storeu_si128(
+        (__m128i*)&shades[x],
+        _mm_or_si128(
+            _mm_or_si128(
+                _mm_and_si128(_mm_cmpeq_epi8(color, _mm_set1_epi8(0)), shade0),
+                _mm_and_si128(_mm_cmpeq_epi8(color, _mm_set1_epi8(1)),
+                              shade1)),
+            _mm_or_si128(
+                _mm_and_si128(_mm_cmpeq_epi8(color, _mm_set1_epi8(2)), shade2),
+                _mm_and_si128(_mm_cmpeq_epi8(color, _mm_set1_epi8(3)),
+                              shade3))));
+  }
+#elif defined(PPU_SIMD_NEON)
+  uint8_t table_bytes[16];
+  uint8x16_t table;
+
+  memset(table_bytes, 0, sizeof(table_bytes));
+
+  for (x = 0; x < 4; ++x) {
+    table_bytes[x] = (palette >> (x * 2)) & 3;
+  }
+  table = vld1q_u8(table_bytes);
+
+  for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; x += 16) {
+    vst1q_u8(&shades[x], vqtbl1q_u8(table, vld1q_u8(&colors[x])));
+  }
+#else
+  for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; ++x) {
+    shades[x] = (palette >> (colors[x] * 2)) & 3;
+  }
+#endif /* defined(PPU_SIMD_AVX2) */
+}
+
+/* Each group of 4 shades is treated as a 32-bit value, which is then shifted
+ * so that every shade lands in its place within the lowest byte:
+ *
+ *   bits 0-1 of byte 0 go to bits 6-7 (shifted left by 6)
+ *   bits 0-1 of byte 1 go to bits 4-5 (shifted right by 4)
+ *   bits 0-1 of byte 2 go to bits 2-3 (shifted right by 14)
+ *   bits 0-1 of byte 3 go to bits 0-1 (shifted right by 24)
+ *
+ * None of the bits shifted into the lowest byte along the way are set, as
+ * shades only ever use the lowest 2 bits of their byte. */
+void libyagbe_ppu_simd_write_2bpp(const uint8_t* const shades,
+                                  uint8_t* const line) {
+  unsigned int x;
+
+#if defined(PPU_SIMD_SSE2)
+  for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; x += 16) {
+    const __m128i group = _mm_loadu_si128((const __m128i*)&shades[x]);
+    __m128i packed = _mm_and_si128(
+        _mm_or_si128(
+            _mm_or_si128(_mm_slli_epi32(group, 6), _mm_srli_epi32(group, 4)),
+            _mm_or_si128(_mm_srli_epi32(group, 14), _mm_srli_epi32(group, 24))),
+        _mm_set1_epi32(0xFF));
+    int bytes;
+
+    packed = _mm_packs_epi32(packed, packed);
+    bytes = _mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+
+    memcpy(&line[x / 4], &bytes, 4);
+  }
+#elif defined(PPU_SIMD_NEON)
+  for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; x += 16) {
+    const uint32x4_t group = vreinterpretq_u32_u8(vld1q_u8(&shades[x]));
+    const uint16x4_t packed = vmovn_u32(
+        vorrq_u32(vorrq_u32(vshlq_n_u32(group, 6), vshrq_n_u32(group, 4)),
+                  vorrq_u32(vshrq_n_u32(group, 14), vshrq_n_u32(group, 24))));
+    const uint32_t bytes = vget_lane_u32(
+        vreinterpret_u32_u8(vmovn_u16(vcombine_u16(packed, packed))), 0);
+
+    memcpy(&line[x / 4], &bytes, 4);
+  }
+#else
+  for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; x += 4) {
+    line[x / 4] = (uint8_t)((shades[x] << 6) | (shades[x + 1] << 4) |
+                            (shades[x + 2] << 2) | shades[x + 3]);
+  }
+#endif /* defined(PPU_SIMD_SSE2) */
+}
+
+#if defined(PPU_SIMD_SSE2) && !defined(PPU_SIMD_AVX2)
+/* Looks up the colors for 4 shades held as 32-bit values. */
+static __m128i lookup_rgba_sse2(const __m128i shades,
+                                const uint32_t* const colors) {
+  __m128i result = _mm_setzero_si128();
+  int shade;
+
+  for (shade = 0; shade < 4; ++shade) {
+    result = _mm_or_si128(
+        result, _mm_and_si128(_mm_cmpeq_epi32(shades, _mm_set1_epi32(shade)),
+                              _mm_set1_epi32((int)colors[shade])));
+  }
+  return result;
+}
+#endif /* defined(PPU_SIMD_SSE2) && !defined(PPU_SIMD_AVX2) */
+
+void libyagbe_ppu_simd_write_rgba32(const uint8_t* const shades,
+                                    uint32_t* const line,
+                                    const uint32_t* const colors) {
+  unsigned int x;
+
+#if defined(PPU_SIMD_AVX2)
+  const __m256i table = _mm256_setr_epi32(
+      (int)colors[0], (int)colors[1], (int)colors[2], (int)colors[3],
+      (int)colors[0], (int)colors[1], (int)colors[2], (int)colors[3]);
+
+  for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; x += 8) {
+    _mm256_storeu_si256(
+        (__m256i*)&line[x],
+        _mm256_permutevar8x32_epi32(
+            table, _mm256_cvtepu8_epi32(
+                       _mm_loadl_epi64((const __m128i*)&shades[x]))));
+  }
+#elif defined(PPU_SIMD_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+
+  for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; x += 16) {
+    const __m128i group = _mm_loadu_si128((const __m128i*)&shades[x]);
+    const __m128i low = _mm_unpacklo_epi8(group, zero);
+    const __m128i high = _mm_unpackhi_epi8(group, zero);
+
+    _mm_storeu_si128((__m128i*)&line[x],
+                     lookup_rgba_sse2(_mm_unpacklo_epi16(low, zero), colors));
+    _mm_storeu_si128((__m128i*)&line[x + 4],
+                     lookup_rgba_sse2(_mm_unpackhi_epi16(low, zero), colors));
+    _mm_storeu_si128((__m128i*)&line[x + 8],
+                     lookup_rgba_sse2(_mm_unpacklo_epi16(high, zero), colors));
+    _mm_storeu_si128((__m128i*)&line[x + 12],
+                     lookup_rgba_sse2(_mm_unpackhi_epi16(high, zero), colors));
+  }
+#elif defined(PPU_SIMD_NEON)
+  /* Each shade is repeated 4 times and turned into the offsets of the bytes
+   * of its color, which are then looked up all at once. */
+  static const uint8_t byte_offsets[16] = {0, 1, 2, 3, 0, 1, 2, 3,
+                                           0, 1, 2, 3, 0, 1, 2, 3};
+  const uint8x16_t table = vreinterpretq_u8_u32(vld1q_u32(colors));
+  const uint8x16_t offsets = vld1q_u8(byte_offsets);
+
+  for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; x += 16) {
+    const uint8x16_t group = vshlq_n_u8(vld1q_u8(&shades[x]), 2);
+    const uint8x16x2_t pairs = vzipq_u8(group, group);
+    const uint8x16x2_t low = vzipq_u8(pairs.val[0], pairs.val[0]);
+    const uint8x16x2_t high = vzipq_u8(pairs.val[1], pairs.val[1]);
+
+    vst1q_u8((uint8_t*)&line[x],
+             vqtbl1q_u8(table, vaddq_u8(low.val[0], offsets)));
+    vst1q_u8((uint8_t*)&line[x + 4],
+             vqtbl1q_u8(table, vaddq_u8(low.val[1], offsets)));
+    vst1q_u8((uint8_t*)&line[x + 8],
+             vqtbl1q_u8(table, vaddq_u8(high.val[0], offsets)));
+    vst1q_u8((uint8_t*)&line[x + 12],
+             vqtbl1q_u8(table, vaddq_u8(high.val[1], offsets)));
+  }
+#else
+  for (x = 0; x < LIBYAGBE_PPU_SCREEN_WIDTH; ++x) {
+    line[x] = colors[shades[x]];
+  }
+#endif /* defined(PPU_SIMD_AVX2) */
+}
@@ -0,0 +1,46 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* The inner loops of the PPU's scanline renderer. Each kernel has SSE2, AVX2
+ * and NEON versions along with a plain C one, picked at compile time by what
+ * the target supports, unless the YAGBE_PPU_SIMD CMake option is turned off.
+ * All of them work on whole lines of LIBYAGBE_PPU_SCREEN_WIDTH pixels. */
+
+#ifndef LIBYAGBE_PPU_SIMD_H
+#define LIBYAGBE_PPU_SIMD_H
+
+#include "libyagbe/compat/compat_stdint.h"
+
+/* Decodes the 16 bytes of a tile into one color number per pixel, row by
+ * row. */
+void libyagbe_ppu_simd_decode_tile(const uint8_t* const data,
+                                   uint8_t* const pixels);
+
+/* Looks up the shade for each color number in a palette register. */
+void libyagbe_ppu_simd_apply_palette(const uint8_t* const colors,
+                                     uint8_t* const shades,
+                                     const uint8_t palette);
+
+/* Writes a line in LIBYAGBE_PPU_PIXEL_FORMAT_2BPP. */
+void libyagbe_ppu_simd_write_2bpp(const uint8_t* const shades,
+                                  uint8_t* const line);
+
+/* Writes a line in LIBYAGBE_PPU_PIXEL_FORMAT_RGBA32, looking up the value for
+ * each shade in \p colors. */
+void libyagbe_ppu_simd_write_rgba32(const uint8_t* const shades,
+                                    uint32_t* const line,
+                                    const uint32_t* const colors);
+
+#endif /* LIBYAGBE_PPU_SIMD_H */
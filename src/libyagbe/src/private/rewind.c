@@ -0,0 +1,377 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/rewind.h"
+
+#include <string.h>
+
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/gb.h"
+#include "libyagbe/state.h"
+
+/* A state is encoded as a series of tokens, each made up of the number of
+ * unchanged bytes to skip and the number of changed bytes that follow, 16
+ * bits each, then the changed bytes XORed with their previous values. A
+ * keyframe is encoded the same way, as the changes from all zeroes. */
+#define TOKEN_HEADER_SIZE 4
+#define MAX_RUN 0xFFFF
+
+/* The fewest unchanged bytes worth starting a new token for; fewer than that
+ * take up less room left in with the changed bytes. */
+#define MIN_SKIP 4
+
+
+/* Precedes every record in the ring. Records are packed without regard to
+ * alignment, so these are only ever copied in and out. */
+struct record_header {
+  /* The offset of the record before this one, if there is one. */
+  size_t prev;
+
+  /* The size of the record, including this header. */
+  size_t size;
+
+  bool keyframe;
+};
+
+/* Returns the most room a state of \p state_size bytes can take encoded. A
+ * token which skips at least MIN_SKIP bytes pays for itself, which leaves the
+ * first token and those following a run of changed bytes cut short at
+ * MAX_RUN. */
+static size_t get_max_encoded_size(const size_t state_size) {
+  return state_size + (TOKEN_HEADER_SIZE * ((state_size / MAX_RUN) + 2));
+}
+
+static void read_header(const struct libyagbe_rewind* const rewind,
+                        const size_t offset,
+                        struct record_header* const header) {
+  memcpy(header, &rewind->ring[offset], sizeof(struct record_header));
+}
+
+static const uint8_t* get_payload(const struct libyagbe_rewind* const rewind,
+                                  const size_t offset) {
+  return &rewind->ring[offset + sizeof(struct record_header)];
+}
+
+/* Returns true if nothing changed in the word starting at \p index. Most of a
+ * state stays the same from one snapshot to the next, so this is where most of
+ * the time goes. */
+static bool word_unchanged(const uint8_t* const base, const uint8_t* const data,
+                           const size_t index) {
+  size_t word;
+
+  if (base != NULL) {
+    return memcmp(&base[index], &data[index], sizeof(size_t)) == 0;
+  }
+
+  memcpy(&word, &data[index], sizeof(size_t));
+  return word == 0;
+}
+
+static uint8_t get_change(const uint8_t* const base, const uint8_t* const data,
+                          const size_t index) {
+  return (base != NULL) ? (base[index] ^ data[index]) : data[index];
+}
+
+/* Returns true if the changes run out for long enough from \p index on to be
+ * worth skipping, including if they run out for good. */
+static bool changes_pause(const uint8_t* const base, const uint8_t* const data,
+                          const size_t size, const size_t index) {
+  size_t i;
+
+  for (i = index; (i < size) && (i < (index + MIN_SKIP)); ++i) {
+    if (get_change(base, data, i) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Encodes the changes from \p base to \p data, both \p data_size bytes long,
+ * or all of \p data if \p base is NULL, returning the number of bytes written
+ * to \p out. */
+static size_t encode(const uint8_t* const base, const uint8_t* const data,
+                     const size_t data_size, uint8_t* const out) {
+  size_t size = 0;
+  size_t i = 0;
+
+  while (i < data_size) {
+    size_t skip = 0;
+    size_t count = 0;
+    size_t start;
+
+    while (((i + sizeof(size_t)) <= data_size) &&
+           ((skip + sizeof(size_t)) <= MAX_RUN) &&
+           word_unchanged(base, data, i)) {
+      skip += sizeof(size_t);
+      i += sizeof(size_t);
+    }
+
+    while ((i < data_size) && (skip < MAX_RUN) &&
+           (get_change(base, data, i) == 0)) {
+      skip++;
+      i++;
+    }
+
+    /* Whatever's left is unchanged. */
+    if (i == data_size) {
+      break;
+    }
+
+    start = i;
+
+    while ((i < data_size) && (count < MAX_RUN) &&
+           ((get_change(base, data, i) != 0) ||
+            !changes_pause(base, data, data_size, i))) {
+      count++;
+      i++;
+    }
+
+    out[size + 0] = (uint8_t)(skip & 0xFF);
+    out[size + 1] = (uint8_t)(skip >> 8);
+    out[size + 2] = (uint8_t)(count & 0xFF);
+    out[size + 3] = (uint8_t)(count >> 8);
+    size += TOKEN_HEADER_SIZE;
+
+    for (; start < i; ++start) {
+      out[size++] = get_change(base, data, start);
+    }
+  }
+  return size;
+}
+
+/* XORs encoded changes into a state, which turns the state before them into
+ * the state after them, and the other way around. */
+static void apply(const uint8_t* in, const size_t size, uint8_t* const data) {
+  const uint8_t* const in_end = in + size;
+  size_t offset = 0;
+
+  while (in < in_end) {
+    const size_t skip = in[0] | (in[1] << 8);
+    const size_t count = in[2] | (in[3] << 8);
+    size_t i;
+
+    in += TOKEN_HEADER_SIZE;
+    offset += skip;
+
+    for (i = 0; i < count; ++i) {
+      data[offset + i] ^= in[i];
+    }
+
+    offset += count;
+    in += count;
+  }
+}
+
+static void clear_ring(struct libyagbe_rewind* const rewind) {
+  rewind->tail = 0;
+  rewind->newest = 0;
+  rewind->head = 0;
+  rewind->end = 0;
+  rewind->count = 0;
+  rewind->keyframe_distance = 0;
+}
+
+/* Finds room for a record of \p size bytes after the newest one. */
+static bool find_space(struct libyagbe_rewind* const rewind, const size_t size,
+                       size_t* const offset) {
+  if (rewind->count == 0) {
+    clear_ring(rewind);
+
+    *offset = 0;
+    return true;
+  }
+
+  if (rewind->head >= rewind->tail) {
+    if ((rewind->ring_size - rewind->head) >= size) {
+      *offset = rewind->head;
+      return true;
+    }
+
+    /* The head must never catch up with the tail, or the ring would look
+     * empty. */
+    if (size < rewind->tail) {
+      rewind->end = rewind->head;
+
+      *offset = 0;
+      return true;
+    }
+    return false;
+  }
+
+  if ((rewind->tail - rewind->head) > size) {
+    *offset = rewind->head;
+    return true;
+  }
+  return false;
+}
+
+/* Drops the oldest keyframe, and the records depending on it. */
+static void drop_oldest(struct libyagbe_rewind* const rewind) {
+  struct record_header header;
+
+  do {
+    read_header(rewind, rewind->tail, &header);
+
+    rewind->tail += header.size;
+    rewind->count--;
+
+    if ((rewind->head < rewind->tail) && (rewind->tail == rewind->end)) {
+      rewind->tail = 0;
+    }
+
+    if (rewind->count == 0) {
+      clear_ring(rewind);
+      return;
+    }
+    read_header(rewind, rewind->tail, &header);
+  } while (!header.keyframe);
+}
+
+/* Works out the newest snapshot from the keyframe it depends on. */
+static void rebuild_newest(struct libyagbe_rewind* const rewind) {
+  size_t chain[LIBYAGBE_REWIND_MAX_KEYFRAME_INTERVAL];
+  unsigned int length = 0;
+  size_t offset = rewind->newest;
+  struct record_header header;
+
+  for (;;) {
+    chain[length++] = offset;
+    read_header(rewind, offset, &header);
+
+    if (header.keyframe) {
+      break;
+    }
+    offset = header.prev;
+  }
+  rewind->keyframe_distance = length;
+
+  memset(rewind->newest_state, 0, rewind->state_size);
+
+  while (length != 0) {
+    offset = chain[--length];
+    read_header(rewind, offset, &header);
+
+    apply(get_payload(rewind, offset),
+          header.size - sizeof(struct record_header),
+          (uint8_t*)rewind->newest_state);
+  }
+}
+
+int libyagbe_rewind_start(struct libyagbe_gb* const gb, void* const arena,
+                          const size_t size,
+                          const unsigned int keyframe_interval) {
+  struct libyagbe_rewind* const rewind = &gb->rewind;
+  const size_t state_size = libyagbe_state_get_size(gb);
+
+  if ((size < ((state_size * 2) + sizeof(struct record_header) +
+               get_max_encoded_size(state_size))) ||
+      (keyframe_interval == 0) ||
+      (keyframe_interval > LIBYAGBE_REWIND_MAX_KEYFRAME_INTERVAL)) {
+    return 0;
+  }
+
+  /* Cartridge RAM comes in whole pages, so the second state is aligned just
+   * like the first. */
+  rewind->arena = arena;
+  rewind->state_size = state_size;
+  rewind->newest_state = (struct libyagbe_state*)arena;
+  rewind->scratch_state = (struct libyagbe_state*)&rewind->arena[state_size];
+  rewind->ring = &rewind->arena[state_size * 2];
+  rewind->ring_size = size - (state_size * 2);
+  rewind->keyframe_interval = keyframe_interval;
+
+  clear_ring(rewind);
+  return 1;
+}
+
+void libyagbe_rewind_stop(struct libyagbe_gb* const gb) {
+  memset(&gb->rewind, 0, sizeof(struct libyagbe_rewind));
+}
+
+int libyagbe_rewind_capture(struct libyagbe_gb* const gb) {
+  struct libyagbe_rewind* const rewind = &gb->rewind;
+  struct libyagbe_state* const state = rewind->scratch_state;
+  struct record_header header;
+  size_t offset;
+
+  if ((rewind->arena == NULL) ||
+      (libyagbe_state_get_size(gb) != rewind->state_size)) {
+    return 0;
+  }
+
+  libyagbe_state_save(gb, state, rewind->state_size);
+
+  while (!find_space(rewind,
+                     sizeof(struct record_header) +
+                         get_max_encoded_size(rewind->state_size),
+                     &offset)) {
+    drop_oldest(rewind);
+  }
+
+  header.prev = rewind->newest;
+  header.keyframe = (rewind->count == 0) ||
+                    (rewind->keyframe_distance == rewind->keyframe_interval);
+  header.size = sizeof(struct record_header) +
+                encode(header.keyframe ? NULL : (uint8_t*)rewind->newest_state,
+                       (const uint8_t*)state, rewind->state_size,
+                       &rewind->ring[offset + sizeof(struct record_header)]);
+
+  memcpy(&rewind->ring[offset], &header, sizeof(struct record_header));
+
+  rewind->newest = offset;
+  rewind->head = offset + header.size;
+  rewind->count++;
+  rewind->keyframe_distance =
+      header.keyframe ? 1 : (rewind->keyframe_distance + 1);
+
+  rewind->scratch_state = rewind->newest_state;
+  rewind->newest_state = state;
+
+  return 1;
+}
+
+int libyagbe_rewind_step_back(struct libyagbe_gb* const gb) {
+  struct libyagbe_rewind* const rewind = &gb->rewind;
+  struct record_header header;
+
+  if ((rewind->arena == NULL) || (rewind->count == 0)) {
+    return 0;
+  }
+
+  /* The snapshot is only dropped once the instance is back at it. */
+  if (!libyagbe_state_load(gb, rewind->newest_state, rewind->state_size)) {
+    return 0;
+  }
+
+  read_header(rewind, rewind->newest, &header);
+
+  /* The record stays where it is until the next snapshot is taken, which is
+   * plenty of time to use it to step back once more. */
+  rewind->head = rewind->newest;
+  rewind->newest = header.prev;
+  rewind->count--;
+
+  if (rewind->count == 0) {
+    clear_ring(rewind);
+  } else if (header.keyframe) {
+    rebuild_newest(rewind);
+  } else {
+    apply(get_payload(rewind, rewind->head),
+          header.size - sizeof(struct record_header),
+          (uint8_t*)rewind->newest_state);
+    rewind->keyframe_distance--;
+  }
+  return 1;
+}
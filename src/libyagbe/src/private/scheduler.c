@@ -16,150 +16,141 @@
 #include "libyagbe/scheduler.h"
 
 #include <assert.h>
-#include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
-#include "libyagbe/debug/logger.h"
-#include "libyagbe/timer.h"
+#include "debug/log.h"
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/gb.h"
 #include "utility.h"
 
-static struct libyagbe_scheduler scheduler;
-
-static char* get_event_name(const enum libyagbe_scheduler_event_types type) {
-  size_t alloc_size;
-  char* str;
-
-  switch (type) {
-    case LIBYAGBE_SCHEDULER_EVENT_TIMA_INCREMENT:
-      alloc_size = strlen("TIMA increment event");
-      str = malloc(sizeof(char) * alloc_size);
-      strcpy(str, "TIMA increment event");
-
-      return str;
-
-    case LIBYAGBE_SCHEDULER_EVENT_TIMA_OVERFLOW:
-      alloc_size = strlen("TIMA overflow event");
-      str = malloc(sizeof(char) * alloc_size);
-
-      strcpy(str, "TIMA overflow event");
-      return str;
-
-    default:
-      return NULL;
+/* Finds the earliest pending event. There are only ever a handful of event
+ * types, so looking at every pending one is as cheap as it gets. Ties go to
+ * the event type declared first, so the order events run in never depends on
+ * the order they were scheduled in. */
+static void update_next_event(struct libyagbe_scheduler* const scheduler) {
+  unsigned int mask = scheduler->active_mask;
+  unsigned int type;
+
+  scheduler->timestamp_next_event = LIBYAGBE_SCHEDULER_NO_EVENT;
+
+  for (type = 0; mask != 0; ++type, mask >>= 1) {
+    if ((mask & 1) &&
+        (scheduler->events[type].timestamp <
+         scheduler->timestamp_next_event)) {
+      scheduler->timestamp_next_event = scheduler->events[type].timestamp;
+      scheduler->next_event = (enum libyagbe_scheduler_event_types)type;
+    }
   }
 }
 
-static size_t get_parent_node(const size_t index) { return (index - 1) / 2; }
+static void step(struct libyagbe_gb* const gb, const uintmax_t timestamp_next) {
+  struct libyagbe_scheduler* const scheduler = &gb->scheduler;
 
-static size_t get_left_child_of_node(const size_t index) {
-  return (index * 2) + 1;
-}
-
-static size_t get_right_child_of_node(const size_t index) {
-  return (index * 2) + 2;
-}
-
-static void heapify_top_bottom(const size_t parent_node) {
-  size_t left_node;
-  size_t right_node;
-  size_t smallest_node;
-
-  left_node = get_left_child_of_node(parent_node);
-  right_node = get_right_child_of_node(parent_node);
-  smallest_node = parent_node;
-
-  if ((smallest_node < scheduler.heap_size) &&
-      (scheduler.events[left_node].timestamp <
-       scheduler.events[smallest_node].timestamp)) {
-    smallest_node = left_node;
-  }
+  while (scheduler->timestamp_next_event <= timestamp_next) {
+    const enum libyagbe_scheduler_event_types type = scheduler->next_event;
 
-  if ((right_node < scheduler.heap_size) &&
-      scheduler.events[right_node].timestamp <
-          scheduler.events[smallest_node].timestamp) {
-    smallest_node = right_node;
-  }
+    /* The event stops being pending before its function is called, as the
+     * function may very well schedule it again. */
+    CLEAR_BIT(scheduler->active_mask, type);
 
-  if (smallest_node != parent_node) {
-    SWAP(scheduler.events[smallest_node], scheduler.events[parent_node],
-         struct libyagbe_scheduler_event);
+    scheduler->timestamp_now = scheduler->timestamp_next_event;
+    update_next_event(scheduler);
 
-    heapify_top_bottom(smallest_node);
+    scheduler->events[type].cb_func(gb);
   }
+  scheduler->timestamp_now = timestamp_next;
 }
 
-static void heapify_bottom_top(const size_t index) {
-  size_t parent_node;
-
-  parent_node = get_parent_node(index);
+void libyagbe_scheduler_reset(struct libyagbe_gb* const gb) {
+  memset(&gb->scheduler, 0, sizeof(struct libyagbe_scheduler));
+  gb->scheduler.timestamp_next_event = LIBYAGBE_SCHEDULER_NO_EVENT;
 
-  if (scheduler.events[parent_node].timestamp >
-      scheduler.events[index].timestamp) {
-    SWAP(scheduler.events[parent_node], scheduler.events[index],
-         struct libyagbe_scheduler_event);
-    heapify_bottom_top(parent_node);
-  }
+  LOG_INFO((gb, "Resetting scheduler."));
 }
 
-static void delete_min(void) {
-  assert(scheduler.heap_size != 0);
-
-  scheduler.events[0] = scheduler.events[--scheduler.heap_size];
-  heapify_top_bottom(0);
+void libyagbe_scheduler_register_event(
+    struct libyagbe_gb* const gb,
+    const enum libyagbe_scheduler_event_types type,
+    const enum libyagbe_scheduler_event_groups group,
+    const libyagbe_scheduler_event_cb cb_func) {
+  assert(type < LIBYAGBE_SCHEDULER_EVENT_COUNT);
+  assert(group < LIBYAGBE_SCHEDULER_EVENT_GROUP_COUNT);
+  assert(cb_func != NULL);
+
+  gb->scheduler.events[type].cb_func = cb_func;
+  SET_BIT(gb->scheduler.group_masks[group], type);
 }
 
-static void step(const uintmax_t timestamp_next) {
-  while ((scheduler.events[0].timestamp <= timestamp_next) &&
-         scheduler.heap_size > 0) {
-    scheduler.events[0].cb_func();
-    scheduler.timestamp_now = scheduler.events[0].timestamp;
-    delete_min();
+void libyagbe_scheduler_schedule_event(
+    struct libyagbe_gb* const gb,
+    const enum libyagbe_scheduler_event_types type,
+    const uintmax_t timestamp) {
+  struct libyagbe_scheduler* const scheduler = &gb->scheduler;
+  const bool was_next = BIT_IS_SET(scheduler->active_mask, type) &&
+                        (scheduler->next_event == type);
+
+  assert(scheduler->events[type].cb_func != NULL);
+
+  scheduler->events[type].timestamp = timestamp;
+  SET_BIT(scheduler->active_mask, type);
+
+  if (timestamp < scheduler->timestamp_next_event) {
+    scheduler->timestamp_next_event = timestamp;
+    scheduler->next_event = type;
+  } else if (was_next) {
+    /* The earliest event was pushed back, so something else may be first
+     * now. */
+    update_next_event(scheduler);
   }
 }
 
-void libyagbe_scheduler_reset(void) {
-  memset(&scheduler, 0, sizeof(struct libyagbe_scheduler));
-  libyagbe_log(LIBYAGBE_LOG_LEVEL_INFO, "Resetting scheduler.");
-}
+void libyagbe_scheduler_cancel_event(
+    struct libyagbe_gb* const gb,
+    const enum libyagbe_scheduler_event_types type) {
+  struct libyagbe_scheduler* const scheduler = &gb->scheduler;
 
-void libyagbe_scheduler_insert_event(
-    struct libyagbe_scheduler_event* const event) {
-  assert(event != NULL);
-  assert(scheduler.heap_size != (LIBYAGBE_SCHEDULER_MAX_EVENTS - 1));
+  if (!BIT_IS_SET(scheduler->active_mask, type)) {
+    return;
+  }
 
-  memcpy(&scheduler.events[scheduler.heap_size], &event,
-         sizeof(struct libyagbe_scheduler_event));
+  CLEAR_BIT(scheduler->active_mask, type);
 
-  heapify_bottom_top(scheduler.heap_size);
-  scheduler.heap_size++;
+  if (scheduler->next_event == type) {
+    update_next_event(scheduler);
+  }
 }
 
-struct libyagbe_scheduler_event* libyagbe_scheduler_find_event(
-    const enum libyagbe_scheduler_event_types event) {
-  size_t index;
-
-  for (index = 0; index < scheduler.heap_size; ++index) {
-    if (scheduler.events[index].type == event) {
-      return &scheduler.events[index];
-    }
+const struct libyagbe_scheduler_event* libyagbe_scheduler_find_event(
+    const struct libyagbe_gb* const gb,
+    const enum libyagbe_scheduler_event_types type) {
+  if (!BIT_IS_SET(gb->scheduler.active_mask, type)) {
+    return NULL;
   }
-  return NULL;
+  return &gb->scheduler.events[type];
 }
 
 void libyagbe_scheduler_delete_event_group(
+    struct libyagbe_gb* const gb,
     const enum libyagbe_scheduler_event_groups group) {
-  size_t index;
+  struct libyagbe_scheduler* const scheduler = &gb->scheduler;
 
-  for (index = 0; index < scheduler.heap_size; ++index) {
-    if (scheduler.events[index].group == group) {
-      /*delete_by_index(index);*/
-    }
+  if ((scheduler->active_mask & scheduler->group_masks[group]) == 0) {
+    return;
   }
+
+  scheduler->active_mask &= ~scheduler->group_masks[group];
+  update_next_event(scheduler);
 }
 
-void libyagbe_scheduler_add_cycles(const unsigned int cycles) {
-  const uintmax_t timestamp_next = scheduler.timestamp_now + cycles;
-  step(timestamp_next);
-  scheduler.timestamp_now = timestamp_next;
-}
\ No newline at end of file
+void libyagbe_scheduler_add_cycles(struct libyagbe_gb* const gb,
+                                   const unsigned int cycles) {
+  const uintmax_t timestamp_next = gb->scheduler.timestamp_now + cycles;
+
+  /* This is called after every instruction, and most of the time nothing is
+   * due yet. */
+  if (timestamp_next < gb->scheduler.timestamp_next_event) {
+    gb->scheduler.timestamp_now = timestamp_next;
+    return;
+  }
+  step(gb, timestamp_next);
+}
@@ -0,0 +1,335 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "libyagbe/state.h"
+
+#include <string.h>
+
+#include "libyagbe/apu.h"
+#include "libyagbe/bus.h"
+#include "libyagbe/compat/compat_stdbool.h"
+#include "libyagbe/gb.h"
+#include "libyagbe/ppu.h"
+#include "libyagbe/scheduler.h"
+#include "utility.h"
+
+/* WRAM is kept in pages, but saved as the two banks it's made up of. */
+static size_t get_wram_offset(const unsigned int page) {
+  return (page * LIBYAGBE_BUS_PAGE_SIZE) % LIBYAGBE_BUS_MEM_SIZE_WRAM;
+}
+
+static bool is_wram1_page(const unsigned int page) {
+  return page >= (LIBYAGBE_BUS_MEM_SIZE_WRAM / LIBYAGBE_BUS_PAGE_SIZE);
+}
+
+static void save_wram(const struct libyagbe_bus* const bus,
+                      struct libyagbe_state* const state) {
+  unsigned int page;
+
+  for (page = 0; page < LIBYAGBE_BUS_WRAM_PAGE_COUNT; ++page) {
+    uint8_t* const bank = is_wram1_page(page) ? state->wram1 : state->wram0;
+
+    memcpy(&bank[get_wram_offset(page)], bus->wram[page],
+           LIBYAGBE_BUS_PAGE_SIZE);
+  }
+}
+
+static void load_wram(struct libyagbe_bus* const bus,
+                      const struct libyagbe_state* const state) {
+  unsigned int page;
+
+  for (page = 0; page < LIBYAGBE_BUS_WRAM_PAGE_COUNT; ++page) {
+    const uint8_t* const bank =
+        is_wram1_page(page) ? state->wram1 : state->wram0;
+
+    memcpy(bus->wram[page], &bank[get_wram_offset(page)],
+           LIBYAGBE_BUS_PAGE_SIZE);
+  }
+}
+
+static size_t get_cart_ram_size(const struct libyagbe_cart* const cart) {
+  return (size_t)cart->ram_page_count * LIBYAGBE_BUS_PAGE_SIZE;
+}
+
+/* Cartridge RAM follows the rest of the state. */
+static void save_cart(const struct libyagbe_cart* const cart,
+                      struct libyagbe_state* const state) {
+  uint8_t* const ram = (uint8_t*)(state + 1);
+  unsigned int page;
+
+  for (page = 0; page < cart->ram_page_count; ++page) {
+    memcpy(&ram[page * LIBYAGBE_BUS_PAGE_SIZE], cart->ram[page],
+           LIBYAGBE_BUS_PAGE_SIZE);
+  }
+  state->cart_ram_size = (uint32_t)get_cart_ram_size(cart);
+
+  state->ram_enabled = cart->ram_enabled;
+  state->rom_bank = cart->rom_bank;
+  state->ram_bank = cart->ram_bank;
+  state->mbc_mode = cart->mode;
+  state->rom_banks[0] = cart->rom_banks[0];
+  state->rom_banks[1] = cart->rom_banks[1];
+  state->ram_page = cart->ram_page;
+
+  memcpy(state->rtc, cart->rtc, sizeof(state->rtc));
+  memcpy(state->rtc_latched, cart->rtc_latched, sizeof(state->rtc_latched));
+  state->rtc_latch_armed = cart->rtc_latch_armed;
+  state->timestamp_rtc = cart->timestamp_rtc;
+  state->rtc_cycles = cart->rtc_cycles;
+}
+
+/* The banks are mapped again along with the rest of the memory map. */
+static void load_cart(struct libyagbe_cart* const cart,
+                      const struct libyagbe_state* const state) {
+  const uint8_t* const ram = (const uint8_t*)(state + 1);
+  unsigned int page;
+
+  for (page = 0; page < cart->ram_page_count; ++page) {
+    memcpy(cart->ram[page], &ram[page * LIBYAGBE_BUS_PAGE_SIZE],
+           LIBYAGBE_BUS_PAGE_SIZE);
+  }
+
+  /* None of that went through the bus. */
+  memset(cart->ram_dirty, 0xFF, sizeof(cart->ram_dirty));
+
+  cart->ram_enabled = state->ram_enabled;
+  cart->rom_bank = state->rom_bank;
+  cart->ram_bank = state->ram_bank;
+  cart->mode = state->mbc_mode;
+
+  cart->rom_banks[0] = state->rom_banks[0];
+  cart->rom_banks[1] = state->rom_banks[1];
+  cart->ram_page = state->ram_page;
+
+  /* A state saved with a bigger cartridge inserted mustn't map memory past
+   * the end of this one. */
+  if (cart->rom_bank_count != 0) {
+    cart->rom_banks[0] %= cart->rom_bank_count;
+    cart->rom_banks[1] %= cart->rom_bank_count;
+  }
+
+  memcpy(cart->rtc, state->rtc, sizeof(cart->rtc));
+  memcpy(cart->rtc_latched, state->rtc_latched, sizeof(cart->rtc_latched));
+  cart->rtc_latch_armed = state->rtc_latch_armed;
+  cart->timestamp_rtc = state->timestamp_rtc;
+  cart->rtc_cycles = state->rtc_cycles;
+}
+
+static void save_ppu(const struct libyagbe_ppu* const ppu,
+                     struct libyagbe_state* const state) {
+  memcpy(state->vram, ppu->vram, sizeof(state->vram));
+  memcpy(state->oam, ppu->oam, sizeof(state->oam));
+
+  state->ppu_regs[LIBYAGBE_PPU_IO_REG_LCDC] = ppu->lcdc;
+  state->ppu_regs[LIBYAGBE_PPU_IO_REG_STAT] = ppu->stat;
+  state->ppu_regs[LIBYAGBE_PPU_IO_REG_SCY] = ppu->scy;
+  state->ppu_regs[LIBYAGBE_PPU_IO_REG_SCX] = ppu->scx;
+  state->ppu_regs[LIBYAGBE_PPU_IO_REG_LY] = ppu->ly;
+  state->ppu_regs[LIBYAGBE_PPU_IO_REG_LYC] = ppu->lyc;
+  state->ppu_regs[LIBYAGBE_PPU_IO_REG_DMA] = ppu->dma;
+  state->ppu_regs[LIBYAGBE_PPU_IO_REG_BGP] = ppu->bgp;
+  state->ppu_regs[LIBYAGBE_PPU_IO_REG_OBP0] = ppu->obp0;
+  state->ppu_regs[LIBYAGBE_PPU_IO_REG_OBP1] = ppu->obp1;
+  state->ppu_regs[LIBYAGBE_PPU_IO_REG_WY] = ppu->wy;
+  state->ppu_regs[LIBYAGBE_PPU_IO_REG_WX] = ppu->wx;
+
+  state->ppu_mode = ppu->mode;
+  state->window_line = ppu->window_line;
+  state->stat_line = ppu->stat_line;
+  state->frame_drawn = ppu->frame_drawn;
+  state->frame_count = ppu->frame_count;
+}
+
+static void load_ppu(struct libyagbe_ppu* const ppu,
+                     const struct libyagbe_state* const state) {
+  memcpy(ppu->vram, state->vram, sizeof(state->vram));
+  memcpy(ppu->oam, state->oam, sizeof(ppu->oam));
+
+  /* Decoding every tile again is left until the next line is drawn, which
+   * may well be never. */
+  memset(ppu->dirty_tiles, 0xFF, sizeof(ppu->dirty_tiles));
+  ppu->tiles_dirty = true;
+
+  ppu->lcdc = state->ppu_regs[LIBYAGBE_PPU_IO_REG_LCDC];
+  ppu->stat = state->ppu_regs[LIBYAGBE_PPU_IO_REG_STAT];
+  ppu->scy = state->ppu_regs[LIBYAGBE_PPU_IO_REG_SCY];
+  ppu->scx = state->ppu_regs[LIBYAGBE_PPU_IO_REG_SCX];
+  ppu->ly = state->ppu_regs[LIBYAGBE_PPU_IO_REG_LY];
+  ppu->lyc = state->ppu_regs[LIBYAGBE_PPU_IO_REG_LYC];
+  ppu->dma = state->ppu_regs[LIBYAGBE_PPU_IO_REG_DMA];
+  ppu->bgp = state->ppu_regs[LIBYAGBE_PPU_IO_REG_BGP];
+  ppu->obp0 = state->ppu_regs[LIBYAGBE_PPU_IO_REG_OBP0];
+  ppu->obp1 = state->ppu_regs[LIBYAGBE_PPU_IO_REG_OBP1];
+  ppu->wy = state->ppu_regs[LIBYAGBE_PPU_IO_REG_WY];
+  ppu->wx = state->ppu_regs[LIBYAGBE_PPU_IO_REG_WX];
+
+  ppu->mode = state->ppu_mode;
+  ppu->window_line = state->window_line;
+  ppu->stat_line = state->stat_line;
+  ppu->frame_drawn = state->frame_drawn;
+  ppu->frame_count = state->frame_count;
+}
+
+static void save_apu(const struct libyagbe_apu* const apu,
+                     struct libyagbe_state* const state) {
+  memcpy(state->apu_regs, apu->regs, sizeof(state->apu_regs));
+  memcpy(state->wave_ram, apu->wave_ram, sizeof(state->wave_ram));
+  memcpy(state->channels, apu->channels, sizeof(state->channels));
+
+  state->sweep_frequency = apu->sweep_frequency;
+  state->sweep_timer = apu->sweep_timer;
+  state->sweep_enabled = apu->sweep_enabled;
+  state->sequencer_step = apu->sequencer_step;
+  state->timestamp_sequencer = apu->timestamp_sequencer;
+}
+
+static void load_apu(struct libyagbe_gb* const gb,
+                     const struct libyagbe_state* const state) {
+  struct libyagbe_apu* const apu = &gb->apu;
+
+  memcpy(apu->regs, state->apu_regs, sizeof(apu->regs));
+  memcpy(apu->wave_ram, state->wave_ram, sizeof(apu->wave_ram));
+  memcpy(apu->channels, state->channels, sizeof(apu->channels));
+
+  apu->sweep_frequency = state->sweep_frequency;
+  apu->sweep_timer = state->sweep_timer;
+  apu->sweep_enabled = state->sweep_enabled;
+  apu->sequencer_step = state->sequencer_step;
+  apu->timestamp_sequencer = state->timestamp_sequencer;
+
+  /* Samples from before the state was loaded belong to another timeline, so
+   * output starts over. The APU isn't caught up, so that loading leaves no
+   * trace in the state. */
+  libyagbe_apu_restart_output(gb);
+}
+
+size_t libyagbe_state_get_size(const struct libyagbe_gb* const gb) {
+  return sizeof(struct libyagbe_state) + get_cart_ram_size(&gb->cart);
+}
+
+int libyagbe_state_save(const struct libyagbe_gb* const gb, void* const buffer,
+                        const size_t size) {
+  struct libyagbe_state* const state = buffer;
+  unsigned int type;
+
+  if (size < libyagbe_state_get_size(gb)) {
+    return 0;
+  }
+
+  memcpy(state->magic, LIBYAGBE_STATE_MAGIC, LIBYAGBE_STATE_MAGIC_SIZE);
+  state->version = LIBYAGBE_STATE_VERSION;
+  state->size = sizeof(struct libyagbe_state);
+
+  state->af = gb->cpu.reg.af.value;
+  state->bc = gb->cpu.reg.bc.value;
+  state->de = gb->cpu.reg.de.value;
+  state->hl = gb->cpu.reg.hl.value;
+  state->sp = gb->cpu.reg.sp.value;
+  state->pc = gb->cpu.reg.pc.value;
+
+  save_wram(&gb->bus, state);
+  memcpy(state->hram, gb->bus.hram, sizeof(state->hram));
+  state->interrupt_flag = gb->bus.interrupt_flag;
+  state->interrupt_enable = gb->bus.interrupt_enable;
+
+  save_cart(&gb->cart, state);
+
+  state->pending_events = gb->scheduler.active_mask;
+
+  for (type = 0; type < LIBYAGBE_SCHEDULER_EVENT_COUNT; ++type) {
+    state->event_timestamps[type] = gb->scheduler.events[type].timestamp;
+  }
+  state->timestamp_now = gb->scheduler.timestamp_now;
+
+  state->timer = gb->timer;
+
+  save_ppu(&gb->ppu, state);
+  save_apu(&gb->apu, state);
+
+  return 1;
+}
+
+int libyagbe_state_load(struct libyagbe_gb* const gb, const void* const buffer,
+                        const size_t size) {
+  const struct libyagbe_state* const state = buffer;
+  unsigned int type;
+
+  if ((size < sizeof(struct libyagbe_state)) ||
+      (memcmp(state->magic, LIBYAGBE_STATE_MAGIC,
+              LIBYAGBE_STATE_MAGIC_SIZE) != 0) ||
+      (state->version != LIBYAGBE_STATE_VERSION) ||
+      (state->size != sizeof(struct libyagbe_state)) ||
+      (state->cart_ram_size != get_cart_ram_size(&gb->cart)) ||
+      (size < libyagbe_state_get_size(gb))) {
+    return 0;
+  }
+
+  /* Every event is registered when the instance is reset. */
+  for (type = 0; type < LIBYAGBE_SCHEDULER_EVENT_COUNT; ++type) {
+    if (gb->scheduler.events[type].cb_func == NULL) {
+      return 0;
+    }
+  }
+
+  /* Memory shared with forked instances is overwritten below, so this
+   * instance needs its own copy first. */
+  if (!libyagbe_bus_unshare_memory(gb)) {
+    return 0;
+  }
+
+  /* Like resetting, this gives an instance that stopped another chance. */
+  gb->logger.critical_raised = 0;
+
+  gb->cpu.reg.af.value = state->af;
+  gb->cpu.reg.bc.value = state->bc;
+  gb->cpu.reg.de.value = state->de;
+  gb->cpu.reg.hl.value = state->hl;
+  gb->cpu.reg.sp.value = state->sp;
+  gb->cpu.reg.pc.value = state->pc;
+
+  load_wram(&gb->bus, state);
+  memcpy(gb->bus.hram, state->hram, sizeof(gb->bus.hram));
+  gb->bus.interrupt_flag = state->interrupt_flag;
+  gb->bus.interrupt_enable = state->interrupt_enable;
+
+  load_cart(&gb->cart, state);
+
+  /* Memory was written behind the bus' back, so any block decoded from
+   * writable memory is dropped along with the pages being watched. Blocks
+   * decoded from ROM are still good. */
+  libyagbe_bus_update_memory_map(gb);
+
+  gb->scheduler.timestamp_now = state->timestamp_now;
+
+  for (type = 0; type < LIBYAGBE_SCHEDULER_EVENT_COUNT; ++type) {
+    libyagbe_scheduler_cancel_event(
+        gb, (enum libyagbe_scheduler_event_types)type);
+  }
+
+  for (type = 0; type < LIBYAGBE_SCHEDULER_EVENT_COUNT; ++type) {
+    if (BIT_IS_SET(state->pending_events, type)) {
+      libyagbe_scheduler_schedule_event(
+          gb, (enum libyagbe_scheduler_event_types)type,
+          state->event_timestamps[type]);
+    }
+  }
+
+  gb->timer = state->timer;
+
+  load_ppu(&gb->ppu, state);
+  load_apu(gb, state);
+
+  return 1;
+}
@@ -15,122 +15,151 @@
 
 #include "libyagbe/timer.h"
 
+#include "debug/log.h"
 #include "libyagbe/bus.h"
 #include "libyagbe/compat/compat_stdbool.h"
-#include "libyagbe/debug/logger.h"
+#include "libyagbe/gb.h"
 #include "libyagbe/scheduler.h"
 #include "utility.h"
 
-static struct libyagbe_timer timer;
-static const unsigned int timing[4] = {1024, 256, 16, 8};
+/* The number of cycles between TIMA ticks for each clock select value. These
+ * are all powers of two, as TIMA ticks whenever a certain bit of the system
+ * counter goes from 1 to 0. */
+static const unsigned int timing[4] = {1024, 16, 64, 256};
 
-static void handle_tima_increment(void);
-static void handle_tima_overflow(void);
+static void handle_tima_overflow(struct libyagbe_gb* const gb);
 
-static void set_tac_value(const uint8_t new_tac) {
-  timer.tac = (timer.tac & ~0x07) | (new_tac & 0x07);
+static bool timer_is_enabled(struct libyagbe_gb* const gb) {
+  return BIT_IS_SET(gb->timer.tac, LIBYAGBE_TIMER_TAC_ENABLED);
 }
 
-static bool timer_is_enabled(void) {
-  return BIT_IS_SET(timer.tac, LIBYAGBE_TIMER_TAC_ENABLED);
+static uintmax_t get_timestamp_now(struct libyagbe_gb* const gb) {
+  return gb->scheduler.timestamp_now;
 }
 
-static void insert_tima_increment_event(void) {
-  struct libyagbe_scheduler_event event;
+static unsigned int get_tima_period(struct libyagbe_gb* const gb) {
+  return timing[gb->timer.tac & LIBYAGBE_TIMER_TAC_CLOCK_MASK];
+}
+
+/* Returns the value of the system counter at the given point in time. */
+static uintmax_t get_system_counter(struct libyagbe_gb* const gb,
+                                    const uintmax_t timestamp) {
+  return timestamp - gb->timer.timestamp_div;
+}
 
-  event.timestamp = timing[timer.tac & LIBYAGBE_TIMER_TAC_CLOCK_MASK];
-  event.cb_func = &handle_tima_increment;
-  event.type = LIBYAGBE_SCHEDULER_EVENT_TIMA_INCREMENT;
-  event.group = LIBYAGBE_SCHEDULER_EVENT_GROUP_TIMER;
+/* Returns the number of times TIMA has ticked since it was last brought up to
+ * date. */
+static uintmax_t get_elapsed_ticks(struct libyagbe_gb* const gb) {
+  const unsigned int period = get_tima_period(gb);
 
-  libyagbe_scheduler_insert_event(&event);
+  return (get_system_counter(gb, get_timestamp_now(gb)) / period) -
+         (get_system_counter(gb, gb->timer.timestamp_tima) / period);
 }
 
-static void insert_tima_overflow_event(void) {
-  struct libyagbe_scheduler_event event;
+/* Folds the ticks since TIMA was last brought up to date into its value. This
+ * has to happen before anything changes how TIMA ticks. */
+static void sync_tima(struct libyagbe_gb* const gb) {
+  if (timer_is_enabled(gb)) {
+    gb->timer.tima += (uint8_t)get_elapsed_ticks(gb);
+  }
+  gb->timer.timestamp_tima = get_timestamp_now(gb);
+}
 
-  event.timestamp = timing[timer.tac & LIBYAGBE_TIMER_TAC_CLOCK_MASK];
-  event.cb_func = &handle_tima_overflow;
-  event.type = LIBYAGBE_SCHEDULER_EVENT_TIMA_OVERFLOW;
-  event.group = LIBYAGBE_SCHEDULER_EVENT_GROUP_TIMER;
+static void schedule_tima_overflow_event(struct libyagbe_gb* const gb) {
+  const unsigned int period = get_tima_period(gb);
+  const uintmax_t first_tick =
+      get_system_counter(gb, gb->timer.timestamp_tima) / period;
 
-  libyagbe_scheduler_insert_event(&event);
+  libyagbe_scheduler_schedule_event(
+      gb, LIBYAGBE_SCHEDULER_EVENT_TIMA_OVERFLOW,
+      gb->timer.timestamp_div +
+          ((first_tick + (0x100 - gb->timer.tima)) * period));
 }
 
-#if 0
-static void adjust_tima_overflow_timestamp(const uint8_t new_tima_value) {
-  (void)new_tima_value;
-  struct libyagbe_scheduler_event* event =
-      libyagbe_scheduler_find_event(LIBYAGBE_SCHEDULER_EVENT_TIMA_OVERFLOW);
-  uintmax_t delta;
+/* Brings the overflow event in line with a change to TIMA or to how it
+ * ticks. */
+static void update_tima_overflow_event(struct libyagbe_gb* const gb) {
+  if (timer_is_enabled(gb)) {
+    schedule_tima_overflow_event(gb);
+  } else {
+    libyagbe_scheduler_delete_event_group(gb,
+                                          LIBYAGBE_SCHEDULER_EVENT_GROUP_TIMER);
+  }
+}
 
-  /* This event should be guaranteed to be present. */
-  assert(event != NULL);
+static void handle_tima_overflow(struct libyagbe_gb* const gb) {
+  gb->timer.tima = gb->timer.tma;
+  gb->timer.timestamp_tima = get_timestamp_now(gb);
 
-  delta = (0xFF - new_tima_value) *
-          timing[timer.tac & LIBYAGBE_TIMER_TAC_CLOCK_MASK];
+  libyagbe_bus_set_interrupt(gb, LIBYAGBE_BUS_IF_TIMER);
+  schedule_tima_overflow_event(gb);
 }
-#endif
 
-static void handle_tima_overflow(void) {
-  timer.tima = timer.tma;
-  libyagbe_bus_set_interrupt(LIBYAGBE_BUS_IF_TIMER);
+void libyagbe_timer_reset(struct libyagbe_gb* const gb) {
+  gb->timer.tima = 0x00;
+  gb->timer.tma = 0x00;
+  gb->timer.tac = 0xF8;
 
-  if (timer_is_enabled()) {
-    insert_tima_overflow_event();
-  }
+  gb->timer.timestamp_tima = get_timestamp_now(gb);
+  gb->timer.timestamp_div = get_timestamp_now(gb);
+
+  libyagbe_scheduler_register_event(gb, LIBYAGBE_SCHEDULER_EVENT_TIMA_OVERFLOW,
+                                    LIBYAGBE_SCHEDULER_EVENT_GROUP_TIMER,
+                                    &handle_tima_overflow);
 }
 
-static void handle_tima_increment(void) {
-  timer.tima++;
+uint8_t libyagbe_timer_read_div(struct libyagbe_gb* const gb) {
+  return (get_system_counter(gb, get_timestamp_now(gb)) >> 8) & 0xFF;
+}
 
-  if (timer_is_enabled()) {
-    insert_tima_increment_event();
+uint8_t libyagbe_timer_read_tima(struct libyagbe_gb* const gb) {
+  if (timer_is_enabled(gb)) {
+    return gb->timer.tima + (uint8_t)get_elapsed_ticks(gb);
   }
+  return gb->timer.tima;
 }
 
-void libyagbe_timer_reset(void) {
-  timer.tima = 0x00;
-  timer.tma = 0x00;
-  timer.tac = 0xF8;
+uint8_t libyagbe_timer_read_tma(struct libyagbe_gb* const gb) {
+  return gb->timer.tma;
 }
 
-void libyagbe_timer_handle_tima_write(const uint8_t new_tima_value) {
-  if (timer_is_enabled()) {
-    /* The timer is enabled, which means a TIMA overflow event is already
-     * present. We need to adjust the expiry time for it. */
-    /*adjust_tima_overflow_timestamp(new_tima_value);*/
-  }
-  timer.tima = new_tima_value;
+uint8_t libyagbe_timer_read_tac(struct libyagbe_gb* const gb) {
+  return gb->timer.tac;
 }
 
-void libyagbe_timer_handle_tma_write(const uint8_t new_tma_value) {
-  timer.tma = new_tma_value;
+void libyagbe_timer_handle_div_write(struct libyagbe_gb* const gb) {
+  /* Any write resets the whole system counter, which moves the points in time
+   * TIMA ticks at. */
+  sync_tima(gb);
+  gb->timer.timestamp_div = get_timestamp_now(gb);
+
+  update_tima_overflow_event(gb);
 }
 
-void libyagbe_timer_handle_tac_write(const uint8_t new_tac_value) {
-  /* Is the timer being enabled from a disabled state? */
-  if (!timer_is_enabled() &&
-      BIT_IS_SET(new_tac_value, LIBYAGBE_TIMER_TAC_ENABLED)) {
-    libyagbe_log(LIBYAGBE_LOG_LEVEL_INFO, "Timer became enabled.");
+void libyagbe_timer_handle_tima_write(struct libyagbe_gb* const gb,
+                                      const uint8_t new_tima_value) {
+  sync_tima(gb);
+  gb->timer.tima = new_tima_value;
 
-    /* The timer has now been enabled from a previously disabled state,
-     * schedule the appropriate events. */
-    insert_tima_increment_event();
-    insert_tima_overflow_event();
+  update_tima_overflow_event(gb);
+}
 
-    set_tac_value(new_tac_value);
-    return;
-  }
+void libyagbe_timer_handle_tma_write(struct libyagbe_gb* const gb,
+                                     const uint8_t new_tma_value) {
+  gb->timer.tma = new_tma_value;
+}
 
-  /* Is the timer being disabled from an enabled state? */
-  if (timer_is_enabled() &&
-      !BIT_IS_SET(new_tac_value, LIBYAGBE_TIMER_TAC_ENABLED)) {
-    libyagbe_log(LIBYAGBE_LOG_LEVEL_INFO, "Timer became disabled.");
+void libyagbe_timer_handle_tac_write(struct libyagbe_gb* const gb,
+                                     const uint8_t new_tac_value) {
+  const bool was_enabled = timer_is_enabled(gb);
 
-    libyagbe_scheduler_delete_event_group(LIBYAGBE_SCHEDULER_EVENT_GROUP_TIMER);
-    set_tac_value(new_tac_value);
+  sync_tima(gb);
+  gb->timer.tac = 0xF8 | (new_tac_value & 0x07);
 
-    return;
+  if (!was_enabled && timer_is_enabled(gb)) {
+    LOG_INFO((gb, "Timer became enabled."));
+  } else if (was_enabled && !timer_is_enabled(gb)) {
+    LOG_INFO((gb, "Timer became disabled."));
   }
+  update_tima_overflow_event(gb);
 }
@@ -16,20 +16,265 @@
 #ifndef LIBYAGBE_APU_H
 #define LIBYAGBE_APU_H
 
+#include <stddef.h>
+
 #include "compat/compat_stdint.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/* Forward declaration. */
+struct libyagbe_gb;
+
+/**
+ * @brief Defines the memory addresses of each APU register, as offsets from
+ * $FF10.
+ */
 enum libyagbe_apu_io_regs {
-  LIBYAGBE_APU_IO_REG_NR50 = 0x4,
-  LIBYAGBE_APU_IO_REG_NR51 = 0x5,
-  LIBYAGBE_APU_IO_REG_NR52 = 0x6
+  LIBYAGBE_APU_IO_REG_NR10 = 0x00,
+  LIBYAGBE_APU_IO_REG_NR11 = 0x01,
+  LIBYAGBE_APU_IO_REG_NR12 = 0x02,
+  LIBYAGBE_APU_IO_REG_NR13 = 0x03,
+  LIBYAGBE_APU_IO_REG_NR14 = 0x04,
+  LIBYAGBE_APU_IO_REG_NR21 = 0x06,
+  LIBYAGBE_APU_IO_REG_NR22 = 0x07,
+  LIBYAGBE_APU_IO_REG_NR23 = 0x08,
+  LIBYAGBE_APU_IO_REG_NR24 = 0x09,
+  LIBYAGBE_APU_IO_REG_NR30 = 0x0A,
+  LIBYAGBE_APU_IO_REG_NR31 = 0x0B,
+  LIBYAGBE_APU_IO_REG_NR32 = 0x0C,
+  LIBYAGBE_APU_IO_REG_NR33 = 0x0D,
+  LIBYAGBE_APU_IO_REG_NR34 = 0x0E,
+  LIBYAGBE_APU_IO_REG_NR41 = 0x10,
+  LIBYAGBE_APU_IO_REG_NR42 = 0x11,
+  LIBYAGBE_APU_IO_REG_NR43 = 0x12,
+  LIBYAGBE_APU_IO_REG_NR44 = 0x13,
+  LIBYAGBE_APU_IO_REG_NR50 = 0x14,
+  LIBYAGBE_APU_IO_REG_NR51 = 0x15,
+  LIBYAGBE_APU_IO_REG_NR52 = 0x16,
+
+  /** The number of register addresses, including unused ones. */
+  LIBYAGBE_APU_IO_REG_COUNT = 0x17,
+
+  /** The start of wave RAM, $FF30. */
+  LIBYAGBE_APU_IO_WAVE_RAM = 0x20
+};
+
+/**
+ * @brief Identifies each of the sound channels.
+ */
+enum libyagbe_apu_channels {
+  LIBYAGBE_APU_CHANNEL_SQUARE1,
+  LIBYAGBE_APU_CHANNEL_SQUARE2,
+  LIBYAGBE_APU_CHANNEL_WAVE,
+  LIBYAGBE_APU_CHANNEL_NOISE,
+
+  /** The number of channels; not a channel itself. */
+  LIBYAGBE_APU_CHANNEL_COUNT
+};
+
+/**
+ * @brief The sizes of APU memory areas in bytes, and of the sample buffer.
+ */
+enum libyagbe_apu_sizes {
+  LIBYAGBE_APU_WAVE_RAM_SIZE = 16,
+
+  /** The number of samples each side of the output buffer has room for. Half
+   * of them are kept for the caller to read, the rest are the frame being
+   * produced. */
+  LIBYAGBE_APU_BUFFER_SIZE = 8192,
+
+  /** The number of samples each step in the output is spread over, to keep
+   * it free of aliasing. */
+  LIBYAGBE_APU_STEP_WIDTH = 16
+};
+
+/**
+ * @brief The limits of the output sample rate in Hz.
+ */
+enum libyagbe_apu_sample_rates {
+  LIBYAGBE_APU_SAMPLE_RATE_MIN = 8000,
+  LIBYAGBE_APU_SAMPLE_RATE_MAX = 192000
+};
+
+/**
+ * @brief The state of a sound channel.
+ *
+ * Not every field is used by every channel.
+ */
+struct libyagbe_apu_channel {
+  /** The scheduler timestamp at which the waveform next moves on. */
+  uintmax_t timestamp_step;
+
+  /** The number of cycles between steps of the waveform. */
+  unsigned int period;
+
+  /** The length counter; the channel is disabled once it runs out. */
+  unsigned int length;
+
+  /** The linear feedback shift register of the noise channel. */
+  uint16_t lfsr;
+
+  uint8_t enabled;
+
+  /** The step of the duty cycle, or the sample of wave RAM, being played. */
+  uint8_t position;
+
+  /** The volume set by the envelope. */
+  uint8_t volume;
+
+  /** The number of envelope clocks left until the volume changes. */
+  uint8_t envelope_timer;
+
+  /** The level the channel is currently outputting, from 0 to 15. */
+  uint8_t level;
+};
+
+/**
+ * @brief A band-limited step buffer for one side of the output.
+ *
+ * Instead of samples, changes in level are stored here, each spread out over
+ * \ref LIBYAGBE_APU_STEP_WIDTH samples. Reading samples adds the changes up.
+ */
+struct libyagbe_apu_buffer {
+  int32_t deltas[LIBYAGBE_APU_BUFFER_SIZE + LIBYAGBE_APU_STEP_WIDTH];
+
+  /** The sum of the deltas read so far, i.e. the current level. */
+  int32_t integrator;
+};
+
+/**
+ * @brief Defines the structure of the audio processing unit.
+ *
+ * The APU isn't ticked along with the CPU. It only catches up to the current
+ * point in time when one of its registers is accessed, when samples are read,
+ * and about once a video frame, and even then it only does work where the
+ * output of a channel changes.
+ */
+struct libyagbe_apu {
+  /** The registers from NR10 to NR52, as last written. */
+  uint8_t regs[LIBYAGBE_APU_IO_REG_COUNT];
+
+  uint8_t wave_ram[LIBYAGBE_APU_WAVE_RAM_SIZE];
+
+  struct libyagbe_apu_channel channels[LIBYAGBE_APU_CHANNEL_COUNT];
+
+  /** The frequency channel 1's sweep works from. */
+  unsigned int sweep_frequency;
+  uint8_t sweep_timer;
+  uint8_t sweep_enabled;
+
+  /** Which of the 8 steps of the frame sequencer is next. */
+  uint8_t sequencer_step;
+
+  /** The scheduler timestamp of the next frame sequencer step. */
+  uintmax_t timestamp_sequencer;
+
+  /** The scheduler timestamp the current frame of output started at. */
+  uintmax_t timestamp_frame;
+
+  /** The output of each side, allocated together the first time samples are
+   * produced, or NULL until then. Forks which are never heard don't pay for
+   * them. */
+  struct libyagbe_apu_buffer* left;
+  struct libyagbe_apu_buffer* right;
+
+  /** The output sample rate in Hz, or 0 if no samples are produced. Like the
+   * framebuffer of the PPU, this survives \ref libyagbe_system_reset(). */
+  unsigned long sample_rate;
+
+  /** The number of output samples per cycle, with 20 fractional bits. */
+  unsigned long sample_factor;
+
+  /** The number of samples finished and ready to be read. */
+  size_t samples_available;
+
+  /** The fraction of a sample the current frame started at, in the same
+   * format as \ref libyagbe_apu::sample_factor. */
+  unsigned long sample_remainder;
 };
 
+/**
+ * @brief Resets the APU to the startup state.
+ *
+ * This function should not be called directly; use \ref libyagbe_system_reset()
+ * instead.
+ */
+void libyagbe_apu_reset(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Releases the output buffers.
+ *
+ * This function should not be called directly; it's called by
+ * \ref libyagbe_gb_destroy().
+ */
+void libyagbe_apu_release(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Sets the rate samples are produced at.
+ *
+ * Without a sample rate, which is the default, the APU keeps track of nothing
+ * but what programs can read back from its registers, which costs next to
+ * nothing. Any samples not read yet are discarded.
+ *
+ * @param gb The instance to produce samples from.
+ * @param sample_rate The rate in Hz, between \ref LIBYAGBE_APU_SAMPLE_RATE_MIN
+ * and \ref LIBYAGBE_APU_SAMPLE_RATE_MAX, or 0 to produce no samples.
+ * @return int 1 if the rate was set, or 0 if it's out of range. This is not a
+ * bool as its size would then depend on the language standard used.
+ */
+int libyagbe_apu_set_sample_rate(struct libyagbe_gb* const gb,
+                                 const unsigned long sample_rate);
+
+/**
+ * @brief Discards any samples produced, and starts producing them again from
+ * where the APU was last caught up to.
+ *
+ * This function should not be called directly; it's called once the state of
+ * the APU has been replaced, by \ref libyagbe_state_load() or
+ * \ref libyagbe_gb_fork().
+ */
+void libyagbe_apu_restart_output(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Reads the samples produced so far.
+ *
+ * Up to half of \ref LIBYAGBE_APU_BUFFER_SIZE samples are kept; if they're not
+ * read often enough, the oldest ones are discarded.
+ *
+ * @param gb The instance to read samples from.
+ * @param samples Where to write the samples to, as pairs of left and right
+ * signed 16-bit values.
+ * @param count The maximum number of pairs to write.
+ * @return size_t The number of pairs written.
+ */
+size_t libyagbe_apu_read_samples(struct libyagbe_gb* const gb,
+                                 int16_t* const samples, const size_t count);
+
+/**
+ * @brief Reads an APU register or wave RAM.
+ *
+ * @param gb The instance to read from.
+ * @param address The memory address, between $FF10 and $FF3F.
+ * @return uint8_t The value read.
+ */
+uint8_t libyagbe_apu_read_register(struct libyagbe_gb* const gb,
+                                   const uint16_t address);
+
+/**
+ * @brief Writes to an APU register or wave RAM.
+ *
+ * @param gb The instance to write to.
+ * @param address The memory address, between $FF10 and $FF3F.
+ * @param data The value to write.
+ */
+void libyagbe_apu_handle_register_write(struct libyagbe_gb* const gb,
+                                        const uint16_t address,
+                                        const uint8_t data);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
 
-#endif /* LIBYAGBE_APU_H */
\ No newline at end of file
+#endif /* LIBYAGBE_APU_H */
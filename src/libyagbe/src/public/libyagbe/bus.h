@@ -16,12 +16,16 @@
 #ifndef LIBYAGBE_BUS_H
 #define LIBYAGBE_BUS_H
 
+#include "compat/compat_stdbool.h"
 #include "compat/compat_stdint.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/* Forward declaration. */
+struct libyagbe_gb;
+
 /**
  * @brief The sizes of memory areas in bytes.
  */
@@ -30,6 +34,39 @@ enum libyagbe_bus_mem_sizes {
   LIBYAGBE_BUS_MEM_SIZE_HRAM = 128
 };
 
+/**
+ * @brief Defines the granularity of the memory map.
+ */
+enum libyagbe_bus_page_sizes {
+  /** The number of bytes covered by a single memory map entry. */
+  LIBYAGBE_BUS_PAGE_SIZE = 256,
+
+  /** The number of memory map entries needed to cover the address space. */
+  LIBYAGBE_BUS_PAGE_COUNT = 256,
+
+  /** The number of pages both banks of WRAM are made up of. */
+  LIBYAGBE_BUS_WRAM_PAGE_COUNT =
+      (LIBYAGBE_BUS_MEM_SIZE_WRAM * 2) / LIBYAGBE_BUS_PAGE_SIZE
+};
+
+/**
+ * @brief The number of distinct addresses that accesses the bus couldn't handle
+ * are counted for.
+ */
+enum libyagbe_bus_unhandled_limits { LIBYAGBE_BUS_UNHANDLED_MAX = 256 };
+
+/**
+ * @brief Counts accesses to an address the bus doesn't know how to handle.
+ */
+struct libyagbe_bus_unhandled_access {
+  /** The address accessed, with bit 16 set for writes. */
+  unsigned long key;
+
+  /** The number of times the address was accessed, or 0 if this entry is not
+   * in use. */
+  unsigned long hits;
+};
+
 /**
  * @brief Defines the bus memory registers.
  */
@@ -39,62 +76,196 @@ enum libyagbe_bus_io_regs {
   LIBYAGBE_BUS_IO_REG_IF = 0xF
 };
 
-enum libyagbe_bus_if_bits { LIBYAGBE_BUS_IF_TIMER = 2 };
+enum libyagbe_bus_if_bits {
+  LIBYAGBE_BUS_IF_VBLANK = 0,
+  LIBYAGBE_BUS_IF_LCD_STAT = 1,
+  LIBYAGBE_BUS_IF_TIMER = 2
+};
+
+/**
+ * @brief Called for every byte sent out over the serial port.
+ */
+typedef void (*libyagbe_bus_serial_cb)(struct libyagbe_gb* const gb,
+                                       const uint8_t data);
 
 /** @brief This structure defines the interconnect between the CPU and devices.
  */
 struct libyagbe_bus {
-  uint8_t wram0[LIBYAGBE_BUS_MEM_SIZE_WRAM];
-  uint8_t wram1[LIBYAGBE_BUS_MEM_SIZE_WRAM];
+  /** Each page of WRAM, from $C000 on. Pages are allocated separately, so
+   * that instances forked from one another can share those neither of them
+   * wrote to since. Shared pages are left out of the write map, and the first
+   * write to one makes a copy of it. */
+  uint8_t* wram[LIBYAGBE_BUS_WRAM_PAGE_COUNT];
 
   uint8_t hram[LIBYAGBE_BUS_MEM_SIZE_HRAM];
 
   uint8_t interrupt_flag;
   uint8_t interrupt_enable;
+
+  /** Receives serial output, or NULL to discard it. */
+  libyagbe_bus_serial_cb serial_cb;
+
+  /** Host memory backing each page of the address space for reads, or NULL
+   * if reads from the page must be decoded as I/O. */
+  const uint8_t* read_map[LIBYAGBE_BUS_PAGE_COUNT];
+
+  /** Same as above, but for writes. */
+  uint8_t* write_map[LIBYAGBE_BUS_PAGE_COUNT];
+
+  /** Writable memory backing pages which the CPU has cached code from. These
+   * pages are taken out of the write map, so that the first write to one goes
+   * through the slow path and can invalidate the code. */
+  uint8_t* watched_pages[LIBYAGBE_BUS_PAGE_COUNT];
+
+  /** Only the first access to an unhandled address is logged, as programs
+   * polling such an address would otherwise flood the log. */
+  struct libyagbe_bus_unhandled_access unhandled[LIBYAGBE_BUS_UNHANDLED_MAX];
 };
 
 /**
- * @brief Returns the bus structure.
+ * @brief Resets the bus to the startup state.
+ *
+ * This function should not be called directly; use \ref libyagbe_system_reset()
+ * instead.
+ */
+void libyagbe_bus_reset(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Allocates WRAM and VRAM. Cartridge RAM is allocated when a
+ * cartridge is inserted.
  *
- * This is useful if you want to inspect memory areas, change the values of
- * memory areas, or bus registers.
+ * This function should not be called directly; it's called by
+ * \ref libyagbe_gb_create().
  *
- * @return struct libyagbe_bus*
+ * @return bool true on success, or false if out of memory, in which case
+ * whatever was allocated must still be released.
+ */
+bool libyagbe_bus_alloc_memory(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Releases WRAM and VRAM, or this instance's references to them if
+ * they're shared.
  */
-struct libyagbe_bus* libyagbe_bus_get_data(void);
+void libyagbe_bus_release_memory(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Shares memory with a new instance, and copies the rest of the bus.
+ *
+ * Both instances then write to shared pages through the slow path, which
+ * copies a page before the first write to it. Nothing is copied up front.
+ *
+ * This function should not be called directly; use \ref libyagbe_gb_fork()
+ * instead.
+ *
+ * @param child The new instance, which must not have any memory allocated.
+ * @param gb The instance to share memory with.
+ */
+void libyagbe_bus_fork(struct libyagbe_gb* const child,
+                       struct libyagbe_gb* const gb);
+
+/**
+ * @brief Makes sure no memory is shared with other instances, such as before
+ * overwriting all of it.
+ *
+ * @return bool true on success, or false if out of memory, in which case some
+ * memory may still be shared.
+ */
+bool libyagbe_bus_unshare_memory(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Rebuilds the memory map.
+ *
+ * This must be called whenever memory is mapped to a different host buffer,
+ * i.e. when a cartridge is inserted. Switching banks only needs
+ * \ref libyagbe_bus_map_cart_rom() or \ref libyagbe_bus_map_cart_ram().
+ */
+void libyagbe_bus_update_memory_map(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Watches a page for writes on behalf of the CPU's block cache.
+ *
+ * The next write to the page invalidates every block cached from it, after
+ * which the page is no longer watched.
+ *
+ * @param gb The instance whose memory map to update.
+ * @param page The index of the page, i.e. the upper 8 bits of its address.
+ * @return bool true if the page is writable memory and is now watched, or
+ * false if the page can't be written to and there is nothing to watch. Pages
+ * shared with other instances count as writable.
+ */
+bool libyagbe_bus_watch_page(struct libyagbe_gb* const gb,
+                             const unsigned int page);
 
 /**
  * @brief Enables the specified interrupt.
  *
+ * @param gb The instance to trigger the interrupt on.
  * @param interrupt The interrupt to set as triggered.
  */
-void libyagbe_bus_set_interrupt(const enum libyagbe_bus_if_bits interrupt);
+void libyagbe_bus_set_interrupt(struct libyagbe_gb* const gb,
+                                const enum libyagbe_bus_if_bits interrupt);
+
+/**
+ * @brief Maps the ROM banks selected by the MBC.
+ *
+ * Switching banks costs no more than this: the pages of each 16 KiB area are
+ * pointed at the new bank, and nothing is copied.
+ */
+void libyagbe_bus_map_cart_rom(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Maps the RAM bank selected by the MBC, or unmaps RAM if it's
+ * disabled.
+ */
+void libyagbe_bus_map_cart_ram(struct libyagbe_gb* const gb);
 
 /**
- * @brief Sets a pointer to the cartridge data to use.
+ * @brief Takes the clean pages of mapped cartridge RAM back out of the write
+ * map, so that the next write to each marks it dirty.
  *
- * The cartridge data will not be copied to an internal buffer, it is your
- * responsibility to make sure that the pointer remains valid.
+ * Unlike remapping RAM, this leaves the code cached from it alone.
+ */
+void libyagbe_bus_protect_cart_ram(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Sets the function to receive bytes sent over the serial port.
+ *
+ * Test ROMs commonly report their results this way. Unlike the rest of the
+ * bus, this survives \ref libyagbe_system_reset().
+ *
+ * @param gb The instance to receive serial output from.
+ * @param cb_func The function to call, or NULL to discard serial output.
+ */
+void libyagbe_bus_set_serial_cb(struct libyagbe_gb* const gb,
+                                const libyagbe_bus_serial_cb cb_func);
+
+/**
+ * @brief Logs every address the bus didn't know how to handle an access to,
+ * along with the number of accesses since the last reset.
  *
- * @param data The pointer to the cartridge data.
+ * @param gb The instance to report on.
  */
-void libyagbe_bus_set_cart_data(uint8_t* const data);
+void libyagbe_bus_report_unhandled(struct libyagbe_gb* const gb);
 
 /**
  * @brief Reads a byte from memory or I/O devices.
  *
+ * @param gb The instance whose memory to read from.
  * @param address The memory address to read from.
  * @return uint8_t The value from memory or an I/O device.
  */
-uint8_t libyagbe_bus_read_memory(const uint16_t address);
+uint8_t libyagbe_bus_read_memory(struct libyagbe_gb* const gb,
+                                 const uint16_t address);
 
 /**
  * @brief Writes a byte to memory or I/O devices.
  *
+ * @param gb The instance whose memory to write to.
  * @param address The memory address to write to.
  * @param data The data to write to the memory address.
  */
-void libyagbe_bus_write_memory(const uint16_t address, const uint8_t data);
+void libyagbe_bus_write_memory(struct libyagbe_gb* const gb,
+                               const uint16_t address, const uint8_t data);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,322 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_CART_H
+#define LIBYAGBE_CART_H
+
+#include <stddef.h>
+
+#include "bus.h"
+#include "compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Forward declaration. */
+struct libyagbe_gb;
+
+/**
+ * @brief Called by \ref libyagbe_cart_flush_ram() for each run of cartridge
+ * RAM written to since the last flush.
+ *
+ * @param gb The instance whose RAM was written to.
+ * @param offset Where the run starts, in bytes from the start of RAM.
+ * @param size The size of the run in bytes.
+ */
+typedef void (*libyagbe_cart_dirty_cb)(struct libyagbe_gb* const gb,
+                                       const size_t offset, const size_t size);
+
+/**
+ * @brief The sizes of cartridge memory in bytes.
+ */
+enum libyagbe_cart_mem_sizes {
+  /** The smallest a cartridge can be, i.e. two ROM banks. */
+  LIBYAGBE_CART_MEM_SIZE_ROM_MIN = 32768,
+
+  LIBYAGBE_CART_MEM_SIZE_ROM_BANK = 16384,
+  LIBYAGBE_CART_MEM_SIZE_RAM_BANK = 8192,
+
+  /** The most RAM any supported cartridge has, i.e. 16 banks on an MBC5. */
+  LIBYAGBE_CART_MEM_SIZE_RAM_MAX = 131072,
+
+  /** The size of the RAM built into the MBC2, which only holds 4 bits per
+   * byte. */
+  LIBYAGBE_CART_MEM_SIZE_MBC2_RAM = 512,
+
+  /** The number of pages the largest RAM is made up of. */
+  LIBYAGBE_CART_RAM_PAGE_COUNT =
+      LIBYAGBE_CART_MEM_SIZE_RAM_MAX / LIBYAGBE_BUS_PAGE_SIZE
+};
+
+/**
+ * @brief Defines the memory bank controllers that are supported.
+ */
+enum libyagbe_cart_mbc_types {
+  /** A plain 32 KiB ROM, possibly with 8 KiB of RAM. */
+  LIBYAGBE_CART_MBC_NONE,
+
+  LIBYAGBE_CART_MBC1,
+  LIBYAGBE_CART_MBC2,
+  LIBYAGBE_CART_MBC3,
+  LIBYAGBE_CART_MBC5,
+
+  /** Anything else. Such a cartridge is run as if it had no MBC. */
+  LIBYAGBE_CART_MBC_UNSUPPORTED
+};
+
+/**
+ * @brief Defines the registers of the MBC3's real time clock.
+ */
+enum libyagbe_cart_rtc_regs {
+  LIBYAGBE_CART_RTC_REG_S,
+  LIBYAGBE_CART_RTC_REG_M,
+  LIBYAGBE_CART_RTC_REG_H,
+  LIBYAGBE_CART_RTC_REG_DL,
+  LIBYAGBE_CART_RTC_REG_DH,
+  LIBYAGBE_CART_RTC_REG_COUNT
+};
+
+enum libyagbe_cart_header_sizes {
+  /** The number of characters in the title. Later cartridges use the last
+   * few for other purposes, so they may not be printable. */
+  LIBYAGBE_CART_TITLE_SIZE = 16,
+
+  /** The number of bytes the header takes up from the start of the ROM. */
+  LIBYAGBE_CART_HEADER_END = 0x150
+};
+
+/**
+ * @brief Defines what the cartridge header says about a cartridge.
+ */
+struct libyagbe_cart_header {
+  /** The title, with a terminating NUL. */
+  char title[LIBYAGBE_CART_TITLE_SIZE + 1];
+
+  /** The cartridge type as found in the header. */
+  uint8_t type;
+
+  /** One of \ref libyagbe_cart_mbc_types. */
+  uint8_t mbc;
+
+  /** Nonzero if the cartridge has RAM, a battery keeping the RAM and the
+   * clock going, or a real time clock, respectively. */
+  uint8_t has_ram;
+  uint8_t has_battery;
+  uint8_t has_rtc;
+
+  /** The sizes of ROM and RAM in bytes. The MBC2's RAM is always
+   * \ref LIBYAGBE_CART_MEM_SIZE_MBC2_RAM bytes, whatever the header says. */
+  unsigned long rom_size;
+  unsigned long ram_size;
+
+  /** Nonzero if the header checksum matches, which the boot ROM insists on
+   * before starting a cartridge. */
+  uint8_t checksum_valid;
+};
+
+/**
+ * @brief Defines the structure of a cartridge and its memory bank controller.
+ *
+ * Banks are switched by pointing the memory map at another part of ROM or
+ * RAM, so that accesses cost the same no matter which bank they go to.
+ */
+struct libyagbe_cart {
+  struct libyagbe_cart_header header;
+
+  /** The cartridge data, owned by the caller. */
+  const uint8_t* rom;
+
+  /** The number of whole ROM banks in \ref rom. */
+  unsigned int rom_bank_count;
+
+  /** Each page of RAM; only the first \ref ram_page_count are used. These
+   * are shared between forked instances the same way as WRAM, unless they
+   * point into \ref ram_buffer. */
+  uint8_t* ram[LIBYAGBE_CART_RAM_PAGE_COUNT];
+  unsigned int ram_page_count;
+
+  /** The memory lent by the caller to hold RAM, or NULL if the instance
+   * allocated it. */
+  uint8_t* ram_buffer;
+
+  /** Bit N % 8 of entry N / 8 is set if page N of RAM was written to since
+   * the last flush. Clean pages are left out of the write map, so only the
+   * first write to each takes the slow path. */
+  uint8_t ram_dirty[LIBYAGBE_CART_RAM_PAGE_COUNT / 8];
+
+  /** The ROM banks mapped to $0000 and $4000. */
+  unsigned int rom_banks[2];
+
+  /** The index of the first page of RAM mapped to $A000, or -1 if RAM isn't
+   * mapped. */
+  int ram_page;
+
+  /** The MBC registers, as written. What they mean depends on the MBC:
+   * \ref rom_bank holds up to 9 bits of the ROM bank number, \ref ram_bank
+   * holds the RAM bank number, the upper bits of the ROM bank number on an
+   * MBC1, or the clock register selected on an MBC3, and \ref mode is the
+   * banking mode of an MBC1. */
+  uint8_t ram_enabled;
+  unsigned int rom_bank;
+  uint8_t ram_bank;
+  uint8_t mode;
+
+  /** The clock registers, and a copy of them taken when they were last
+   * latched, which is what's actually read. */
+  uint8_t rtc[LIBYAGBE_CART_RTC_REG_COUNT];
+  uint8_t rtc_latched[LIBYAGBE_CART_RTC_REG_COUNT];
+
+  /** Nonzero if $00 was written to the latch register last, so that writing
+   * $01 next latches the clock. */
+  uint8_t rtc_latch_armed;
+
+  /** The clock isn't ticked along with the CPU; \ref rtc is only brought up
+   * to date when it's accessed. These are the scheduler timestamp it was last
+   * brought up to date at, and the number of cycles into the current
+   * second. */
+  uintmax_t timestamp_rtc;
+  unsigned long rtc_cycles;
+};
+
+/**
+ * @brief Reads the header of a cartridge.
+ *
+ * @param data The cartridge data.
+ * @param size The size of \p data in bytes.
+ * @param header Receives what the header says.
+ * @return int 1 on success, or 0 if \p data is too small to hold a header.
+ */
+int libyagbe_cart_parse_header(const uint8_t* const data, const size_t size,
+                               struct libyagbe_cart_header* const header);
+
+/**
+ * @brief Inserts a cartridge.
+ *
+ * The cartridge data will not be copied to an internal buffer, it is your
+ * responsibility to make sure that the pointer remains valid. The data is
+ * never written to, so it may be read-only memory, and may be shared between
+ * any number of instances.
+ *
+ * Cartridge RAM is allocated here and cleared; unlike the rest of the
+ * system, it survives \ref libyagbe_system_reset(), as does the clock. Any
+ * buffer set with \ref libyagbe_cart_set_ram_buffer() is let go of.
+ *
+ * @param gb The instance to insert the cartridge into.
+ * @param data The cartridge data.
+ * @param size The size of \p data in bytes, at least
+ * \ref LIBYAGBE_CART_MEM_SIZE_ROM_MIN. Any partial bank at the end is ignored.
+ * @return int 1 on success, or 0 if \p data is too small or out of memory, in
+ * which case no cartridge is inserted.
+ */
+int libyagbe_cart_insert(struct libyagbe_gb* const gb,
+                         const uint8_t* const data, const size_t size);
+
+/**
+ * @brief Keeps cartridge RAM in memory provided by the caller.
+ *
+ * This is meant for battery-backed RAM: with \p data pointing into a shared
+ * file mapping, every write the program makes lands in the file without any
+ * copying, and survives the process crashing. Writes to RAM cost the same as
+ * ever, apart from the first one to each page after a flush.
+ *
+ * The memory will not be copied to an internal buffer, it is your
+ * responsibility to make sure that the pointer remains valid until the
+ * cartridge is removed, another buffer is set, or the instance is destroyed.
+ * Instances forked from this one get a copy of RAM of their own.
+ *
+ * @param gb The instance whose cartridge RAM to keep in \p data.
+ * @param data The memory to keep RAM in, which must hold
+ * \ref libyagbe_cart_header::ram_size bytes. Its contents become the contents
+ * of RAM, and every page of it starts out clean. If NULL, RAM is copied back
+ * into memory allocated by the instance.
+ * @return int 1 on success, or 0 if the cartridge has no RAM or out of memory,
+ * in which case nothing is changed.
+ */
+int libyagbe_cart_set_ram_buffer(struct libyagbe_gb* const gb,
+                                 uint8_t* const data);
+
+/**
+ * @brief Reports which parts of cartridge RAM were written to since the last
+ * flush, and marks them clean again.
+ *
+ * Nothing is written out here; \p cb_func is expected to start writing each
+ * run out on its own, e.g. with an asynchronous msync(), so that the instance
+ * is never kept waiting on storage. Loading a state marks all of RAM dirty.
+ *
+ * @param gb The instance to flush.
+ * @param cb_func Called for each run of dirty RAM, in order.
+ */
+void libyagbe_cart_flush_ram(struct libyagbe_gb* const gb,
+                             const libyagbe_cart_dirty_cb cb_func);
+
+/**
+ * @brief Releases cartridge RAM, or this instance's references to it if it's
+ * shared.
+ *
+ * This function should not be called directly; it's called by
+ * \ref libyagbe_gb_destroy().
+ */
+void libyagbe_cart_release(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Shares cartridge RAM with a new instance, and copies the rest of the
+ * cartridge.
+ *
+ * This function should not be called directly; use \ref libyagbe_gb_fork()
+ * instead.
+ *
+ * @return int 1 on success, or 0 if RAM kept in a buffer of the caller's
+ * couldn't be copied.
+ */
+int libyagbe_cart_fork(struct libyagbe_gb* const child,
+                       const struct libyagbe_gb* const gb);
+
+/**
+ * @brief Resets the MBC to the startup state.
+ *
+ * Unlike the other devices, this is called before the scheduler is reset, so
+ * that the clock can be brought up to date first.
+ *
+ * This function should not be called directly; use \ref libyagbe_system_reset()
+ * instead.
+ */
+void libyagbe_cart_reset(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Handles a write to the MBC registers, i.e. to $0000-$7FFF.
+ */
+void libyagbe_cart_handle_register_write(struct libyagbe_gb* const gb,
+                                         const uint16_t address,
+                                         const uint8_t data);
+
+/**
+ * @brief Reads from $A000-$BFFF when it isn't mapped, i.e. when RAM is
+ * disabled or the clock is selected.
+ */
+uint8_t libyagbe_cart_read_ram(struct libyagbe_gb* const gb,
+                               const uint16_t address);
+
+/**
+ * @brief Writes to $A000-$BFFF when it isn't mapped for writes.
+ */
+void libyagbe_cart_write_ram(struct libyagbe_gb* const gb,
+                             const uint16_t address, const uint8_t data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_CART_H */
@@ -23,7 +23,9 @@
 extern "C" {
 #endif /* __cplusplus */
 
-#if (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L)
+#if defined(__cplusplus)
+/* bool, true and false are keywords. */
+#elif (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L)
 #include <stdbool.h>
 #else
 #define false 0
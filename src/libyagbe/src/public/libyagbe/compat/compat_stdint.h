@@ -27,7 +27,10 @@ extern "C" {
 
 typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
+typedef unsigned int uint32_t;
 typedef signed char int8_t;
+typedef short int16_t;
+typedef int int32_t;
 typedef unsigned long uintmax_t;
 
 #endif /* (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L) || \
@@ -16,6 +16,9 @@
 #ifndef LIBYAGBE_CPU_H
 #define LIBYAGBE_CPU_H
 
+#include <stddef.h>
+
+#include "bus.h"
 #include "compat/compat_stdint.h"
 
 #ifdef __cplusplus
@@ -23,7 +26,51 @@ extern "C" {
 #endif /* __cplusplus */
 
 /* Forward declaration. */
-struct libyagbe_bus;
+struct libyagbe_gb;
+
+/** @brief Passed to \ref libyagbe_cpu_run() to not stop at any address. */
+#define LIBYAGBE_CPU_NO_BREAKPOINT 0x10000UL
+
+/**
+ * @brief Limits of the decoded block cache.
+ */
+enum libyagbe_cpu_block_limits {
+  /** The number of blocks which can be cached at once; a power of 2. */
+  LIBYAGBE_CPU_BLOCK_COUNT = 1024,
+
+  /** The maximum number of instructions in a single block. */
+  LIBYAGBE_CPU_BLOCK_MAX_INSTRUCTIONS = 16
+};
+
+/**
+ * @brief Implements a single instruction.
+ */
+typedef void (*libyagbe_cpu_opcode_handler)(struct libyagbe_gb* const gb);
+
+/**
+ * @brief A block compiled to native code by the JIT compiler.
+ *
+ * Runs the whole block, leaving the program counter at the next block, and
+ * returns the number of cycles taken. Adding those to the scheduler is left to
+ * the caller.
+ */
+typedef unsigned int (*libyagbe_cpu_native_block)(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Selects how cached blocks are run when the JIT compiler is built in.
+ */
+enum libyagbe_cpu_jit_mode {
+  /** Blocks which run often enough are compiled to native code. */
+  LIBYAGBE_CPU_JIT_ENABLED,
+
+  /** Every block is interpreted. */
+  LIBYAGBE_CPU_JIT_DISABLED,
+
+  /** Every compiled block is run by both the JIT compiler and the
+   * interpreter, and a critical message is logged if they disagree on the
+   * resulting registers or cycle count. The interpreter's result is kept. */
+  LIBYAGBE_CPU_JIT_VERIFY
+};
 
 /* XXX: On older compilers, though I seriously doubt it, this may be dangerous.
  *  Need to investigate.
@@ -46,6 +93,57 @@ typedef union _libyagbe_cpu_register_pair {
   } byte;
 } libyagbe_cpu_register_pair;
 
+/**
+ * @brief A block of instructions decoded ahead of time.
+ */
+struct libyagbe_cpu_block {
+  /** The host memory the block was decoded from, or NULL if this entry is
+   * not in use. As banked memory is backed by different host memory for
+   * every bank, this tells apart blocks at the same address. */
+  const uint8_t* code;
+
+  /** The generation of the block's page when it was decoded. The block is out
+   * of date once the page has moved on to another. */
+  uint32_t generation;
+
+  /** The address of the first instruction. */
+  uint16_t pc;
+
+  /** The number of bytes of code covered by the block. */
+  uint16_t size;
+
+  /** The number of instructions in the block. */
+  uint8_t instruction_count;
+
+  /** The number of times the block was interpreted while waiting to be
+   * compiled by the JIT compiler, which only bothers with blocks run
+   * often. */
+  uint8_t runs;
+
+  /** The block compiled to native code, or NULL if it hasn't been. */
+  libyagbe_cpu_native_block native;
+
+  struct libyagbe_cpu_decoded_instruction {
+    libyagbe_cpu_opcode_handler handler;
+    uint16_t operand;
+    uint8_t opcode;
+    uint8_t length;
+  } instructions[LIBYAGBE_CPU_BLOCK_MAX_INSTRUCTIONS];
+};
+
+/**
+ * @brief Blocks decoded ahead of time, and what's needed to tell when they're
+ * out of date.
+ */
+struct libyagbe_cpu_block_cache {
+  /** Blocks indexed by a hash of their starting address. */
+  struct libyagbe_cpu_block blocks[LIBYAGBE_CPU_BLOCK_COUNT];
+
+  /** Indexed by the upper 8 bits of an address. Bumping the generation of a
+   * page drops every block decoded from it at once. */
+  uint32_t page_generations[LIBYAGBE_BUS_PAGE_COUNT];
+};
+
 /**
  * @brief Defines the structure of an SM83 CPU.
  *
@@ -60,8 +158,47 @@ struct libyagbe_cpu {
     libyagbe_cpu_register_pair sp;
   } reg;
 
+  /** Where Z and C are kept while the CPU runs, when the core is built with
+   * the YAGBE_CPU_LAZY_FLAGS CMake option. F in \ref reg is brought up to
+   * date before libyagbe_cpu_step() and libyagbe_cpu_run() return, and any
+   * changes made to it in between calls are picked up. */
+  struct libyagbe_cpu_lazy_flags {
+    /** The value Z was last set from; Z is set if this is 0. */
+    uint8_t zero_result;
+
+    /** Nonzero if C is set. */
+    uint8_t carry;
+  } lazy_flags;
+
   /** The current instruction being processed. */
   uint8_t instruction;
+
+  /** The immediate operand of the current instruction, if it has one. For
+   * instructions prefixed with $CB, this is the opcode following the prefix.
+   */
+  uint16_t operand;
+
+#ifdef LIBYAGBE_CPU_BLOCK_CACHE
+  /** Only present when the core is built with the YAGBE_CPU_BLOCK_CACHE CMake
+   * option, and NULL until libyagbe_cpu_run() first needs it. */
+  struct libyagbe_cpu_block_cache* block_cache;
+#endif /* LIBYAGBE_CPU_BLOCK_CACHE */
+
+  /** State of the JIT compiler; unused unless it was built in. */
+  struct libyagbe_cpu_jit {
+    /** Executable memory holding the compiled blocks, or NULL if none has
+     * been allocated yet. */
+    uint8_t* code;
+
+    /** The size of \ref code in bytes. */
+    size_t code_size;
+
+    /** The number of bytes of \ref code in use. */
+    size_t code_used;
+
+    /** One of \ref libyagbe_cpu_jit_mode. */
+    uint8_t mode;
+  } jit;
 };
 
 /**
@@ -73,7 +210,7 @@ struct libyagbe_cpu {
  * This function should not be called directly; use \ref libyagbe_system_reset()
  * instead.
  */
-void libyagbe_cpu_reset(void);
+void libyagbe_cpu_reset(struct libyagbe_gb* const gb);
 
 /**
  * @brief Executes the next instruction.
@@ -83,14 +220,68 @@ void libyagbe_cpu_reset(void);
  * This function should not be called directly; use \ref libyagbe_system_step()
  * instead.
  */
-void libyagbe_cpu_step(void);
+void libyagbe_cpu_step(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Executes instructions until a stop condition is met.
+ *
+ * Execution stops once at least \p cycles cycles have elapsed, the program
+ * counter equals \p breakpoint before an instruction is executed, or a
+ * critical message has been logged. The budget is only checked between blocks
+ * of instructions, so it may be exceeded by the length of the last block.
+ *
+ * This function should not be called directly; use
+ * \ref libyagbe_system_run_cycles() or \ref libyagbe_system_run_until()
+ * instead.
+ *
+ * @param gb The instance to run.
+ * @param cycles The maximum number of cycles to execute.
+ * @param breakpoint The address to stop at, or \ref LIBYAGBE_CPU_NO_BREAKPOINT.
+ * @return uintmax_t The number of cycles that were actually executed.
+ */
+uintmax_t libyagbe_cpu_run(struct libyagbe_gb* const gb, const uintmax_t cycles,
+                           const unsigned long breakpoint);
+
+/**
+ * @brief Discards every cached block decoded from a page of the address space.
+ *
+ * The bus calls this when a page holding cached code is written to or mapped
+ * to different memory.
+ *
+ * @param gb The instance whose cache to update.
+ * @param page The index of the page, i.e. the upper 8 bits of its address.
+ */
+void libyagbe_cpu_invalidate_page(struct libyagbe_gb* const gb,
+                                  const unsigned int page);
+
+/**
+ * @brief Discards every cached block.
+ *
+ * @param gb The instance whose cache to clear.
+ */
+void libyagbe_cpu_flush_blocks(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Releases the block cache, if one was allocated.
+ *
+ * This function should not be called directly; it's called by
+ * \ref libyagbe_gb_destroy().
+ */
+void libyagbe_cpu_release_blocks(struct libyagbe_gb* const gb);
 
 /**
- * @brief Returns the current SM83 CPU instance.
+ * @brief Selects how cached blocks are run.
+ *
+ * Unlike the rest of the CPU, this survives \ref libyagbe_system_reset().
  *
- * @return struct libyagbe_cpu*
+ * @param gb The instance to configure.
+ * @param mode The new mode.
+ * @return int Nonzero if the mode was changed, or 0 if the JIT compiler is not
+ * built in, in which case every block is interpreted regardless. This is not a
+ * bool as its size would then depend on the language standard used.
  */
-struct libyagbe_cpu* libyagbe_cpu_get_data(void);
+int libyagbe_cpu_set_jit_mode(struct libyagbe_gb* const gb,
+                              const enum libyagbe_cpu_jit_mode mode);
 
 #ifdef __cplusplus
 }
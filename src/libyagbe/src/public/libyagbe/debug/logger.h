@@ -18,11 +18,17 @@
 
 #include <stdarg.h>
 
+#include "../compat/compat_stdint.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
-typedef void (*libyagbe_log_cb)(const char* const str);
+/* Forward declaration. */
+struct libyagbe_gb;
+
+typedef void (*libyagbe_log_cb)(struct libyagbe_gb* const gb,
+                                const char* const str);
 
 enum libyagbe_log_level {
   LIBYAGBE_LOG_LEVEL_INFO,
@@ -30,16 +36,134 @@ enum libyagbe_log_level {
   LIBYAGBE_LOG_LEVEL_CRITICAL
 };
 
+/**
+ * @brief Defines the limits of asynchronous logging.
+ */
+enum libyagbe_logger_limits {
+  /** The number of messages that can be waiting to be drained; must be a
+   * power of two. */
+  LIBYAGBE_LOGGER_RING_SIZE = 256,
+
+  /** The maximum number of arguments a message can be deferred with. */
+  LIBYAGBE_LOGGER_MAX_ARGS = 4
+};
+
+/**
+ * @brief Defines a message waiting to be formatted and delivered.
+ */
+struct libyagbe_log_record {
+  /** The format string; must be a string literal. */
+  const char* str;
+
+  /** The arguments, each widened to unsigned long. */
+  unsigned long args[LIBYAGBE_LOGGER_MAX_ARGS];
+
+  /** The scheduler timestamp the message was logged at. */
+  uintmax_t timestamp;
+
+  /** The level the message was logged at. */
+  uint8_t level;
+
+  /** Nonzero if the format string has conversions other than integer ones,
+   * or too many of them, in which case it's delivered as is. */
+  uint8_t raw;
+};
+
 struct libyagbe_logger {
   libyagbe_log_cb info_cb;
   libyagbe_log_cb warning_cb;
   libyagbe_log_cb critical_cb;
+
+  /** Nonzero if a critical message has been logged since the last reset. A
+   * critical message means the emulator can no longer continue, so the batch
+   * execution functions in gb.h stop as soon as this is set.
+   *
+   * This is not a bool as its size would then depend on the language standard
+   * the including code is compiled with. */
+  uint8_t critical_raised;
+
+  /** The timestamp of the message currently being delivered. */
+  uintmax_t message_timestamp;
+
+  /** Nonzero if messages are queued for \ref libyagbe_logger_drain() rather
+   * than being delivered straight away. */
+  uint8_t async;
+
+  /** The queued messages; \ref LIBYAGBE_LOGGER_RING_SIZE of them, allocated
+   * the first time asynchronous mode is turned on, or NULL until then. The
+   * emulation thread only writes to \ref ring_head, and the thread draining
+   * the messages only writes to \ref ring_tail. Both only ever increase,
+   * wrapping around. */
+  struct libyagbe_log_record* ring;
+  unsigned long ring_head;
+  unsigned long ring_tail;
+
+  /** The number of messages thrown away because the ring was full, and how
+   * many of those the draining thread has reported. */
+  unsigned long dropped;
+  unsigned long dropped_reported;
 };
 
-void libyagbe_logger_set_log_level_cb(const enum libyagbe_log_level log_level,
+void libyagbe_logger_set_log_level_cb(struct libyagbe_gb* const gb,
+                                      const enum libyagbe_log_level log_level,
                                       const libyagbe_log_cb cb_func);
 
-void libyagbe_log(const enum libyagbe_log_level log_level,
+/**
+ * @brief Switches between delivering messages synchronously and
+ * asynchronously.
+ *
+ * By default, messages are formatted and passed to the log callbacks from
+ * within the emulation thread as soon as they're logged, so slow callbacks
+ * slow down emulation. In asynchronous mode, messages are instead queued in a
+ * lock-free ring buffer, and formatted and delivered only once
+ * \ref libyagbe_logger_drain() is called, from whichever thread the host
+ * likes. Logging never blocks; if the ring is full the message is dropped.
+ *
+ * Only integer conversions are deferred, which is all the core uses.
+ *
+ * Critical messages still stop emulation as soon as they're logged.
+ *
+ * @param gb The instance to set the mode of.
+ * @param async Nonzero to queue messages, or zero to deliver them straight
+ * away. Drain any queued messages before switching back.
+ * @return int Nonzero on success, or zero if asynchronous logging isn't
+ * supported by the compiler the library was built with, or if out of memory.
+ */
+int libyagbe_logger_set_async(struct libyagbe_gb* const gb, const int async);
+
+/**
+ * @brief Releases the ring messages are queued in.
+ *
+ * This function should not be called directly; it's called by
+ * \ref libyagbe_gb_destroy().
+ */
+void libyagbe_logger_release(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Formats and delivers every queued message.
+ *
+ * This may be called from any one thread other than the emulation thread, as
+ * well as from the emulation thread itself. The log callbacks are called from
+ * the draining thread, and as such must not access the instance other than
+ * through \ref libyagbe_logger_get_timestamp().
+ *
+ * @param gb The instance to deliver messages of.
+ * @return unsigned long The number of messages delivered.
+ */
+unsigned long libyagbe_logger_drain(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Returns the scheduler timestamp the message being delivered was
+ * logged at.
+ *
+ * Only valid from within a log callback.
+ *
+ * @param gb The instance the message was logged by.
+ */
+uintmax_t libyagbe_logger_get_timestamp(const struct libyagbe_gb* const gb);
+
+void libyagbe_log(struct libyagbe_gb* const gb,
+                  const enum libyagbe_log_level log_level,
                   const char* const str, ...);
 
 #ifdef __cplusplus
@@ -0,0 +1,159 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_TRACE_H
+#define LIBYAGBE_TRACE_H
+
+#include <stddef.h>
+
+#include "../compat/compat_stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Forward declaration. */
+struct libyagbe_gb;
+
+/** @brief Identifies a binary trace; written once when tracing starts. */
+#define LIBYAGBE_TRACE_MAGIC "YGBTRC01"
+
+/**
+ * @brief Defines the layout of a binary trace.
+ *
+ * A trace is \ref LIBYAGBE_TRACE_MAGIC followed by any number of fixed-size
+ * records. Every field of a record is stored in little endian byte order.
+ */
+enum libyagbe_trace_layout {
+  /** The size of \ref LIBYAGBE_TRACE_MAGIC, excluding the NUL terminator. */
+  LIBYAGBE_TRACE_MAGIC_SIZE = 8,
+
+  /** BC, DE, HL, AF, SP and PC, 16 bits each. */
+  LIBYAGBE_TRACE_OFFSET_REGS = 0,
+
+  /** The opcode about to be executed, followed by 3 bytes of padding. */
+  LIBYAGBE_TRACE_OFFSET_OPCODE = 12,
+
+  /** The scheduler timestamp before the instruction is executed, 64 bits. */
+  LIBYAGBE_TRACE_OFFSET_TIMESTAMP = 16,
+
+  LIBYAGBE_TRACE_RECORD_SIZE = 24
+};
+
+/**
+ * @brief Called whenever the trace buffer fills up or is flushed.
+ *
+ * @param gb The instance being traced.
+ * @param data The trace data to write out.
+ * @param size The number of bytes pointed to by \p data.
+ */
+typedef void (*libyagbe_trace_sink_cb)(struct libyagbe_gb* const gb,
+                                       const uint8_t* const data,
+                                       const size_t size);
+
+/**
+ * @brief Defines a decoded trace record.
+ */
+struct libyagbe_trace_record {
+  uint16_t bc;
+  uint16_t de;
+  uint16_t hl;
+  uint16_t af;
+  uint16_t sp;
+  uint16_t pc;
+
+  uint8_t opcode;
+
+  /** Only the lower 32 bits are kept if uintmax_t is 32 bits wide. */
+  uintmax_t timestamp;
+};
+
+struct libyagbe_trace {
+  /** The function to pass full buffers to, or NULL if tracing is disabled. */
+  libyagbe_trace_sink_cb sink_cb;
+
+  /** The buffer records are collected in, owned by the caller. */
+  uint8_t* buffer;
+
+  /** The usable size of the buffer, a multiple of the record size. */
+  size_t buffer_size;
+
+  /** The number of bytes of the buffer holding records not yet flushed. */
+  size_t buffer_used;
+};
+
+/**
+ * @brief Starts tracing every instruction executed.
+ *
+ * Records are collected in \p buffer, which is handed to \p sink_cb every time
+ * it fills up. The bigger the buffer, the fewer and larger the writes; a few
+ * megabytes is a good size. The buffer is borrowed, and must remain valid until
+ * \ref libyagbe_trace_stop() is called.
+ *
+ * \ref LIBYAGBE_TRACE_MAGIC is passed to \p sink_cb before this function
+ * returns.
+ *
+ * While tracing, the batch execution functions in gb.h run one instruction at
+ * a time, and are considerably slower as a result.
+ *
+ * @param gb The instance to trace.
+ * @param buffer The buffer to collect records in.
+ * @param buffer_size The size of \p buffer in bytes; must be at least
+ * \ref LIBYAGBE_TRACE_RECORD_SIZE.
+ * @param sink_cb The function to write trace data out with.
+ */
+void libyagbe_trace_start(struct libyagbe_gb* const gb, uint8_t* const buffer,
+                          const size_t buffer_size,
+                          const libyagbe_trace_sink_cb sink_cb);
+
+/**
+ * @brief Flushes any buffered records and stops tracing.
+ *
+ * @param gb The instance being traced.
+ */
+void libyagbe_trace_stop(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Passes any buffered records to the sink.
+ *
+ * @param gb The instance being traced.
+ */
+void libyagbe_trace_flush(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Records the current state of the CPU.
+ *
+ * This is done automatically before every instruction is executed while
+ * tracing, but may also be called manually, e.g. to record the state the
+ * instance was left in. Does nothing if tracing is disabled.
+ *
+ * @param gb The instance to record.
+ */
+void libyagbe_trace_record(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Decodes a single record.
+ *
+ * @param data Exactly \ref LIBYAGBE_TRACE_RECORD_SIZE bytes of trace data.
+ * @param record Receives the decoded record.
+ */
+void libyagbe_trace_decode(const uint8_t* const data,
+                           struct libyagbe_trace_record* const record);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_TRACE_H */
@@ -16,13 +16,134 @@
 #ifndef LIBYAGBE_GB_H
 #define LIBYAGBE_GB_H
 
+#include "apu.h"
+#include "bus.h"
+#include "cart.h"
+#include "compat/compat_stdint.h"
+#include "cpu.h"
+#include "debug/logger.h"
+#include "debug/trace.h"
+#include "output.h"
+#include "ppu.h"
+#include "rewind.h"
+#include "scheduler.h"
+#include "timer.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
-void libyagbe_system_reset(void);
+/**
+ * @brief Defines a Game Boy instance.
+ *
+ * Every bit of emulator state lives in here, so any number of instances can be
+ * run side by side, each on its own thread if desired.
+ */
+struct libyagbe_gb {
+  struct libyagbe_cpu cpu;
+  struct libyagbe_bus bus;
+  struct libyagbe_cart cart;
+  struct libyagbe_scheduler scheduler;
+  struct libyagbe_timer timer;
+  struct libyagbe_ppu ppu;
+  struct libyagbe_apu apu;
+  struct libyagbe_output output;
+  struct libyagbe_rewind rewind;
+  struct libyagbe_logger logger;
+  struct libyagbe_trace trace;
+
+  /** Free for the caller to use, e.g. to find its own state from within a
+   * callback. The library never touches it. */
+  void* userdata;
+};
+
+/**
+ * @brief Creates a new instance.
+ *
+ * The instance has no cartridge inserted and no log callbacks set. Set those
+ * up, then call \ref libyagbe_system_reset() before running it.
+ *
+ * @return struct libyagbe_gb* The new instance, or NULL if out of memory.
+ */
+struct libyagbe_gb* libyagbe_gb_create(void);
+
+/**
+ * @brief Destroys an instance created by \ref libyagbe_gb_create().
+ *
+ * The cartridge data is owned by the caller and is not freed.
+ *
+ * @param gb The instance to destroy. May be NULL.
+ */
+void libyagbe_gb_destroy(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Creates a new instance in the same state as another.
+ *
+ * Forking is cheap enough to do thousands of times over: the two instances
+ * share WRAM, VRAM and cartridge RAM a page at a time, and a page is only
+ * copied once either of them writes to it. Cartridge RAM kept in a buffer of
+ * the caller's is copied up front instead. Either may be destroyed before the
+ * other. Given atomics, the two may also run on different threads.
+ *
+ * The new instance has the same cartridge, callbacks, settings and userdata,
+ * but none of the buffers the caller lent out: no framebuffer, no output
+ * queues, no trace and no rewind. Messages are delivered synchronously, and
+ * cached code is decoded again as it runs.
+ *
+ * @param gb The instance to fork, which must have been reset with
+ * \ref libyagbe_system_reset() at least once. Its own state is unchanged,
+ * though writes to the memory it now shares take the slow path once.
+ * @return struct libyagbe_gb* The new instance, or NULL if out of memory.
+ */
+struct libyagbe_gb* libyagbe_gb_fork(struct libyagbe_gb* const gb);
+
+void libyagbe_system_reset(struct libyagbe_gb* const gb);
+
+void libyagbe_system_step(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Runs the system for a number of cycles.
+ *
+ * This is considerably cheaper than calling \ref libyagbe_system_step() in a
+ * loop, as no per-instruction work is left to the caller. Execution also stops
+ * early if a critical message is logged.
+ *
+ * @param gb The instance to run.
+ * @param budget The number of cycles to run for.
+ * @return uintmax_t The number of cycles that were actually run; this may
+ * exceed \p budget by the length of the last few instructions.
+ */
+uintmax_t libyagbe_system_run_cycles(struct libyagbe_gb* const gb,
+                                     const uintmax_t budget);
 
-void libyagbe_system_step(void);
+/**
+ * @brief Runs the system until the program counter reaches an address.
+ *
+ * The check happens before each instruction is executed, so nothing is run if
+ * the program counter is already at \p pc. Execution also stops early if a
+ * critical message is logged.
+ *
+ * @param gb The instance to run.
+ * @param pc The address to stop at.
+ * @return uintmax_t The number of cycles that were run.
+ */
+uintmax_t libyagbe_system_run_until(struct libyagbe_gb* const gb,
+                                    const uint16_t pc);
+
+/**
+ * @brief Runs the system until either of the above stop conditions is met.
+ *
+ * This allows a runaway program to be caught when waiting for it to reach a
+ * certain address.
+ *
+ * @param gb The instance to run.
+ * @param budget The maximum number of cycles to run for.
+ * @param pc The address to stop at.
+ * @return uintmax_t The number of cycles that were run.
+ */
+uintmax_t libyagbe_system_run_cycles_until(struct libyagbe_gb* const gb,
+                                           const uintmax_t budget,
+                                           const uint16_t pc);
 
 #ifdef __cplusplus
 }
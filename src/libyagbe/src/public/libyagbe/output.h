@@ -0,0 +1,217 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_OUTPUT_H
+#define LIBYAGBE_OUTPUT_H
+
+#include <stddef.h>
+
+#include "compat/compat_stdint.h"
+#include "ppu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Forward declaration. */
+struct libyagbe_gb;
+
+/**
+ * @brief Defines the sizes of the output queues.
+ */
+enum libyagbe_output_limits {
+  /** The number of framebuffers; one being drawn, one ready to be presented
+   * and one being presented. */
+  LIBYAGBE_OUTPUT_FRAME_COUNT = 3,
+
+  /** The number of pairs of samples a block of audio holds. */
+  LIBYAGBE_OUTPUT_AUDIO_BLOCK_SIZE = 1024,
+
+  /** The number of blocks of audio that can be waiting to be read; must be a
+   * power of two. */
+  LIBYAGBE_OUTPUT_AUDIO_BLOCK_COUNT = 16
+};
+
+/**
+ * @brief A run of samples queued for the host.
+ */
+struct libyagbe_output_audio_block {
+  /** The scheduler timestamp of the first sample. */
+  uintmax_t timestamp;
+
+  /** The number of pairs of samples in the block. */
+  size_t count;
+
+  /** Pairs of left and right samples. */
+  int16_t samples[LIBYAGBE_OUTPUT_AUDIO_BLOCK_SIZE * 2];
+};
+
+/**
+ * @brief Defines the queues that hand finished frames and samples over to the
+ * host.
+ *
+ * The emulation thread and a single host thread share these without ever
+ * waiting for each other. Apart from setting things up, the emulation thread
+ * only writes to \ref back, \ref audio_head and what they refer to, and the
+ * host thread only to \ref front, \ref audio_tail and what they refer to; the
+ * two only ever meet in \ref middle, which is swapped atomically.
+ */
+struct libyagbe_output {
+  /** The framebuffers, or all NULL if frames aren't queued. */
+  uint8_t* frames[LIBYAGBE_OUTPUT_FRAME_COUNT];
+
+  /** The scheduler timestamp each framebuffer was finished at. */
+  uintmax_t frame_timestamps[LIBYAGBE_OUTPUT_FRAME_COUNT];
+
+  /** The framebuffer being drawn into. */
+  unsigned int back;
+
+  /** The framebuffer handed over last, with \ref LIBYAGBE_OUTPUT_FRAME_FRESH
+   * set if it hasn't been picked up by the host yet. */
+  unsigned int middle;
+
+  /** The framebuffer being presented. */
+  unsigned int front;
+
+  /** Nonzero once the host has picked up a frame. */
+  uint8_t front_valid;
+
+  /** The number of frames that were replaced by a newer one before the host
+   * picked them up. */
+  unsigned long frames_skipped;
+
+  /** \ref LIBYAGBE_OUTPUT_AUDIO_BLOCK_COUNT blocks, allocated the first time
+   * samples are queued, or NULL until then. */
+  struct libyagbe_output_audio_block* audio_blocks;
+
+  /** Like the log ring, both only ever increase, wrapping around. */
+  unsigned long audio_head;
+  unsigned long audio_tail;
+
+  /** How many pairs of samples of the oldest block the host has read. */
+  size_t audio_offset;
+
+  /** The sample rate samples are queued at, or 0 if they aren't. */
+  unsigned long sample_rate;
+};
+
+/** @brief Marks a frame in \ref libyagbe_output::middle as not picked up. */
+#define LIBYAGBE_OUTPUT_FRAME_FRESH 0x4
+
+/**
+ * @brief Queues frames for the host to pick up from another thread.
+ *
+ * The PPU draws into each of the framebuffers in turn, taking over from
+ * \ref libyagbe_ppu_set_framebuffer(). Finished frames are never copied, and
+ * the PPU never waits for the host; if the host is too slow to keep up, it
+ * just gets the newest frame each time.
+ *
+ * This, like \ref libyagbe_output_set_audio(), must not be called while the
+ * host thread may be picking up output. Both survive
+ * \ref libyagbe_system_reset().
+ *
+ * @param gb The instance to queue frames from.
+ * @param framebuffers The memory for \ref LIBYAGBE_OUTPUT_FRAME_COUNT
+ * framebuffers, one after the other, as described for
+ * \ref libyagbe_ppu_set_framebuffer(). If NULL, frames are no longer queued
+ * or drawn.
+ * @param pixel_format One of \ref libyagbe_ppu_pixel_formats.
+ * @param pitch The number of bytes from the start of one line to the start of
+ * the next. If 0, lines are tightly packed.
+ * @return int 1 on success, or 0 if the compiler used has no atomic operations
+ * to build on.
+ */
+int libyagbe_output_set_video(
+    struct libyagbe_gb* const gb, void* const framebuffers,
+    const enum libyagbe_ppu_pixel_formats pixel_format, const size_t pitch);
+
+/**
+ * @brief Releases the audio queue.
+ *
+ * This function should not be called directly; it's called by
+ * \ref libyagbe_gb_destroy().
+ */
+void libyagbe_output_release(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Queues samples for the host to pick up from another thread.
+ *
+ * Samples are taken from the APU once every video frame. If the queue is
+ * full, they're left in the APU, which discards the oldest ones once they no
+ * longer fit.
+ *
+ * @param gb The instance to queue samples from.
+ * @param sample_rate The sample rate to pass on to
+ * \ref libyagbe_apu_set_sample_rate(), or 0 to no longer queue samples.
+ * @return int 1 on success, or 0 if the sample rate isn't supported, the
+ * compiler used has no atomic operations to build on, or out of memory.
+ */
+int libyagbe_output_set_audio(struct libyagbe_gb* const gb,
+                              const unsigned long sample_rate);
+
+/**
+ * @brief Picks up the newest finished frame.
+ *
+ * This is meant to be called from the host thread, and as such must not
+ * access the instance other than through this function and
+ * \ref libyagbe_output_read_samples().
+ *
+ * @param gb The instance to pick up a frame from.
+ * @param timestamp If not NULL, where to store the scheduler timestamp the
+ * frame was finished at.
+ * @return const void* The frame, which stays untouched until the next call,
+ * or NULL if no frame has been finished yet. If no new frame has been
+ * finished since the last call, the same frame is returned again.
+ */
+const void* libyagbe_output_acquire_frame(struct libyagbe_gb* const gb,
+                                          uintmax_t* const timestamp);
+
+/**
+ * @brief Reads queued samples.
+ *
+ * This is meant to be called from the host thread, like
+ * \ref libyagbe_output_acquire_frame().
+ *
+ * @param gb The instance to read samples from.
+ * @param samples Where to write the samples to, as pairs of left and right
+ * signed 16-bit values.
+ * @param count The maximum number of pairs to write.
+ * @param timestamp If not NULL, where to store the scheduler timestamp of the
+ * first sample written. Left alone if nothing is written.
+ * @return size_t The number of pairs written.
+ */
+size_t libyagbe_output_read_samples(struct libyagbe_gb* const gb,
+                                    int16_t* const samples, const size_t count,
+                                    uintmax_t* const timestamp);
+
+/**
+ * @brief Hands the frame just finished over to the host.
+ *
+ * This function should not be called directly; the PPU calls it.
+ */
+void libyagbe_output_handle_frame(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Queues the samples produced so far.
+ *
+ * This function should not be called directly; the APU calls it.
+ */
+void libyagbe_output_handle_samples(struct libyagbe_gb* const gb);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_OUTPUT_H */
@@ -16,20 +16,372 @@
 #ifndef LIBYAGBE_PPU_H
 #define LIBYAGBE_PPU_H
 
+#include <stddef.h>
+
+#include "compat/compat_stdint.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/* Forward declaration. */
+struct libyagbe_gb;
+
+/**
+ * @brief The dimensions of the screen in pixels.
+ */
+enum libyagbe_ppu_screen_sizes {
+  LIBYAGBE_PPU_SCREEN_WIDTH = 160,
+  LIBYAGBE_PPU_SCREEN_HEIGHT = 144
+};
+
+/**
+ * @brief The sizes of PPU memory areas in bytes.
+ */
+enum libyagbe_ppu_mem_sizes {
+  LIBYAGBE_PPU_MEM_SIZE_VRAM = 8192,
+  LIBYAGBE_PPU_MEM_SIZE_OAM = 160,
+
+  /** The part of VRAM at the start which holds tiles, rather than tile
+   * maps. */
+  LIBYAGBE_PPU_MEM_SIZE_TILE_DATA = 6144
+};
+
+/**
+ * @brief The number of tiles in VRAM, and the size of each.
+ */
+enum libyagbe_ppu_tile_sizes {
+  LIBYAGBE_PPU_TILE_COUNT = 384,
+  LIBYAGBE_PPU_TILE_SIZE = 16,
+
+  /** The number of pixels in a tile. */
+  LIBYAGBE_PPU_TILE_PIXELS = 64
+};
+
+/**
+ * @brief Defines the memory addresses of each PPU register.
+ *
+ */
 enum libyagbe_ppu_io_regs {
+  /** $FF40 */
   LIBYAGBE_PPU_IO_REG_LCDC = 0x0,
+
+  /** $FF41 */
+  LIBYAGBE_PPU_IO_REG_STAT = 0x1,
+
+  /** $FF42 */
   LIBYAGBE_PPU_IO_REG_SCY = 0x2,
+
+  /** $FF43 */
   LIBYAGBE_PPU_IO_REG_SCX = 0x3,
+
+  /** $FF44 */
   LIBYAGBE_PPU_IO_REG_LY = 0x4,
-  LIBYAGBE_PPU_IO_REG_BGP = 0x7
+
+  /** $FF45 */
+  LIBYAGBE_PPU_IO_REG_LYC = 0x5,
+
+  /** $FF46 */
+  LIBYAGBE_PPU_IO_REG_DMA = 0x6,
+
+  /** $FF47 */
+  LIBYAGBE_PPU_IO_REG_BGP = 0x7,
+
+  /** $FF48 */
+  LIBYAGBE_PPU_IO_REG_OBP0 = 0x8,
+
+  /** $FF49 */
+  LIBYAGBE_PPU_IO_REG_OBP1 = 0x9,
+
+  /** $FF4A */
+  LIBYAGBE_PPU_IO_REG_WY = 0xA,
+
+  /** $FF4B */
+  LIBYAGBE_PPU_IO_REG_WX = 0xB
 };
 
+/**
+ * @brief Defines the bits of the LCDC register.
+ *
+ */
+enum libyagbe_ppu_lcdc_bits {
+  LIBYAGBE_PPU_LCDC_BG_ENABLED = 0,
+  LIBYAGBE_PPU_LCDC_OBJ_ENABLED = 1,
+  LIBYAGBE_PPU_LCDC_OBJ_TALL = 2,
+  LIBYAGBE_PPU_LCDC_BG_MAP = 3,
+  LIBYAGBE_PPU_LCDC_TILE_DATA = 4,
+  LIBYAGBE_PPU_LCDC_WINDOW_ENABLED = 5,
+  LIBYAGBE_PPU_LCDC_WINDOW_MAP = 6,
+  LIBYAGBE_PPU_LCDC_LCD_ENABLED = 7
+};
+
+/**
+ * @brief Defines the bits of the STAT register which select the interrupt
+ * sources.
+ *
+ */
+enum libyagbe_ppu_stat_bits {
+  LIBYAGBE_PPU_STAT_HBLANK_INT = 3,
+  LIBYAGBE_PPU_STAT_VBLANK_INT = 4,
+  LIBYAGBE_PPU_STAT_OAM_SCAN_INT = 5,
+  LIBYAGBE_PPU_STAT_LYC_INT = 6
+};
+
+/**
+ * @brief The modes the PPU goes through, as reported in the lower 2 bits of
+ * STAT.
+ */
+enum libyagbe_ppu_modes {
+  LIBYAGBE_PPU_MODE_HBLANK = 0,
+  LIBYAGBE_PPU_MODE_VBLANK = 1,
+  LIBYAGBE_PPU_MODE_OAM_SCAN = 2,
+  LIBYAGBE_PPU_MODE_DRAWING = 3
+};
+
+/**
+ * @brief The layouts frames can be written to the framebuffer in.
+ *
+ * Each pixel is one of 4 shades, 0 being the lightest and 3 the darkest, with
+ * the palettes already applied.
+ */
+enum libyagbe_ppu_pixel_formats {
+  /** 4 pixels packed into each byte, the leftmost one in the upper 2 bits, as
+   * the Game Boy itself would send them to the LCD. */
+  LIBYAGBE_PPU_PIXEL_FORMAT_2BPP,
+
+  /** One byte per pixel, holding the shade. */
+  LIBYAGBE_PPU_PIXEL_FORMAT_INDEX8,
+
+  /** One 32-bit value per pixel, looked up from the colors set with
+   * \ref libyagbe_ppu_set_rgba_colors(). */
+  LIBYAGBE_PPU_PIXEL_FORMAT_RGBA32
+};
+
+/**
+ * @brief Selects which frames are drawn.
+ *
+ * Frames which aren't drawn cost next to nothing, as no pixels are fetched or
+ * composed, yet LY, STAT and the interrupts keep their timing, so programs
+ * can't tell the difference.
+ */
+enum libyagbe_ppu_render_modes {
+  /** Every frame is drawn. */
+  LIBYAGBE_PPU_RENDER_ALL,
+
+  /** Only the first of every so many frames is drawn. */
+  LIBYAGBE_PPU_RENDER_EVERY_NTH,
+
+  /** Nothing is drawn. Use \ref libyagbe_ppu_draw_frame() to get a picture of
+   * the state the program finished in. */
+  LIBYAGBE_PPU_RENDER_NONE
+};
+
+/**
+ * @brief Called once a frame has been completely written to the framebuffer,
+ * at the start of VBlank.
+ */
+typedef void (*libyagbe_ppu_frame_cb)(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Defines the structure of the picture processing unit.
+ *
+ * The PPU isn't ticked along with the CPU. The scheduler calls it at each
+ * mode change, and a whole scanline is rendered at once when the drawing mode
+ * ends, using the registers as they are at that point.
+ */
+struct libyagbe_ppu {
+  /** Allocated by the bus, which shares it between forked instances the same
+   * way as a page of WRAM. */
+  uint8_t* vram;
+
+  uint8_t oam[LIBYAGBE_PPU_MEM_SIZE_OAM];
+
+  /** Every tile decoded to one color number per pixel, so that lines can be
+   * drawn by copying pixels rather than picking apart bits. Allocated when
+   * the first line is drawn, or NULL until then. */
+  uint8_t (*tiles)[LIBYAGBE_PPU_TILE_PIXELS];
+
+  /** Bit N of entry T / 8 is set if tile T + N was written to since it was
+   * last decoded. Tiles are only decoded again before drawing a line. */
+  uint8_t dirty_tiles[LIBYAGBE_PPU_TILE_COUNT / 8];
+
+  /** Whether any bit of \ref dirty_tiles is set. */
+  uint8_t tiles_dirty;
+
+  uint8_t lcdc;
+
+  /** Only the interrupt source bits; the rest of STAT is worked out when it's
+   * read. */
+  uint8_t stat;
+
+  uint8_t scy;
+  uint8_t scx;
+  uint8_t ly;
+  uint8_t lyc;
+  uint8_t dma;
+  uint8_t bgp;
+  uint8_t obp0;
+  uint8_t obp1;
+  uint8_t wy;
+  uint8_t wx;
+
+  /** The current mode; one of \ref libyagbe_ppu_modes. */
+  uint8_t mode;
+
+  /** The line of the window to be drawn next. This only advances on lines
+   * the window is actually visible on. */
+  uint8_t window_line;
+
+  /** The STAT interrupt is requested when any of its sources become active
+   * while none were before, so the previous state has to be kept. */
+  uint8_t stat_line;
+
+  /** The number of frames started since reset. */
+  unsigned long frame_count;
+
+  /** Whether the current frame is being drawn. */
+  uint8_t frame_drawn;
+
+  /** Where frames are written to, owned by the caller, or NULL to not render
+   * at all. The output settings below survive
+   * \ref libyagbe_system_reset(). */
+  void* framebuffer;
+
+  /** The number of bytes from the start of one line of the framebuffer to the
+   * start of the next. */
+  size_t pitch;
+
+  /** One of \ref libyagbe_ppu_pixel_formats. */
+  uint8_t pixel_format;
+
+  /** The colors for each shade in the RGBA32 format, or NULL for the default
+   * grayscale ones. */
+  const uint32_t* rgba_colors;
+
+  libyagbe_ppu_frame_cb frame_cb;
+
+  /** One of \ref libyagbe_ppu_render_modes. */
+  uint8_t render_mode;
+
+  /** How many frames apart drawn frames are in
+   * \ref LIBYAGBE_PPU_RENDER_EVERY_NTH. */
+  unsigned int frame_interval;
+};
+
+/**
+ * @brief Resets the PPU to the startup state.
+ *
+ * This function should not be called directly; use \ref libyagbe_system_reset()
+ * instead.
+ */
+void libyagbe_ppu_reset(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Releases the decoded tiles.
+ *
+ * This function should not be called directly; it's called by
+ * \ref libyagbe_gb_destroy().
+ */
+void libyagbe_ppu_release(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Sets where frames are to be written to.
+ *
+ * The framebuffer will not be copied to an internal buffer, it is your
+ * responsibility to make sure that the pointer remains valid. Each scanline is
+ * written as soon as it's drawn, so the frame is only complete once the frame
+ * callback is called.
+ *
+ * @param gb The instance to render frames from.
+ * @param framebuffer The memory to write frames to, which must hold
+ * \ref LIBYAGBE_PPU_SCREEN_HEIGHT lines of \ref LIBYAGBE_PPU_SCREEN_WIDTH
+ * pixels in the given format. If NULL, nothing is rendered, but the PPU keeps
+ * its timing.
+ * @param pixel_format One of \ref libyagbe_ppu_pixel_formats.
+ * @param pitch The number of bytes from the start of one line to the start of
+ * the next, which must be enough to hold a line. If 0, lines are tightly
+ * packed.
+ */
+void libyagbe_ppu_set_framebuffer(
+    struct libyagbe_gb* const gb, void* const framebuffer,
+    const enum libyagbe_ppu_pixel_formats pixel_format, const size_t pitch);
+
+/**
+ * @brief Sets the colors used by \ref LIBYAGBE_PPU_PIXEL_FORMAT_RGBA32.
+ *
+ * The colors will not be copied to an internal buffer, it is your
+ * responsibility to make sure that the pointer remains valid.
+ *
+ * @param gb The instance to set the colors for.
+ * @param colors The 32-bit value to write for each of the 4 shades, lightest
+ * first, or NULL for grayscale stored as 0xRRGGBBAA.
+ */
+void libyagbe_ppu_set_rgba_colors(struct libyagbe_gb* const gb,
+                                  const uint32_t* const colors);
+
+/**
+ * @brief Sets the function to call whenever a frame is complete.
+ *
+ * Unlike the rest of the PPU, this survives \ref libyagbe_system_reset().
+ *
+ * @param gb The instance to receive frames from.
+ * @param cb_func The function to call, or NULL to not be told.
+ */
+void libyagbe_ppu_set_frame_cb(struct libyagbe_gb* const gb,
+                               const libyagbe_ppu_frame_cb cb_func);
+
+/**
+ * @brief Selects which frames are drawn.
+ *
+ * This takes effect from the next frame on. Like the framebuffer, it survives
+ * \ref libyagbe_system_reset(), and the frame callback is only called for
+ * frames which are drawn.
+ *
+ * @param gb The instance to set the mode of.
+ * @param mode One of \ref libyagbe_ppu_render_modes.
+ * @param interval The number of frames from one drawn frame to the next in
+ * \ref LIBYAGBE_PPU_RENDER_EVERY_NTH; ignored otherwise.
+ */
+void libyagbe_ppu_set_render_mode(struct libyagbe_gb* const gb,
+                                  const enum libyagbe_ppu_render_modes mode,
+                                  const unsigned int interval);
+
+/**
+ * @brief Draws a whole frame into the framebuffer at once.
+ *
+ * The frame is drawn from VRAM, OAM and the registers as they are now, so
+ * anything a program changes mid-frame, such as scrolling, will look
+ * different from a frame drawn as the PPU goes along. This is meant for
+ * taking a picture after having run without drawing anything.
+ *
+ * @param gb The instance to draw a frame from. Nothing happens if no
+ * framebuffer is set.
+ */
+void libyagbe_ppu_draw_frame(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Writes to tile data in VRAM.
+ *
+ * Tile data is never in the memory map, so that the decoded tiles can be
+ * kept up to date.
+ *
+ * @param gb The instance whose VRAM to write to.
+ * @param address The memory address to write to, between $8000 and $9FFF.
+ * @param data The value to write.
+ */
+void libyagbe_ppu_handle_vram_write(struct libyagbe_gb* const gb,
+                                    const uint16_t address,
+                                    const uint8_t data);
+
+uint8_t libyagbe_ppu_read_register(struct libyagbe_gb* const gb,
+                                   const enum libyagbe_ppu_io_regs reg);
+
+void libyagbe_ppu_handle_register_write(struct libyagbe_gb* const gb,
+                                        const enum libyagbe_ppu_io_regs reg,
+                                        const uint8_t data);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
 
-#endif /* LIBYAGBE_PPU_H */
\ No newline at end of file
+#endif /* LIBYAGBE_PPU_H */
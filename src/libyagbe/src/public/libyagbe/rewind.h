@@ -0,0 +1,148 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_REWIND_H
+#define LIBYAGBE_REWIND_H
+
+#include <stddef.h>
+
+#include "compat/compat_stdint.h"
+#include "state.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Forward declaration. */
+struct libyagbe_gb;
+
+enum libyagbe_rewind_limits {
+  /** The most snapshots there can be between keyframes. */
+  LIBYAGBE_REWIND_MAX_KEYFRAME_INTERVAL = 256
+};
+
+/**
+ * @brief Defines the rewind buffer.
+ *
+ * Snapshots are kept in a ring of records in a single arena borrowed from the
+ * caller. Every so often a record is a keyframe, holding a whole state;
+ * otherwise it only holds what changed since the previous snapshot, as the
+ * XOR of the two states with runs of zeroes left out. The newest snapshot is
+ * also kept in full, so that stepping back is a matter of loading it and
+ * XORing the newest record into it.
+ *
+ * When the ring fills up, the oldest keyframe is dropped along with the
+ * records that depend on it.
+ */
+struct libyagbe_rewind {
+  /** The arena, or NULL if rewinding is disabled. The newest snapshot and a
+   * scratch state come first, followed by the ring. */
+  uint8_t* arena;
+
+  /** The size of a state, which depends on the cartridge. */
+  size_t state_size;
+
+  /** Where the newest snapshot and the scratch state are in \ref arena; the
+   * two swap places with every snapshot. */
+  struct libyagbe_state* newest_state;
+  struct libyagbe_state* scratch_state;
+
+  /** The ring of records, and its size in bytes. */
+  uint8_t* ring;
+  size_t ring_size;
+
+  /** The offsets of the oldest and the newest record, and of where the next
+   * one goes. The ring has wrapped around if \ref head is below \ref tail, in
+   * which case the records at the end stop at \ref end. */
+  size_t tail;
+  size_t newest;
+  size_t head;
+  size_t end;
+
+  /** The number of snapshots held. */
+  unsigned long count;
+
+  /** The number of snapshots from one keyframe to the next. */
+  unsigned int keyframe_interval;
+
+  /** The number of snapshots since the newest keyframe, including it. */
+  unsigned int keyframe_distance;
+};
+
+/**
+ * @brief Starts keeping snapshots to rewind to.
+ *
+ * The arena is borrowed, and must remain valid until
+ * \ref libyagbe_rewind_stop() is called. Nothing is allocated; the older
+ * snapshots are dropped once the arena is full, so its size alone decides how
+ * far back one can go. How much each snapshot takes depends on how much of
+ * the state changes in between; snapshots taken once a frame typically take
+ * a few hundred bytes each.
+ *
+ * Unlike most state, this survives \ref libyagbe_system_reset(). The
+ * cartridge must not change while rewinding, since how large each snapshot is
+ * depends on how much RAM it has.
+ *
+ * @param gb The instance to rewind.
+ * @param arena The memory to keep snapshots in, aligned like memory returned
+ * by malloc().
+ * @param size The size of \p arena in bytes. This must hold at least three
+ * states, and should be much larger.
+ * @param keyframe_interval How many snapshots there are from one keyframe to
+ * the next, up to \ref LIBYAGBE_REWIND_MAX_KEYFRAME_INTERVAL. The more there
+ * are, the less memory snapshots take, and the longer stepping back past a
+ * keyframe takes.
+ * @return int 1 on success, or 0 if \p arena is too small or
+ * \p keyframe_interval is out of range.
+ */
+int libyagbe_rewind_start(struct libyagbe_gb* const gb, void* const arena,
+                          const size_t size,
+                          const unsigned int keyframe_interval);
+
+/**
+ * @brief Drops every snapshot and stops using the arena.
+ *
+ * @param gb The instance being rewound.
+ */
+void libyagbe_rewind_stop(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Takes a snapshot of the current state.
+ *
+ * This is meant to be called at regular intervals, such as once a frame.
+ *
+ * @param gb The instance to take a snapshot of.
+ * @return int 1 on success, or 0 if rewinding isn't enabled, or if a cartridge
+ * with a different amount of RAM has been inserted since it was.
+ */
+int libyagbe_rewind_capture(struct libyagbe_gb* const gb);
+
+/**
+ * @brief Goes back to the newest snapshot, and drops it.
+ *
+ * Calling this repeatedly goes back one snapshot at a time.
+ *
+ * @param gb The instance to rewind.
+ * @return int 1 on success, or 0 if there are no snapshots left, or if the
+ * newest one couldn't be loaded, in which case it's kept and the instance is
+ * left alone.
+ */
+int libyagbe_rewind_step_back(struct libyagbe_gb* const gb);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_REWIND_H */
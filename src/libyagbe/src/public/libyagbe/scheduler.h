@@ -16,62 +16,150 @@
 #ifndef LIBYAGBE_SCHEDULER_H
 #define LIBYAGBE_SCHEDULER_H
 
-#include <stddef.h>
-
 #include "compat/compat_stdint.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
-/** @brief The maximum number of events possible. */
-#define LIBYAGBE_SCHEDULER_MAX_EVENTS 10
+/** @brief The next event timestamp when no event is pending. */
+#define LIBYAGBE_SCHEDULER_NO_EVENT ((uintmax_t)-1)
 
 /**
  * @brief The type of events that we support.
  *
- * We need a good way to identify events.
+ * Each type of event has exactly one slot in the scheduler, so an event of a
+ * given type can only be pending once.
  */
 enum libyagbe_scheduler_event_types {
-  LIBYAGBE_SCHEDULER_EVENT_TIMA_INCREMENT,
-  LIBYAGBE_SCHEDULER_EVENT_TIMA_OVERFLOW
+  LIBYAGBE_SCHEDULER_EVENT_TIMA_OVERFLOW,
+  LIBYAGBE_SCHEDULER_EVENT_PPU_MODE_END,
+  LIBYAGBE_SCHEDULER_EVENT_APU_FRAME_END,
+
+  /** The number of event types; not an event type itself. */
+  LIBYAGBE_SCHEDULER_EVENT_COUNT
+};
+
+enum libyagbe_scheduler_event_groups {
+  LIBYAGBE_SCHEDULER_EVENT_GROUP_TIMER,
+  LIBYAGBE_SCHEDULER_EVENT_GROUP_PPU,
+  LIBYAGBE_SCHEDULER_EVENT_GROUP_APU,
+
+  /** The number of event groups; not an event group itself. */
+  LIBYAGBE_SCHEDULER_EVENT_GROUP_COUNT
 };
 
-enum libyagbe_scheduler_event_groups { LIBYAGBE_SCHEDULER_EVENT_GROUP_TIMER };
+/* Forward declaration. */
+struct libyagbe_gb;
 
-typedef void (*libyagbe_scheduler_event_cb)(void);
+typedef void (*libyagbe_scheduler_event_cb)(struct libyagbe_gb* const gb);
 
 struct libyagbe_scheduler_event {
-  /** How many cycles in the future should this event be called? */
+  /** At which point in time, in cycles since reset, should this event be
+   * called? Only meaningful while the event is pending. */
   uintmax_t timestamp;
 
   /** What function should this event call once it has expired? */
   libyagbe_scheduler_event_cb cb_func;
-
-  /** The type of event this is. */
-  enum libyagbe_scheduler_event_types type;
-
-  /** The group this event belongs to. */
-  enum libyagbe_scheduler_event_groups group;
 };
 
 struct libyagbe_scheduler {
-  struct libyagbe_scheduler_event events[LIBYAGBE_SCHEDULER_MAX_EVENTS];
-  size_t heap_size;
+  /** One slot for every type of event. */
+  struct libyagbe_scheduler_event events[LIBYAGBE_SCHEDULER_EVENT_COUNT];
+
+  /** Bit N is set if the event of type N is pending. */
+  unsigned int active_mask;
+
+  /** Bit N of entry G is set if the event of type N belongs to group G. */
+  unsigned int group_masks[LIBYAGBE_SCHEDULER_EVENT_GROUP_COUNT];
+
   uintmax_t timestamp_now;
+
+  /** A copy of the timestamp of the earliest pending event, so that adding
+   * cycles only has to look at the events once something is actually due. */
+  uintmax_t timestamp_next_event;
+
+  /** The type of the earliest pending event, if any. */
+  enum libyagbe_scheduler_event_types next_event;
 };
 
-void libyagbe_scheduler_reset(void);
+/**
+ * @brief Resets the scheduler to the startup state.
+ *
+ * This cancels all events, and forgets all of the registered event types.
+ *
+ * This function should not be called directly; use \ref libyagbe_system_reset()
+ * instead.
+ */
+void libyagbe_scheduler_reset(struct libyagbe_gb* const gb);
 
-void libyagbe_scheduler_insert_event(struct libyagbe_scheduler_event* event);
+/**
+ * @brief Sets up the slot for a type of event.
+ *
+ * This must be done for each type of event after the scheduler is reset, and
+ * before the event is scheduled for the first time.
+ *
+ * @param gb The instance to register the event with.
+ * @param type The type of event.
+ * @param group The group the event belongs to.
+ * @param cb_func The function to call once the event expires.
+ */
+void libyagbe_scheduler_register_event(
+    struct libyagbe_gb* const gb,
+    const enum libyagbe_scheduler_event_types type,
+    const enum libyagbe_scheduler_event_groups group,
+    const libyagbe_scheduler_event_cb cb_func);
 
-struct libyagbe_scheduler_event* libyagbe_scheduler_find_event(
-    const enum libyagbe_scheduler_event_types event);
+/**
+ * @brief Schedules an event, rescheduling it if it's already pending.
+ *
+ * An event is no longer pending by the time its function is called, so the
+ * function may schedule it again.
+ *
+ * @param gb The instance to schedule the event on.
+ * @param type The type of event to schedule.
+ * @param timestamp The point in time, in cycles since reset, to call the event
+ * at.
+ */
+void libyagbe_scheduler_schedule_event(
+    struct libyagbe_gb* const gb,
+    const enum libyagbe_scheduler_event_types type,
+    const uintmax_t timestamp);
 
+/**
+ * @brief Cancels an event. Does nothing if the event isn't pending.
+ *
+ * @param gb The instance to cancel the event on.
+ * @param type The type of event to cancel.
+ */
+void libyagbe_scheduler_cancel_event(
+    struct libyagbe_gb* const gb,
+    const enum libyagbe_scheduler_event_types type);
+
+/**
+ * @brief Returns a pending event.
+ *
+ * @param gb The instance to look for the event on.
+ * @param type The type of event to look for.
+ * @return const struct libyagbe_scheduler_event* The event, or NULL if it's not
+ * pending.
+ */
+const struct libyagbe_scheduler_event* libyagbe_scheduler_find_event(
+    const struct libyagbe_gb* const gb,
+    const enum libyagbe_scheduler_event_types type);
+
+/**
+ * @brief Cancels every event in a group.
+ *
+ * @param gb The instance to cancel the events on.
+ * @param group The group of events to cancel.
+ */
 void libyagbe_scheduler_delete_event_group(
+    struct libyagbe_gb* const gb,
     const enum libyagbe_scheduler_event_groups group);
 
-void libyagbe_scheduler_add_cycles(const unsigned int cycles);
+void libyagbe_scheduler_add_cycles(struct libyagbe_gb* const gb,
+                                   const unsigned int cycles);
 
 #ifdef __cplusplus
 }
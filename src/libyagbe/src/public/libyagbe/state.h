@@ -0,0 +1,177 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBYAGBE_STATE_H
+#define LIBYAGBE_STATE_H
+
+#include <stddef.h>
+
+#include "apu.h"
+#include "bus.h"
+#include "cart.h"
+#include "compat/compat_stdint.h"
+#include "ppu.h"
+#include "scheduler.h"
+#include "timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Forward declaration. */
+struct libyagbe_gb;
+
+/** @brief Identifies a save state; stored at the start of every one. */
+#define LIBYAGBE_STATE_MAGIC "YGBSTATE"
+
+enum libyagbe_state_limits {
+  /** The size of \ref LIBYAGBE_STATE_MAGIC, excluding the NUL terminator. */
+  LIBYAGBE_STATE_MAGIC_SIZE = 8,
+
+  /** Bumped whenever the layout of \ref libyagbe_state changes. */
+  LIBYAGBE_STATE_VERSION = 3
+};
+
+/**
+ * @brief Defines the layout of a save state.
+ *
+ * Everything that determines how emulation carries on is stored as plain
+ * data, so that saving and loading are little more than a few copies. A state
+ * is stored in host byte order, and only loads in builds where this structure
+ * has the same size, which covers the types whose size differs between
+ * compilers and language standards.
+ *
+ * Anything set up by the caller, such as the cartridge ROM, callbacks and
+ * framebuffers, is not part of a state. Cartridge RAM is, and follows this
+ * structure; only as much of it as the cartridge has is stored, which is why
+ * a state is sized with \ref libyagbe_state_get_size().
+ */
+struct libyagbe_state {
+  char magic[LIBYAGBE_STATE_MAGIC_SIZE];
+  uint32_t version;
+
+  /** The size of this structure in the build that saved the state. */
+  uint32_t size;
+
+  uint16_t af;
+  uint16_t bc;
+  uint16_t de;
+  uint16_t hl;
+  uint16_t sp;
+  uint16_t pc;
+
+  uint8_t wram0[LIBYAGBE_BUS_MEM_SIZE_WRAM];
+  uint8_t wram1[LIBYAGBE_BUS_MEM_SIZE_WRAM];
+  uint8_t hram[LIBYAGBE_BUS_MEM_SIZE_HRAM];
+  uint8_t interrupt_flag;
+  uint8_t interrupt_enable;
+
+  /** The size of the cartridge RAM following this structure, in bytes. */
+  uint32_t cart_ram_size;
+
+  /** The MBC registers, and the banks they select, so that loading a state
+   * doesn't have to work them out again. */
+  uint8_t ram_enabled;
+  unsigned int rom_bank;
+  uint8_t ram_bank;
+  uint8_t mbc_mode;
+  unsigned int rom_banks[2];
+  int ram_page;
+
+  uint8_t rtc[LIBYAGBE_CART_RTC_REG_COUNT];
+  uint8_t rtc_latched[LIBYAGBE_CART_RTC_REG_COUNT];
+  uint8_t rtc_latch_armed;
+  uintmax_t timestamp_rtc;
+  unsigned long rtc_cycles;
+
+  /** Bit N is set if the event of type N is pending, in which case entry N
+   * of \ref event_timestamps is when it's due. Events are stored by type, and
+   * find their functions again when loaded. */
+  uint32_t pending_events;
+  uintmax_t event_timestamps[LIBYAGBE_SCHEDULER_EVENT_COUNT];
+  uintmax_t timestamp_now;
+
+  struct libyagbe_timer timer;
+
+  uint8_t vram[LIBYAGBE_PPU_MEM_SIZE_VRAM];
+  uint8_t oam[LIBYAGBE_PPU_MEM_SIZE_OAM];
+
+  /** The PPU registers, indexed by \ref libyagbe_ppu_io_regs. */
+  uint8_t ppu_regs[LIBYAGBE_PPU_IO_REG_WX + 1];
+  uint8_t ppu_mode;
+  uint8_t window_line;
+  uint8_t stat_line;
+  uint8_t frame_drawn;
+  unsigned long frame_count;
+
+  uint8_t apu_regs[LIBYAGBE_APU_IO_REG_COUNT];
+  uint8_t wave_ram[LIBYAGBE_APU_WAVE_RAM_SIZE];
+  struct libyagbe_apu_channel channels[LIBYAGBE_APU_CHANNEL_COUNT];
+  unsigned int sweep_frequency;
+  uint8_t sweep_timer;
+  uint8_t sweep_enabled;
+  uint8_t sequencer_step;
+  uintmax_t timestamp_sequencer;
+};
+
+/**
+ * @brief Gets the size of a state saved from an instance.
+ *
+ * This depends on how much RAM the cartridge inserted has, so it changes
+ * whenever a cartridge is inserted.
+ *
+ * @param gb The instance to get the state size of.
+ * @return size_t The size of a state in bytes.
+ */
+size_t libyagbe_state_get_size(const struct libyagbe_gb* const gb);
+
+/**
+ * @brief Saves the state of an instance.
+ *
+ * @param gb The instance to save.
+ * @param buffer Where to save the state to. This must hold at least
+ * \ref libyagbe_state_get_size() bytes, aligned like memory returned by
+ * malloc().
+ * @param size The size of \p buffer in bytes.
+ * @return int 1 if the state was saved, or 0 if \p buffer is too small.
+ */
+int libyagbe_state_save(const struct libyagbe_gb* const gb, void* const buffer,
+                        const size_t size);
+
+/**
+ * @brief Loads a state saved by \ref libyagbe_state_save().
+ *
+ * The instance must have been reset with \ref libyagbe_system_reset() at
+ * least once, and should have the same cartridge inserted as the one the
+ * state was saved from. Blocks cached from ROM stay cached, so loading is
+ * cheap enough to do over and over again.
+ *
+ * @param gb The instance to load the state into.
+ * @param buffer The state, aligned like memory returned by malloc().
+ * @param size The size of \p buffer in bytes.
+ * @return int 1 if the state was loaded, or 0 if it isn't a state from this
+ * version and build of the library, if the cartridge inserted has a
+ * different amount of RAM, or if memory shared with a forked
+ * instance couldn't be copied, in which case the state of the instance is
+ * left alone.
+ */
+int libyagbe_state_load(struct libyagbe_gb* const gb, const void* const buffer,
+                        const size_t size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LIBYAGBE_STATE_H */
@@ -22,14 +22,30 @@
 extern "C" {
 #endif /* __cplusplus */
 
+/* Forward declaration. */
+struct libyagbe_gb;
+
 /**
  * @brief Defines the structure of the Game Boy timer.
  *
+ * TIMA isn't incremented one tick at a time; instead its value is worked out
+ * from the number of cycles elapsed whenever it's needed, and the only thing
+ * scheduled is the point at which it overflows.
  */
 struct libyagbe_timer {
+  /** The value of TIMA at \ref timestamp_tima. */
   uint8_t tima;
+
   uint8_t tma;
   uint8_t tac;
+
+  /** The scheduler timestamp TIMA was last brought up to date at. */
+  uintmax_t timestamp_tima;
+
+  /** The scheduler timestamp the system counter, the upper 8 bits of which
+   * are DIV, was last reset at. TIMA ticks on the system counter, so this is
+   * needed to know when TIMA ticks, too. */
+  uintmax_t timestamp_div;
 };
 
 /**
@@ -37,6 +53,9 @@ struct libyagbe_timer {
  *
  */
 enum libyagbe_timer_io_regs {
+  /** $FF04 */
+  LIBYAGBE_TIMER_IO_REG_DIV = 0x4,
+
   /** $FF05 */
   LIBYAGBE_TIMER_IO_REG_TIMA = 0x5,
 
@@ -60,10 +79,20 @@ enum libyagbe_timer_tac_bits {
  * @brief Resets the timer to the startup state.
  *
  */
-void libyagbe_timer_reset(void);
-void libyagbe_timer_handle_tima_write(const uint8_t new_tima_value);
-void libyagbe_timer_handle_tma_write(const uint8_t new_tma_value);
-void libyagbe_timer_handle_tac_write(const uint8_t new_tac_value);
+void libyagbe_timer_reset(struct libyagbe_gb* const gb);
+
+uint8_t libyagbe_timer_read_div(struct libyagbe_gb* const gb);
+uint8_t libyagbe_timer_read_tima(struct libyagbe_gb* const gb);
+uint8_t libyagbe_timer_read_tma(struct libyagbe_gb* const gb);
+uint8_t libyagbe_timer_read_tac(struct libyagbe_gb* const gb);
+
+void libyagbe_timer_handle_div_write(struct libyagbe_gb* const gb);
+void libyagbe_timer_handle_tima_write(struct libyagbe_gb* const gb,
+                                      const uint8_t new_tima_value);
+void libyagbe_timer_handle_tma_write(struct libyagbe_gb* const gb,
+                                     const uint8_t new_tma_value);
+void libyagbe_timer_handle_tac_write(struct libyagbe_gb* const gb,
+                                     const uint8_t new_tac_value);
 
 #ifdef __cplusplus
 }
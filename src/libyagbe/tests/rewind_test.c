@@ -0,0 +1,158 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Checks that stepping back through snapshots taken with audio on returns an
+ * instance to exactly the state it was in when each one was taken. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libyagbe/apu.h"
+#include "libyagbe/cart.h"
+#include "libyagbe/gb.h"
+#include "libyagbe/rewind.h"
+#include "libyagbe/state.h"
+
+/* Snapshots are taken partway into each frame, and before samples are read,
+ * so that the APU hasn't been caught up. */
+#define CYCLES_BEFORE_CAPTURE 20000
+#define SNAPSHOT_COUNT 120
+#define KEYFRAME_INTERVAL 30
+#define ARENA_SIZE (1024 * 1024)
+#define FRAME_CYCLES 70224
+
+/* Turns the APU on, sends channel 1 to both sides and triggers it, then loops
+ * forever. */
+static const uint8_t program[] = {
+    0x3E, 0x80, 0xE0, 0x26, /* LD A,$80; LDH (NR52),A */
+    0x3E, 0x77, 0xE0, 0x24, /* LD A,$77; LDH (NR50),A */
+    0x3E, 0xFF, 0xE0, 0x25, /* LD A,$FF; LDH (NR51),A */
+    0x3E, 0x80, 0xE0, 0x11, /* LD A,$80; LDH (NR11),A */
+    0x3E, 0xF0, 0xE0, 0x12, /* LD A,$F0; LDH (NR12),A */
+    0x3E, 0x00, 0xE0, 0x13, /* LD A,$00; LDH (NR13),A */
+    0x3E, 0x87, 0xE0, 0x14, /* LD A,$87; LDH (NR14),A */
+    0x18, 0xFE              /* JR -2 */
+};
+
+static uint8_t rom[LIBYAGBE_CART_MEM_SIZE_ROM_MIN];
+
+static struct libyagbe_gb* create_instance(void) {
+  struct libyagbe_gb* const gb = libyagbe_gb_create();
+
+  if ((gb == NULL) || !libyagbe_cart_insert(gb, rom, sizeof(rom)) ||
+      !libyagbe_apu_set_sample_rate(gb, 48000)) {
+    fprintf(stderr, "unable to create an instance\n");
+    exit(EXIT_FAILURE);
+  }
+  libyagbe_system_reset(gb);
+
+  return gb;
+}
+
+/* Reads the samples produced so far, as a frontend would. This catches the
+ * APU up. */
+static void read_samples(struct libyagbe_gb* const gb) {
+  static int16_t samples[LIBYAGBE_APU_BUFFER_SIZE * 2];
+
+  libyagbe_apu_read_samples(gb, samples, LIBYAGBE_APU_BUFFER_SIZE);
+}
+
+static void* save_state(const struct libyagbe_gb* const gb) {
+  const size_t size = libyagbe_state_get_size(gb);
+  void* const state = malloc(size);
+
+  if ((state == NULL) || !libyagbe_state_save(gb, state, size)) {
+    fprintf(stderr, "unable to save a state\n");
+    exit(EXIT_FAILURE);
+  }
+  return state;
+}
+
+/* Compares an instance against a state, reporting the first difference. */
+static int check_state(const char* const name,
+                       const struct libyagbe_gb* const gb,
+                       const void* const expected) {
+  const size_t size = libyagbe_state_get_size(gb);
+  void* const actual = save_state(gb);
+  const uint8_t* const a = expected;
+  const uint8_t* const b = actual;
+  size_t offset;
+
+  for (offset = 0; offset < size; ++offset) {
+    if (a[offset] != b[offset]) {
+      fprintf(stderr, "%s: state differs at offset %lu\n", name,
+              (unsigned long)offset);
+      free(actual);
+      return 0;
+    }
+  }
+  free(actual);
+  return 1;
+}
+
+static int test_step_back(void) {
+  struct libyagbe_gb* const gb = create_instance();
+  void* const arena = malloc(ARENA_SIZE);
+  void* expected[SNAPSHOT_COUNT];
+  unsigned int count;
+  int result = 1;
+
+  if ((arena == NULL) ||
+      !libyagbe_rewind_start(gb, arena, ARENA_SIZE, KEYFRAME_INTERVAL)) {
+    fprintf(stderr, "step back: unable to start rewinding\n");
+    exit(EXIT_FAILURE);
+  }
+  libyagbe_system_run_cycles(gb, CYCLES_BEFORE_CAPTURE);
+
+  for (count = 0; count < SNAPSHOT_COUNT; ++count) {
+    libyagbe_system_run_cycles(gb, FRAME_CYCLES);
+    expected[count] = save_state(gb);
+    libyagbe_rewind_capture(gb);
+    read_samples(gb);
+  }
+
+  while (result && (count != 0)) {
+    libyagbe_system_run_cycles(gb, FRAME_CYCLES);
+    read_samples(gb);
+
+    if (!libyagbe_rewind_step_back(gb)) {
+      fprintf(stderr, "step back: ran out of snapshots\n");
+      result = 0;
+    } else {
+      result = check_state("step back", gb, expected[--count]);
+    }
+  }
+
+  if (result && libyagbe_rewind_step_back(gb)) {
+    fprintf(stderr, "step back: stepped back past the oldest snapshot\n");
+    result = 0;
+  }
+
+  for (count = 0; count < SNAPSHOT_COUNT; ++count) {
+    free(expected[count]);
+  }
+  libyagbe_rewind_stop(gb);
+  libyagbe_gb_destroy(gb);
+  free(arena);
+
+  return result;
+}
+
+int main(void) {
+  memcpy(&rom[0x100], program, sizeof(program));
+
+  return test_step_back() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,170 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Checks that a state which is saved and loaded again, or a forked instance,
+ * carries on exactly like the instance it came from, with samples being
+ * produced throughout. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libyagbe/apu.h"
+#include "libyagbe/cart.h"
+#include "libyagbe/gb.h"
+#include "libyagbe/state.h"
+
+/* The point at which the state is saved, and how long to run past it. */
+#define CYCLES_BEFORE_SAVE 20000
+#define FRAMES_AFTER_SAVE 3
+#define FRAME_CYCLES 70224
+
+/* Turns the APU on, sends channel 1 to both sides and triggers it, then loops
+ * forever. */
+static const uint8_t program[] = {
+    0x3E, 0x80, 0xE0, 0x26, /* LD A,$80; LDH (NR52),A */
+    0x3E, 0x77, 0xE0, 0x24, /* LD A,$77; LDH (NR50),A */
+    0x3E, 0xFF, 0xE0, 0x25, /* LD A,$FF; LDH (NR51),A */
+    0x3E, 0x80, 0xE0, 0x11, /* LD A,$80; LDH (NR11),A */
+    0x3E, 0xF0, 0xE0, 0x12, /* LD A,$F0; LDH (NR12),A */
+    0x3E, 0x00, 0xE0, 0x13, /* LD A,$00; LDH (NR13),A */
+    0x3E, 0x87, 0xE0, 0x14, /* LD A,$87; LDH (NR14),A */
+    0x18, 0xFE              /* JR -2 */
+};
+
+static uint8_t rom[LIBYAGBE_CART_MEM_SIZE_ROM_MIN];
+
+static struct libyagbe_gb* create_instance(void) {
+  struct libyagbe_gb* const gb = libyagbe_gb_create();
+
+  if ((gb == NULL) || !libyagbe_cart_insert(gb, rom, sizeof(rom)) ||
+      !libyagbe_apu_set_sample_rate(gb, 48000)) {
+    fprintf(stderr, "unable to create an instance\n");
+    exit(EXIT_FAILURE);
+  }
+  libyagbe_system_reset(gb);
+
+  return gb;
+}
+
+/* Runs an instance frame by frame, reading the samples as a frontend would. */
+static void run_frames(struct libyagbe_gb* const gb, const unsigned int count) {
+  static int16_t samples[LIBYAGBE_APU_BUFFER_SIZE * 2];
+  unsigned int frame;
+
+  for (frame = 0; frame < count; ++frame) {
+    libyagbe_system_run_cycles(gb, FRAME_CYCLES);
+    libyagbe_apu_read_samples(gb, samples, LIBYAGBE_APU_BUFFER_SIZE);
+  }
+}
+
+static void* save_state(const struct libyagbe_gb* const gb) {
+  const size_t size = libyagbe_state_get_size(gb);
+  void* const state = malloc(size);
+
+  if ((state == NULL) || !libyagbe_state_save(gb, state, size)) {
+    fprintf(stderr, "unable to save a state\n");
+    exit(EXIT_FAILURE);
+  }
+  return state;
+}
+
+/* Compares an instance against a state, reporting the first difference. */
+static int check_state(const char* const name,
+                       const struct libyagbe_gb* const gb,
+                       const void* const expected) {
+  const size_t size = libyagbe_state_get_size(gb);
+  void* const actual = save_state(gb);
+  const uint8_t* const a = expected;
+  const uint8_t* const b = actual;
+  size_t offset;
+
+  for (offset = 0; offset < size; ++offset) {
+    if (a[offset] != b[offset]) {
+      fprintf(stderr, "%s: state differs at offset %lu\n", name,
+              (unsigned long)offset);
+      free(actual);
+      return 0;
+    }
+  }
+  free(actual);
+  return 1;
+}
+
+static int test_load(void) {
+  struct libyagbe_gb* const gb = create_instance();
+  void* saved;
+  void* expected;
+  int result;
+
+  libyagbe_system_run_cycles(gb, CYCLES_BEFORE_SAVE);
+  saved = save_state(gb);
+
+  run_frames(gb, FRAMES_AFTER_SAVE);
+  expected = save_state(gb);
+
+  if (!libyagbe_state_load(gb, saved, libyagbe_state_get_size(gb))) {
+    fprintf(stderr, "load: unable to load the state\n");
+    result = 0;
+  } else {
+    run_frames(gb, FRAMES_AFTER_SAVE);
+    result = check_state("load", gb, expected);
+  }
+
+  free(expected);
+  free(saved);
+  libyagbe_gb_destroy(gb);
+
+  return result;
+}
+
+static int test_fork(void) {
+  struct libyagbe_gb* const gb = create_instance();
+  struct libyagbe_gb* child;
+  void* expected;
+  int result;
+
+  libyagbe_system_run_cycles(gb, CYCLES_BEFORE_SAVE);
+  child = libyagbe_gb_fork(gb);
+
+  if (child == NULL) {
+    fprintf(stderr, "fork: unable to fork the instance\n");
+    libyagbe_gb_destroy(gb);
+    return 0;
+  }
+
+  run_frames(gb, FRAMES_AFTER_SAVE);
+  expected = save_state(gb);
+
+  run_frames(child, FRAMES_AFTER_SAVE);
+  result = check_state("fork", child, expected);
+
+  free(expected);
+  libyagbe_gb_destroy(child);
+  libyagbe_gb_destroy(gb);
+
+  return result;
+}
+
+int main(void) {
+  int passed = 1;
+
+  memcpy(&rom[0x100], program, sizeof(program));
+
+  passed &= test_load();
+  passed &= test_fork();
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,110 @@
+/* Copyright 2022 Michael Rodriguez <mike@kaichiuchu.dev>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Converts a binary trace produced by the trace facility in libyagbe into the
+ * text format understood by the usual log comparison scripts, one line per
+ * instruction. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libyagbe/debug/trace.h"
+
+/* The number of records read at once. */
+#define RECORDS_PER_CHUNK 65536
+
+static int convert(FILE* const in, FILE* const out) {
+  static uint8_t chunk[RECORDS_PER_CHUNK * LIBYAGBE_TRACE_RECORD_SIZE];
+  struct libyagbe_trace_record record;
+  size_t num_bytes;
+  size_t offset;
+
+  while ((num_bytes = fread(chunk, 1, sizeof(chunk), in)) != 0) {
+    if ((num_bytes % LIBYAGBE_TRACE_RECORD_SIZE) != 0) {
+      fprintf(stderr, "trace is truncated, ignoring the last record\n");
+      num_bytes -= num_bytes % LIBYAGBE_TRACE_RECORD_SIZE;
+    }
+
+    for (offset = 0; offset < num_bytes;
+         offset += LIBYAGBE_TRACE_RECORD_SIZE) {
+      libyagbe_trace_decode(&chunk[offset], &record);
+
+      fprintf(out, "BC=%04X DE=%04X HL=%04X AF=%04X SP=%04X PC=%04X\n",
+              record.bc, record.de, record.hl, record.af, record.sp, record.pc);
+    }
+  }
+
+  if (ferror(in)) {
+    fprintf(stderr, "unable to read trace: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+  char magic[LIBYAGBE_TRACE_MAGIC_SIZE];
+  FILE* in;
+  FILE* out;
+  int result;
+
+  if (argc < 2) {
+    fprintf(stderr, "%s: missing required argument.\n", argv[0]);
+    fprintf(stderr, "%s: syntax: %s trace_file [output_file]\n", argv[0],
+            argv[0]);
+
+    return EXIT_FAILURE;
+  }
+
+  in = fopen(argv[1], "rb");
+
+  if (!in) {
+    fprintf(stderr, "unable to open trace file %s: %s\n", argv[1],
+            strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  if ((fread(magic, 1, sizeof(magic), in) != sizeof(magic)) ||
+      (memcmp(magic, LIBYAGBE_TRACE_MAGIC, sizeof(magic)) != 0)) {
+    fprintf(stderr, "%s is not a trace file\n", argv[1]);
+    fclose(in);
+
+    return EXIT_FAILURE;
+  }
+
+  if (argc < 3) {
+    out = stdout;
+  } else {
+    out = fopen(argv[2], "w");
+
+    if (!out) {
+      fprintf(stderr, "unable to open output file %s: %s\n", argv[2],
+              strerror(errno));
+      fclose(in);
+
+      return EXIT_FAILURE;
+    }
+  }
+
+  result = convert(in, out);
+
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  fclose(in);
+  return result;
+}